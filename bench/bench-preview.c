@@ -0,0 +1,248 @@
+//
+// -----------------------------------------------------------------------------
+// bench-preview.c
+// -----------------------------------------------------------------------------
+//
+// Benchmark harness for Preview. Drives the frame and data layers
+// against an ncurses screen that writes to /dev/null and reports the
+// results as JSON.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <argp.h>
+#include <stdio.h>          // FILE, fopen, fprintf
+#include <stdlib.h>         // qsort, exit
+#include <time.h>           // clock_gettime
+#include <sys/resource.h>   // getrusage
+#include <ncurses.h>
+#include "mem.h"
+#include "frame.h"
+#include "errorcodes.h"
+
+const char *argp_program_version = "bench-preview (Preview v0.1)";
+
+struct arguments {
+  char **paths;
+  int npaths;
+  char *output;
+  int shifts;
+  int lines;
+  int cols;
+  char delim;
+};
+
+static struct argp_option options[] = {
+  {"output", 'o', "FILE", 0, "Write JSON results to FILE instead of stdout"},
+  {"shifts", 'n', "NUM", 0, "Keystrokes to time per direction (default: 1000)"},
+  {"lines", 'y', "NUM", 0, "Height of the simulated terminal (default: 50)"},
+  {"cols", 'x', "NUM", 0, "Width of the simulated terminal (default: 200)"},
+  {"delimiter", 'd', "DELIM", 0, "Use DELIM instead of COMMA"},
+  {0}
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+
+  struct arguments *arguments = state->input;
+
+  switch (key) {
+    case 'o': arguments->output = arg; break;
+    case 'n': arguments->shifts = strtol(arg, NULL, 10); break;
+    case 'y': arguments->lines = strtol(arg, NULL, 10); break;
+    case 'x': arguments->cols = strtol(arg, NULL, 10); break;
+    case 'd': arguments->delim = arg[0]; break;
+    case ARGP_KEY_ARGS:
+      arguments->paths = state->argv + state->next;
+      arguments->npaths = state->argc - state->next;
+      break;
+    case ARGP_KEY_NO_ARGS: argp_usage(state); break;
+    default: return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+
+}
+
+static char args_doc[] = "FILE...";
+static char doc[] = "bench-preview -- measure Preview's hot paths";
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+#define COL_WIDTH 16
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+// Prints latency percentiles in microseconds
+static void print_latencies(FILE *out, const char *name, double *t, int n,
+  int depth) {
+
+  qsort(t, n, sizeof *t, cmp_double);
+
+  fprintf(out, "      \"%s\": { \"count\": %d, \"depth\": %d", name, n, depth);
+  if (n > 0)
+    fprintf(out, ", \"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f",
+      t[n/2] * 1e6, t[(int) (n * .99)] * 1e6, t[n-1] * 1e6);
+  fprintf(out, " },\n");
+
+}
+
+static void bench_file(FILE *out, char *path, struct arguments *args,
+  int last) {
+
+  double *t = CALLOC(args->shifts, sizeof(double));
+  int n, ret;
+
+  fprintf(out, "    {\n      \"path\": \"%s\",\n", path);
+
+  // Open latency
+  double start = now();
+  Data_T data = Data_mmap_init(path, args->delim);
+  if (!data || Data_open(data) != E_OK) {
+    fprintf(out, "      \"error\": \"open failed\"\n    }%s\n", last ? "" : ",");
+    FREE(t);
+    return;
+  }
+  double opened = now();
+
+  // Time to first frame
+  Frame_T frame = Frame_init(COL_WIDTH, COLS / COL_WIDTH, LINES - 1, 1);
+  ret = Frame_load(frame, data);
+  if (ret == E_OK) Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+  double first_frame = now();
+
+  fprintf(out, "      \"bytes\": %zd,\n", data->st_size);
+  fprintf(out, "      \"open_ms\": %.3f,\n", (opened - start) * 1e3);
+
+  if (ret != E_OK) {
+    fprintf(out, "      \"error\": \"load failed with code %d\"\n    }%s\n",
+      ret, last ? "" : ",");
+    goto cleanup;
+  }
+
+  fprintf(out, "      \"first_frame_ms\": %.3f,\n", (first_frame - start) * 1e3);
+
+  // Scroll down as deep as the data allows, then time
+  // the last keystrokes there
+  int depth = 0;
+  while (Frame_shift_row(frame, data, 1) == E_OK) depth++;
+  for (n=0; n<args->shifts && n < depth; n++) {
+    double t0 = now();
+    Frame_shift_row(frame, data, -1);
+    t[n] = now() - t0;
+  }
+  print_latencies(out, "shift_row", t, n, depth);
+
+  for (n=0; n<args->shifts; n++) {
+    double t0 = now();
+    if (Frame_shift_col(frame, data, 1) != E_OK) break;
+    t[n] = now() - t0;
+  }
+  print_latencies(out, "shift_col", t, n, frame->data_loaded.first_col);
+
+  // Row discovery over the whole file
+  long nrows = 0;
+  if (data->scan_rows) {
+    double t0 = now();
+    data->scan_rows(data, 0, data->st_size, &nrows);
+    double elapsed = now() - t0;
+    fprintf(out, "      \"rows\": %ld,\n", nrows);
+    fprintf(out, "      \"scan_gbps\": %.3f,\n", data->st_size / elapsed / 1e9);
+  }
+
+  // Parallel row count, as used by --count
+  if (data->count_rows) {
+    double t0 = now();
+    data->count_rows(data, 0);
+    double elapsed = now() - t0;
+    fprintf(out, "      \"count_gbps\": %.3f,\n", data->st_size / elapsed / 1e9);
+  }
+
+  // Full tokenization of every row with a fresh Data_T
+  Data_T fresh = Data_mmap_init(path, args->delim);
+  if (Data_open(fresh) == E_OK) {
+    char **buf = CALLOC(data->ncols, sizeof(char *));
+    double t0 = now();
+    int irow = 0;
+    while (fresh->get_row(fresh, buf, irow, 0, -1) == E_OK) irow++;
+    double elapsed = now() - t0;
+    ssize_t nbytes = irow ? Index_get(fresh->rows, irow) : 0;
+    fprintf(out, "      \"tokenized_rows\": %d,\n", irow);
+    fprintf(out, "      \"tokenize_gbps\": %.3f,\n", nbytes / elapsed / 1e9);
+    FREE(buf);
+    Data_close(fresh);
+  }
+  Data_mmap_free(&fresh);
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  fprintf(out, "      \"peak_rss_kb\": %ld\n    }%s\n", usage.ru_maxrss,
+    last ? "" : ",");
+
+cleanup:
+  Frame_free(&frame, data->free_node, NULL);
+  Data_close(data);
+  Data_mmap_free(&data);
+  FREE(t);
+
+}
+
+int main(int argc, char **argv) {
+
+  struct arguments arguments = { NULL, 0, NULL, 1000, 50, 200, ',' };
+  argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+  FILE *out = arguments.output ? fopen(arguments.output, "w") : stdout;
+  if (!out) {
+    perror(arguments.output);
+    exit(EXIT_FAILURE);
+  }
+
+  // Stub out the terminal: ncurses renders into its own buffers as
+  // usual but the escape sequences go to /dev/null
+  FILE *null_out = fopen("/dev/null", "w");
+  FILE *null_in = fopen("/dev/null", "r");
+  SCREEN *screen = newterm("vt100", null_out, null_in);
+  if (!screen) {
+    fprintf(stderr, "Error initializing terminal\n");
+    exit(EXIT_FAILURE);
+  }
+  resizeterm(arguments.lines, arguments.cols);
+
+  fprintf(out, "{\n  \"version\": \"%s\",\n", argp_program_version);
+  fprintf(out, "  \"terminal\": { \"lines\": %d, \"cols\": %d },\n",
+    LINES, COLS);
+  fprintf(out, "  \"results\": [\n");
+
+  for (int i=0; i<arguments.npaths; i++)
+    bench_file(out, arguments.paths[i], &arguments, i == arguments.npaths-1);
+
+  fprintf(out, "  ]\n}\n");
+
+  endwin();
+  delscreen(screen);
+
+  if (out != stdout) fclose(out);
+
+  return 0;
+
+}
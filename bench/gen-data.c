@@ -0,0 +1,236 @@
+//
+// -----------------------------------------------------------------------------
+// gen-data.c
+// -----------------------------------------------------------------------------
+//
+// Deterministic generator of synthetic delimited data for benchmarks.
+// The same shape, size and seed always produce the same bytes.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <argp.h>
+#include <stdint.h>   // uint64_t
+#include <stdio.h>    // FILE, fopen, fprintf, fputc
+#include <stdlib.h>   // strtoull, exit
+#include <string.h>   // strcmp
+#include <unistd.h>   // sysconf
+
+const char *argp_program_version = "gen-data (Preview v0.1)";
+
+struct arguments {
+  char *shape;
+  char *output;
+  uint64_t size;
+  uint64_t seed;
+  char delim;
+};
+
+static struct argp_option options[] = {
+  {"shape", 's', "SHAPE", 0,
+    "One of tall, wide, quotes, long or ragged (default: tall)"},
+  {"size", 'n', "BYTES", 0, "Approximate output size, e.g. 64M or 20G"},
+  {"seed", 'r', "NUM", 0, "Random seed (default: 42)"},
+  {"delimiter", 'd', "DELIM", 0, "Use DELIM instead of COMMA"},
+  {"output", 'o', "FILE", 0, "Write to FILE instead of stdout"},
+  {0}
+};
+
+static uint64_t parse_size(const char *arg) {
+
+  char *end;
+  uint64_t n = strtoull(arg, &end, 10);
+
+  switch (*end) {
+    case 'k': case 'K': return n << 10;
+    case 'm': case 'M': return n << 20;
+    case 'g': case 'G': return n << 30;
+    default: return n;
+  }
+
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+
+  struct arguments *arguments = state->input;
+
+  switch (key) {
+    case 's': arguments->shape = arg; break;
+    case 'n': arguments->size = parse_size(arg); break;
+    case 'r': arguments->seed = strtoull(arg, NULL, 10); break;
+    case 'd': arguments->delim = arg[0]; break;
+    case 'o': arguments->output = arg; break;
+    case ARGP_KEY_ARG: argp_usage(state); break;
+    default: return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+
+}
+
+static char doc[] = "gen-data -- generate synthetic delimited data";
+static struct argp argp = { options, parse_opt, NULL, doc };
+
+// xorshift64*, good enough for test data and stable across platforms
+static uint64_t state;
+
+static uint64_t rnd(void) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 2685821657736338717ULL;
+}
+
+static uint64_t rnd_range(uint64_t lo, uint64_t hi) {
+  return lo + rnd() % (hi - lo + 1);
+}
+
+static const char *words[] = {
+  "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+  "hotel", "india", "juliett", "kilo", "lima", "mike", "november",
+  "oscar", "papa", "quebec", "romeo", "sierra", "tango", "uniform",
+  "victor", "whiskey", "xray", "yankee", "zulu"
+};
+
+#define NWORDS (sizeof words / sizeof words[0])
+
+struct shape {
+  const char *name;
+  int ncols;
+  void (*field)(FILE *out, int col, char delim);
+};
+
+static uint64_t written;
+
+static void emit(FILE *out, const char *s) {
+  written += fprintf(out, "%s", s);
+}
+
+static void emit_int(FILE *out, uint64_t n) {
+  written += fprintf(out, "%llu", (unsigned long long) n);
+}
+
+static void emit_char(FILE *out, char c) {
+  fputc(c, out);
+  written++;
+}
+
+// Short numeric and word fields
+static void field_tall(FILE *out, int col, char delim) {
+  switch (col % 4) {
+    case 0: emit_int(out, rnd() % 1000000); break;
+    case 1: emit(out, words[rnd() % NWORDS]); break;
+    case 2:
+      written += fprintf(out, "%.4f", (rnd() % 10000000) / 1000.);
+      break;
+    default: emit_int(out, rnd() % 100); break;
+  }
+}
+
+// Every field is quoted and many contain delimiters and escaped quotes
+static void field_quotes(FILE *out, int col, char delim) {
+  emit_char(out, '"');
+  for (int i=rnd_range(1, 4); i>0; i--) {
+    emit(out, words[rnd() % NWORDS]);
+    switch (rnd() % 4) {
+      case 0: emit_char(out, delim); break;
+      case 1: emit(out, "\"\""); break;
+      default: emit_char(out, ' ');
+    }
+  }
+  emit_char(out, '"');
+}
+
+// A few normal fields and one very long free-text field
+static void field_long(FILE *out, int col, char delim) {
+  if (col != 2) {
+    field_tall(out, col, delim);
+    return;
+  }
+  for (uint64_t n=rnd_range(1024, 8192); n > 0; ) {
+    const char *w = words[rnd() % NWORDS];
+    emit(out, w);
+    emit_char(out, ' ');
+    n -= n < strlen(w) + 1 ? n : strlen(w) + 1;
+  }
+}
+
+static struct shape shapes[] = {
+  { "tall",   8,   field_tall },
+  { "wide",   500, field_tall },
+  { "quotes", 10,  field_quotes },
+  { "long",   4,   field_long },
+  { "ragged", 12,  field_tall },
+  { NULL }
+};
+
+static void emit_row(FILE *out, struct shape *shape, char delim) {
+
+  int ncols = shape->ncols;
+
+  // Roughly one row in 50 has too few or too many fields
+  if (!strcmp(shape->name, "ragged") && rnd() % 50 == 0)
+    ncols += rnd() % 2 ? -(int) rnd_range(1, 3) : (int) rnd_range(1, 3);
+
+  for (int icol=0; icol<ncols; icol++) {
+    if (icol) emit_char(out, delim);
+    shape->field(out, icol, delim);
+  }
+  emit_char(out, '\n');
+
+}
+
+int main(int argc, char **argv) {
+
+  struct arguments arguments = { "tall", NULL, 1 << 20, 42, ',' };
+  argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+  struct shape *shape = shapes;
+  while (shape->name && strcmp(shape->name, arguments.shape)) shape++;
+  if (!shape->name) {
+    fprintf(stderr, "Unknown shape: %s\n", arguments.shape);
+    exit(EXIT_FAILURE);
+  }
+
+  FILE *out = arguments.output ? fopen(arguments.output, "w") : stdout;
+  if (!out) {
+    perror(arguments.output);
+    exit(EXIT_FAILURE);
+  }
+  setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+  state = arguments.seed ? arguments.seed : 1;
+
+  // Header row
+  for (int icol=0; icol<shape->ncols; icol++) {
+    if (icol) emit_char(out, arguments.delim);
+    written += fprintf(out, "col%d", icol+1);
+  }
+  emit_char(out, '\n');
+
+  // Preview refuses to map files that end on a page boundary,
+  // so keep writing rows until we're past one
+  long pagesize = sysconf(_SC_PAGESIZE);
+  while (written < arguments.size || written % pagesize == 0)
+    emit_row(out, shape, arguments.delim);
+
+  if (fclose(out) != 0) {
+    perror(arguments.output ? arguments.output : "stdout");
+    exit(EXIT_FAILURE);
+  }
+
+  return 0;
+
+}
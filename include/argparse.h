@@ -9,7 +9,8 @@
 // 
 
 #include <argp.h>
-#include <stdlib.h> // strtol
+#include <stdlib.h> // strtol, strtod
+#include <string.h> // strcmp
 
 // TODO: do error checking on arguments here
 
@@ -26,18 +27,96 @@ struct arguments {
   int col_width;
   char delim;
   int headers;
+  char *trace;
+  char *rows;
+  char *cols;
+  int count;
+  int align;
+  long max_resident;
+  int diff;
+  char *path2;
+  char *key;
+  char *format;
+  char *widths;
+  long sample;
+  int ragged;
+  char *serve;
+  char *connect;
+  char *mem_report;
 };
 
 static struct argp_option options[] = {
   {"delimiter", 'd', "DELIM", 0, "Use DELIM instead of COMMA"},
   {"col-width", 'c', "NUM", 0, "Character width of columns"},
   {"no-header", 'h', 0, 0, "Enable header row"},
+  {"trace", 't', "FILE", 0, "Write latency histograms to FILE on exit"},
+  {"rows", 'r', "SPEC", 0, "Print rows FIRST:LAST to stdout and exit"},
+  {"cols", 'k', "LIST", 0, "Only print columns in LIST, e.g. 1,3-5"},
+  {"count", 'n', 0, 0, "Print the number of rows and exit"},
+  {"align", 'a', 0, 0, "Line up printed columns instead of keeping delimiters"},
+  {"max-resident", 'm', "SIZE", 0, 
+    "Keep at most SIZE bytes of the file and index in memory, e.g. 512M"},
+  {"format", 'f', "FMT", 0, 
+    "Read the file as csv, jsonl, arrow, fixed, uring (csv read ahead "
+    "through io_uring) or with a backend loaded from PREVIEW_BACKENDS "
+    "(default: by content and extension)"},
+  {"backend", 0, 0, OPTION_ALIAS},
+  {"widths", 'w', "LIST", 0, 
+    "Read fixed-width columns of these widths, e.g. 10,8,12"},
+  {"sample", 's', "N", 0, "Show N rows picked at random"},
+  {"ragged", 'R', 0, 0, 
+    "Allow rows with more or fewer fields than the first"},
+  {"diff", 'D', 0, 0, "Show the differences between two files"},
+  {"key", 'K', "COL", 0, "Line up diffed rows by COL instead of by order"},
+  {"serve", 'S', "SOCKET", 0, 
+    "Serve the file to previews connecting to SOCKET, until interrupted"},
+  {"connect", 'C', "SOCKET", 0, "Show the file served at SOCKET"},
+  {"mem-report", 'M', "FILE", 0, 
+    "Write allocations by callsite to FILE on exit and when M is pressed"},
   {0}
 };
 
+// Parses widths like 10,8,12 into widths, if it's given, and returns
+// how many there are, or -1 if any aren't positive numbers
+static int parse_widths(const char *arg, int *widths) {
+
+  int n = 0;
+
+  for (;;) {
+    char *end;
+    long width = strtol(arg, &end, 10);
+    if (end == arg || width < 1 || width > 1 << 16) return -1;
+    if (widths) widths[n] = width;
+    n++;
+    if (*end == '\0') return n;
+    if (*end != ',') return -1;
+    arg = end + 1;
+  }
+
+}
+
+// Parses sizes like 4096, 512K, 1.5G
+static long parse_size(const char *arg) {
+
+  char *end;
+  double n = strtod(arg, &end);
+
+  switch (*end) {
+    case 'k': case 'K': n *= 1L << 10; end++; break;
+    case 'm': case 'M': n *= 1L << 20; end++; break;
+    case 'g': case 'G': n *= 1L << 30; end++; break;
+    case 't': case 'T': n *= 1L << 40; end++; break;
+  }
+
+  return end == arg || *end || n <= 0 ? -1 : (long) n;
+
+}
+
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
 
   struct arguments *arguments = state->input;
+  char *end;
+  double rows;
 
   switch (key) {
     case 'd':
@@ -52,17 +131,100 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
       arguments->headers = 1;
       break;
 
+    case 't':
+      arguments->trace = arg;
+      break;
+
+    case 'r':
+      arguments->rows = arg;
+      break;
+
+    case 'k':
+      arguments->cols = arg;
+      break;
+
+    case 'n':
+      arguments->count = 1;
+      break;
+
+    case 'a':
+      arguments->align = 1;
+      break;
+
+    case 'm':
+      arguments->max_resident = parse_size(arg);
+      if (arguments->max_resident < 0) 
+        argp_error(state, "invalid size '%s'", arg);
+      break;
+
+    // Backends loaded from shared objects aren't known yet
+    case 'f':
+      arguments->format = arg;
+      break;
+
+    case 'w':
+      if (parse_widths(arg, NULL) < 0)
+        argp_error(state, "invalid widths '%s'", arg);
+      arguments->widths = arg;
+      break;
+
+    case 's':
+      rows = strtod(arg, &end);
+      if (end == arg || *end || rows < 1 || rows > 1e12)
+        argp_error(state, "invalid number of rows '%s'", arg);
+      arguments->sample = rows;
+      break;
+
+    case 'R':
+      arguments->ragged = 1;
+      break;
+
+    case 'D':
+      arguments->diff = 1;
+      break;
+
+    case 'K':
+      arguments->key = arg;
+      break;
+
+    case 'S':
+      arguments->serve = arg;
+      break;
+
+    case 'C':
+      arguments->connect = arg;
+      break;
+
+    case 'M':
+      arguments->mem_report = arg;
+      break;
+
     // Position args
     case ARGP_KEY_ARG:
       // Too many arguments
       if (state->arg_num > 1) argp_usage(state);
       // arguments->args[state->arg_num] = arg;
-      arguments->path = arg;
+      if (state->arg_num == 0) arguments->path = arg;
+      else arguments->path2 = arg;
       break;
 
     case ARGP_KEY_END: 
-      // Not enough arguments
-      if (state->arg_num < 1) argp_usage(state); 
+      // Not enough arguments, or a second path without --diff, or a
+      // path with --connect
+      if (state->arg_num != (arguments->connect ? 0 : 1 + arguments->diff)) 
+        argp_usage(state); 
+      if (arguments->connect && (arguments->serve || arguments->diff))
+        argp_error(state, "--connect doesn't apply to --serve or --diff");
+      if (arguments->serve && (arguments->diff || arguments->rows 
+        || arguments->count || arguments->sample))
+        argp_error(state, "--serve only applies to viewing a file");
+      if (arguments->key && !arguments->diff)
+        argp_error(state, "--key only applies to --diff");
+      if (arguments->sample && arguments->diff)
+        argp_error(state, "--sample doesn't apply to --diff");
+      if (arguments->widths && arguments->format 
+        && strcmp(arguments->format, "fixed"))
+        argp_error(state, "--widths only applies to fixed-width files");
       break;
 
     default: 
@@ -72,6 +234,7 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
-static char args_doc[] = "path";
+static char args_doc[] = 
+  "path\n--diff path1 path2\n--serve SOCKET path\n--connect SOCKET";
 static char doc[] = "preview -- display delimited data for quick investigation";
 static struct argp argp = { options, parse_opt, args_doc, doc };
@@ -0,0 +1,60 @@
+//
+// -----------------------------------------------------------------------------
+// backend.h
+// -----------------------------------------------------------------------------
+//
+// Registry of the backends that read files into a Data_T. A backend is
+// picked by name, or for a file by the bytes it starts with and then by
+// its extension. Backends other than those built in are loaded from
+// shared objects, each of which exports a struct Backend_T named
+// preview_backend.
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef BACKEND_INCLUDED
+#define BACKEND_INCLUDED
+
+#include "frame.h" // Data_T
+
+// Version of this struct and of Data_T, which backends fill in
+// themselves. Bumped whenever either changes, and backends built
+// against another version aren't loaded.
+#define BACKEND_ABI 3
+
+// Symbol a shared object exports its backend as
+#define BACKEND_SYMBOL "preview_backend"
+
+#define T Backend_T
+typedef struct T {
+  int abi;                        // BACKEND_ABI when it was built
+  const char *name;               // as given to --backend
+  const char *const *extensions;  // like ".csv", NULL-terminated, or NULL
+  const char *magic;              // bytes its files start with, or NULL
+  int magic_len;
+  int headers;                    // the first row is always the header
+
+  // Opens path, with options given for this backend, such as the widths
+  // of fixed-width columns, or NULL
+  Data_T (*init)(const char *path, char delim, const char *options);
+} *T;
+
+extern int  Backend_register  (T);
+extern T    Backend_find      (const char *name);
+extern T    Backend_detect    (const char *path);
+extern int  Backend_load      (const char *dir);
+
+#undef T
+#endif // BACKEND_INCLUDED
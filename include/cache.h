@@ -0,0 +1,46 @@
+//
+// -----------------------------------------------------------------------------
+// cache.h
+// -----------------------------------------------------------------------------
+//
+// Reads a file ahead of where it's being read from, in aligned blocks,
+// through io_uring or with the kernel's readahead where that isn't
+// available. Blocks land in the page cache, read through io_uring into a
+// few buffers of our own, so a mapping of the file then finds them there
+// instead of waiting on the disk. Safe to use from any number of threads.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef CACHE_INCLUDED
+#define CACHE_INCLUDED
+
+#include <sys/types.h> // ssize_t
+
+// Size and alignment of each read
+#define CACHE_BLOCK (256L << 10)
+
+#define T Cache_T
+typedef struct T *T;
+
+extern T    Cache_new     (int fd, ssize_t size, int uring);
+extern void Cache_free    (T *);
+extern void Cache_want    (T, ssize_t offset, ssize_t len);
+extern void Cache_forget  (T, ssize_t offset, ssize_t len);
+extern int  Cache_uring   (T);
+extern long Cache_reads   (T);
+
+#undef T
+#endif // CACHE_INCLUDED
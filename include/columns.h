@@ -0,0 +1,33 @@
+// 
+// -----------------------------------------------------------------------------
+// columns.h
+// -----------------------------------------------------------------------------
+//
+// Column lists, as given to --cols and :cols. Entries are separated by
+// commas and are either column numbers counting from 1, ranges like 3-5,
+// or header names.
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef COLUMNS_INCLUDED
+#define COLUMNS_INCLUDED
+
+#include "frame.h" // Data_T
+
+extern int Columns_parse(Data_T data, const char *spec, int headers,
+             int **cols, int *ncols);
+
+#endif // COLUMNS_INCLUDED
@@ -0,0 +1,56 @@
+// 
+// -----------------------------------------------------------------------------
+// diff.h
+// -----------------------------------------------------------------------------
+//
+// Diff ADT. Lines up the rows of two files from their hashes, which can
+// be added a batch at a time as they're computed. Rows are aligned by
+// key, or otherwise by longest common subsequence.
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DIFF_INCLUDED
+#define DIFF_INCLUDED
+
+#include <stdint.h> // uint64_t
+
+#define T Diff_T
+typedef struct T *T;
+
+// Sides
+#define DIFF_A 0
+#define DIFF_B 1
+
+// Aligned row types
+#define DIFF_SAME     0
+#define DIFF_CHANGED  1
+#define DIFF_DELETED  2   // only in A
+#define DIFF_ADDED    3   // only in B
+#define DIFF_PENDING  4   // only in A so far, B isn't finished
+
+extern T    Diff_new    (int keyed);
+extern void Diff_free   (T *);
+extern void Diff_add    (T, int side, const uint64_t *hashes, 
+              const uint64_t *keys, long n);
+extern void Diff_done   (T, int side);
+extern int  Diff_finished (T);
+extern long Diff_length (T);
+extern int  Diff_get    (T, long i, long *a, long *b);
+extern long Diff_next   (T, long i, int dir);
+extern long Diff_changes (T);
+
+#undef T
+#endif // DIFF_INCLUDED
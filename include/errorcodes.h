@@ -35,6 +35,11 @@
 #define E_DTA_MAX_ROWS 8
 #define E_DTA_EOF 9
 
+#define E_LOOP_RESOURCE_ERROR 10
+
+#define E_IO_WRITE_ERROR 11
+#define E_IO_CANCELLED 12
+
 // TODO: add frame error codes
 
 #endif // ERRORCODES_INCLUDED
@@ -23,18 +23,18 @@
 #ifndef FRAME_INCLUDED
 #define FRAME_INCLUDED
 
+#include <stdint.h> // uint64_t
 #include <ncurses.h>
 #include "deque.h" // Deque_T
+#include "index.h" // Index_T
+#include "pool.h"  // Pool_T
 
 #define O_FRM_CURS 1
 #define O_FRM_DATA 2
 
 #define Data_open(data) (data->open)(data)
 #define Data_close(data) (data->close)(data)
-
-// TODO: set this dynamically?
-#define MAX_ROWS 8192
-#define MAX_COLS 1024
+#define Data_free(data) ((*(data))->free)(data)
 
 typedef struct Frame_T {
   int col_width;
@@ -52,17 +52,48 @@ typedef struct Frame_T {
     int last_row;
     int last_col;
   } data_loaded;
+  struct projection {
+    int *cols;  // columns to show, in order, NULL for all
+    int ncols;
+  } projection;
+  struct margin {
+    int left;   // columns loaded past the left of the screen
+    int right;  // and past the right, so scrolling to them is free
+  } margin;
+  struct buffered {
+    Deque_T above;  // rows read past the top of the screen, nearest first
+    Deque_T below;  // and past the bottom
+    int depth;      // screens of rows to read ahead, more when scrolling fast
+    int dir;        // which way the screen last scrolled
+    long scrolled;  // and when, in ms
+  } buffered;
+  Pool_T pool;              // fills the margins ahead of time, if set
+  struct refill *refill;    // margin being filled
+  struct parse *parse;      // rows being read ahead
+  int layout;               // changed whenever the loaded columns are
+  struct row_buf {
+    char **toks;            // tokens of the row being added, grown as
+    int size;               // wider rows are loaded
+  } row_buf;
   Deque_T headers;
-  Deque_T data;
+  Deque_T data;             // columns loaded, left margin first
+  char status[128];
 } *Frame_T;
 
 typedef struct Data_T {
   char *path;
   char delim;
-  int *row_offsets;
+  int delimited;          // fields are split by delim, so rows can be
+                          // copied as they are
+  int quoted;             // cells are fields as they are in a delimited
+                          // file, quoted already where they need to be
+  int ragged;             // rows can have more or fewer fields than the
+                          // first, and are marked in the index if so
+  Index_T rows;
   ssize_t st_size;
   int ncols;
   int nrows;
+  ssize_t max_resident;   // memory budget in bytes, 0 for none
   int (*open)(struct Data_T *data);
 
   int (*get_col)(struct Data_T *data, char **buf, 
@@ -74,7 +105,39 @@ typedef struct Data_T {
   int (*mvaddntok)(int row, int col, const char *str,
     int n, char delim);
 
+  int (*toklen)(const char *str, char delim);
+
+  // Text of a token that isn't stored as text, formatted into buf.
+  // Returns the length of the whole text, as snprintf does, or -1 if
+  // the token is its own text. NULL if every token is.
+  int (*format)(const char *tok, char *buf, int size);
+
   int (*close)(struct Data_T *data);
+
+  ssize_t (*scan_rows)(struct Data_T *data, ssize_t offset, ssize_t nbytes,
+    long *nrows);
+
+  long (*count_rows)(struct Data_T *data, int nthreads);
+
+  ssize_t (*resident)(struct Data_T *data);
+
+  ssize_t (*hash_rows)(struct Data_T *data, ssize_t offset, int key_col,
+    uint64_t *hashes, uint64_t *keys, long max, long *n);
+
+  // Fields cols of up to max rows starting at offset, without touching
+  // the index, so they can be read on worker threads. Field j of row i
+  // goes in toks[i*ncols + j] and its length in lens. NULL if rows
+  // aren't stored as bytes.
+  ssize_t (*scan_fields)(struct Data_T *data, ssize_t offset, 
+    const int *cols, int ncols, char **toks, int *lens, long max, long *n);
+
+  // Start of the row holding the byte at offset, found without the
+  // index, and where the next row starts in end. -1 if the row can't
+  // be told apart from its neighbours. NULL if rows aren't stored as
+  // bytes.
+  ssize_t (*row_near)(struct Data_T *data, ssize_t offset, ssize_t *end);
+
+  void (*free)(struct Data_T **data);
   void (*free_node)(void **node, void *args);
   void *args;
 } *Data_T;
@@ -85,9 +148,41 @@ extern void     Frame_free(Frame_T *frame,
                   void free_node(void **node, void *args), void *args);
 extern int      Frame_shift_row(Frame_T frame, Data_T data, int n);
 extern int      Frame_shift_col(Frame_T frame, Data_T data, int n);
+extern int      Frame_resize(Frame_T frame, Data_T data, int max_cols, 
+                  int max_rows);
 extern int      Frame_print(Frame_T frame, Data_T data, int action);
+extern void     Frame_status(Frame_T frame, const char *fmt, ...);
+extern int      Frame_project(Frame_T frame, Data_T data, int *cols, int ncols);
+extern int      Frame_goto_col(Frame_T frame, Data_T data, int icol);
+extern int      Frame_goto_row(Frame_T frame, Data_T data, int row);
+extern int      Frame_goto_ragged(Frame_T frame, Data_T data, int dir);
+extern void     Frame_prefetch(Frame_T frame, Data_T data, Pool_T pool);
+
+extern uint64_t Data_hash(const char *str, ssize_t len);
 
 extern Data_T Data_mmap_init(char *path, char delim);
+extern Data_T Data_uring_init(char *path, char delim);
 extern void   Data_mmap_free(Data_T *data);
 
+extern Data_T Data_json_init(char *path);
+extern void   Data_json_free(Data_T *data);
+
+extern Data_T Data_arrow_init(char *path);
+extern void   Data_arrow_free(Data_T *data);
+
+extern Data_T Data_fixed_init(char *path, const int *widths, int nwidths);
+extern void   Data_fixed_free(Data_T *data);
+
+extern Data_T Data_shards_init(char *pattern, int headers,
+                Data_T (*init)(const char *path, char delim, 
+                  const char *options),
+                char delim, const char *options);
+extern void   Data_shards_free(Data_T *data);
+
+extern long   Data_sample(Data_T data, ssize_t offset, long n, uint64_t seed,
+                ssize_t *rows);
+extern Data_T Data_sample_init(Data_T data, int headers, const ssize_t *rows,
+                long n);
+extern void   Data_sample_free(Data_T *data);
+
 #endif
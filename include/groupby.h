@@ -0,0 +1,66 @@
+// 
+// -----------------------------------------------------------------------------
+// groupby.h
+// -----------------------------------------------------------------------------
+//
+// Group-by ADT. Counts rows by the value of a key column and keeps
+// simple aggregates of a value column. At most a fixed number of groups
+// are kept; past that, the least frequent half is dropped and counts
+// become upper bounds, as in Space-Saving.
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef GROUPBY_INCLUDED
+#define GROUPBY_INCLUDED
+
+#include <stdint.h> // uint64_t
+
+#define T Groupby_T
+typedef struct T *T;
+
+// Aggregates
+#define GROUPBY_COUNT 0
+#define GROUPBY_SUM   1
+#define GROUPBY_MEAN  2
+#define GROUPBY_MIN   3
+#define GROUPBY_MAX   4
+
+typedef struct Groupby_group {
+  const char *key;    // points into the data, it isn't copied
+  int len;
+  uint64_t hash;
+  long count;
+  long err;           // count may be over by up to this much
+  long n;             // rows with a numeric value
+  double sum;
+  double min;
+  double max;
+} Groupby_group;
+
+extern T      Groupby_new     (int capacity);
+extern void   Groupby_free    (T *);
+extern void   Groupby_add     (T, const char *key, int len, 
+                const double *value);
+extern void   Groupby_merge   (T into, T from);
+extern T      Groupby_snapshot (T, int max);
+extern int    Groupby_length  (T);
+extern long   Groupby_rows    (T);
+extern long   Groupby_error   (T);
+extern int    Groupby_top     (T, Groupby_group *groups, int max, int agg);
+extern double Groupby_value   (const Groupby_group *group, int agg);
+
+#undef T
+#endif // GROUPBY_INCLUDED
@@ -0,0 +1,46 @@
+//
+// -----------------------------------------------------------------------------
+// index.h
+// -----------------------------------------------------------------------------
+//
+// Row index ADT. A growable, monotone sequence of byte offsets where
+// entry i is the offset of the start of row i, compressed to a few bits
+// a row. Rows can also be marked with their number of fields when it
+// isn't what's expected.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef INDEX_INCLUDED
+#define INDEX_INCLUDED
+
+#include <sys/types.h> // ssize_t
+
+#define I Index_T
+typedef struct I *I;
+
+extern I       Index_new    (void);
+extern void    Index_free   (I *);
+extern long    Index_length (I);
+extern ssize_t Index_get    (I, long i);
+extern void    Index_append (I, ssize_t offset);
+extern long    Index_rank   (I, ssize_t offset);
+extern size_t  Index_bytes  (I);
+extern void    Index_mark   (I, long i, int nfields);
+extern int     Index_fields (I, long i);
+extern long    Index_next_mark (I, long i, int dir);
+
+#undef I
+#endif // INDEX_INCLUDED
@@ -0,0 +1,50 @@
+//
+// -----------------------------------------------------------------------------
+// loop.h
+// -----------------------------------------------------------------------------
+//
+// epoll-based event loop. Multiplexes file descriptors, signals,
+// timers and messages posted by worker threads, so the UI thread
+// never blocks on anything but epoll_wait.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef LOOP_INCLUDED
+#define LOOP_INCLUDED
+
+#include "spsc.h" // Spsc_T
+
+#define T Loop_T
+typedef struct T *T;
+
+extern T      Loop_new        (void);
+extern void   Loop_free       (T *);
+extern int    Loop_add_fd     (T, int fd,
+                void callback(T loop, int fd, void *cl), void *cl);
+extern int    Loop_remove_fd  (T, int fd);
+extern int    Loop_watch_fd   (T, int fd, int read, int write);
+extern int    Loop_add_signal (T, int signo,
+                void callback(T loop, int signo, void *cl), void *cl);
+extern int    Loop_add_timer  (T, long msec,
+                void callback(T loop, void *cl), void *cl);
+extern Spsc_T Loop_channel    (T, int capacity,
+                void callback(T loop, void *msg, void *cl), void *cl);
+extern int    Loop_post       (T, Spsc_T channel, void *msg);
+extern int    Loop_run        (T);
+extern void   Loop_stop       (T);
+
+#undef T
+#endif // LOOP_INCLUDED
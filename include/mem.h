@@ -29,6 +29,7 @@
 #ifndef MEM_INCLUDED
 #define MEM_INCLUDED
 
+#include <stdio.h> // FILE
 #include <error.h>
 
 extern const Except_T Mem_Failed;
@@ -37,6 +38,7 @@ extern void *Mem_alloc(long nbytes, const char *file, int line);
 extern void *Mem_calloc(long count, long nbytes, const char *file, int line);
 extern void  Mem_free(void *ptr, const char *file, int line);
 extern void *Mem_resize(void *ptr, long nbytes, const char *file, int line);
+extern int   Mem_report(FILE *out);
 
 #define ALLOC(nbytes) Mem_alloc((nbytes), __FILE__, __LINE__)
 #define CALLOC(count, nbytes) Mem_calloc((count), (nbytes), __FILE__, __LINE__)
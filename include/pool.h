@@ -0,0 +1,55 @@
+// 
+// -----------------------------------------------------------------------------
+// pool.h
+// -----------------------------------------------------------------------------
+//
+// Thread pool ADT. Runs tasks on a fixed set of worker threads, most
+// urgent first. Each worker has a deque of tasks per priority; it runs
+// its newest task and, once it has none, steals the oldest task of
+// another worker. Tasks are cancelled through tokens they check as
+// they run.
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef POOL_INCLUDED
+#define POOL_INCLUDED
+
+#define T Pool_T
+typedef struct T *T;
+typedef struct Pool_token *Pool_token;
+
+// Priorities, most urgent first
+#define POOL_HIGH   0   // work for the rows on screen, or about to be
+#define POOL_NORMAL 1
+#define POOL_LOW    2   // scans of the whole file
+#define POOL_PRIORITIES 3
+
+extern T    Pool_new      (int nthreads);
+extern void Pool_free     (T *);
+extern int  Pool_size     (T);
+extern int  Pool_self     (T);
+extern void Pool_submit   (T, int priority, Pool_token token,
+              void run(void *cl, Pool_token token), void *cl);
+extern void Pool_wait     (T, Pool_token token);
+
+extern Pool_token Pool_token_new   (void);
+extern void       Pool_token_free  (Pool_token *);
+extern void       Pool_cancel      (Pool_token);
+extern int        Pool_cancelled   (Pool_token);
+extern long       Pool_pending     (Pool_token);
+
+#undef T
+#endif // POOL_INCLUDED
@@ -4,7 +4,7 @@
 // -----------------------------------------------------------------------------
 //
 // Input parser for Preview.
-// Forward declares flex & bison types and functions
+// Forward declares scanner & bison types and functions
 //
 // Copyright © 2021 Tyler Wayne
 // 
@@ -24,17 +24,152 @@
 #ifndef INPUTPARSER_INCLUDED
 #define INPUTPARSER_INCLUDED
 
+#include <stdatomic.h> // atomic_int
+#include <stdint.h>    // uint64_t
+#include <sys/types.h> // ssize_t
 #include "deque.h"
+#include "diff.h"
 #include "frame.h"
+#include "groupby.h"
+#include "loop.h"
+#include "pool.h"
+#include "slice.h"
+#include "spsc.h"
 
-// Interface to lexer
-extern int yylineno;
+// Interface to scanner. The parser is a bison push parser,
+// so tokens are pushed with yypush_parse as keys arrive
 void yyerror(char *s);
-int yylex();
-int yyparse();
+int scan_key(int c, char **text);
+
+// Runs a command entered after ':'. Returns nonzero to quit.
+extern int run_command(char *line);
+
+// Moves the cursor to the next ragged row in direction dir
+extern void goto_ragged(int dir);
 
 // Program data
 extern Frame_T frame;
 extern Data_T data;
 
+// Background work, most urgent first
+extern Pool_T pool;
+
+// Debug HUD with latency stats in the status line
+extern int hud;
+extern void show_hud(void);
+
+// Writes allocations by callsite to the file given with --mem-report
+extern void report_mem(void);
+
+// Results posted by worker threads to the UI thread
+#define MSG_INDEX_PROGRESS 1
+#define MSG_INDEX_DONE 2
+#define MSG_HASH_ROWS 3
+#define MSG_HASH_DONE 4
+#define MSG_GROUP_PROGRESS 5
+#define MSG_GROUP_DONE 6
+#define MSG_WRITE_DONE 7
+
+typedef struct Msg_T {
+  int type;
+  long nrows;
+  ssize_t done;
+  ssize_t total;
+  int side;           // which file of a diff
+  uint64_t *hashes;   // hashes of the next n rows, owned by the receiver
+  uint64_t *keys;
+  long n;
+  Groupby_T groups;   // groups so far, owned by the receiver
+  int err;            // what a write returned
+} *Msg_T;
+
+typedef struct Worker_T {
+  Loop_T loop;
+  Spsc_T channel;
+  Data_T data;
+  int side;
+  int key_col;        // column to hash or group by, -1 for none
+  int val_col;        // column to aggregate, -1 for none
+  ssize_t offset;     // where to start, or how far it's got
+  long nrows;         // rows counted so far
+  atomic_int stop;    // set by the UI thread to abandon the job
+  Pool_T pool;        // runs the job's tasks, if it's split up
+  Slice_T slice;      // rows and columns to write, and where
+  int fd;
+} *Worker_T;
+
+extern void  Worker_index(void *worker, Pool_token token);
+extern void  Worker_write(void *worker, Pool_token token);
+extern void *Worker_hash(void *worker);
+extern void *Worker_group(void *worker);
+
+// Side-by-side view of two files, used in place of the frame 
+// with --diff
+typedef struct Diffview_T {
+  Diff_T diff;
+  Data_T data[2];
+  int headers;
+  int col_width;
+  long top;           // first aligned row on screen
+  int first_col;
+  int cursor_row;
+  int cursor_col;
+  ssize_t progress[2];
+  char status[128];
+} *Diffview_T;
+
+extern Diffview_T diffview;
+
+extern Diffview_T Diffview_new(Data_T a, Data_T b, int keyed, int headers,
+                    int col_width);
+extern void Diffview_free(Diffview_T *view);
+extern void Diffview_print(Diffview_T view);
+extern void Diffview_status(Diffview_T view, const char *fmt, ...);
+extern void Diffview_move(Diffview_T view, int drow, int dcol);
+extern int  Diffview_jump(Diffview_T view, int dir);
+extern void Diffview_message(Diffview_T view, Msg_T msg);
+
+// Groups from :count or :agg, shown in place of the frame until it's
+// closed
+typedef struct Panel_T {
+  char key[64];       // name of the grouped column
+  char value[64];     // name of the aggregate, e.g. sum(amount)
+  int agg;
+  Groupby_group *top; // groups in the order they're listed
+  int ntop;
+  int ngroups;
+  long nrows;         // rows grouped so far
+  long error;         // counts may be over by up to this much
+  int first;          // first group on screen
+  int cursor;
+  char status[128];
+} *Panel_T;
+
+extern Panel_T panel;
+
+extern Panel_T Panel_new(const char *key, const char *value, int agg);
+extern void Panel_free(Panel_T *panel);
+extern void Panel_print(Panel_T panel);
+extern void Panel_status(Panel_T panel, const char *fmt, ...);
+extern void Panel_move(Panel_T panel, int drow);
+extern void Panel_message(Panel_T panel, Msg_T msg);
+
+// Shows panel while the rows are grouped by key_col in the background,
+// aggregating val_col. Closing the panel stops the scan.
+extern int  open_panel(Panel_T panel, int key_col, int val_col);
+extern void close_panel(void);
+
+// Writes slice of the data to fd on the pool for :w, with its progress
+// in the status line. The data is the write's until it's done, so any
+// key stops it first. Closing it stops it early and closes fd.
+extern void open_write(Slice_T slice, int fd, const char *path);
+extern void close_write(void);
+
+// Rows picked at random by :sample or --sample, shown in place of the
+// whole file until they're closed. While they're shown, data and frame
+// are theirs, and whole is the file they were picked from.
+extern Data_T whole;
+extern int  open_sample(long n);
+extern void close_sample(void);
+
 #endif // INPUTPARSER_INCLUDED
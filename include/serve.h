@@ -0,0 +1,95 @@
+//
+// -----------------------------------------------------------------------------
+// serve.h
+// -----------------------------------------------------------------------------
+//
+// Serves one Data_T to any number of clients over a Unix domain socket,
+// so the file is mapped, indexed and counted once however many people
+// are looking at it. Clients send fixed-size requests, each followed by
+// len bytes of text, and get one reply to each, in order, followed by
+// the lengths of its cells and then their text. Both ends are on the
+// same host, so numbers are sent in its byte order.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef SERVE_INCLUDED
+#define SERVE_INCLUDED
+
+#include <stdint.h> // int64_t
+#include "frame.h"  // Data_T
+
+// Bumped whenever requests or replies change
+#define SERVE_VERSION 2
+
+// Requests
+#define SERVE_STATS 1   // rows counted so far, once more than first
+                        // bytes have been, or they all have
+#define SERVE_ROWS  2   // cells col_start to col_end of rows first to
+                        // last
+#define SERVE_FIND  3   // first of rows first to last with the text in
+                        // one of columns col_start to col_end
+
+// Most cells sent in one reply, and rows searched for one request
+#define SERVE_CELLS 65536
+#define SERVE_FIND_ROWS 65536
+
+// Longest text sent with a request
+#define SERVE_TEXT 4096
+
+struct serve_request {
+  uint32_t op;
+  uint32_t len;         // bytes of text that follow
+  int64_t first;        // first row, or for SERVE_STATS bytes counted
+  int64_t last;         // last row, inclusive
+  int32_t col_start;
+  int32_t col_end;      // inclusive, or -1 for the last column
+};
+
+struct serve_reply {
+  uint32_t op;
+  int32_t err;          // E_OK, or why the first row couldn't be read
+  uint32_t ncells;      // cell lengths that follow, as uint32_t
+  uint32_t len;         // bytes of text after them
+  int64_t value;        // rows sent, or row found or -1
+  int64_t next;         // row to search from next
+  int64_t nrows;        // rows counted so far, headers included
+  int64_t done;         // bytes counted so far
+  int64_t total;        // bytes in all
+  int32_t ncols;
+  int32_t headers;
+  int32_t version;
+  int32_t delim;        // delimiter the cells are quoted for, or 0 if
+                        // they're plain text
+};
+
+#define T Serve_T
+typedef struct T *T;
+
+// Server, listening at path
+extern T    Serve_new   (Data_T data, int headers, const char *path);
+extern int  Serve_run   (T);
+extern void Serve_stop  (T);
+extern void Serve_free  (T *);
+
+// Client, reading the data served at path
+extern Data_T Data_remote_init    (char *path);
+extern int    Data_remote_headers (Data_T data);
+extern long   Data_remote_find    (Data_T data, const char *text, long from,
+                int col_start, int col_end);
+extern void   Data_remote_free    (Data_T *data);
+
+#undef T
+#endif // SERVE_INCLUDED
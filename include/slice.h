@@ -0,0 +1,49 @@
+//
+// -----------------------------------------------------------------------------
+// slice.h
+// -----------------------------------------------------------------------------
+//
+// Headless output of a range of rows and a projection of columns,
+// written straight from the data without going through ncurses.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef SLICE_INCLUDED
+#define SLICE_INCLUDED
+
+#include <stdatomic.h> // atomic_long
+#include "frame.h" // Data_T
+#include "pool.h"  // Pool_token
+
+typedef struct Slice_T {
+  long first;     // first data row, counting from 1
+  long last;      // last data row (inclusive), -1 for end of file
+  int *cols;      // projected columns counting from 0, NULL for all
+  int ncols;
+  int headers;
+  int align;      // pad columns to line up instead of keeping delimiters
+  int col_width;  // maximum width of an aligned column
+  Pool_token token;     // stops the write once it's cancelled, or NULL
+  atomic_long written;  // bytes written so far, read while it's written
+} *Slice_T;
+
+extern Slice_T Slice_init       (int headers, int align, int col_width);
+extern void    Slice_free       (Slice_T *slice);
+extern int     Slice_parse_rows (Slice_T slice, const char *spec);
+extern int     Slice_parse_cols (Slice_T slice, Data_T data, const char *spec);
+extern int     Slice_write      (Slice_T slice, Data_T data, int fd);
+
+#endif // SLICE_INCLUDED
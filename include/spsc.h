@@ -0,0 +1,38 @@
+//
+// -----------------------------------------------------------------------------
+// spsc.h
+// -----------------------------------------------------------------------------
+//
+// Lock-free single-producer, single-consumer queue of pointers.
+// Exactly one thread may call Spsc_push and exactly one thread
+// may call Spsc_pop.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef SPSC_INCLUDED
+#define SPSC_INCLUDED
+
+#define Q Spsc_T
+typedef struct Q *Q;
+
+extern Q     Spsc_new    (int capacity);
+extern void  Spsc_free   (Q *);
+extern int   Spsc_push   (Q, void *);
+extern void *Spsc_pop    (Q);
+extern int   Spsc_length (Q);
+
+#undef Q
+#endif // SPSC_INCLUDED
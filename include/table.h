@@ -0,0 +1,42 @@
+// 
+// -----------------------------------------------------------------------------
+// table.h
+// -----------------------------------------------------------------------------
+//
+// Hash table ADT. Maps keys to values using caller-supplied comparison
+// and hash functions, or pointer identity when they're NULL.
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef TABLE_INCLUDED
+#define TABLE_INCLUDED
+
+#define T Table_T
+typedef struct T *T;
+
+extern T     Table_new    (int hint,
+                int cmp(const void *x, const void *y),
+                unsigned hash(const void *key));
+extern void  Table_free   (T *);
+extern int   Table_length (T);
+extern void *Table_put    (T, const void *key, void *value);
+extern void *Table_get    (T, const void *key);
+extern void *Table_remove (T, const void *key);
+extern void  Table_map    (T, void apply(const void *key, void **value, 
+                void *cl), void *cl);
+
+#undef T
+#endif // TABLE_INCLUDED
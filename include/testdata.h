@@ -0,0 +1,69 @@
+//
+// -----------------------------------------------------------------------------
+// testdata.h
+// -----------------------------------------------------------------------------
+//
+// Temporary files and cell comparisons shared by the backends' unit
+// tests, inline so programs that use only some of it build cleanly.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef TESTDATA_INCLUDED
+#define TESTDATA_INCLUDED
+
+#include <stdio.h>    // remove
+#include <stdlib.h>   // mkstemp
+#include <string.h>   // memcmp, strcmp, strcpy, strlen
+#include <unistd.h>   // close, write
+#include "frame.h"    // Data_T
+
+// Writes len bytes of text to a new file made from the template path,
+// e.g. "/tmp/test-XXXXXX", which is filled in with the file's name.
+// Returns 0, or -1 if the file couldn't be written.
+static inline int write_temp(char *path, const char *text, size_t len) {
+
+  int fd = mkstemp(path);
+  if (fd < 0) return -1;
+
+  int ret = write(fd, text, len) == (ssize_t) len ? 0 : -1;
+  close(fd);
+
+  return ret;
+
+}
+
+// Removes a file or empty directory made from a template, and restores
+// the template so it can be made again
+static inline void remove_temp(char *path) {
+
+  remove(path);
+  strcpy(path + strlen(path) - 6, "XXXXXX");
+
+}
+
+// Whether a cell's text, formatted if it isn't stored as text, is str
+static inline int is(Data_T data, const char *tok, const char *str) {
+
+  char buf[256];
+  int len = data->format ? data->format(tok, buf, sizeof buf) : -1;
+  if (len >= 0) return len < (int) sizeof buf && strcmp(buf, str) == 0;
+
+  len = data->toklen(tok, data->delim);
+  return len == (int) strlen(str) && memcmp(tok, str, len) == 0;
+
+}
+
+#endif // TESTDATA_INCLUDED
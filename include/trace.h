@@ -0,0 +1,68 @@
+//
+// -----------------------------------------------------------------------------
+// trace.h
+// -----------------------------------------------------------------------------
+//
+// Optional latency tracing for Preview's hot paths. Configure with
+// --enable-trace to compile the spans in; otherwise the macros below
+// expand to nothing and cost nothing.
+//
+// Spans and keystrokes are recorded from the UI thread only.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>   // ENABLE_TRACE
+#endif
+
+#include <stdio.h>    // FILE
+#include <stddef.h>   // size_t
+
+enum {
+  TRACE_GET_ROW,
+  TRACE_GET_COL,
+  TRACE_SHIFT_ROW,
+  TRACE_SHIFT_COL,
+  TRACE_PRINT,
+  TRACE_NOPS
+};
+
+extern unsigned long long Trace_clock   (void);
+extern void               Trace_record  (int op, unsigned long long nsec);
+extern void               Trace_bytes   (long nbytes);
+extern void               Trace_key_start (void);
+extern void               Trace_key_stop  (void);
+extern int                Trace_hud     (char *buf, size_t size);
+extern int                Trace_dump    (FILE *out);
+
+#ifdef ENABLE_TRACE
+#define TRACE_START(t) unsigned long long t = Trace_clock()
+#define TRACE_STOP(op, t) Trace_record((op), Trace_clock() - (t))
+#define TRACE_BYTES(n) Trace_bytes(n)
+#define TRACE_KEY_START() Trace_key_start()
+#define TRACE_KEY_STOP() Trace_key_stop()
+#else
+#define TRACE_START(t)
+#define TRACE_STOP(op, t) ((void) 0)
+#define TRACE_BYTES(n) ((void) 0)
+#define TRACE_KEY_START() ((void) 0)
+#define TRACE_KEY_STOP() ((void) 0)
+#endif
+
+#endif // TRACE_INCLUDED
@@ -0,0 +1,148 @@
+//
+// -----------------------------------------------------------------------------
+// backend.c
+// -----------------------------------------------------------------------------
+//
+// Backends are kept in the order they're registered and searched from
+// the newest, so one loaded from a shared object takes the place of a
+// built-in backend of the same name, extension or magic bytes.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdio.h>    // snprintf
+#include <string.h>   // strcmp, strchr, strrchr, strlen, memcmp
+#include <fcntl.h>    // open, O_RDONLY
+#include <unistd.h>   // read, close
+#include <dirent.h>   // opendir, readdir, closedir
+#include <dlfcn.h>    // dlopen, dlsym, dlclose
+#include <limits.h>   // PATH_MAX
+#include "error.h"
+#include "mem.h"      // ALLOC, RESIZE
+#include "backend.h"
+#include "errorcodes.h"
+
+#define T Backend_T
+
+// Longest magic looked for at the start of a file
+#define MAGIC_MAX 64
+
+static T *backends = NULL;
+static int nbackends = 0;
+static int size = 0;
+
+// Adds backend to those files can be opened with. It must stay valid
+// for as long as it might be used. Returns E_DTA_BAD_INPUT if it was
+// built against another version of the ABI.
+int Backend_register(T backend) {
+
+  assert(backend);
+
+  if (backend->abi != BACKEND_ABI || !backend->name || !backend->init
+    || backend->magic_len < 0 || backend->magic_len > MAGIC_MAX
+    || (backend->magic_len > 0 && !backend->magic))
+    return E_DTA_BAD_INPUT;
+
+  if (nbackends == size) {
+    size = size ? 2 * size : 8;
+    if (backends) RESIZE(backends, size * sizeof(T));
+    else backends = ALLOC(size * sizeof(T));
+  }
+
+  backends[nbackends++] = backend;
+
+  return E_OK;
+
+}
+
+// The backend called name, or NULL if there isn't one
+T Backend_find(const char *name) {
+
+  assert(name);
+
+  for (int i=nbackends-1; i>=0; i--)
+    if (strcmp(backends[i]->name, name) == 0) return backends[i];
+
+  return NULL;
+
+}
+
+// The backend for path, found by the bytes the file starts with or,
+// failing that, by its extension. NULL if neither is known.
+T Backend_detect(const char *path) {
+
+  assert(path);
+
+  char head[MAGIC_MAX];
+  ssize_t len = 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd >= 0) {
+    len = read(fd, head, sizeof head);
+    close(fd);
+  }
+
+  for (int i=nbackends-1; i>=0; i--)
+    if (backends[i]->magic_len > 0 && len >= backends[i]->magic_len
+      && memcmp(head, backends[i]->magic, backends[i]->magic_len) == 0)
+      return backends[i];
+
+  const char *ext = strrchr(path, '.');
+  if (!ext || strchr(ext, '/')) return NULL;
+
+  for (int i=nbackends-1; i>=0; i--)
+    for (int j=0; backends[i]->extensions && backends[i]->extensions[j]; j++)
+      if (strcmp(backends[i]->extensions[j], ext) == 0) return backends[i];
+
+  return NULL;
+
+}
+
+// Registers the backend of each shared object in dir. Those that can't
+// be loaded, or were built against another version of the ABI, are
+// skipped. Returns how many were registered.
+int Backend_load(const char *dir) {
+
+  assert(dir);
+
+  DIR *entries = opendir(dir);
+  if (!entries) return 0;
+
+  int n = 0;
+  struct dirent *entry;
+
+  while ((entry = readdir(entries))) {
+    size_t len = strlen(entry->d_name);
+    if (len < 4 || strcmp(entry->d_name + len - 3, ".so")) continue;
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof path, "%s/%s", dir, entry->d_name)
+      >= (int) sizeof path) continue;
+
+    // Loaded backends are used until preview exits, so they're never
+    // closed once registered
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) continue;
+
+    T backend = dlsym(handle, BACKEND_SYMBOL);
+    if (backend && Backend_register(backend) == E_OK) n++;
+    else dlclose(handle);
+  }
+
+  closedir(entries);
+
+  return n;
+
+}
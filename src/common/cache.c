@@ -0,0 +1,455 @@
+//
+// -----------------------------------------------------------------------------
+// cache.c
+// -----------------------------------------------------------------------------
+//
+// Each block is empty, being read, or read. Whoever wants a block that's
+// empty starts reading it along with the CACHE_AHEAD blocks after it,
+// and then waits for just the ones it wants, so the reads after them
+// overlap with whatever is done with those. io_uring is driven through
+// its system calls directly; one thread at a time waits on the
+// completion queue and wakes the others as their blocks come in.
+// Without it, the kernel reads the blocks wanted into the page cache
+// with readahead and is told the ones ahead will be wanted, and they're
+// all marked read, since the mapping takes them from the page cache.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#define _GNU_SOURCE     // readahead
+#include <config.h>     // HAVE_LINUX_IO_URING_H
+#include <string.h>     // memset
+#include <stdatomic.h>  // atomic_uchar, atomic_long
+#include <pthread.h>    // pthread_mutex_lock, pthread_cond_wait
+#include <fcntl.h>      // posix_fadvise, readahead
+#include <unistd.h>     // close
+#include "error.h"
+#include "mem.h"        // NEW0, ALLOC, CALLOC, FREE
+#include "cache.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>     // mmap, munmap
+#include <sys/syscall.h>  // __NR_io_uring_setup, __NR_io_uring_enter
+#include <linux/io_uring.h>
+#endif
+
+#define T Cache_T
+
+// Reads in flight at once, each into a buffer of its own
+#define CACHE_QUEUE 16
+
+// Blocks read past the last one wanted
+#define CACHE_AHEAD 8
+
+enum { EMPTY, READING, READ };
+
+#ifdef HAVE_LINUX_IO_URING_H
+struct ring {
+  int fd;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq, *cq;
+  size_t sq_len, cq_len;
+  int single;           // the queues share one mapping
+  int pending;          // entries not yet submitted
+};
+#else
+struct ring;
+#endif
+
+struct T {
+  int fd;
+  ssize_t size;
+  long nblocks;
+  atomic_uchar *state;  // of each block
+  atomic_long reads;    // blocks read so far
+  char *buffers;        // CACHE_QUEUE blocks that reads land in
+  long slots[CACHE_QUEUE]; // block being read into each buffer, or -1
+  struct ring *ring;    // NULL when blocks are left to the kernel
+  int reaping;          // a thread is waiting on the completion queue
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+};
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+static void ring_free(struct ring *ring) {
+
+  if (ring->sqes) munmap(ring->sqes, CACHE_QUEUE * sizeof *ring->sqes);
+  if (ring->cq && !ring->single) munmap(ring->cq, ring->cq_len);
+  if (ring->sq) munmap(ring->sq, ring->sq_len);
+  close(ring->fd);
+  FREE(ring);
+
+}
+
+// Sets up a ring of CACHE_QUEUE entries, or returns NULL if the kernel
+// doesn't have io_uring or won't let us use it
+static struct ring *ring_new(void) {
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof p);
+
+  int fd = syscall(__NR_io_uring_setup, CACHE_QUEUE, &p);
+  if (fd < 0) return NULL;
+
+  struct ring *ring;
+  NEW0(ring);
+  ring->fd = fd;
+
+  ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  ring->single = !!(p.features & IORING_FEAT_SINGLE_MMAP);
+  if (ring->single && ring->cq_len > ring->sq_len)
+    ring->sq_len = ring->cq_len;
+
+  void *sq = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) {
+    ring_free(ring);
+    return NULL;
+  }
+  ring->sq = sq;
+
+  void *cq = sq;
+  if (!ring->single) {
+    cq = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) {
+      ring_free(ring);
+      return NULL;
+    }
+  }
+  ring->cq = cq;
+
+  void *sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    ring_free(ring);
+    return NULL;
+  }
+  ring->sqes = sqes;
+
+  ring->sq_tail = (unsigned *) ((char *) sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned *) ((char *) sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *) ((char *) sq + p.sq_off.array);
+  ring->cq_head = (unsigned *) ((char *) cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *) ((char *) cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *) ((char *) cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *) ((char *) cq + p.cq_off.cqes);
+
+  return ring;
+
+}
+
+// Queues a read of len bytes at offset into buf, tagged with slot
+static void ring_read(struct ring *ring, int slot, int fd, char *buf,
+  unsigned len, ssize_t offset) {
+
+  unsigned tail = *ring->sq_tail, i = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[i];
+
+  memset(sqe, 0, sizeof *sqe);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long) buf;
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->user_data = slot;
+
+  ring->sq_array[i] = i;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->pending++;
+
+}
+
+// Submits the reads queued
+static void ring_submit(struct ring *ring) {
+
+  if (ring->pending)
+    syscall(__NR_io_uring_enter, ring->fd, ring->pending, 0, 0, NULL, 0);
+  ring->pending = 0;
+
+}
+
+// Waits for at least one read to finish
+static void ring_wait(struct ring *ring) {
+
+  syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS,
+    NULL, 0);
+
+}
+
+#endif // HAVE_LINUX_IO_URING_H
+
+static void submit(T cache) {
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if (cache->ring) ring_submit(cache->ring);
+#endif
+
+}
+
+// Marks the blocks of the reads that have finished as read and frees
+// their buffers. Whether a read failed doesn't matter here: the blocks
+// are read again through the mapping, and the error surfaces there.
+static void reap(T cache) {
+
+#ifdef HAVE_LINUX_IO_URING_H
+  struct ring *ring = cache->ring;
+  unsigned head = *ring->cq_head;
+  unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+  for ( ; head != tail; head++) {
+    int slot = ring->cqes[head & *ring->cq_mask].user_data;
+    atomic_store(&cache->state[cache->slots[slot]], READ);
+    cache->slots[slot] = -1;
+  }
+
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+#endif
+
+}
+
+// Waits, with the lock held, for a read to finish. One thread waits
+// on the ring and the rest wait to be woken by it.
+static void wait_read(T cache) {
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if (cache->ring && !cache->reaping) {
+    ring_submit(cache->ring);
+    cache->reaping = 1;
+    pthread_mutex_unlock(&cache->lock);
+    ring_wait(cache->ring);
+    pthread_mutex_lock(&cache->lock);
+    reap(cache);
+    cache->reaping = 0;
+    pthread_cond_broadcast(&cache->done);
+    return;
+  }
+#endif
+
+  pthread_cond_wait(&cache->done, &cache->lock);
+
+}
+
+static int free_slot(T cache) {
+
+  for (int i=0; i<CACHE_QUEUE; i++) if (cache->slots[i] == -1) return i;
+
+  return -1;
+
+}
+
+// Queues a read of block b through io_uring, with the lock held.
+// Returns 0 if every buffer is in use.
+static int start_read(T cache, long b) {
+
+  int slot = free_slot(cache);
+  if (slot < 0) return 0;
+
+  cache->slots[slot] = b;
+  atomic_store(&cache->state[b], READING);
+  atomic_fetch_add(&cache->reads, 1);
+
+#ifdef HAVE_LINUX_IO_URING_H
+  ssize_t offset = b * CACHE_BLOCK;
+  ssize_t len = offset + CACHE_BLOCK <= cache->size
+    ? CACHE_BLOCK : cache->size - offset;
+  ring_read(cache->ring, slot, cache->fd, cache->buffers + slot * CACHE_BLOCK,
+    len, offset);
+#endif
+
+  return 1;
+
+}
+
+// Marks blocks first to last read, returning the first that wasn't
+// already, or -1 if they all were
+static long mark_read(T cache, long first, long last) {
+
+  long marked = -1;
+
+  for (long b=first; b<=last; b++) {
+    unsigned char empty = EMPTY;
+    if (atomic_compare_exchange_strong(&cache->state[b], &empty, READ)) {
+      atomic_fetch_add(&cache->reads, 1);
+      if (marked < 0) marked = b;
+    }
+  }
+
+  return marked;
+
+}
+
+// Without io_uring, the blocks wanted are read into the page cache
+// before returning and those ahead are read by the kernel in the
+// background. Nothing is copied; the mapping finds the pages there.
+static void advise(T cache, long first, long last, long ahead) {
+
+  long b = mark_read(cache, first, last);
+  if (b >= 0)
+    readahead(cache->fd, b * CACHE_BLOCK, (last - b + 1) * CACHE_BLOCK);
+
+  b = ahead > last ? mark_read(cache, last + 1, ahead) : -1;
+  if (b >= 0)
+    posix_fadvise(cache->fd, b * CACHE_BLOCK, (ahead - b + 1) * CACHE_BLOCK,
+      POSIX_FADV_WILLNEED);
+
+}
+
+// Reads of size bytes of fd, which is closed when the cache is freed.
+// Blocks are read through io_uring if uring is set and the kernel has
+// it, and left to the kernel's readahead otherwise.
+T Cache_new(int fd, ssize_t size, int uring) {
+
+  assert(fd >= 0 && size >= 0);
+
+  T cache;
+  NEW0(cache);
+
+  cache->fd = fd;
+  cache->size = size;
+  cache->nblocks = (size + CACHE_BLOCK - 1) / CACHE_BLOCK;
+  cache->state = CALLOC(cache->nblocks + 1, sizeof(atomic_uchar));
+  for (int i=0; i<CACHE_QUEUE; i++) cache->slots[i] = -1;
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if (uring) cache->ring = ring_new();
+#endif
+
+  // Only reads through io_uring land in buffers of our own
+  if (cache->ring) cache->buffers = ALLOC(CACHE_QUEUE * CACHE_BLOCK);
+
+  pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->done, NULL);
+
+  return cache;
+
+}
+
+void Cache_free(T *cache) {
+
+  assert(cache && *cache);
+
+  T c = *cache;
+
+  // Reads in flight still write to the buffers
+  pthread_mutex_lock(&c->lock);
+  for (int i=0; i<CACHE_QUEUE; i++)
+    while (c->slots[i] != -1) wait_read(c);
+  pthread_mutex_unlock(&c->lock);
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if (c->ring) ring_free(c->ring);
+#endif
+
+  pthread_mutex_destroy(&c->lock);
+  pthread_cond_destroy(&c->done);
+
+  close(c->fd);
+  FREE(c->state);
+  if (c->buffers) FREE(c->buffers);
+  FREE(*cache);
+
+}
+
+// Returns once the blocks holding [offset, offset+len) have been read,
+// starting reads of the CACHE_AHEAD blocks after them if they haven't
+// been already. A len of 0 wants just the block holding offset.
+void Cache_want(T cache, ssize_t offset, ssize_t len) {
+
+  assert(cache);
+
+  if (offset < 0 || offset >= cache->size) return;
+  if (len < 1) len = 1;
+
+  long first = offset / CACHE_BLOCK, last = (offset + len - 1) / CACHE_BLOCK;
+  if (last >= cache->nblocks) last = cache->nblocks - 1;
+  long ahead = last + CACHE_AHEAD < cache->nblocks
+    ? last + CACHE_AHEAD : cache->nblocks - 1;
+
+  // Nearly always, what's wanted was read ahead of time
+  long b = first;
+  while (b <= last && atomic_load(&cache->state[b]) == READ) b++;
+  if (b > last && (ahead == last 
+    || atomic_load(&cache->state[ahead]) != EMPTY)) return;
+
+  if (!cache->ring) {
+    advise(cache, first, last, ahead);
+    return;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+
+  for (b=first; b<=ahead; b++) {
+    if (atomic_load(&cache->state[b]) != EMPTY || start_read(cache, b)) 
+      continue;
+    if (b > last) break;
+    // Blocks wanted wait for a buffer to come free
+    wait_read(cache);
+    b--;
+  }
+
+  submit(cache);
+
+  // A block can be forgotten again as soon as it's read, in which case
+  // it's read over
+  for (b=first; b<=last; b++)
+    while (atomic_load(&cache->state[b]) != READ) {
+      if (atomic_load(&cache->state[b]) == EMPTY && start_read(cache, b))
+        submit(cache);
+      else wait_read(cache);
+    }
+
+  pthread_mutex_unlock(&cache->lock);
+
+}
+
+// Forgets that the blocks wholly inside [offset, offset+len) were
+// read, once their pages have been dropped, so they're read again if
+// they're wanted
+void Cache_forget(T cache, ssize_t offset, ssize_t len) {
+
+  assert(cache);
+
+  long first = (offset + CACHE_BLOCK - 1) / CACHE_BLOCK;
+  long last = offset + len >= cache->size
+    ? cache->nblocks - 1 : (offset + len) / CACHE_BLOCK - 1;
+
+  for (long b=first; b<=last; b++) {
+    unsigned char read = READ;
+    atomic_compare_exchange_strong(&cache->state[b], &read, EMPTY);
+  }
+
+}
+
+// Whether blocks are read through io_uring
+int Cache_uring(T cache) {
+
+  assert(cache);
+  return cache->ring != NULL;
+
+}
+
+// Blocks read so far, counting those read again
+long Cache_reads(T cache) {
+
+  assert(cache);
+  return atomic_load(&cache->reads);
+
+}
@@ -0,0 +1,156 @@
+//
+// -----------------------------------------------------------------------------
+// columns.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdint.h>   // intptr_t
+#include <stdlib.h>   // strtol
+#include <string.h>   // strcmp, strcspn, strspn, memcpy
+#include "error.h"
+#include "mem.h"      // ALLOC, CALLOC, RESIZE, FREE
+#include "table.h"
+#include "frame.h"
+#include "columns.h"
+#include "errorcodes.h"
+
+static int cmpstr(const void *x, const void *y) {
+  return strcmp(x, y);
+}
+
+// FNV-1a
+static unsigned hashstr(const void *key) {
+
+  unsigned h = 2166136261u;
+  for (const unsigned char *s = key; *s; s++) h = (h ^ *s) * 16777619u;
+
+  return h;
+
+}
+
+static char *copy(const char *str, int len) {
+
+  char *s = ALLOC(len + 1);
+  memcpy(s, str, len);
+  s[len] = '\0';
+
+  return s;
+
+}
+
+static void free_key(const void *key, void **value, void *cl) {
+  char *name = (char *) key;
+  FREE(name);
+}
+
+// Maps each header name, without surrounding quotes, to its column
+// counting from 1 so that a missing name reads as NULL
+static Table_T header_names(Data_T data) {
+
+  // Reading one field first tells us how many columns there are
+  char *tok, **buf;
+  if (data->get_row(data, &tok, 0, 0, 0) != E_OK) return NULL;
+
+  buf = CALLOC(data->ncols, sizeof(char *));
+  if (data->get_row(data, buf, 0, 0, data->ncols-1) != E_OK) {
+    FREE(buf);
+    return NULL;
+  }
+
+  Table_T names = Table_new(data->ncols, cmpstr, hashstr);
+
+  for (int icol=0; icol<data->ncols; icol++) {
+    tok = buf[icol];
+    int len = data->toklen(tok, data->delim);
+    if (len >= 2 && tok[0] == '"' && tok[len-1] == '"') tok++, len -= 2;
+
+    char *name = copy(tok, len);
+    // The first of any duplicate names wins
+    if (Table_get(names, name)) FREE(name);
+    else Table_put(names, name, (void *) (intptr_t) (icol + 1));
+  }
+
+  FREE(buf);
+
+  return names;
+
+}
+
+// Parses spec into a list of columns counting from 0. Names are only
+// looked up if the data has headers. On success *cols is allocated
+// and must be freed by the caller.
+int Columns_parse(Data_T data, const char *spec, int headers,
+  int **cols, int *ncols) {
+
+  assert(data && spec && cols && ncols);
+
+  Table_T names = NULL;
+  int n = 0, size = 16, err = E_OK;
+  int *list = CALLOC(size, sizeof(int));
+
+  while (*spec && err == E_OK) {
+
+    int len = strcspn(spec, ",");
+    long lo = 0, hi = 0;
+    char *end;
+
+    // Numbers and ranges of numbers, otherwise a name
+    if (strspn(spec, "0123456789-") == (size_t) len) {
+      lo = hi = strtol(spec, &end, 10);
+      if (*end == '-') hi = strtol(end + 1, &end, 10);
+      if (end != spec + len || lo < 1 || hi < lo) err = E_DTA_BAD_INPUT;
+    } else {
+      if (!headers) err = E_DTA_BAD_INPUT;
+      else if (!names && !(names = header_names(data))) err = E_DTA_PARSE_ERROR;
+      else {
+        char *name = copy(spec, len);
+        lo = hi = (intptr_t) Table_get(names, name);
+        FREE(name);
+        if (!lo) err = E_DTA_BAD_INPUT;
+      }
+    }
+
+    for (long c = lo; err == E_OK && c <= hi; c++) {
+      if (data->ncols && c > data->ncols) err = E_DTA_COL_OOB;
+      else {
+        if (n == size) RESIZE(list, (size *= 2) * sizeof(int));
+        list[n++] = c - 1;
+      }
+    }
+
+    spec += len;
+    if (*spec == ',') spec++;
+  }
+
+  if (names) {
+    Table_map(names, free_key, NULL);
+    Table_free(&names);
+  }
+
+  if (err == E_OK && n == 0) err = E_DTA_BAD_INPUT;
+
+  if (err != E_OK) {
+    FREE(list);
+    return err;
+  }
+
+  *cols = list;
+  *ncols = n;
+
+  return E_OK;
+
+}
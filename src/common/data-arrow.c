@@ -0,0 +1,1008 @@
+//
+// -----------------------------------------------------------------------------
+// data-arrow.c
+// -----------------------------------------------------------------------------
+//
+// Implementation of Data_T instance for Arrow IPC files (Feather v2).
+// The file is mapped and only its footer and batch metadata are read on
+// open. Cells are pointers straight into the column buffers: strings
+// are shown as they are, and numbers, dates and times are only
+// formatted when they're printed.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdio.h>    // snprintf
+#include <stdlib.h>   // bsearch
+#include <string.h>   // memcmp, memcpy, strlen
+#include <stdint.h>   // int64_t, uint8_t
+#include <time.h>     // gmtime_r
+#include <sys/mman.h> // mmap, MAP_FAILED
+#include <sys/stat.h> // fstat
+#include <fcntl.h>    // O_RDONLY
+#include <unistd.h>   // close
+#include "mem.h"      // NEW0, CALLOC, RESIZE, FREE
+#include "index.h"
+#include "frame.h"
+#include "errorcodes.h"
+
+#define MAGIC "ARROW1"
+
+// Tags of the Type union in Schema.fbs
+#define TYPE_NULL           1
+#define TYPE_INT            2
+#define TYPE_FLOAT          3
+#define TYPE_BINARY         4
+#define TYPE_UTF8           5
+#define TYPE_BOOL           6
+#define TYPE_DECIMAL        7
+#define TYPE_DATE           8
+#define TYPE_TIME           9
+#define TYPE_TIMESTAMP      10
+#define TYPE_INTERVAL       11
+#define TYPE_LIST           12
+#define TYPE_STRUCT         13
+#define TYPE_UNION          14
+#define TYPE_FIXED_BINARY   15
+#define TYPE_FIXED_LIST     16
+#define TYPE_MAP            17
+#define TYPE_DURATION       18
+#define TYPE_LARGE_BINARY   19
+#define TYPE_LARGE_UTF8     20
+#define TYPE_LARGE_LIST     21
+
+// Tags of the MessageHeader union in Message.fbs
+#define MESSAGE_DICTIONARY  2
+#define MESSAGE_BATCH       3
+
+// Longest formatted value
+#define TEXT_MAX 48
+
+// -----------------------------------------------------------------------------
+// Flatbuffers
+//
+// Just enough to walk the footer and message tables. Every read is
+// checked against the mapping, and a bad offset makes the read return
+// 0 or NULL and marks the file as bad.
+// -----------------------------------------------------------------------------
+
+typedef struct fb {
+  const uint8_t *lo, *hi;
+  int bad;
+} *fb;
+
+static int inside(fb f, const uint8_t *p, int64_t len) {
+
+  if (p && p >= f->lo && len >= 0 && len <= f->hi - p) return 1;
+  f->bad = 1;
+  return 0;
+
+}
+
+static uint32_t u32(const uint8_t *p) { uint32_t x; memcpy(&x, p, 4); return x; }
+static uint16_t u16(const uint8_t *p) { uint16_t x; memcpy(&x, p, 2); return x; }
+static int64_t i64(const uint8_t *p) { int64_t x; memcpy(&x, p, 8); return x; }
+
+// Address of field i of a table, or NULL if it's absent
+static const uint8_t *fb_field(fb f, const uint8_t *table, int i) {
+
+  if (!table || !inside(f, table, 4)) return NULL;
+
+  const uint8_t *vt = table - (int32_t) u32(table);
+  if (!inside(f, vt, 4) || !inside(f, vt, u16(vt))) return NULL;
+  if (4 + 2*i + 2 > u16(vt)) return NULL;
+
+  uint16_t off = u16(vt + 4 + 2*i);
+  if (!off || !inside(f, table + off, 1)) return NULL;
+
+  return table + off;
+
+}
+
+static int64_t fb_int(fb f, const uint8_t *table, int i, int width, 
+  int64_t def) {
+
+  const uint8_t *p = fb_field(f, table, i);
+  if (!p || !inside(f, p, width)) return def;
+
+  switch (width) {
+    case 1: return *p;
+    case 2: return (int16_t) u16(p);
+    case 4: return (int32_t) u32(p);
+    default: return i64(p);
+  }
+
+}
+
+static const uint8_t *fb_deref(fb f, const uint8_t *p) {
+
+  if (!p || !inside(f, p, 4)) return NULL;
+  p += u32(p);
+
+  return inside(f, p, 4) ? p : NULL;
+
+}
+
+static const uint8_t *fb_table(fb f, const uint8_t *table, int i) {
+  return fb_deref(f, fb_field(f, table, i));
+}
+
+// Elements of a vector, each size bytes, and their number
+static const uint8_t *fb_vector(fb f, const uint8_t *table, int i, int size,
+  long *n) {
+
+  const uint8_t *v = fb_table(f, table, i);
+  *n = 0;
+  if (!v || !inside(f, v + 4, (int64_t) u32(v) * size)) return NULL;
+
+  *n = u32(v);
+  return v + 4;
+
+}
+
+static const char *fb_string(fb f, const uint8_t *table, int i) {
+
+  long n;
+  const uint8_t *s = fb_vector(f, table, i, 1, &n);
+
+  // Strings are followed by a NUL
+  return s && inside(f, s, n + 1) ? (const char *) s : NULL;
+
+}
+
+// -----------------------------------------------------------------------------
+// Columns
+// -----------------------------------------------------------------------------
+
+// Values of a column in one batch, or of a dictionary
+struct array {
+  const uint8_t *validity;  // NULL if nothing's null
+  const uint8_t *values;    // fixed-width values, indices or offsets
+  const uint8_t *data;      // bytes of strings
+  long length;
+};
+
+struct column {
+  const char *name;
+  int type;
+  int width;            // bytes per value of fixed-width types
+  int is_signed;
+  int unit;             // of dates, times and durations, or float precision
+  int scale;            // of decimals
+  int nodes;            // field nodes and buffers of the column and
+  int buffers;          // its children in each batch
+  int64_t dict_id;      // -1 unless the column is dictionary encoded
+  int index_width;
+  int index_signed;
+  struct array dict;
+};
+
+struct batch {
+  long first;           // first row, counting from 0
+  long length;
+  ssize_t offset;       // where the batch starts in the file
+  ssize_t size;
+  struct array *arrays;
+};
+
+typedef struct arrow_args {
+  uint8_t *ptr;
+  struct column *columns;
+  struct batch *batches;
+  long nbatches;
+  long length;          // rows in every batch
+} *arrow_args;
+
+// Cells that aren't in any buffer point here
+static char missing[] = "";
+static char true_str[] = "true";
+static char false_str[] = "false";
+static char list_str[] = "[...]";
+static char struct_str[] = "{...}";
+static char other_str[] = "?";
+
+// Number of field nodes and buffers a field and its children take up,
+// or -1 if the layout isn't one we know
+static int layout(fb f, const uint8_t *field, int *nodes, int *buffers) {
+
+  int type = fb_int(f, field, 2, 1, 0);
+  long nchildren;
+  const uint8_t *children = fb_vector(f, field, 5, 4, &nchildren);
+
+  (*nodes)++;
+
+  // Dictionary encoded values are laid out as their indices
+  if (fb_field(f, field, 4)) type = TYPE_INT;
+
+  switch (type) {
+    case TYPE_NULL:         break;
+    case TYPE_BINARY:
+    case TYPE_UTF8:
+    case TYPE_LARGE_BINARY:
+    case TYPE_LARGE_UTF8:   *buffers += 3; break;
+    case TYPE_LIST:
+    case TYPE_LARGE_LIST:
+    case TYPE_MAP:          *buffers += 2; break;
+    case TYPE_STRUCT:
+    case TYPE_FIXED_LIST:   *buffers += 1; break;
+    case TYPE_INT:
+    case TYPE_FLOAT:
+    case TYPE_BOOL:
+    case TYPE_DECIMAL:
+    case TYPE_DATE:
+    case TYPE_TIME:
+    case TYPE_TIMESTAMP:
+    case TYPE_INTERVAL:
+    case TYPE_FIXED_BINARY:
+    case TYPE_DURATION:     *buffers += 2; break;
+    default:                return -1;
+  }
+
+  for (long i=0; i<nchildren; i++)
+    if (layout(f, fb_deref(f, children + 4*i), nodes, buffers) < 0) return -1;
+
+  return 0;
+
+}
+
+static int column(fb f, const uint8_t *field, struct column *c) {
+
+  c->name = fb_string(f, field, 0);
+  if (!c->name) c->name = missing;
+  c->type = fb_int(f, field, 2, 1, 0);
+  c->dict_id = -1;
+
+  const uint8_t *type = fb_table(f, field, 3);
+
+  switch (c->type) {
+    case TYPE_INT:
+      c->width = fb_int(f, type, 0, 4, 0) / 8;
+      c->is_signed = fb_int(f, type, 1, 1, 0);
+      break;
+    case TYPE_FLOAT:
+      c->unit = fb_int(f, type, 0, 2, 0);
+      c->width = 2 << c->unit;
+      break;
+    case TYPE_DECIMAL:
+      c->scale = fb_int(f, type, 1, 4, 0);
+      c->width = fb_int(f, type, 2, 4, 128) / 8;
+      break;
+    case TYPE_DATE:
+      c->unit = fb_int(f, type, 0, 2, 1);
+      c->width = c->unit ? 8 : 4;
+      break;
+    case TYPE_TIME:
+      c->unit = fb_int(f, type, 0, 2, 1);
+      c->width = fb_int(f, type, 1, 4, 32) / 8;
+      break;
+    case TYPE_TIMESTAMP:
+      c->unit = fb_int(f, type, 0, 2, 0);
+      c->width = 8;
+      break;
+    case TYPE_DURATION:
+      c->unit = fb_int(f, type, 0, 2, 1);
+      c->width = 8;
+      break;
+    case TYPE_INTERVAL:
+      c->width = 16;
+      break;
+    case TYPE_FIXED_BINARY:
+      c->width = fb_int(f, type, 0, 4, 0);
+      break;
+  }
+
+  const uint8_t *dict = fb_table(f, field, 4);
+  if (dict) {
+    c->dict_id = fb_int(f, dict, 0, 8, 0);
+    const uint8_t *index = fb_table(f, dict, 1);
+    c->index_width = index ? fb_int(f, index, 0, 4, 32) / 8 : 4;
+    c->index_signed = index ? fb_int(f, index, 1, 1, 0) : 1;
+  }
+
+  if (layout(f, field, &c->nodes, &c->buffers) < 0) return E_DTA_PARSE_ERROR;
+
+  return f->bad ? E_DTA_PARSE_ERROR : E_OK;
+
+}
+
+// -----------------------------------------------------------------------------
+// Batches
+// -----------------------------------------------------------------------------
+
+// Header and body of the message a footer block points to
+static const uint8_t *message(fb f, const uint8_t *block, int type, 
+  const uint8_t **body, int64_t *body_len) {
+
+  const uint8_t *p = f->lo + i64(block);
+  int64_t meta_len = (int32_t) u32(block + 8);
+  *body_len = i64(block + 16);
+
+  if (!inside(f, p, meta_len) || meta_len < 8) return NULL;
+  *body = p + meta_len;
+  if (!inside(f, *body, *body_len)) return NULL;
+
+  // Messages start with a continuation marker, except in old files
+  const uint8_t *msg = u32(p) == 0xFFFFFFFF ? p + 8 : p + 4;
+  msg = fb_deref(f, msg);
+
+  if (fb_int(f, msg, 1, 1, 0) != type) return NULL;
+
+  return fb_table(f, msg, 2);
+
+}
+
+// Points an array at its buffers, taking the nodes and buffers
+// of a column from the front of a record batch's
+static int array(fb f, struct column *c, const uint8_t *body, 
+  int64_t body_len, const uint8_t *node, const uint8_t *buffers,
+  struct array *a) {
+
+  a->length = i64(node);
+
+  const uint8_t *bufs[3] = { NULL, NULL, NULL };
+  for (int i=0; i<3 && i<c->buffers; i++) {
+    int64_t offset = i64(buffers + 16*i), len = i64(buffers + 16*i + 8);
+    if (offset < 0 || len < 0 || offset + len > body_len) return E_DTA_PARSE_ERROR;
+    bufs[i] = len ? body + offset : NULL;
+  }
+
+  a->validity = i64(node + 8) ? bufs[0] : NULL;
+  a->values = bufs[1];
+  a->data = bufs[2];
+
+  return E_OK;
+
+}
+
+static int batches(fb f, arrow_args args, int ncols, const uint8_t *footer) {
+
+  long nblocks;
+  const uint8_t *blocks = fb_vector(f, footer, 3, 24, &nblocks);
+
+  args->batches = CALLOC(nblocks + 1, sizeof(struct batch));
+
+  for (long b=0; b<nblocks; b++) {
+    const uint8_t *body;
+    int64_t body_len;
+    const uint8_t *batch = message(f, blocks + 24*b, MESSAGE_BATCH, 
+      &body, &body_len);
+    if (!batch) return E_DTA_PARSE_ERROR;
+
+    // Compressed bodies would have to be decoded
+    if (fb_field(f, batch, 3)) return E_DTA_PARSE_ERROR;
+
+    long nnodes, nbuffers;
+    const uint8_t *nodes = fb_vector(f, batch, 1, 16, &nnodes);
+    const uint8_t *buffers = fb_vector(f, batch, 2, 16, &nbuffers);
+
+    struct batch *bt = &args->batches[args->nbatches++];
+    bt->first = args->length;
+    bt->length = fb_int(f, batch, 0, 8, 0);
+    bt->offset = body - f->lo;
+    bt->size = body_len;
+    bt->arrays = CALLOC(ncols, sizeof(struct array));
+    args->length += bt->length;
+
+    long node = 0, buffer = 0;
+    for (int icol=0; icol<ncols; icol++) {
+      struct column *c = &args->columns[icol];
+      if (node + c->nodes > nnodes || buffer + c->buffers > nbuffers)
+        return E_DTA_PARSE_ERROR;
+      if (array(f, c, body, body_len, nodes + 16*node, buffers + 16*buffer,
+        &bt->arrays[icol]) != E_OK) return E_DTA_PARSE_ERROR;
+      node += c->nodes;
+      buffer += c->buffers;
+    }
+  }
+
+  return f->bad ? E_DTA_PARSE_ERROR : E_OK;
+
+}
+
+// Reads the values of each dictionary. Deltas aren't supported, and
+// their values show up as missing.
+static int dictionaries(fb f, arrow_args args, int ncols, 
+  const uint8_t *footer) {
+
+  long nblocks;
+  const uint8_t *blocks = fb_vector(f, footer, 2, 24, &nblocks);
+
+  for (long b=0; b<nblocks; b++) {
+    const uint8_t *body;
+    int64_t body_len;
+    const uint8_t *dict = message(f, blocks + 24*b, MESSAGE_DICTIONARY, 
+      &body, &body_len);
+    if (!dict) return E_DTA_PARSE_ERROR;
+    if (fb_int(f, dict, 2, 1, 0)) continue;
+
+    int64_t id = fb_int(f, dict, 0, 8, 0);
+    const uint8_t *batch = fb_table(f, dict, 1);
+    if (!batch || fb_field(f, batch, 3)) return E_DTA_PARSE_ERROR;
+
+    long nnodes, nbuffers;
+    const uint8_t *nodes = fb_vector(f, batch, 1, 16, &nnodes);
+    const uint8_t *buffers = fb_vector(f, batch, 2, 16, &nbuffers);
+
+    for (int icol=0; icol<ncols; icol++) {
+      struct column *c = &args->columns[icol];
+      if (c->dict_id != id) continue;
+
+      // The dictionary holds values of the column's own type
+      struct column values = *c;
+      values.buffers = c->type == TYPE_UTF8 || c->type == TYPE_BINARY
+        || c->type == TYPE_LARGE_UTF8 || c->type == TYPE_LARGE_BINARY ? 3 : 2;
+      if (nnodes < 1 || nbuffers < values.buffers
+        || array(f, &values, body, body_len, nodes, buffers, &c->dict) != E_OK)
+        return E_DTA_PARSE_ERROR;
+    }
+  }
+
+  return f->bad ? E_DTA_PARSE_ERROR : E_OK;
+
+}
+
+// -----------------------------------------------------------------------------
+// Cells
+//
+// Tokens are pointers into the buffers, which don't say how long they
+// are or what they hold. Every buffer cells can point into is kept in a
+// list sorted by address, so a token can be looked up to find out.
+// -----------------------------------------------------------------------------
+
+struct region {
+  const uint8_t *lo, *hi;
+  const struct column *column;
+  const uint8_t *offsets;   // of strings, whose bytes are [lo, hi)
+  long length;
+  arrow_args owner;
+};
+
+static struct region *regions = NULL;
+static long nregions = 0, region_size = 0;
+
+static int cmp_region(const void *x, const void *y) {
+
+  const struct region *a = x, *b = y;
+
+  return a->lo < b->lo ? -1 : a->lo > b->lo;
+
+}
+
+static int find_region(const void *key, const void *x) {
+
+  const uint8_t *p = key;
+  const struct region *r = x;
+
+  return p < r->lo ? -1 : p >= r->hi;
+
+}
+
+static int is_string(int type) {
+  return type == TYPE_UTF8 || type == TYPE_BINARY 
+    || type == TYPE_LARGE_UTF8 || type == TYPE_LARGE_BINARY;
+}
+
+static int is_large(int type) {
+  return type == TYPE_LARGE_UTF8 || type == TYPE_LARGE_BINARY;
+}
+
+static int64_t offset_at(const struct column *c, const uint8_t *offsets, 
+  long i) {
+
+  return is_large(c->type) ? i64(offsets + 8*i) : (int32_t) u32(offsets + 4*i);
+
+}
+
+static void add_region(arrow_args args, const struct column *c, 
+  const struct array *a) {
+
+  struct region r = { NULL, NULL, c, NULL, a->length, args };
+
+  if (is_string(c->type)) {
+    if (!a->values || !a->data) return;
+    r.lo = a->data;
+    r.hi = a->data + offset_at(c, a->values, a->length);
+    r.offsets = a->values;
+  } else if (c->width && c->type != TYPE_BOOL && c->type != TYPE_INTERVAL) {
+    if (!a->values) return;
+    r.lo = a->values;
+    r.hi = a->values + a->length * c->width;
+  } else return;
+
+  if (r.hi <= r.lo) return;
+
+  if (nregions == region_size) {
+    region_size = region_size ? 2 * region_size : 64;
+    if (regions) RESIZE(regions, region_size * sizeof(struct region));
+    else regions = CALLOC(region_size, sizeof(struct region));
+  }
+
+  regions[nregions++] = r;
+
+}
+
+static void remove_regions(arrow_args args) {
+
+  long n = 0;
+  for (long i=0; i<nregions; i++)
+    if (regions[i].owner != args) regions[n++] = regions[i];
+
+  nregions = n;
+  if (nregions == 0 && regions) {
+    FREE(regions);
+    region_size = 0;
+  }
+
+}
+
+static const struct region *region_of(const char *tok) {
+
+  if (!nregions) return NULL;
+
+  return bsearch(tok, regions, nregions, sizeof(struct region), find_region);
+
+}
+
+// Length of the string starting at p, from the next offset past it
+static long string_len(const struct region *r, const uint8_t *p) {
+
+  int64_t off = p - r->lo;
+  long lo = 0, hi = r->length;
+
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (offset_at(r->column, r->offsets, mid + 1) <= off) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return offset_at(r->column, r->offsets, lo + 1) - off;
+
+}
+
+static int64_t read_int(const uint8_t *p, int width, int is_signed) {
+
+  switch (width) {
+    // Both sides are widened first, or the unsigned side's type wins
+    case 1: return is_signed ? (int64_t) (int8_t) *p : (int64_t) *p;
+    case 2: return is_signed ? (int64_t) (int16_t) u16(p) : (int64_t) u16(p);
+    case 4: return is_signed ? (int64_t) (int32_t) u32(p) : (int64_t) u32(p);
+    default: return i64(p);
+  }
+
+}
+
+static int format_time(char *buf, int size, int64_t t, int unit, int date,
+  int clock) {
+
+  static const int64_t per_sec[] = { 1, 1000, 1000000, 1000000000 };
+  static const int digits[] = { 0, 3, 6, 9 };
+
+  int64_t secs = t / per_sec[unit], frac = t % per_sec[unit];
+  if (frac < 0) secs--, frac += per_sec[unit];
+
+  time_t tt = secs;
+  struct tm tm;
+  if (!gmtime_r(&tt, &tm)) return snprintf(buf, size, "%lld", (long long) t);
+
+  int n = 0;
+  if (date) n += snprintf(buf, size, "%04d-%02d-%02d", 
+    tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+  if (clock) {
+    n += snprintf(buf + n, size - n, "%s%02d:%02d:%02d", date ? " " : "", 
+      tm.tm_hour, tm.tm_min, tm.tm_sec);
+    if (frac) n += snprintf(buf + n, size - n, ".%0*lld", digits[unit], 
+      (long long) frac);
+  }
+
+  return n;
+
+}
+
+static int format_decimal(char *buf, int size, const uint8_t *p, int scale) {
+
+  __int128 x;
+  memcpy(&x, p, 16);
+
+  char digits[48];
+  int n = 0, neg = x < 0;
+  unsigned __int128 u = neg ? -(unsigned __int128) x : (unsigned __int128) x;
+
+  do digits[n++] = '0' + u % 10, u /= 10; while (u || n <= scale);
+
+  int len = 0;
+  if (neg && len < size - 1) buf[len++] = '-';
+  while (n > 0 && len < size - 1) {
+    if (n == scale && scale > 0) buf[len++] = '.';
+    if (len < size - 1) buf[len++] = digits[--n];
+  }
+  buf[len] = '\0';
+
+  return len;
+
+}
+
+static float half(uint16_t h) {
+
+  int exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+  float x = exp ? (1024 + mant) / 1024.f : mant / 1024.f;
+
+  for (int e = exp ? exp - 15 : -14; e > 0; e--) x *= 2;
+  for (int e = exp ? exp - 15 : -14; e < 0; e++) x /= 2;
+  if (exp == 31) x = mant ? 0.f / 0.f : 1.f / 0.f;
+
+  return h >> 15 ? -x : x;
+
+}
+
+// Formats a fixed-width value
+static int format_value(const struct column *c, const uint8_t *p, char *buf, 
+  int size) {
+
+  static const char *units[] = { "s", "ms", "us", "ns" };
+
+  switch (c->type) {
+    case TYPE_INT:
+      if (c->is_signed || c->width < 8)
+        return snprintf(buf, size, "%lld", 
+          (long long) read_int(p, c->width, c->is_signed));
+      return snprintf(buf, size, "%llu", (unsigned long long) i64(p));
+    case TYPE_FLOAT:
+      if (c->width == 2) return snprintf(buf, size, "%g", half(u16(p)));
+      if (c->width == 4) {
+        float x;
+        memcpy(&x, p, 4);
+        return snprintf(buf, size, "%.7g", x);
+      } else {
+        double x;
+        memcpy(&x, p, 8);
+        return snprintf(buf, size, "%.15g", x);
+      }
+    case TYPE_DECIMAL:
+      if (c->width != 16) break;
+      return format_decimal(buf, size, p, c->scale);
+    case TYPE_DATE:
+      return c->unit 
+        ? format_time(buf, size, i64(p), 1, 1, 0)
+        : format_time(buf, size, (int64_t) (int32_t) u32(p) * 86400, 0, 1, 0);
+    case TYPE_TIME:
+      return format_time(buf, size, read_int(p, c->width, 1), c->unit, 0, 1);
+    case TYPE_TIMESTAMP:
+      return format_time(buf, size, i64(p), c->unit, 1, 1);
+    case TYPE_DURATION:
+      return snprintf(buf, size, "%lld%s", (long long) i64(p), 
+        units[c->unit & 3]);
+  }
+
+  return snprintf(buf, size, "%s", other_str);
+
+}
+
+// Text of a cell that isn't stored as text, formatted into buf. Returns
+// -1 if the token is its own text.
+static int format(const char *tok, char *buf, int size) {
+
+  const struct region *r = region_of(tok);
+  if (!r || is_string(r->column->type) || r->column->type == TYPE_FIXED_BINARY)
+    return -1;
+
+  return format_value(r->column, (const uint8_t *) tok, buf, size);
+
+}
+
+static int toklen(const char *tok, char delim) {
+
+  const struct region *r = region_of(tok);
+  char buf[TEXT_MAX];
+
+  if (!r) return strlen(tok);
+  if (is_string(r->column->type)) return string_len(r, (const uint8_t *) tok);
+  if (r->column->type == TYPE_FIXED_BINARY) return r->column->width;
+
+  return format_value(r->column, (const uint8_t *) tok, buf, sizeof buf);
+
+}
+
+static int mvaddntok(int row, int col, const char *tok, int n, char delim) {
+
+  char buf[TEXT_MAX];
+  int len = format(tok, buf, sizeof buf);
+
+  if (len >= 0) tok = buf;
+  else len = toklen(tok, delim);
+
+  mvaddnstr(row, col, tok, len < n ? len : n);
+
+  return 1;
+
+}
+
+static int is_null(const struct array *a, long i) {
+  return a->validity && !((a->validity[i >> 3] >> (i & 7)) & 1);
+}
+
+// Cell i of an array
+static char *cell(const struct column *c, const struct array *a, long i) {
+
+  if (i >= a->length || is_null(a, i)) return missing;
+
+  if (c->dict_id >= 0) {
+    if (!a->values) return missing;
+    int64_t k = read_int(a->values + i * c->index_width, c->index_width, 
+      c->index_signed);
+    a = &c->dict;
+    if (k < 0 || k >= a->length || is_null(a, k)) return missing;
+    i = k;
+  }
+
+  switch (c->type) {
+    case TYPE_NULL:
+      return missing;
+    case TYPE_BOOL:
+      if (!a->values) return missing;
+      return (a->values[i >> 3] >> (i & 7)) & 1 ? true_str : false_str;
+    case TYPE_LIST:
+    case TYPE_LARGE_LIST:
+    case TYPE_FIXED_LIST:
+      return list_str;
+    case TYPE_STRUCT:
+    case TYPE_MAP:
+      return struct_str;
+    case TYPE_INTERVAL:
+      return other_str;
+  }
+
+  if (is_string(c->type)) {
+    if (!a->values || !a->data) return missing;
+    int64_t start = offset_at(c, a->values, i);
+    int64_t end = offset_at(c, a->values, i+1);
+    return end > start ? (char *) a->data + start : missing;
+  }
+
+  return a->values ? (char *) a->values + i * c->width : missing;
+
+}
+
+static struct batch *batch_of(arrow_args args, long row) {
+
+  long lo = 0, hi = args->nbatches - 1;
+
+  while (lo < hi) {
+    long mid = lo + (hi - lo + 1) / 2;
+    if (args->batches[mid].first <= row) lo = mid;
+    else hi = mid - 1;
+  }
+
+  return &args->batches[lo];
+
+}
+
+// The index isn't needed to find rows, but the frame uses it to show
+// how far through the file we are. Rows are spread evenly over the
+// bodies of their batches.
+static void seek_row(Data_T data, int row) {
+
+  arrow_args args = data->args;
+
+  while (Index_length(data->rows) <= row + 1) {
+    long next = Index_length(data->rows) - 1;
+    ssize_t offset = data->st_size;
+    if (next < args->length) {
+      struct batch *b = batch_of(args, next);
+      offset = b->offset + b->size * (next - b->first) / b->length;
+    }
+    if (offset < Index_get(data->rows, Index_length(data->rows)-1))
+      offset = Index_get(data->rows, Index_length(data->rows)-1);
+    Index_append(data->rows, offset);
+  }
+
+}
+
+// Row 0 holds the column names, and row i the record i-1
+static int get_row(Data_T data, char **buf, int row, int col_start, int col_end) {
+
+  arrow_args args = data->args;
+
+  if (row < 0) return E_DTA_ROW_OOB;
+  if (col_end == -1) col_end = data->ncols-1;
+  if (col_start < 0 || col_end >= data->ncols || col_end < col_start) 
+    return E_DTA_COL_OOB;
+
+  if (row == 0) {
+    for (int icol=col_start; icol<=col_end; icol++)
+      buf[icol-col_start] = (char *) args->columns[icol].name;
+    return E_OK;
+  }
+
+  if (row > args->length) return E_DTA_EOF;
+  seek_row(data, row);
+
+  struct batch *b = batch_of(args, row-1);
+  for (int icol=col_start; icol<=col_end; icol++)
+    buf[icol-col_start] = cell(&args->columns[icol], &b->arrays[icol], 
+      row-1 - b->first);
+
+  return E_OK;
+
+}
+
+static int get_col(Data_T data, char **buf, int col, int row_start, int row_end) {
+
+  if (col > data->ncols-1) return E_DTA_COL_OOB;
+  if (row_end > data->nrows-1) return E_DTA_ROW_OOB;
+
+  for (int irow=row_start, i=0; irow<=row_end; irow++, i++) {
+    int err = get_row(data, &buf[i], irow, col, col);
+    if (err != E_OK) return err;
+  }
+
+  return E_OK;
+
+}
+
+// Every row is known from the footer, including the row of names
+static ssize_t scan_rows(Data_T data, ssize_t offset, ssize_t nbytes,
+  long *nrows) {
+
+  if (offset == 0) *nrows += data->nrows;
+
+  return data->st_size;
+
+}
+
+static long count_rows(Data_T data, int nthreads) {
+  return data->nrows;
+}
+
+static ssize_t resident(Data_T data) {
+  return Index_bytes(data->rows);
+}
+
+// Unmaps the file and forgets everything read from it
+static int release(Data_T data) {
+
+  arrow_args args = data->args;
+
+  remove_regions(args);
+
+  for (long b=0; b<args->nbatches; b++) FREE(args->batches[b].arrays);
+  if (args->batches) FREE(args->batches);
+  if (args->columns) FREE(args->columns);
+  args->nbatches = args->length = 0;
+
+  int err = E_OK;
+  if (args->ptr && munmap(args->ptr, data->st_size) != 0) 
+    err = E_DTA_RESOURCE_ERROR;
+  args->ptr = NULL;
+
+  return err;
+
+}
+
+static int data_open(Data_T data) {
+
+  arrow_args args = data->args;
+
+  int fd = open(data->path, O_RDONLY);
+  if (fd < 0) return E_DTA_FILE_ERROR;
+
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) < 0 || statbuf.st_size < 16) {
+    close(fd);
+    return E_DTA_FILE_ERROR;
+  }
+
+  uint8_t *ptr = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) return E_DTA_FILE_ERROR;
+
+  data->st_size = statbuf.st_size;
+  args->ptr = ptr;
+
+  struct fb f = { ptr, ptr + statbuf.st_size, 0 };
+  const uint8_t *end = ptr + statbuf.st_size;
+  int err = E_DTA_PARSE_ERROR;
+
+  // The footer sits before its length and the closing magic
+  if (memcmp(ptr, MAGIC, 6) || memcmp(end - 6, MAGIC, 6)) goto fail;
+
+  const uint8_t *footer = end - 10 - (int32_t) u32(end - 10);
+  if (!inside(&f, footer, 4)) goto fail;
+  footer = fb_deref(&f, footer);
+
+  long nfields;
+  const uint8_t *schema = fb_table(&f, footer, 1);
+  const uint8_t *fields = fb_vector(&f, schema, 1, 4, &nfields);
+  if (!fields || nfields == 0) goto fail;
+
+  args->columns = CALLOC(nfields, sizeof(struct column));
+  for (long i=0; i<nfields; i++)
+    if (column(&f, fb_deref(&f, fields + 4*i), &args->columns[i]) != E_OK)
+      goto fail;
+
+  if (dictionaries(&f, args, nfields, footer) != E_OK
+    || batches(&f, args, nfields, footer) != E_OK) goto fail;
+
+  data->ncols = nfields;
+  data->nrows = args->length + 1;
+
+  // Dictionary encoded cells point into the dictionary, not the batch
+  for (int icol=0; icol<nfields; icol++) {
+    struct column *c = &args->columns[icol];
+    if (c->dict_id >= 0) add_region(args, c, &c->dict);
+    else for (long b=0; b<args->nbatches; b++)
+      add_region(args, c, &args->batches[b].arrays[icol]);
+  }
+  qsort(regions, nregions, sizeof(struct region), cmp_region);
+
+  return E_OK;
+
+fail:
+  release(data);
+  return err;
+
+}
+
+static int data_close(Data_T data) {
+  return release(data);
+}
+
+Data_T Data_arrow_init(char *path) {
+
+  if (!strlen(path)) return NULL;
+
+  Data_T data;
+  NEW0(data);
+
+  data->path = path;
+  data->delim = ',';    // separates values when slicing
+  data->delimited = 0;
+  data->quoted = 0;
+  data->rows = Index_new();
+  Index_append(data->rows, 0);
+  Index_append(data->rows, 0);
+
+  data->open = data_open;
+  data->get_col = get_col;
+  data->get_row = get_row;
+  data->mvaddntok = mvaddntok;
+  data->toklen = toklen;
+  data->format = format;
+  data->close = data_close;
+  data->scan_rows = scan_rows;
+  data->count_rows = count_rows;
+  data->resident = resident;
+  data->hash_rows = NULL;
+  data->scan_fields = NULL;
+  data->row_near = NULL;
+  data->free = Data_arrow_free;
+  data->free_node = NULL;
+
+  arrow_args args;
+  NEW0(args);
+  data->args = args;
+
+  return data;
+
+}
+
+void Data_arrow_free(Data_T *data) {
+
+  assert(data && *data && (*data)->args);
+
+  Index_free(&(*data)->rows);
+  FREE((*data)->args);
+  FREE(*data);
+
+}
@@ -0,0 +1,500 @@
+//
+// -----------------------------------------------------------------------------
+// data-fixed.c
+// -----------------------------------------------------------------------------
+//
+// Implementation of Data_T instance for fixed-width text, where each
+// column starts at the same position on every line. Unless they're
+// given, the columns are found from sampled lines: wherever every line
+// is blank at one position and not at the next, a column starts. Once
+// the columns are known, fields are found by arithmetic.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <string.h>   // memchr, memcpy, memset
+#include <stdint.h>   // uint64_t, uint32_t
+#include <sys/mman.h> // mmap, MAP_FAILED
+#include <sys/stat.h> // fstat
+#include <fcntl.h>    // O_RDONLY
+#include <unistd.h>   // close
+#include "mem.h"      // NEW0, CALLOC, RESIZE, FREE
+#include "index.h"
+#include "frame.h"
+#include "errorcodes.h"
+#include "trace.h"
+
+// Lines sampled to find the columns, taken in runs from evenly
+// spaced parts of the file
+#define SAMPLE_RUNS 10
+#define SAMPLE_LINES 100
+
+// Positions past this on a line aren't sampled
+#define MAX_WIDTH (1 << 16)
+
+// At least one sampled line in this many has to be long enough to hold
+// a column, so the words of a few long lines don't each start one
+#define MIN_SHARE 4
+
+typedef struct fixed_args {
+  char *ptr;
+  int *starts;      // where each column starts on a line
+  int nstarts;
+} *fixed_args;
+
+// Open files, so that a token can be traced back to its columns
+static struct { const char *lo, *hi; fixed_args args; } *files = NULL;
+static int nfiles = 0;
+
+// Blank fields point here
+static char missing[] = "";
+
+static const uint64_t ones = 0x0101010101010101ULL;
+static const uint64_t highs = 0x8080808080808080ULL;
+
+// 1 in each byte of w that isn't a space, tab or carriage return
+static uint64_t nonblank(uint64_t w) {
+
+  uint64_t blank = 0;
+  const char blanks[] = { ' ', '\t', '\r' };
+
+  for (int i=0; i<3; i++) {
+    uint64_t x = w ^ (ones * (unsigned char) blanks[i]);
+    blank |= ~(((x & ~highs) + ~highs) | x | ~highs);
+  }
+
+  return (~blank & highs) >> 7;
+
+}
+
+// Adds one to count[i] for every non-blank byte line[i]. Eight
+// positions are counted at once in the bytes of a word, and the words
+// are added into the totals before they can overflow.
+struct histogram {
+  uint64_t *bytes;    // counts of the lines since the last flush
+  uint32_t *totals;
+  uint32_t *lens;     // lines of each length
+  int lines;
+  int width;          // widest line seen
+  int pending;
+};
+
+static void flush(struct histogram *h) {
+
+  for (int w=0; w<(h->width + 7) / 8; w++) {
+    for (int i=0; i<8; i++) h->totals[8*w + i] += (h->bytes[w] >> 8*i) & 0xff;
+    h->bytes[w] = 0;
+  }
+
+  h->pending = 0;
+
+}
+
+static void count(struct histogram *h, const char *line, int len) {
+
+  if (len > MAX_WIDTH) len = MAX_WIDTH;
+  if (len > h->width) h->width = len;
+  h->lens[len]++;
+  h->lines++;
+
+  for (int w=0; 8*w < len; w++) {
+    uint64_t word;
+    if (len - 8*w >= 8) memcpy(&word, line + 8*w, 8);
+    else {
+      word = ones * ' ';
+      memcpy(&word, line + 8*w, len - 8*w);
+    }
+    h->bytes[w] += nonblank(word);
+  }
+
+  if (++h->pending == 255) flush(h);
+
+}
+
+static ssize_t next_row(const char *ptr, ssize_t offset, ssize_t len) {
+
+  const char *nl = memchr(ptr + offset, '\n', len - offset);
+
+  return nl ? nl - ptr + 1 : len;
+
+}
+
+// Length of the line starting at offset, without its line ending
+static int line_len(const char *ptr, ssize_t offset, ssize_t next) {
+
+  if (next > offset && ptr[next-1] == '\n') next--;
+  if (next > offset && ptr[next-1] == '\r') next--;
+
+  return next - offset;
+
+}
+
+// A column starts wherever a position that's blank on every sampled
+// line that reaches it is followed by one that isn't, as long as
+// enough of the lines reach that far
+static void find_columns(Data_T data) {
+
+  fixed_args args = data->args;
+  struct histogram h = { 
+    CALLOC(MAX_WIDTH / 8, sizeof(uint64_t)), 
+    CALLOC(MAX_WIDTH, sizeof(uint32_t)), 
+    CALLOC(MAX_WIDTH + 1, sizeof(uint32_t)), 0, 0, 0 
+  };
+
+  // Runs stop where the next starts, so lines of small files aren't
+  // counted more than once
+  for (int run=0; run<SAMPLE_RUNS; run++) {
+    ssize_t offset = data->st_size / SAMPLE_RUNS * run;
+    ssize_t end = run + 1 < SAMPLE_RUNS 
+      ? data->st_size / SAMPLE_RUNS * (run + 1) : data->st_size;
+    if (run > 0) offset = next_row(args->ptr, offset, data->st_size);
+    for (int i=0; i<SAMPLE_LINES && offset < end; i++) {
+      ssize_t next = next_row(args->ptr, offset, data->st_size);
+      count(&h, args->ptr + offset, line_len(args->ptr, offset, next));
+      offset = next;
+    }
+  }
+  flush(&h);
+
+  int min_lines = h.lines / MIN_SHARE > 1 ? h.lines / MIN_SHARE : 1;
+  int reach = h.lines - h.lens[0];   // lines longer than i
+
+  args->starts = CALLOC(h.width / 2 + 1, sizeof(int));
+  args->starts[args->nstarts++] = 0;
+  for (int i=1; i<h.width; i++) {
+    reach -= h.lens[i];
+    if (reach < min_lines) break;
+    if (h.totals[i] && !h.totals[i-1]) args->starts[args->nstarts++] = i;
+  }
+
+  FREE(h.bytes);
+  FREE(h.totals);
+  FREE(h.lens);
+
+}
+
+// Makes sure the end of row is in the index
+static int seek_row(Data_T data, int row) {
+
+  Index_T rows = data->rows;
+  char *ptr = ((fixed_args) data->args)->ptr;
+
+  while (Index_length(rows) <= row + 1) {
+    ssize_t offset = Index_get(rows, Index_length(rows)-1);
+    if (offset >= data->st_size) return E_DTA_EOF;
+    Index_append(rows, next_row(ptr, offset, data->st_size));
+    data->nrows++;
+  }
+
+  return E_OK;
+
+}
+
+// Field icol of a line, without the blanks around it
+static char *field(fixed_args args, const char *line, int len, int icol, 
+  int *flen) {
+
+  int start = args->starts[icol];
+  int end = icol + 1 < args->nstarts ? args->starts[icol+1] : len;
+  if (end > len) end = len;
+  if (start > end) start = end;
+
+  while (start < end && (line[start] == ' ' || line[start] == '\t')) start++;
+  while (end > start && (line[end-1] == ' ' || line[end-1] == '\t')) end--;
+
+  if (flen) *flen = end - start;
+
+  return start < end ? (char *) line + start : missing;
+
+}
+
+static int get_row(Data_T data, char **buf, int row, int col_start, int col_end) {
+
+  fixed_args args = data->args;
+  int err;
+
+  if (row < 0) return E_DTA_ROW_OOB;
+  if (col_end == -1) col_end = data->ncols-1;
+  if (col_start < 0 || col_end >= data->ncols || col_end < col_start) 
+    return E_DTA_COL_OOB;
+
+  if ((err = seek_row(data, row)) != E_OK) return err;
+
+  ssize_t offset = Index_get(data->rows, row);
+  int len = line_len(args->ptr, offset, Index_get(data->rows, row+1));
+
+  for (int icol=col_start; icol<=col_end; icol++)
+    buf[icol-col_start] = field(args, args->ptr + offset, len, icol, NULL);
+
+  TRACE_BYTES(len);
+
+  return E_OK;
+
+}
+
+// Each field is found from where its row starts, without looking
+// at the rest of the row
+static int get_col(Data_T data, char **buf, int col, int row_start, int row_end) {
+
+  fixed_args args = data->args;
+
+  if (col > data->ncols-1) return E_DTA_COL_OOB;
+  if (row_end > data->nrows-1) return E_DTA_ROW_OOB;
+
+  for (int irow=row_start, i=0; irow<=row_end; irow++, i++) {
+    ssize_t offset = Index_get(data->rows, irow);
+    int len = line_len(args->ptr, offset, Index_get(data->rows, irow+1));
+    buf[i] = field(args, args->ptr + offset, len, col, NULL);
+  }
+
+  return E_OK;
+
+}
+
+// Length of a field, found from its position on its line
+static int toklen(const char *tok, char delim) {
+
+  for (int i=0; i<nfiles; i++) {
+    if (tok < files[i].lo || tok >= files[i].hi) continue;
+
+    const char *line = tok;
+    while (line > files[i].lo && line[-1] != '\n') line--;
+
+    const char *nl = memchr(tok, '\n', files[i].hi - tok);
+    int len = line_len(line, 0, (nl ? nl + 1 : files[i].hi) - line);
+
+    // The field the token falls in
+    fixed_args args = files[i].args;
+    int icol = args->nstarts - 1;
+    while (icol > 0 && args->starts[icol] > tok - line) icol--;
+
+    int flen;
+    field(args, line, len, icol, &flen);
+    return flen;
+  }
+
+  return strlen(tok);
+
+}
+
+static int mvaddntok(int row, int col, const char *tok, int n, char delim) {
+
+  int len = toklen(tok, delim);
+  mvaddnstr(row, col, tok, len < n ? len : n);
+
+  return 1;
+
+}
+
+static ssize_t scan_rows(Data_T data, ssize_t offset, ssize_t nbytes,
+  long *nrows) {
+
+  char *ptr = ((fixed_args) data->args)->ptr;
+  ssize_t len = data->st_size;
+  ssize_t stop = offset + nbytes < len ? offset + nbytes : len;
+
+  while (offset < stop) {
+    offset = next_row(ptr, offset, len);
+    (*nrows)++;
+  }
+
+  return offset;
+
+}
+
+static long count_rows(Data_T data, int nthreads) {
+
+  long nrows = 0;
+  scan_rows(data, 0, data->st_size, &nrows);
+
+  return nrows;
+
+}
+
+static ssize_t resident(Data_T data) {
+  return Index_bytes(data->rows);
+}
+
+static ssize_t hash_rows(Data_T data, ssize_t offset, int key_col,
+  uint64_t *hashes, uint64_t *keys, long max, long *n) {
+
+  fixed_args args = data->args;
+  ssize_t len = data->st_size;
+
+  for (*n = 0; *n < max && offset < len; (*n)++) {
+    ssize_t next = next_row(args->ptr, offset, len);
+    int llen = line_len(args->ptr, offset, next);
+
+    hashes[*n] = Data_hash(args->ptr + offset, llen);
+
+    if (key_col >= 0) {
+      int flen;
+      char *value = field(args, args->ptr + offset, llen, key_col, &flen);
+      keys[*n] = Data_hash(value, flen);
+    }
+
+    offset = next;
+  }
+
+  return offset;
+
+}
+
+// Fields cols of up to max rows starting at offset. Only reads the
+// mapping, so it is safe to call from a worker thread.
+static ssize_t scan_fields(Data_T data, ssize_t offset, const int *cols,
+  int ncols, char **toks, int *lens, long max, long *n) {
+
+  fixed_args args = data->args;
+  ssize_t len = data->st_size;
+
+  for (*n = 0; *n < max && offset < len; (*n)++) {
+    ssize_t next = next_row(args->ptr, offset, len);
+    int llen = line_len(args->ptr, offset, next);
+
+    for (int j=0; j<ncols; j++)
+      toks[*n * ncols + j] = field(args, args->ptr + offset, llen, cols[j], 
+        &lens[*n * ncols + j]);
+
+    offset = next;
+  }
+
+  return offset;
+
+}
+
+// Start of the line holding the byte at offset. Every newline ends a
+// row, so there's no need to look further back than that.
+static ssize_t row_near(Data_T data, ssize_t offset, ssize_t *end) {
+
+  const char *ptr = ((fixed_args) data->args)->ptr;
+
+  ssize_t start = offset;
+  while (start > 0 && ptr[start-1] != '\n') start--;
+  *end = next_row(ptr, start, data->st_size);
+
+  return start;
+
+}
+
+static int data_open(Data_T data) {
+
+  fixed_args args = data->args;
+
+  int fd = open(data->path, O_RDONLY);
+  if (fd < 0) return E_DTA_FILE_ERROR;
+
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) < 0 || statbuf.st_size == 0) {
+    close(fd);
+    return E_DTA_FILE_ERROR;
+  }
+
+  char *ptr = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) return E_DTA_FILE_ERROR;
+
+  data->st_size = statbuf.st_size;
+  args->ptr = ptr;
+
+  if (!args->starts) find_columns(data);
+  data->ncols = args->nstarts;
+
+  if (files) RESIZE(files, (nfiles + 1) * sizeof *files);
+  else files = CALLOC(1, sizeof *files);
+  files[nfiles].lo = ptr;
+  files[nfiles].hi = ptr + statbuf.st_size;
+  files[nfiles].args = args;
+  nfiles++;
+
+  return E_OK;
+
+}
+
+static int data_close(Data_T data) {
+
+  fixed_args args = data->args;
+
+  for (int i=0; i<nfiles; i++)
+    if (files[i].args == args) files[i--] = files[--nfiles];
+  if (nfiles == 0 && files) FREE(files);
+
+  if (munmap(args->ptr, data->st_size) != 0)
+    return E_DTA_RESOURCE_ERROR;
+
+  return E_OK;
+
+}
+
+// Columns are found from the file unless widths are given, in which
+// case the last column runs to the end of the line
+Data_T Data_fixed_init(char *path, const int *widths, int nwidths) {
+
+  if (!strlen(path) || nwidths < 0) return NULL;
+  for (int i=0; i<nwidths; i++) if (widths[i] < 1) return NULL;
+
+  Data_T data;
+  NEW0(data);
+
+  data->path = path;
+  data->delim = ',';    // separates fields when slicing
+  data->delimited = 0;
+  data->quoted = 0;
+  data->rows = Index_new();
+  Index_append(data->rows, 0);
+
+  data->open = data_open;
+  data->get_col = get_col;
+  data->get_row = get_row;
+  data->mvaddntok = mvaddntok;
+  data->toklen = toklen;
+  data->close = data_close;
+  data->scan_rows = scan_rows;
+  data->count_rows = count_rows;
+  data->resident = resident;
+  data->hash_rows = hash_rows;
+  data->scan_fields = scan_fields;
+  data->row_near = row_near;
+  data->free = Data_fixed_free;
+  data->free_node = NULL;
+
+  fixed_args args;
+  NEW0(args);
+
+  if (nwidths) {
+    args->starts = CALLOC(nwidths, sizeof(int));
+    for (int i=1; i<nwidths; i++) 
+      args->starts[i] = args->starts[i-1] + widths[i-1];
+    args->nstarts = nwidths;
+  }
+
+  data->args = args;
+
+  return data;
+
+}
+
+void Data_fixed_free(Data_T *data) {
+
+  assert(data && *data && (*data)->args);
+
+  fixed_args args = (*data)->args;
+  if (args->starts) FREE(args->starts);
+
+  Index_free(&(*data)->rows);
+  FREE((*data)->args);
+  FREE(*data);
+
+}
@@ -0,0 +1,667 @@
+//
+// -----------------------------------------------------------------------------
+// data-json.c
+// -----------------------------------------------------------------------------
+//
+// Implementation of Data_T instance for JSON Lines, one object per row.
+// The top-level keys of the first rows become the columns, and are
+// served as a header row ahead of the data. Values are found without
+// parsing the objects, by scanning each row for structural characters
+// (quotes, colons, commas and brackets) a block at a time.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <string.h>   // memchr, memcpy, memset
+#include <stdint.h>   // uint64_t, uintptr_t
+#include <sys/mman.h> // mmap, MAP_FAILED
+#include <sys/stat.h> // fstat
+#include <fcntl.h>    // O_RDONLY
+#include <unistd.h>   // close, sysconf
+#include "mem.h"      // NEW0, ALLOC, CALLOC, RESIZE, FREE
+#include "table.h"
+#include "index.h"
+#include "frame.h"
+#include "errorcodes.h"
+#include "trace.h"
+
+// Rows read at open to find the keys
+#define KEY_SAMPLE 1000
+
+// Bytes classified at once by the structural scan
+#define BLOCK 64
+
+typedef struct json_args {
+  char *ptr;
+  Table_T columns;    // hash of a key to its column, plus one
+  char **names;       // each key in quotes, as its header
+  int size;
+} *json_args;
+
+// Missing values point here
+static char missing[] = "";
+
+static const uint64_t ones = 0x0101010101010101ULL;
+static const uint64_t highs = 0x8080808080808080ULL;
+
+// High bit set in each byte of w equal to c, with no false positives
+static uint64_t eq(uint64_t w, char c) {
+
+  uint64_t x = w ^ (ones * (unsigned char) c);
+  uint64_t t = (x & ~highs) + ~highs;
+
+  return ~(t | x | ~highs);
+
+}
+
+// Bit i set if p[i] is a quote, backslash, colon, comma or bracket
+static uint64_t structurals(const char *p) {
+
+  uint64_t mask = 0;
+
+  for (int i=0; i<BLOCK/8; i++) {
+    uint64_t w;
+    memcpy(&w, p + 8*i, 8);
+
+    uint64_t m = eq(w, '"') | eq(w, '\\') | eq(w, ':') | eq(w, ',')
+      | eq(w, '{') | eq(w, '}') | eq(w, '[') | eq(w, ']');
+
+    // Gather the high bit of each byte into the low byte
+    mask |= (((m >> 7) * 0x0102040810204080ULL) >> 56) << 8*i;
+  }
+
+  return mask;
+
+}
+
+// FNV-1a, never 0 so it can be used as a table key
+static uint64_t hash(const char *str, ssize_t len) {
+
+  uint64_t h = 14695981039346656037ULL;
+  for (ssize_t i=0; i<len; i++) h = (h ^ (unsigned char) str[i]) * 1099511628211ULL;
+
+  return h ? h : 1;
+
+}
+
+// Calls visit with each top-level key of the object on [p, end) and the
+// start of its value, until visit returns nonzero
+static void scan_object(const char *p, const char *end, 
+  int visit(const char *key, int keylen, const char *value, void *cl),
+  void *cl) {
+
+  int depth = 0, in_string = 0, expect_key = 0, carry = 0;
+  const char *key = NULL, *key_end = NULL;
+  char tail[BLOCK];
+
+  for (const char *block = p; block < end; block += BLOCK) {
+
+    // The last block is copied so the scan never reads past the row
+    const char *q = block;
+    if (end - block < BLOCK) {
+      memset(tail, ' ', BLOCK);
+      memcpy(tail, block, end - block);
+      q = tail;
+    }
+
+    uint64_t mask = structurals(q);
+
+    // A backslash at the end of the last block escapes the first byte
+    if (carry) mask &= ~1ULL, carry = 0;
+
+    for ( ; mask; mask &= mask - 1) {
+      int i = __builtin_ctzll(mask);
+
+      switch (q[i]) {
+        case '\\':
+          if (!in_string) break;
+          if (i == BLOCK-1) carry = 1;
+          else mask &= ~(2ULL << i);
+          break;
+
+        case '"':
+          in_string = !in_string;
+          if (depth == 1 && expect_key) {
+            if (in_string) key = block + i + 1;
+            else key_end = block + i;
+          }
+          break;
+
+        case ':': {
+          if (in_string || depth != 1 || !key_end) break;
+          const char *value = block + i + 1;
+          while (value < end && (*value == ' ' || *value == '\t')) value++;
+          if (visit(key, key_end - key, value, cl)) return;
+          expect_key = 0;
+          key_end = NULL;
+          break;
+        }
+
+        case ',':
+          if (!in_string && depth == 1) expect_key = 1;
+          break;
+
+        case '{':
+        case '[':
+          if (in_string) break;
+          if (++depth == 1 && q[i] == '{') expect_key = 1;
+          break;
+
+        case '}':
+        case ']':
+          if (in_string) break;
+          if (--depth == 0) return;
+          break;
+      }
+    }
+  }
+
+}
+
+// Start of the row after the one starting at offset. JSON strings can't
+// hold a raw newline, so every newline ends a row.
+static ssize_t next_row(const char *ptr, ssize_t offset, ssize_t len) {
+
+  const char *nl = memchr(ptr + offset, '\n', len - offset);
+
+  return nl ? nl - ptr + 1 : len;
+
+}
+
+// End of the row starting at offset, without its line ending
+static ssize_t row_end(const char *ptr, ssize_t offset, ssize_t next) {
+
+  if (next > offset && ptr[next-1] == '\n') next--;
+  if (next > offset && ptr[next-1] == '\r') next--;
+
+  return next;
+
+}
+
+// Makes sure the end of row is in the index
+static int seek_row(Data_T data, int row) {
+
+  Index_T rows = data->rows;
+  char *ptr = ((json_args) data->args)->ptr;
+
+  while (Index_length(rows) <= row + 1) {
+    ssize_t offset = Index_get(rows, Index_length(rows)-1);
+    if (offset >= data->st_size) return E_DTA_EOF;
+    Index_append(rows, next_row(ptr, offset, data->st_size));
+    data->nrows++;
+  }
+
+  return E_OK;
+
+}
+
+static int add_key(const char *key, int len, const char *value, void *cl) {
+
+  json_args args = cl;
+  void *h = (void *) (uintptr_t) hash(key, len);
+
+  if (Table_get(args->columns, h)) return 0;
+
+  int icol = Table_length(args->columns);
+  if (icol == args->size) {
+    args->size *= 2;
+    RESIZE(args->names, args->size * sizeof(char *));
+  }
+
+  char *name = ALLOC(len + 3);
+  name[0] = '"';
+  memcpy(name + 1, key, len);
+  name[len+1] = '"';
+  name[len+2] = '\0';
+
+  args->names[icol] = name;
+  Table_put(args->columns, h, (void *) (uintptr_t) (icol + 1));
+
+  return 0;
+
+}
+
+// Values of the columns asked for, filled in as their keys are found
+struct fetch {
+  json_args args;
+  char **buf;
+  int col_start;
+  int col_end;
+  int left;
+};
+
+static int fetch_value(const char *key, int len, const char *value, void *cl) {
+
+  struct fetch *f = cl;
+  int icol = (int) (uintptr_t) Table_get(f->args->columns, 
+    (void *) (uintptr_t) hash(key, len)) - 1;
+
+  // The first of any duplicate keys wins
+  if (icol < f->col_start || icol > f->col_end 
+    || f->buf[icol - f->col_start] != missing) return 0;
+
+  f->buf[icol - f->col_start] = (char *) value;
+
+  // Nothing more to look for once every column is found
+  return --f->left == 0;
+
+}
+
+static void fetch(json_args args, const char *row, const char *end, 
+  char **buf, int col_start, int col_end) {
+
+  for (int i=0; i<=col_end-col_start; i++) buf[i] = missing;
+
+  struct fetch f = { args, buf, col_start, col_end, col_end - col_start + 1 };
+  scan_object(row, end, fetch_value, &f);
+
+  TRACE_BYTES(end - row);
+
+}
+
+// Row 0 holds the keys, and row i the object on line i
+static int get_row(Data_T data, char **buf, int row, int col_start, int col_end) {
+
+  json_args args = data->args;
+  int err;
+
+  if (row < 0) return E_DTA_ROW_OOB;
+  if (col_end == -1) col_end = data->ncols-1;
+  if (col_start < 0 || col_end >= data->ncols || col_end < col_start) 
+    return E_DTA_COL_OOB;
+
+  if (row == 0) {
+    for (int icol=col_start; icol<=col_end; icol++) 
+      buf[icol-col_start] = args->names[icol];
+    return E_OK;
+  }
+
+  if ((err = seek_row(data, row)) != E_OK) return err;
+
+  ssize_t offset = Index_get(data->rows, row);
+  ssize_t end = row_end(args->ptr, offset, Index_get(data->rows, row+1));
+
+  fetch(args, args->ptr + offset, args->ptr + end, buf, col_start, col_end);
+
+  return E_OK;
+
+}
+
+static int get_col(Data_T data, char **buf, int col, int row_start, int row_end) {
+
+  if (col > data->ncols-1) return E_DTA_COL_OOB;
+  if (row_end > data->nrows-1) return E_DTA_ROW_OOB;
+
+  for (int irow=row_start, i=0; irow<=row_end; irow++, i++) {
+    int err = get_row(data, &buf[i], irow, col, col);
+    if (err != E_OK) return err;
+  }
+
+  return E_OK;
+
+}
+
+// Length of the JSON value at tok, including any quotes or brackets
+static int toklen(const char *tok, char delim) {
+
+  int n = 0, depth = 0, in_string = 0;
+
+  for ( ; tok[n] && tok[n] != '\n'; n++) {
+    char c = tok[n];
+
+    if (in_string) {
+      if (c == '\\' && tok[n+1] && tok[n+1] != '\n') n++;
+      else if (c == '"') {
+        in_string = 0;
+        if (depth == 0) return n + 1;
+      }
+    }
+    else if (c == '"') in_string = 1;
+    else if (c == '{' || c == '[') depth++;
+    else if (c == '}' || c == ']') {
+      if (depth == 0) break;
+      if (--depth == 0) return n + 1;
+    }
+    else if (depth == 0 && (c == ',' || c == ' ' || c == '\t' || c == '\r'))
+      break;
+  }
+
+  return n;
+
+}
+
+// Strings are shown without their quotes, everything else as it is
+static int mvaddntok(int row, int col, const char *tok, int n, char delim) {
+
+  int len = toklen(tok, delim);
+  if (len >= 2 && tok[0] == '"' && tok[len-1] == '"') tok++, len -= 2;
+
+  mvaddnstr(row, col, tok, len < n ? len : n);
+
+  return 1;
+
+}
+
+static void put(char *buf, int size, int *n, char c) {
+  if (*n < size - 1) buf[*n] = c;
+  (*n)++;
+}
+
+static int hex4(const char *p, const char *end) {
+
+  int x = 0;
+
+  for (int i=0; i<4; i++) {
+    char c = p + i < end ? p[i] : 0;
+    if (c >= '0' && c <= '9') x = 16*x + c - '0';
+    else if (c >= 'a' && c <= 'f') x = 16*x + c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') x = 16*x + c - 'A' + 10;
+    else return -1;
+  }
+
+  return x;
+
+}
+
+// Text of a string, without its quotes and with its escapes undone.
+// Anything else is its own text.
+static int format(const char *tok, char *buf, int size) {
+
+  if (*tok != '"') return -1;
+
+  int len = toklen(tok, ','), n = 0;
+  const char *p = tok + 1, *end = tok + len;
+  if (len >= 2 && tok[len-1] == '"') end--;
+
+  while (p < end) {
+    if (*p != '\\' || p + 1 == end) {
+      put(buf, size, &n, *p++);
+      continue;
+    }
+
+    char c = p[1];
+    p += 2;
+    switch (c) {
+      case 'b': put(buf, size, &n, '\b'); continue;
+      case 'f': put(buf, size, &n, '\f'); continue;
+      case 'n': put(buf, size, &n, '\n'); continue;
+      case 'r': put(buf, size, &n, '\r'); continue;
+      case 't': put(buf, size, &n, '\t'); continue;
+      case 'u': break;
+      default:  put(buf, size, &n, c); continue;
+    }
+
+    // \uXXXX, with surrogate pairs for code points past the BMP,
+    // as UTF-8. Malformed escapes are left as they are.
+    int u = hex4(p, end);
+    if (u < 0) {
+      put(buf, size, &n, '\\');
+      put(buf, size, &n, 'u');
+      continue;
+    }
+    p += 4;
+    if (u >= 0xd800 && u < 0xdc00 && end - p >= 6 && p[0] == '\\' 
+      && p[1] == 'u') {
+      int lo = hex4(p + 2, end);
+      if (lo >= 0xdc00 && lo < 0xe000) {
+        u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+        p += 6;
+      }
+    }
+
+    if (u < 0x80) put(buf, size, &n, u);
+    else if (u < 0x800) {
+      put(buf, size, &n, 0xc0 | u >> 6);
+      put(buf, size, &n, 0x80 | (u & 0x3f));
+    } else if (u < 0x10000) {
+      put(buf, size, &n, 0xe0 | u >> 12);
+      put(buf, size, &n, 0x80 | (u >> 6 & 0x3f));
+      put(buf, size, &n, 0x80 | (u & 0x3f));
+    } else {
+      put(buf, size, &n, 0xf0 | u >> 18);
+      put(buf, size, &n, 0x80 | (u >> 12 & 0x3f));
+      put(buf, size, &n, 0x80 | (u >> 6 & 0x3f));
+      put(buf, size, &n, 0x80 | (u & 0x3f));
+    }
+  }
+
+  if (size > 0) buf[n < size ? n : size - 1] = '\0';
+
+  return n;
+
+}
+
+// Counts the rows that start in [offset, offset+nbytes), including the
+// row of keys when counting from the start
+static ssize_t scan_rows(Data_T data, ssize_t offset, ssize_t nbytes,
+  long *nrows) {
+
+  char *ptr = ((json_args) data->args)->ptr;
+  ssize_t len = data->st_size;
+  ssize_t stop = offset + nbytes < len ? offset + nbytes : len;
+
+  if (offset == 0) (*nrows)++;
+
+  while (offset < stop) {
+    offset = next_row(ptr, offset, len);
+    (*nrows)++;
+  }
+
+  return offset;
+
+}
+
+static long count_rows(Data_T data, int nthreads) {
+
+  long nrows = 0;
+  scan_rows(data, 0, data->st_size, &nrows);
+
+  return nrows;
+
+}
+
+static ssize_t resident(Data_T data) {
+  return Index_bytes(data->rows);
+}
+
+// Hashes up to max rows starting at offset, and the value of key_col
+// in each if key_col isn't -1
+static ssize_t hash_rows(Data_T data, ssize_t offset, int key_col,
+  uint64_t *hashes, uint64_t *keys, long max, long *n) {
+
+  json_args args = data->args;
+  ssize_t len = data->st_size;
+
+  for (*n = 0; *n < max && offset < len; (*n)++) {
+
+    ssize_t next = next_row(args->ptr, offset, len);
+    ssize_t end = row_end(args->ptr, offset, next);
+
+    hashes[*n] = hash(args->ptr + offset, end - offset);
+
+    if (key_col >= 0) {
+      char *value;
+      fetch(args, args->ptr + offset, args->ptr + end, &value, key_col, key_col);
+      keys[*n] = hash(value, toklen(value, data->delim));
+    }
+
+    offset = next;
+  }
+
+  return offset;
+
+}
+
+// Values of the keys cols of up to max rows starting at offset. Only
+// reads the mapping, so it is safe to call from a worker thread.
+static ssize_t scan_fields(Data_T data, ssize_t offset, const int *cols,
+  int ncols, char **toks, int *lens, long max, long *n) {
+
+  json_args args = data->args;
+  ssize_t len = data->st_size;
+
+  int col_start = cols[0], col_end = cols[0];
+  for (int j=1; j<ncols; j++) {
+    if (cols[j] < col_start) col_start = cols[j];
+    if (cols[j] > col_end) col_end = cols[j];
+  }
+  char **buf = CALLOC(col_end - col_start + 1, sizeof(char *));
+
+  for (*n = 0; *n < max && offset < len; (*n)++) {
+
+    ssize_t next = next_row(args->ptr, offset, len);
+    ssize_t end = row_end(args->ptr, offset, next);
+
+    fetch(args, args->ptr + offset, args->ptr + end, buf, col_start, col_end);
+    for (int j=0; j<ncols; j++) {
+      toks[*n * ncols + j] = buf[cols[j] - col_start];
+      lens[*n * ncols + j] = toklen(buf[cols[j] - col_start], data->delim);
+    }
+
+    offset = next;
+  }
+
+  FREE(buf);
+
+  return offset;
+
+}
+
+// Start of the line holding the byte at offset. Every newline ends a
+// row, so there's no need to look further back than that.
+static ssize_t row_near(Data_T data, ssize_t offset, ssize_t *end) {
+
+  const char *ptr = ((json_args) data->args)->ptr;
+
+  ssize_t start = offset;
+  while (start > 0 && ptr[start-1] != '\n') start--;
+  *end = next_row(ptr, start, data->st_size);
+
+  return start;
+
+}
+
+static int data_open(Data_T data) {
+
+  json_args args = data->args;
+
+  int fd = open(data->path, O_RDONLY);
+  if (fd < 0) return E_DTA_FILE_ERROR;
+
+  // Values are read up to the NUL past the end of the file, which
+  // isn't there if the file fills its last page
+  struct stat statbuf;
+  long PAGESIZE = sysconf(_SC_PAGESIZE);
+  if (fstat(fd, &statbuf) < 0 || statbuf.st_size % PAGESIZE == 0) {
+    close(fd);
+    return E_DTA_FILE_ERROR;
+  }
+
+  char *ptr = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) return E_DTA_FILE_ERROR;
+
+  data->st_size = statbuf.st_size;
+  args->ptr = ptr;
+
+  // Columns are the keys of the first rows, in the order they're seen
+  ssize_t offset = 0;
+  for (int i=0; i<KEY_SAMPLE && offset < data->st_size; i++) {
+    ssize_t next = next_row(ptr, offset, data->st_size);
+    scan_object(ptr + offset, ptr + row_end(ptr, offset, next), add_key, args);
+    offset = next;
+  }
+
+  data->ncols = Table_length(args->columns);
+  if (data->ncols == 0) {
+    munmap(ptr, data->st_size);
+    return E_DTA_PARSE_ERROR;
+  }
+
+  return E_OK;
+
+}
+
+static int data_close(Data_T data) {
+
+  json_args args = data->args;
+
+  if (munmap(args->ptr, data->st_size) != 0)
+    return E_DTA_RESOURCE_ERROR;
+
+  return E_OK;
+
+}
+
+Data_T Data_json_init(char *path) {
+
+  if (!strlen(path)) return NULL;
+
+  Data_T data;
+  NEW0(data);
+
+  data->path = path;
+  data->delim = ',';    // separates values when slicing
+  data->delimited = 0;
+  data->quoted = 0;
+
+  // Row 0 is the keys, which take no space in the file
+  data->rows = Index_new();
+  Index_append(data->rows, 0);
+  Index_append(data->rows, 0);
+  data->nrows = 1;
+
+  data->open = data_open;
+  data->get_col = get_col;
+  data->get_row = get_row;
+  data->mvaddntok = mvaddntok;
+  data->toklen = toklen;
+  data->format = format;
+  data->close = data_close;
+  data->scan_rows = scan_rows;
+  data->count_rows = count_rows;
+  data->resident = resident;
+  data->hash_rows = hash_rows;
+  data->scan_fields = scan_fields;
+  data->row_near = row_near;
+  data->free = Data_json_free;
+  data->free_node = NULL;
+
+  json_args args;
+  NEW0(args);
+  args->columns = Table_new(64, NULL, NULL);
+  args->size = 16;
+  args->names = CALLOC(args->size, sizeof(char *));
+
+  data->args = args;
+
+  return data;
+
+}
+
+void Data_json_free(Data_T *data) {
+
+  assert(data && *data && (*data)->args);
+
+  json_args args = (*data)->args;
+  for (int i=0; i<Table_length(args->columns); i++) FREE(args->names[i]);
+  FREE(args->names);
+  Table_free(&args->columns);
+
+  Index_free(&(*data)->rows);
+  FREE((*data)->args);
+  FREE(*data);
+
+}
@@ -3,7 +3,10 @@
 // data-mmap.c
 // -----------------------------------------------------------------------------
 //
-// Implementation of Data_T instance to load data using mmap
+// Implementation of Data_T instance to load data using mmap. Opened
+// with Data_uring_init, the file is also read ahead of wherever it's
+// being tokenized, through io_uring, so faults on the mapping find
+// their pages already cached rather than waiting on the disk.
 //
 // Copyright © 2021 Tyler Wayne
 // 
@@ -28,21 +31,135 @@
 #include <sys/stat.h> // fstat, open
 #include <fcntl.h>    // O_RDONLY
 #include <unistd.h>   // ssize_t, write, close, sysconf
+#include <pthread.h>  // pthread_create, pthread_join
 #include "mem.h"      // NEW0, CALLOC, FREE
 
+#include "cache.h"
 #include "deque.h"
+#include "index.h"
 #include "frame.h"
 #include "errorcodes.h"
+#include "trace.h"
 
 #define TOK_OK    1
 #define TOK_EOL   2
 #define TOK_EOF   4
 #define TOK_ERR   8
 
+// Every CHECKPOINT_EVERY fields, the offset of the field from the
+// start of the row is saved, so a far-right column can be found by
+// tokenizing at most CHECKPOINT_EVERY fields. Checkpoints are kept for
+// the last CHECKPOINT_ROWS rows seen, which covers a screenful.
+#define CHECKPOINT_EVERY 64
+#define CHECKPOINT_ROWS 256
+
+struct checkpoints {
+  int row;
+  int n;
+  int size;
+  ssize_t *offsets;   // offsets[k] is the start of field k*CHECKPOINT_EVERY
+};
+
+// With a memory budget, the mapping is tracked in chunks. Chunks read
+// by the UI are marked, and once they add up to more than the budget
+// the ones far from the viewport are released. Background scans
+// release what they've read as they go.
+#define RESIDENT_CHUNK (2L << 20)
+
+struct resident {
+  int fd;                   // kept open to drop cached pages, or -1
+  unsigned char *touched;   // chunks read since they were last released
+  long nchunks;
+  long ntouched;
+  ssize_t viewport;         // offset of the last row read
+};
+
 typedef struct mmap_args {
   char *ptr;
+  struct checkpoints checkpoints[CHECKPOINT_ROWS];
+  struct resident resident;
+  int uring;        // read the file ahead through io_uring
+  Cache_T cache;    // which does the reading, once open
 } *mmap_args;
 
+// Drops the pages of [offset, offset+len) from our mapping and from
+// the page cache. They're read back from the file if needed again.
+static void release(mmap_args args, ssize_t offset, ssize_t len) {
+
+  long page = sysconf(_SC_PAGESIZE);
+  ssize_t start = offset / page * page;
+
+  madvise(args->ptr + start, offset + len - start, MADV_DONTNEED);
+  if (args->resident.fd >= 0)
+    posix_fadvise(args->resident.fd, start, offset + len - start, 
+      POSIX_FADV_DONTNEED);
+  if (args->cache) Cache_forget(args->cache, start, offset + len - start);
+
+}
+
+// Bytes held against the budget: chunks of the mapping that have been
+// read, the row index and the column checkpoints
+static ssize_t resident(Data_T data) {
+
+  mmap_args args = data->args;
+  ssize_t bytes = args->resident.ntouched * RESIDENT_CHUNK
+    + Index_bytes(data->rows);
+
+  for (int i=0; i<CHECKPOINT_ROWS; i++)
+    bytes += args->checkpoints[i].size * sizeof(ssize_t);
+
+  return bytes;
+
+}
+
+// Marks [offset, offset+len) as read by the UI, and if that puts us over
+// budget releases every chunk outside a window around it
+static void touch(Data_T data, ssize_t offset, ssize_t len) {
+
+  mmap_args args = data->args;
+  struct resident *r = &args->resident;
+
+  if (!data->max_resident || !r->touched) return;
+
+  r->viewport = offset;
+  for (long c = offset / RESIDENT_CHUNK; 
+    c < r->nchunks && c * RESIDENT_CHUNK < offset + len; c++)
+    if (!r->touched[c]) r->touched[c] = 1, r->ntouched++;
+
+  ssize_t bytes = resident(data);
+  if (bytes <= data->max_resident) return;
+
+  // What's left of the budget once the index and caches are paid for,
+  // half of which is kept around the viewport
+  ssize_t avail = data->max_resident - (bytes - r->ntouched * RESIDENT_CHUNK);
+  if (avail < 4 * RESIDENT_CHUNK) avail = 4 * RESIDENT_CHUNK;
+  ssize_t lo = offset - avail / 4, hi = offset + avail / 4;
+
+  for (long c = 0; c < r->nchunks; c++) {
+    ssize_t start = c * RESIDENT_CHUNK, end = start + RESIDENT_CHUNK;
+    if (!r->touched[c] || (end > lo && start < hi)) continue;
+    release(args, start, 
+      end < data->st_size ? RESIDENT_CHUNK : data->st_size - start);
+    r->touched[c] = 0;
+    r->ntouched--;
+  }
+
+}
+
+// Waits for [offset, offset+len) to be read, and reads on past it, if
+// the file is read ahead. A len of 0 is as far as the block holding
+// offset, for rows that haven't been indexed yet.
+static void want(Data_T data, ssize_t offset, ssize_t len) {
+
+  Cache_T cache = ((mmap_args) data->args)->cache;
+
+  if (cache) Cache_want(cache, offset, len);
+
+}
+
+// Fields that aren't in a row are empty
+static char missing[] = "";
+
 static int get_tok_r(char **tok, int *nbytes, char *str, const char delim, 
   char **saveptr, ssize_t len) {
 
@@ -59,15 +176,19 @@ static int get_tok_r(char **tok, int *nbytes, char *str, const char delim,
 
     switch(field[i]) {
       case '\0':
+        *tok = field;
+        TRACE_BYTES(*nbytes);
+        // The last row may not end in a newline
         if (*saveptr+i >= str+len) return TOK_EOF;
         *saveptr += (i+1);
-        *tok = field;
         return TOK_OK;
 
       case '\n':
+        if (in_quote) break;
         // field[i] = '\0';
         *saveptr += (i+1);
         *tok = field;
+        TRACE_BYTES(*nbytes);
         return TOK_EOL;
 
       case '"':
@@ -79,6 +200,7 @@ static int get_tok_r(char **tok, int *nbytes, char *str, const char delim,
           // field[i] = '\0';
           *saveptr += (i+1);
           *tok = field;
+          TRACE_BYTES(*nbytes);
           return TOK_OK;
         }
     }
@@ -88,107 +210,611 @@ static int get_tok_r(char **tok, int *nbytes, char *str, const char delim,
 
 }
 
+// Returns the offset of the start of the row after the one starting
+// at offset, honoring newlines inside quoted fields
+static ssize_t next_row(char *ptr, ssize_t offset, ssize_t len) {
+
+  char *p = ptr + offset, *end = ptr + len;
+  int in_quote = 0;
+
+  while (p < end) {
+
+    char *nl = memchr(p, '\n', end - p);
+    if (!nl) nl = end;
+
+    for (char *q = p; (q = memchr(q, '"', nl - q)) != NULL; q++)
+      in_quote = !in_quote;
+
+    p = nl + 1;
+    if (!in_quote) break;
+  }
+
+  return p < end ? p - ptr : len;
+
+}
+
+// Returns the number of fields in the row starting at offset, and sets
+// *next to where the row after it starts
+static int count_fields(char *ptr, ssize_t offset, ssize_t len, char delim,
+  ssize_t *next) {
+
+  char *p = ptr + offset, *end = ptr + len;
+  int nfields = 1, in_quote = 0;
+
+  for ( ; p < end; p++) {
+    if (*p == '"') in_quote = !in_quote;
+    else if (in_quote) continue;
+    else if (*p == delim) nfields++;
+    else if (*p == '\n') break;
+  }
+
+  *next = p < end ? p + 1 - ptr : len;
+
+  return nfields;
+
+}
+
+// With ragged rows allowed, rows without as many fields as the first
+// are marked in the index as they're added to it, so they're never
+// tokenized again just to check them
+static void mark(Data_T data, int row, int nfields) {
+
+  if (data->ragged && data->ncols && nfields != data->ncols)
+    Index_mark(data->rows, row, nfields);
+
+}
+
+// Makes sure the start of row is in the index. Rows that haven't been
+// seen yet are skipped over without being tokenized.
+static int seek_row(Data_T data, int row) {
+
+  Index_T rows = data->rows;
+  char *ptr = ((mmap_args) data->args)->ptr;
+
+  ssize_t start = Index_get(rows, Index_length(rows)-1);
+
+  while (Index_length(rows) <= row) {
+    ssize_t offset = Index_get(rows, Index_length(rows)-1);
+    if (offset >= data->st_size) {
+      touch(data, start, offset - start);
+      return E_DTA_EOF;
+    }
+    ssize_t next;
+    want(data, offset, 0);
+    if (data->ragged) mark(data, Index_length(rows)-1, 
+      count_fields(ptr, offset, data->st_size, data->delim, &next));
+    else next = next_row(ptr, offset, data->st_size);
+    Index_append(rows, next);
+    data->nrows++;
+
+    // Long skips are accounted for as they go so the budget holds
+    if (offset - start >= RESIDENT_CHUNK) {
+      touch(data, start, offset - start);
+      start = offset;
+    }
+  }
+
+  ssize_t end = Index_get(rows, Index_length(rows)-1);
+  if (end > start) touch(data, start, end - start);
+
+  return E_OK;
+
+}
+
+// Returns the checkpoints for row, starting over if its slot
+// was last used by another row
+static struct checkpoints *checkpoints(Data_T data, int row) {
+
+  struct checkpoints *cp = 
+    &((mmap_args) data->args)->checkpoints[row % CHECKPOINT_ROWS];
+
+  if (cp->row != row || !cp->offsets) {
+    cp->row = row;
+    cp->n = 0;
+  }
+
+  return cp;
+
+}
+
+// Saves where field icol starts if it's the next checkpoint
+static void checkpoint(struct checkpoints *cp, int icol, ssize_t offset) {
+
+  if (icol % CHECKPOINT_EVERY || icol / CHECKPOINT_EVERY != cp->n) return;
+
+  if (!cp->offsets) {
+    cp->size = 16;
+    cp->offsets = CALLOC(cp->size, sizeof(ssize_t));
+  } else if (cp->n == cp->size) {
+    cp->size *= 2;
+    RESIZE(cp->offsets, cp->size * sizeof(ssize_t));
+  }
+
+  cp->offsets[cp->n++] = offset;
+
+}
+
+// Points *saveptr at the closest checkpointed field at or before col,
+// and returns that field
+static int seek_col(struct checkpoints *cp, int col, char *str, 
+  char **saveptr) {
+
+  int k = col / CHECKPOINT_EVERY;
+  if (k >= cp->n) k = cp->n - 1;
+
+  if (k <= 0) {
+    *saveptr = str;
+    return 0;
+  }
+
+  *saveptr = str + cp->offsets[k];
+  return k * CHECKPOINT_EVERY;
+
+}
+
 // TODO: enable getting multiple rows at a time to make this more efficient
 
 static int get_row(Data_T data, char **buf, int row, int col_start, int col_end) {
 
-  // TODO: currently only supports one row lookahead
   // TODO: check if line is whitespace
 
-  int parsed = 0;
-  int *row_offsets = data->row_offsets;
-  ssize_t len = data->st_size;
+  Index_T rows = data->rows;
   char *ptr = ((mmap_args) data->args)->ptr;
-  int err, nbytes, total_bytes;
+  int err, nbytes;
   char *tok, *saveptr = NULL;
 
   int i = 0, icol = 0; // indexing values
 
   // Input checks
+  if (row < 0) return E_DTA_ROW_OOB;
   if (data->ncols && col_end >= data->ncols) return E_DTA_COL_OOB;
   if (data->ncols && col_end == -1) col_end = data->ncols-1;
 
-  if (row > 0) {
-    if (row_offsets[row] == len) return E_DTA_EOF;
-    if (!row_offsets[row]) return E_DTA_ROW_OOB; 
-  }
+  if ((err = seek_row(data, row)) != E_OK) return err;
+
+  ssize_t offset = Index_get(rows, row);
+  if (offset == data->st_size) return E_DTA_EOF;
 
-  if (row_offsets[row+1]) {
-    len = row_offsets[row+1] - row_offsets[row];
-    parsed = 1;
-  } 
+  int parsed = row + 1 < Index_length(rows);
 
   if (!data->ncols && parsed) return E_DTA_BAD_INPUT;
 
+  want(data, offset, parsed ? Index_get(rows, row+1) - offset : 0);
+
+  struct checkpoints *cp = checkpoints(data, row);
+
   if (parsed) {
 
+    ssize_t len = Index_get(rows, row+1) - offset;
+    icol = seek_col(cp, col_start, ptr+offset, &saveptr);
+
     while (1) {
-      err = get_tok_r(&tok, &nbytes, ptr+row_offsets[row], 
-        data->delim, &saveptr, len);
-      if (err & (TOK_ERR | TOK_EOF))
-        return E_DTA_PARSE_ERROR; 
+      checkpoint(cp, icol, saveptr - (ptr+offset));
+      err = get_tok_r(&tok, &nbytes, ptr+offset, data->delim, &saveptr, len);
+      if (err == TOK_ERR) return E_DTA_PARSE_ERROR; 
       if (icol >= col_start && icol <= col_end) buf[i++] = tok;
       if (icol == col_end) break;
+      if (err & (TOK_EOL | TOK_EOF)) {
+        if (!data->ragged) return E_DTA_MISSING_FIELD;
+        // Short rows are padded with empty fields
+        for (icol++; icol <= col_end; icol++) 
+          if (icol >= col_start) buf[i++] = missing;
+        break;
+      }
       icol++;
     }
 
   } else {
 
-    total_bytes = row_offsets[row];
+    ssize_t len = data->st_size - offset, total_bytes = offset;
+    saveptr = ptr+offset;
+
     while (1) {
-      err = get_tok_r(&tok, &nbytes, ptr+row_offsets[row], 
-        data->delim, &saveptr, len);
+      checkpoint(cp, icol, saveptr - (ptr+offset));
+      err = get_tok_r(&tok, &nbytes, ptr+offset, data->delim, &saveptr, len);
       if (err == TOK_ERR) return E_DTA_PARSE_ERROR; // EOL, EOF are okay
-      else if (err == TOK_EOF) break; 
 
       if (icol >= col_start && (icol <= col_end || col_end == -1)) 
         buf[i++] = tok;
       total_bytes += nbytes;
 
-      if (err == TOK_EOL) {
+      if (err & (TOK_EOL | TOK_EOF)) {
         if (!data->ncols) data->ncols = icol+1;
-        if (icol != data->ncols-1) return E_DTA_MISSING_FIELD;
-        else break;
+        if (icol == data->ncols-1) break;
+        if (!data->ragged) return E_DTA_MISSING_FIELD;
+        mark(data, row, icol+1);
+        for (icol++; icol <= col_end; icol++) 
+          if (icol >= col_start) buf[i++] = missing;
+        break;
+      }
+
+      // Once the last field asked for is found, the rest of the row
+      // only needs to be skipped over, not tokenized, though its fields
+      // are counted if rows can be ragged
+      if (data->ncols && icol == col_end) {
+        if (data->ragged) mark(data, row, icol + 1 + count_fields(ptr, 
+          saveptr - ptr, data->st_size, data->delim, &total_bytes));
+        else total_bytes = next_row(ptr, saveptr - ptr, data->st_size);
+        break;
       }
 
       icol++;
     }
-    row_offsets[row + 1] = total_bytes;
+
+    Index_append(rows, total_bytes < data->st_size ? total_bytes : data->st_size);
     data->nrows++;
   }
 
+  touch(data, offset, Index_get(rows, row+1) - offset);
+
   return E_OK;
 
 }
 
 static int get_col(Data_T data, char **buf, int col, int row_start, int row_end) {
 
-  int *row_offsets = data->row_offsets;
+  Index_T rows = data->rows;
   char *ptr = ((mmap_args) data->args)->ptr;
   int err, nbytes; // , total_bytes;
   char *tok = NULL, *saveptr;
 
   if (col > data->ncols-1) return E_DTA_COL_OOB;
   if (row_end > data->nrows-1) return E_DTA_ROW_OOB;
+
+  want(data, Index_get(rows, row_start), 
+    Index_get(rows, row_end+1) - Index_get(rows, row_start));
   
   for (int irow=row_start, i=0; irow<=row_end; irow++, i++) {
-    saveptr = NULL;
-    int len = row_offsets[irow+1] - row_offsets[irow];
-    for (int icol=0; icol <= col; icol++) {
-
-      err = get_tok_r(&tok, &nbytes, ptr+row_offsets[irow], 
-        data->delim, &saveptr, len);
-      if (err & (TOK_ERR | TOK_EOF))
-        return E_DTA_PARSE_ERROR;
+    ssize_t offset = Index_get(rows, irow);
+    ssize_t len = Index_get(rows, irow+1) - offset;
+    struct checkpoints *cp = checkpoints(data, irow);
+
+    for (int icol=seek_col(cp, col, ptr+offset, &saveptr); icol <= col; icol++) {
+
+      checkpoint(cp, icol, saveptr - (ptr+offset));
+      err = get_tok_r(&tok, &nbytes, ptr+offset, data->delim, &saveptr, len);
+      if (err == TOK_ERR) return E_DTA_PARSE_ERROR;
+      if (err & (TOK_EOL | TOK_EOF) && icol < col) {
+        if (!data->ragged) return E_DTA_MISSING_FIELD;
+        tok = missing;
+        break;
+      }
 
     }
     buf[i] = tok;
   }
 
+  ssize_t offset = Index_get(rows, row_start);
+  touch(data, offset, Index_get(rows, row_end+1) - offset);
+
   return E_OK;
 
 }
 
+// Counts the rows that start in [offset, offset+nbytes). The last row
+// is followed past the end of the window so the returned offset, where
+// counting stopped, is always the start of a row (or the end of file).
+// Only reads the mapping, so it is safe to call from a worker thread.
+static ssize_t scan_rows(Data_T data, ssize_t offset, ssize_t nbytes,
+  long *nrows) {
+
+  char *ptr = ((mmap_args) data->args)->ptr;
+  ssize_t len = data->st_size;
+  ssize_t stop = offset + nbytes < len ? offset + nbytes : len;
+  int in_quote = 0;
+
+  char *p = ptr + offset, *end = ptr + len, *released = p, *wanted = p;
+
+  while (p < end && (p - ptr < stop || in_quote)) {
+
+    if (p >= wanted) {
+      want(data, p - ptr, 0);
+      wanted = ptr + ((p - ptr) / CACHE_BLOCK + 1) * CACHE_BLOCK;
+    }
+
+    // Rows without quotes are the common case, so skip straight
+    // to the next newline and only count quotes in between
+    char *nl = memchr(p, '\n', end - p);
+    if (!nl) nl = end;
+
+    for (char *q = p; (q = memchr(q, '"', nl - q)) != NULL; q++)
+      in_quote = !in_quote;
+
+    p = nl + 1;
+    if (!in_quote) (*nrows)++;
+
+    if (data->max_resident && p - released >= RESIDENT_CHUNK) {
+      release(data->args, released - ptr, p - released);
+      released = p;
+    }
+  }
+
+  if (data->max_resident && p > released)
+    release(data->args, released - ptr, (p < end ? p : end) - released);
+
+  return p < end ? p - ptr : len;
+
+}
+
+// Hashes 8 bytes at a time, reading through the mapping without copying
+// anything but the last few bytes. Shared by the other text backends.
+uint64_t Data_hash(const char *str, ssize_t len) {
+
+  const uint64_t m = 0x9e3779b97f4a7c15ULL;
+  uint64_t h = len * m, w;
+
+  for ( ; len >= 8; str += 8, len -= 8) {
+    memcpy(&w, str, 8);
+    h = (h ^ w) * m;
+    h ^= h >> 32;
+  }
+
+  w = 0;
+  memcpy(&w, str, len);
+  h = (h ^ w) * m;
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 32;
+
+  return h;
+
+}
+
+// Hashes up to max rows starting at offset, and the field key_col of
+// each row if key_col isn't -1. Sets *n to the number of rows hashed and
+// returns the offset of the next row. Only reads the mapping, so it is
+// safe to call from a worker thread.
+static ssize_t hash_rows(Data_T data, ssize_t offset, int key_col,
+  uint64_t *hashes, uint64_t *keys, long max, long *n) {
+
+  char *ptr = ((mmap_args) data->args)->ptr;
+  ssize_t len = data->st_size;
+
+  for (*n = 0; *n < max && offset < len; (*n)++) {
+
+    want(data, offset, 0);
+    ssize_t next = next_row(ptr, offset, len);
+    ssize_t end = next;
+    if (end > offset && ptr[end-1] == '\n') end--;
+    if (end > offset && ptr[end-1] == '\r') end--;
+
+    hashes[*n] = Data_hash(ptr + offset, end - offset);
+
+    if (key_col >= 0) {
+      char *p = ptr + offset, *field = p;
+      int icol = 0, in_quote = 0;
+      for ( ; p < ptr + end; p++) {
+        if (*p == '"') in_quote = !in_quote;
+        else if (*p == data->delim && !in_quote) {
+          if (icol == key_col) break;
+          icol++;
+          field = p + 1;
+        }
+      }
+      keys[*n] = icol == key_col ? Data_hash(field, p - field) : 0;
+    }
+
+    if (data->max_resident && next / RESIDENT_CHUNK != offset / RESIDENT_CHUNK)
+      release(data->args, offset / RESIDENT_CHUNK * RESIDENT_CHUNK, 
+        next / RESIDENT_CHUNK * RESIDENT_CHUNK 
+          - offset / RESIDENT_CHUNK * RESIDENT_CHUNK);
+
+    offset = next;
+  }
+
+  return offset;
+
+}
+
+// Fields cols of up to max rows starting at offset. Each row is only
+// tokenized up to the last field asked for. Only reads the mapping, so
+// it is safe to call from a worker thread.
+static ssize_t scan_fields(Data_T data, ssize_t offset, const int *cols,
+  int ncols, char **toks, int *lens, long max, long *n) {
+
+  char *ptr = ((mmap_args) data->args)->ptr;
+  ssize_t len = data->st_size;
+
+  int maxcol = 0;
+  for (int j=0; j<ncols; j++) if (cols[j] > maxcol) maxcol = cols[j];
+
+  for (*n = 0; *n < max && offset < len; (*n)++) {
+
+    want(data, offset, 0);
+    char **tok = toks + *n * ncols;
+    int *tlen = lens + *n * ncols;
+    for (int j=0; j<ncols; j++) tok[j] = missing, tlen[j] = 0;
+
+    char *p = ptr + offset, *end = ptr + len, *field = p;
+    int icol = 0, in_quote = 0;
+
+    for ( ; p <= end; p++) {
+      if (p < end && *p == '"') in_quote = !in_quote;
+      else if (p == end || (!in_quote && (*p == data->delim || *p == '\n'))) {
+        char *stop = p;
+        if (p < end && *p == '\n' && stop > field && stop[-1] == '\r') stop--;
+        for (int j=0; j<ncols; j++)
+          if (cols[j] == icol) tok[j] = field, tlen[j] = stop - field;
+        if (p == end || *p == '\n' || icol++ == maxcol) break;
+        field = p + 1;
+      }
+    }
+
+    // Past the last field asked for, only the end of the row matters
+    ssize_t next;
+    if (p == end) next = len;
+    else if (*p == '\n') next = p - ptr + 1;
+    else next = next_row(ptr, p - ptr + 1, len);
+
+    if (data->max_resident && next / RESIDENT_CHUNK != offset / RESIDENT_CHUNK)
+      release(data->args, offset / RESIDENT_CHUNK * RESIDENT_CHUNK, 
+        next / RESIDENT_CHUNK * RESIDENT_CHUNK 
+          - offset / RESIDENT_CHUNK * RESIDENT_CHUNK);
+
+    offset = next;
+  }
+
+  return offset;
+
+}
+
+// Lines looked back over to find where a row starts, so a quoted field
+// can span up to this many lines and still be sampled
+#define RESYNC_LINES 32
+
+// Whether [p, end) reads as a whole row: quotes only open at the start
+// of a field and only close at the end of one, and there are as many
+// fields as the header has. Starting inside a quoted field flips which
+// quotes open and which close, which almost never reads this way.
+static int whole_row(const char *p, const char *end, char delim, int ncols) {
+
+  int nfields = 1, in_quote = 0;
+
+  for (const char *q = p; q < end; q++) {
+    if (*q == '"') {
+      if (!in_quote && q > p && q[-1] != delim && q[-1] != '"') return 0;
+      if (in_quote && q+1 < end && q[1] != '"' && q[1] != delim 
+        && q[1] != '\n' && q[1] != '\r') return 0;
+      in_quote = !in_quote;
+    }
+    else if (!in_quote && *q == delim) nfields++;
+  }
+
+  return !in_quote && (!ncols || nfields == ncols);
+
+}
+
+// Start of the row holding the byte at offset. Which newlines are
+// inside quotes can't be known without reading from the top, so each
+// line start before offset is tried in turn until one parses as a
+// whole row that reaches past offset.
+static ssize_t row_near(Data_T data, ssize_t offset, ssize_t *end) {
+
+  char *ptr = ((mmap_args) data->args)->ptr;
+  ssize_t start = offset;
+
+  want(data, offset, 0);
+
+  for (int i=0; i<RESYNC_LINES; i++) {
+    while (start > 0 && ptr[start-1] != '\n') start--;
+
+    ssize_t next = next_row(ptr, start, data->st_size);
+    ssize_t stop = next;
+    if (stop > start && ptr[stop-1] == '\n') stop--;
+
+    if (next > offset 
+      && whole_row(ptr + start, ptr + stop, data->delim, data->ncols)) {
+      *end = next;
+      return start;
+    }
+
+    if (start == 0) break;
+    start--;
+  }
+
+  return -1;
+
+}
+
+// Minimum bytes per thread when counting rows in parallel
+#define COUNT_CHUNK (4L << 20)
+
+struct count_job {
+  Data_T data;
+  char *begin;
+  char *end;
+  long counts[2];
+  int parity;
+  int threaded;
+};
+
+// A chunk can start inside a quoted field, which we can't know until
+// the chunks before it are done. So count the newlines seen at each
+// quote parity relative to the start of the chunk, and let the caller
+// pick the right count once the chunk's starting state is known.
+static void *count_chunk(void *cl) {
+
+  struct count_job *job = cl;
+  Data_T data = job->data;
+  char *ptr = ((mmap_args) data->args)->ptr;
+  char *p = job->begin, *released = p, *wanted = p;
+  int parity = 0;
+
+  while (p < job->end) {
+
+    if (p >= wanted) {
+      want(data, p - ptr, 0);
+      wanted = ptr + ((p - ptr) / CACHE_BLOCK + 1) * CACHE_BLOCK;
+    }
+
+    char *nl = memchr(p, '\n', job->end - p);
+    if (!nl) nl = job->end;
+
+    for (char *q = p; (q = memchr(q, '"', nl - q)) != NULL; q++)
+      parity = !parity;
+
+    if (nl < job->end) job->counts[parity]++;
+    p = nl + 1;
+
+    if (data->max_resident && p - released >= RESIDENT_CHUNK) {
+      release(data->args, released - ptr, p - released);
+      released = p;
+    }
+  }
+
+  if (data->max_resident && job->end > released)
+    release(data->args, released - ptr, job->end - released);
+
+  job->parity = parity;
+
+  return NULL;
+
+}
+
+// Counts every row in the file, splitting the scan across threads
+static long count_rows(Data_T data, int nthreads) {
+
+  char *ptr = ((mmap_args) data->args)->ptr;
+  ssize_t len = data->st_size;
+
+  if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > len / COUNT_CHUNK) nthreads = len / COUNT_CHUNK;
+  if (nthreads < 1) nthreads = 1;
+
+  struct count_job *jobs = CALLOC(nthreads, sizeof(struct count_job));
+  pthread_t *threads = CALLOC(nthreads, sizeof(pthread_t));
+
+  for (int i=0; i<nthreads; i++) {
+    jobs[i].data = data;
+    jobs[i].begin = ptr + len / nthreads * i;
+    jobs[i].end = i == nthreads-1 ? ptr + len : ptr + len / nthreads * (i+1);
+  }
+
+  // Run the first chunk on this thread and fall back to doing the
+  // rest here too if a thread can't be started
+  for (int i=1; i<nthreads; i++)
+    jobs[i].threaded = !pthread_create(&threads[i], NULL, count_chunk, &jobs[i]);
+  for (int i=0; i<nthreads; i++)
+    if (!jobs[i].threaded) count_chunk(&jobs[i]);
+
+  long nrows = 0;
+  int in_quote = 0;
+  for (int i=0; i<nthreads; i++) {
+    if (jobs[i].threaded) pthread_join(threads[i], NULL);
+    nrows += jobs[i].counts[in_quote];
+    in_quote ^= jobs[i].parity;
+  }
+
+  // The last row may not end in a newline
+  if (len > 0 && ptr[len-1] != '\n') nrows++;
+
+  FREE(jobs);
+  FREE(threads);
+
+  return nrows;
+
+}
+
 static int data_open(Data_T data) {
 
   mmap_args _args = data->args;
@@ -197,10 +823,11 @@ static int data_open(Data_T data) {
   if (fd < 0) return E_DTA_FILE_ERROR;
 
   struct stat statbuf;
-  if (fstat(fd, &statbuf) < 0) return E_DTA_FILE_ERROR;
-
   long PAGESIZE = sysconf(_SC_PAGESIZE);
-  if (statbuf.st_size % PAGESIZE == 0) return E_DTA_FILE_ERROR;
+  if (fstat(fd, &statbuf) < 0 || statbuf.st_size % PAGESIZE == 0) {
+    close(fd);
+    return E_DTA_FILE_ERROR;
+  }
 
   char *ptr = mmap(
     NULL,                   // address
@@ -211,22 +838,39 @@ static int data_open(Data_T data) {
     0                       // offset
   );
 
-  close(fd);
+  // The file is read ahead through a descriptor of its own
+  int ahead = _args->uring && ptr != MAP_FAILED ? dup(fd) : -1;
+  if (ahead >= 0) _args->cache = Cache_new(ahead, statbuf.st_size, 1);
+
+  // The descriptor is only needed to drop cached pages
+  _args->resident.fd = -1;
+  if (data->max_resident && ptr != MAP_FAILED) _args->resident.fd = fd;
+  else close(fd);
 
   if (ptr == MAP_FAILED) return E_DTA_FILE_ERROR;
 
   data->st_size = statbuf.st_size;
   _args->ptr = ptr;
 
+  if (data->max_resident) {
+    _args->resident.nchunks = statbuf.st_size / RESIDENT_CHUNK + 1;
+    _args->resident.touched = CALLOC(_args->resident.nchunks, 1);
+  }
+
   return E_OK;
 
 }
 
 static int data_close(Data_T data) {
 
-  char *ptr = ((mmap_args) data->args)->ptr;
+  mmap_args args = data->args;
+
+  if (args->resident.touched) FREE(args->resident.touched);
+  if (args->resident.fd >= 0) close(args->resident.fd);
+  args->resident.fd = -1;
+  if (args->cache) Cache_free(&args->cache);
 
-  if (munmap(ptr, data->st_size) != 0)
+  if (munmap(args->ptr, data->st_size) != 0)
     return E_DTA_RESOURCE_ERROR;
   
   return E_OK;
@@ -236,12 +880,13 @@ static int data_close(Data_T data) {
 // Our tokens from mmap won't be NULL-terminated.
 // Instead they'll be terminated by either the delimiter
 // or the newline. We avoid writing to the mmap-ed file
-// by printing based on these new terminators
+// by printing based on these new terminators. Fields padded
+// onto short rows point to missing, which ends in a NUL.
 static int mvaddntok(int row, int col, const char *tok, 
   int n, char delim) { // this needs to be args
   
   for (int c=0; c<n; c++) {
-    if (*tok == delim || *tok == '\n') return 1; // TODO: figure out return value
+    if (!*tok || *tok == delim || *tok == '\n') return 1; // TODO: figure out return value
     else mvaddch(row, col, *tok);
     col++, tok++;
   }
@@ -250,6 +895,20 @@ static int mvaddntok(int row, int col, const char *tok,
 
 }
 
+// Length of a token, up to the unquoted delimiter or newline
+static int toklen(const char *tok, char delim) {
+
+  int in_quote = 0, n = 0;
+
+  for ( ; tok[n]; n++) {
+    if (tok[n] == '"') in_quote = !in_quote;
+    else if (!in_quote && (tok[n] == delim || tok[n] == '\n')) break;
+  }
+
+  return n;
+
+}
+
 Data_T Data_mmap_init(char *path, char delim) {
 
   if (!delim || !strlen(path)) return NULL;
@@ -259,18 +918,30 @@ Data_T Data_mmap_init(char *path, char delim) {
 
   data->path = path;
   data->delim = delim;
-  data->row_offsets = calloc(MAX_ROWS, sizeof(int));
+  data->delimited = 1;
+  data->quoted = 1;
+  data->rows = Index_new();
+  Index_append(data->rows, 0);
   data->open = data_open;
   data->get_col = get_col;
   data->get_row = get_row;;
   data->mvaddntok = mvaddntok;
+  data->toklen = toklen;
   data->close = data_close;
+  data->scan_rows = scan_rows;
+  data->count_rows = count_rows;
+  data->resident = resident;
+  data->hash_rows = hash_rows;
+  data->scan_fields = scan_fields;
+  data->row_near = row_near;
+  data->free = Data_mmap_free;
 
   // Nothing needs to be done to free nodes inside the frame
   data->free_node = NULL;
 
   mmap_args args;
   NEW0(args);
+  args->resident.fd = -1;
 
   data->args = args;
 
@@ -278,12 +949,29 @@ Data_T Data_mmap_init(char *path, char delim) {
 
 }
 
+// Like Data_mmap_init, but the file is read ahead of where it's being
+// tokenized through io_uring, or with pread if the kernel doesn't have
+// it. Freed with Data_mmap_free.
+Data_T Data_uring_init(char *path, char delim) {
+
+  Data_T data = Data_mmap_init(path, delim);
+
+  if (data) ((mmap_args) data->args)->uring = 1;
+
+  return data;
+
+}
+
 void Data_mmap_free(Data_T *data) {
 
   assert(data && *data && (*data)->args); 
-  assert((*data)->row_offsets);
+  assert((*data)->rows);
+
+  mmap_args args = (*data)->args;
+  for (int i=0; i<CHECKPOINT_ROWS; i++)
+    if (args->checkpoints[i].offsets) FREE(args->checkpoints[i].offsets);
 
-  FREE((*data)->row_offsets);
+  Index_free(&(*data)->rows);
   FREE((*data)->args);
   FREE(*data);
 
@@ -0,0 +1,525 @@
+//
+// -----------------------------------------------------------------------------
+// data-remote.c
+// -----------------------------------------------------------------------------
+//
+// Instance of Data_T that reads rows from a server started with
+// --serve, as described in serve.h. Rows are asked for a batch at a
+// time, in the direction of scrolling, and their cells are kept as
+// text of our own. Cells already handed out stay put for as long as
+// their row is kept, so columns fetched later are added alongside them
+// rather than replacing them.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdlib.h>     // free
+#include <string.h>     // memcpy, strcpy, strlen
+#include <errno.h>      // errno, EINTR
+#include <unistd.h>     // close
+#include <sys/socket.h> // socket, connect, send, recv
+#include <sys/un.h>     // sockaddr_un
+#include "error.h"
+#include "mem.h"        // NEW0, ALLOC, CALLOC, RESIZE, FREE
+#include "index.h"
+#include "frame.h"
+#include "serve.h"
+#include "errorcodes.h"
+
+// Rows kept, each in the slot of its number modulo this. The rows on
+// screen and those held either side of it are always far fewer, so
+// none of their cells are freed while they're shown.
+#define REMOTE_ROWS 16384
+
+// Rows asked for at a time
+#define REMOTE_BATCH 64
+
+struct run {
+  int col_start;
+  int col_end;
+  char **cells;       // NUL-terminated
+  char *text;
+  long size;          // bytes of both
+};
+
+struct row {
+  long row;           // -1 if the slot is empty
+  struct run *runs;   // columns fetched for it, in the order they were
+  int nruns;
+};
+
+typedef struct remote_args {
+  int fd;
+  int counter;        // connection the count is followed on, or -1
+  int headers;
+  long scanned;       // rows counted as of the last scan_rows
+  struct row first;   // row 0, which holds the header
+  struct row *rows;
+  uint32_t *lens;     // lengths and text of the reply being read
+  char *text;
+  long text_size;
+  ssize_t bytes;      // held by rows
+} *remote_args;
+
+static int connect_to(const char *path) {
+
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof addr.sun_path) return -1;
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  if (connect(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+
+}
+
+static int send_all(int fd, const void *buf, size_t len) {
+
+  const char *p = buf;
+
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return E_DTA_FILE_ERROR;
+    p += n, len -= n;
+  }
+
+  return E_OK;
+
+}
+
+static int recv_all(int fd, void *buf, size_t len) {
+
+  char *p = buf;
+
+  while (len > 0) {
+    ssize_t n = recv(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return E_DTA_FILE_ERROR;
+    p += n, len -= n;
+  }
+
+  return E_OK;
+
+}
+
+// Sends a request and reads the reply, leaving its cells in args->lens
+// and args->text
+static int request(remote_args args, int fd, struct serve_request *req,
+  const char *text, struct serve_reply *reply) {
+
+  if (send_all(fd, req, sizeof *req) != E_OK
+    || (req->len && send_all(fd, text, req->len) != E_OK)
+    || recv_all(fd, reply, sizeof *reply) != E_OK
+    || reply->version != SERVE_VERSION || reply->ncells > SERVE_CELLS)
+    return E_DTA_FILE_ERROR;
+
+  if (reply->len > args->text_size) {
+    args->text_size = reply->len;
+    if (args->text) RESIZE(args->text, args->text_size);
+    else args->text = ALLOC(args->text_size);
+  }
+
+  if (recv_all(fd, args->lens, reply->ncells * sizeof(uint32_t)) != E_OK
+    || recv_all(fd, args->text, reply->len) != E_OK)
+    return E_DTA_FILE_ERROR;
+
+  return E_OK;
+
+}
+
+static struct row *slot(remote_args args, long row) {
+
+  return row == 0 ? &args->first : &args->rows[row % REMOTE_ROWS];
+
+}
+
+static void forget(remote_args args, struct row *r) {
+
+  for (int i=0; i<r->nruns; i++) {
+    struct run *run = &r->runs[i];
+    args->bytes -= run->size;
+    FREE(run->cells);
+    FREE(run->text);
+  }
+  if (r->runs) FREE(r->runs);
+  r->nruns = 0;
+  r->row = -1;
+
+}
+
+// A cell of row, the first fetched if it was more than once, or NULL
+static char *cell(remote_args args, long row, int col) {
+
+  struct row *r = slot(args, row);
+  if (r->row != row) return NULL;
+
+  for (int i=0; i<r->nruns; i++)
+    if (col >= r->runs[i].col_start && col <= r->runs[i].col_end)
+      return r->runs[i].cells[col - r->runs[i].col_start];
+
+  return NULL;
+
+}
+
+// The first of columns col_start to col_end of row that hasn't been
+// fetched, and the last in last, or -1
+static int missing(remote_args args, long row, int col_start, int col_end,
+  int *last) {
+
+  int first = -1;
+
+  for (int col=col_start; col<=col_end; col++)
+    if (!cell(args, row, col)) {
+      if (first < 0) first = col;
+      *last = col;
+    }
+
+  return first;
+
+}
+
+// Keeps cells col_start to col_end of row, whose lengths start at lens
+// and text at text. The text is copied with each cell NUL-terminated,
+// so they can be measured without the delimiter.
+static void keep(remote_args args, long row, int col_start, int col_end,
+  const uint32_t *lens, const char *text) {
+
+  struct row *r = slot(args, row);
+  if (r->row != row) {
+    forget(args, r);
+    r->row = row;
+  }
+
+  int ncols = col_end - col_start + 1;
+  long len = 0;
+  for (int j=0; j<ncols; j++) len += lens[j] + 1;
+
+  if (r->runs) RESIZE(r->runs, (r->nruns + 1) * sizeof(struct run));
+  else r->runs = ALLOC(sizeof(struct run));
+
+  struct run *run = &r->runs[r->nruns++];
+  run->col_start = col_start;
+  run->col_end = col_end;
+  run->cells = CALLOC(ncols, sizeof(char *));
+  run->text = ALLOC(len);
+
+  char *p = run->text;
+  for (int j=0; j<ncols; j++) {
+    memcpy(p, text, lens[j]);
+    p[lens[j]] = '\0';
+    run->cells[j] = p;
+    p += lens[j] + 1;
+    text += lens[j];
+  }
+
+  run->size = ncols * sizeof(char *) + len;
+  args->bytes += run->size;
+
+}
+
+// Fetches columns col_start to col_end of rows first to last, keeping
+// those of rows that don't already have them all
+static int fetch(Data_T data, long first, long last, int col_start,
+  int col_end) {
+
+  remote_args args = data->args;
+  struct serve_request req = { SERVE_ROWS, 0, first, last, col_start,
+    col_end };
+  struct serve_reply reply;
+
+  int err = request(args, args->fd, &req, NULL, &reply);
+  if (err != E_OK) return err;
+  if (reply.err != E_OK) return reply.err;
+
+  data->nrows = reply.nrows;
+  data->ncols = reply.ncols;
+
+  int ncols = col_end - col_start + 1, last_col;
+  const uint32_t *lens = args->lens;
+  const char *text = args->text;
+
+  for (long i=0; i<reply.value; i++) {
+    long len = 0;
+    for (int j=0; j<ncols; j++) len += lens[j];
+    if (missing(args, first + i, col_start, col_end, &last_col) >= 0)
+      keep(args, first + i, col_start, col_end, lens, text);
+    lens += ncols;
+    text += len;
+  }
+
+  return E_OK;
+
+}
+
+static int get_row(Data_T data, char **buf, int row, int col_start,
+  int col_end) {
+
+  remote_args args = data->args;
+  int last;
+
+  if (row < 0) return E_DTA_ROW_OOB;
+  if (col_start < 0 || col_end < col_start) return E_DTA_COL_OOB;
+
+  int first = missing(args, row, col_start, col_end, &last);
+  if (first >= 0) {
+    // Rows above are asked for when scrolling up
+    long lo = row, hi = row + REMOTE_BATCH - 1;
+    if (row > 0 && cell(args, row + 1, first)) {
+      lo = row >= REMOTE_BATCH ? row - REMOTE_BATCH + 1 : 0;
+      hi = row;
+    }
+    int err = fetch(data, lo, hi, first, last);
+    // The rows before it were fine, so ask for it alone to find out why
+    // it wasn't sent
+    if (err == E_OK && missing(args, row, first, last, &last) >= 0)
+      err = fetch(data, row, row, first, last);
+    if (err != E_OK) return err;
+  }
+
+  for (int col=col_start, i=0; col<=col_end; col++, i++)
+    buf[i] = cell(args, row, col);
+
+  return E_OK;
+
+}
+
+static int get_col(Data_T data, char **buf, int col, int row_start,
+  int row_end) {
+
+  remote_args args = data->args;
+
+  for (int irow=row_start, i=0; irow<=row_end; irow++, i++) {
+    if (!cell(args, irow, col)) {
+      int err = fetch(data, irow, row_end, col, col);
+      if (err == E_OK && !cell(args, irow, col))
+        err = fetch(data, irow, irow, col, col);
+      if (err != E_OK) return err;
+    }
+    buf[i] = cell(args, irow, col);
+  }
+
+  return E_OK;
+
+}
+
+// Cells are text of their own, ending at a NUL
+static int mvaddntok(int row, int col, const char *tok, int n, char delim) {
+
+  for (int c=0; c<n && tok[c] && tok[c] != '\n'; c++)
+    mvaddch(row, col + c, tok[c]);
+
+  return 1;
+
+}
+
+static int toklen(const char *tok, char delim) {
+
+  return strlen(tok);
+
+}
+
+// Rows are counted by the server. This waits for it to count past
+// offset, and adds the rows it's counted since the last call, so it has
+// to carry on from where that left off, as it does when the whole file
+// is counted.
+static ssize_t scan_rows(Data_T data, ssize_t offset, ssize_t nbytes,
+  long *nrows) {
+
+  remote_args args = data->args;
+
+  if (args->counter < 0 && (args->counter = connect_to(data->path)) < 0)
+    return data->st_size;
+  if (offset == 0) args->scanned = 0;
+
+  struct serve_request req = { SERVE_STATS, 0, offset, 0, 0, 0 };
+  struct serve_reply reply;
+  if (request(args, args->counter, &req, NULL, &reply) != E_OK)
+    return data->st_size;
+
+  *nrows += reply.nrows - args->scanned;
+  args->scanned = reply.nrows;
+
+  return reply.done;
+
+}
+
+static long count_rows(Data_T data, int nthreads) {
+
+  long nrows = 0;
+  ssize_t offset = 0;
+
+  while (offset < data->st_size)
+    offset = scan_rows(data, offset, 0, &nrows);
+
+  return nrows;
+
+}
+
+static ssize_t resident(Data_T data) {
+
+  remote_args args = data->args;
+
+  return args->bytes + (REMOTE_ROWS + 1) * sizeof(struct row);
+
+}
+
+// Connects to the server, and learns the shape of its data
+static int data_open(Data_T data) {
+
+  remote_args args = data->args;
+
+  if (args->fd < 0 && (args->fd = connect_to(data->path)) < 0)
+    return E_DTA_FILE_ERROR;
+
+  // Ask for what's been counted so far, without waiting
+  struct serve_request req = { SERVE_STATS, 0, -1, 0, 0, 0 };
+  struct serve_reply reply;
+  int err = request(args, args->fd, &req, NULL, &reply);
+  if (err != E_OK) return err;
+
+  data->st_size = reply.total;
+  data->ncols = reply.ncols;
+  data->nrows = reply.nrows;
+  data->quoted = reply.delim != 0;
+  if (data->quoted) data->delim = reply.delim;
+  args->headers = reply.headers;
+
+  return E_OK;
+
+}
+
+static int data_close(Data_T data) {
+
+  remote_args args = data->args;
+
+  if (args->fd >= 0) close(args->fd);
+  if (args->counter >= 0) close(args->counter);
+  args->fd = args->counter = -1;
+
+  forget(args, &args->first);
+  for (int i=0; i<REMOTE_ROWS; i++)
+    if (args->rows[i].row >= 0) forget(args, &args->rows[i]);
+
+  return E_OK;
+
+}
+
+// Reads the data served at path. The server is connected to now, so
+// whether it has a header is known before the data is opened.
+Data_T Data_remote_init(char *path) {
+
+  if (!path || !strlen(path)) return NULL;
+
+  remote_args args;
+  NEW0(args);
+  args->counter = -1;
+  args->first.row = -1;
+  args->rows = CALLOC(REMOTE_ROWS, sizeof(struct row));
+  for (int i=0; i<REMOTE_ROWS; i++) args->rows[i].row = -1;
+  args->lens = CALLOC(SERVE_CELLS, sizeof(uint32_t));
+
+  Data_T data;
+  NEW0(data);
+
+  data->path = path;
+  data->delim = ',';
+  data->delimited = 0;
+  data->quoted = 0;
+  data->rows = Index_new();
+  Index_append(data->rows, 0);
+  data->open = data_open;
+  data->get_col = get_col;
+  data->get_row = get_row;
+  data->mvaddntok = mvaddntok;
+  data->toklen = toklen;
+  data->format = NULL;
+  data->close = data_close;
+  data->scan_rows = scan_rows;
+  data->count_rows = count_rows;
+  data->resident = resident;
+  data->hash_rows = NULL;
+  data->scan_fields = NULL;
+  data->row_near = NULL;
+  data->free = Data_remote_free;
+  data->free_node = NULL;
+  data->args = args;
+
+  args->fd = -1;
+  if (data_open(data) != E_OK) {
+    Data_remote_free(&data);
+    return NULL;
+  }
+
+  return data;
+
+}
+
+// Whether the first row served is a header
+int Data_remote_headers(Data_T data) {
+
+  assert(data && data->args);
+
+  return ((remote_args) data->args)->headers;
+
+}
+
+// The first row from row from on with the text in one of columns
+// col_start to col_end, or -1 if there isn't one. The server searches
+// a batch of rows at a time, so others aren't kept waiting.
+long Data_remote_find(Data_T data, const char *text, long from,
+  int col_start, int col_end) {
+
+  assert(data && data->args && text);
+
+  remote_args args = data->args;
+  size_t len = strlen(text);
+  if (len > SERVE_TEXT || args->fd < 0) return -1;
+
+  struct serve_request req = { SERVE_FIND, len, from, INT64_MAX, col_start,
+    col_end };
+
+  for (;;) {
+    struct serve_reply reply;
+    if (request(args, args->fd, &req, text, &reply) != E_OK) return -1;
+    if (reply.value >= 0) return reply.value;
+    if (reply.err != E_OK) return -1;
+    req.first = reply.next;
+  }
+
+}
+
+void Data_remote_free(Data_T *data) {
+
+  assert(data && *data && (*data)->args);
+
+  remote_args args = (*data)->args;
+  data_close(*data);
+
+  FREE(args->rows);
+  FREE(args->lens);
+  if (args->text) FREE(args->text);
+
+  Index_free(&(*data)->rows);
+  FREE((*data)->args);
+  FREE(*data);
+
+}
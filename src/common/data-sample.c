@@ -0,0 +1,260 @@
+//
+// -----------------------------------------------------------------------------
+// data-sample.c
+// -----------------------------------------------------------------------------
+//
+// Rows picked at random from another Data_T, without indexing it, and
+// an instance of Data_T that shows just those rows. Bytes are picked
+// uniformly across the file and the row holding each is found with
+// row_near. Long rows hold more bytes, so they're picked more often;
+// each row is kept with probability inversely proportional to its
+// length, so every row is as likely to be kept as any other.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdlib.h>   // qsort
+#include <stdint.h>   // uint64_t
+#include "error.h"
+#include "mem.h"      // NEW0, CALLOC, FREE
+#include "index.h"
+#include "frame.h"
+#include "errorcodes.h"
+
+// Rows read from the start to find how short a row can be
+#define SAMPLE_HEAD 64
+
+// Bytes picked for every row asked for before giving up, which bounds
+// the time taken when rows vary a lot in length
+#define SAMPLE_TRIES 64
+
+typedef struct sample_args {
+  Data_T data;      // where the rows are read from
+  int headers;
+  int *cols;        // columns asked of data->scan_fields
+  int *lens;
+} *sample_args;
+
+// xorshift64*
+static uint64_t next_random(uint64_t *state) {
+
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+
+  return *state * 0x2545F4914F6CDD1DULL;
+
+}
+
+static int compare(const void *a, const void *b) {
+
+  ssize_t x = *(const ssize_t *) a, y = *(const ssize_t *) b;
+
+  return (x > y) - (x < y);
+
+}
+
+// Sorts rows and drops any picked twice
+static long unique(ssize_t *rows, long n) {
+
+  if (n == 0) return 0;
+
+  qsort(rows, n, sizeof *rows, compare);
+
+  long m = 1;
+  for (long i=1; i<n; i++) if (rows[i] != rows[m-1]) rows[m++] = rows[i];
+
+  return m;
+
+}
+
+// Picks up to n distinct rows at random from those starting at or
+// after offset, and puts where they start in rows, in file order.
+// Returns how many were picked, which is fewer than n if the file
+// doesn't have that many rows.
+long Data_sample(Data_T data, ssize_t offset, long n, uint64_t seed,
+  ssize_t *rows) {
+
+  assert(data && data->row_near && rows);
+
+  ssize_t len = data->st_size - offset, start, end;
+  if (n <= 0 || len <= 0) return 0;
+
+  // Rows are kept minlen/len of the time. Rows shorter than any seen
+  // so far lower minlen as they turn up.
+  ssize_t minlen = len;
+  start = offset;
+  for (int i=0; i<SAMPLE_HEAD && start < data->st_size; i++) {
+    if (data->row_near(data, start, &end) != start) break;
+    if (end - start < minlen) minlen = end - start;
+    start = end;
+  }
+
+  uint64_t state = seed ? seed : 1;
+  long got = 0;
+
+  for (long tries=0; got < n && tries < n * SAMPLE_TRIES; tries++) {
+    start = data->row_near(data, offset + next_random(&state) % len, &end);
+    if (start < offset) continue;
+
+    if (end - start < minlen) minlen = end - start;
+    double u = (next_random(&state) >> 11) * 0x1p-53;
+    if (u * (end - start) >= minlen) continue;
+
+    rows[got++] = start;
+    if (got == n) got = unique(rows, got);
+  }
+
+  return unique(rows, got);
+
+}
+
+// Row 0 is the header of data, if it has one, and row i the ith row
+// picked
+static int get_row(Data_T data, char **buf, int row, int col_start,
+  int col_end) {
+
+  sample_args args = data->args;
+  Data_T from = args->data;
+
+  if (row < 0) return E_DTA_ROW_OOB;
+  if (col_end == -1) col_end = data->ncols-1;
+  if (col_start < 0 || col_end >= data->ncols || col_end < col_start)
+    return E_DTA_COL_OOB;
+
+  if (args->headers && row == 0)
+    return from->get_row(from, buf, 0, col_start, col_end);
+  if (row >= data->nrows) return E_DTA_EOF;
+
+  int ncols = col_end - col_start + 1;
+  for (int j=0; j<ncols; j++) args->cols[j] = col_start + j;
+
+  long n;
+  from->scan_fields(from, Index_get(data->rows, row), args->cols, ncols,
+    buf, args->lens, 1, &n);
+
+  return E_OK;
+
+}
+
+static int get_col(Data_T data, char **buf, int col, int row_start,
+  int row_end) {
+
+  for (int irow=row_start, i=0; irow<=row_end; irow++, i++) {
+    int err = get_row(data, &buf[i], irow, col, col);
+    if (err != E_OK) return err;
+  }
+
+  return E_OK;
+
+}
+
+static long count_rows(Data_T data, int nthreads) {
+
+  return data->nrows;
+
+}
+
+static ssize_t resident(Data_T data) {
+
+  Data_T from = ((sample_args) data->args)->data;
+
+  return from->resident ? from->resident(from) : 0;
+
+}
+
+// The rows are read from data, which stays open for as long as they're
+// shown
+static int data_open(Data_T data) {
+
+  return E_OK;
+
+}
+
+static int data_close(Data_T data) {
+
+  return E_OK;
+
+}
+
+// Shows rows of data, which must stay open until this is freed. The
+// header of data is row 0 if there's one.
+Data_T Data_sample_init(Data_T data, int headers, const ssize_t *rows,
+  long n) {
+
+  assert(data && data->scan_fields && data->ncols > 0);
+  assert(rows || n == 0);
+
+  Data_T sample;
+  NEW0(sample);
+
+  sample->path = data->path;
+  sample->delim = data->delim;
+  sample->delimited = 0;
+  sample->quoted = data->quoted;
+  sample->st_size = data->st_size;
+  sample->ncols = data->ncols;
+  sample->nrows = n + !!headers;
+  sample->max_resident = data->max_resident;
+
+  // Where each row starts in data, which shows where it was picked
+  // from in the status line
+  sample->rows = Index_new();
+  if (headers) Index_append(sample->rows, 0);
+  for (long i=0; i<n; i++) Index_append(sample->rows, rows[i]);
+  Index_append(sample->rows, data->st_size);
+
+  sample->open = data_open;
+  sample->get_col = get_col;
+  sample->get_row = get_row;
+  sample->mvaddntok = data->mvaddntok;
+  sample->toklen = data->toklen;
+  sample->format = data->format;
+  sample->close = data_close;
+  sample->scan_rows = NULL;
+  sample->count_rows = count_rows;
+  sample->resident = resident;
+  sample->hash_rows = NULL;
+  sample->scan_fields = NULL;
+  sample->row_near = NULL;
+  sample->free = Data_sample_free;
+  sample->free_node = data->free_node;
+
+  sample_args args;
+  NEW0(args);
+  args->data = data;
+  args->headers = !!headers;
+  args->cols = CALLOC(data->ncols, sizeof(int));
+  args->lens = CALLOC(data->ncols, sizeof(int));
+
+  sample->args = args;
+
+  return sample;
+
+}
+
+void Data_sample_free(Data_T *data) {
+
+  assert(data && *data && (*data)->args);
+
+  sample_args args = (*data)->args;
+  FREE(args->cols);
+  FREE(args->lens);
+
+  Index_free(&(*data)->rows);
+  FREE((*data)->args);
+  FREE(*data);
+
+}
@@ -0,0 +1,456 @@
+//
+// -----------------------------------------------------------------------------
+// data-shards.c
+// -----------------------------------------------------------------------------
+//
+// Instance of Data_T that shows the files matching a pattern, such as
+// the part files written by Spark, as one table with the header of the
+// first. Each shard is read by an instance of the backend it was opened
+// with. Shards are counted in parallel as rows past them are asked for,
+// and the row each one starts at is kept in order, so the shard holding
+// a row is found by binary search. Shards are only mapped once a row is
+// read from them, and only so many are kept mapped.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdlib.h>     // free
+#include <string.h>     // strdup
+#include <glob.h>       // glob, globfree
+#include <stdatomic.h>  // atomic_int
+#include <pthread.h>    // pthread_create, pthread_join
+#include <sys/stat.h>   // stat
+#include <unistd.h>     // sysconf
+#include "error.h"
+#include "mem.h"        // NEW0, CALLOC, FREE
+#include "index.h"
+#include "frame.h"
+#include "errorcodes.h"
+
+// Shards mapped at once. Past this, the one read from least recently
+// is unmapped, unless it holds rows near the last one read.
+#define SHARDS_OPEN 64
+
+// Rows either side of the last one read whose shards stay mapped,
+// which covers the screen and the rows held above and below it
+#define SHARDS_KEEP 4096
+
+struct shard {
+  char *path;
+  ssize_t base;     // where it starts among the bytes of every shard
+  ssize_t size;
+  long nrows;       // rows, less its header, once it's been counted
+  Data_T data;      // while it's mapped, or NULL
+  long used;        // when a row was last read from it
+};
+
+typedef struct shards_args {
+  glob_t paths;
+  struct shard *shards;
+  int nshards;
+  long *first;      // row each counted shard starts at, and the row
+  int ncounted;     // after the last, for the shards counted so far
+  int nopen;
+  long clock;
+  long last_row;    // last row read
+  int headers;
+  char *options;
+  Data_T (*init)(const char *path, char delim, const char *options);
+} *shards_args;
+
+// An open instance of shard i, or NULL if it can't be opened, as empty
+// files can't be. Shards are opened on their own on worker threads.
+static Data_T shard_open(Data_T data, int i) {
+
+  shards_args args = data->args;
+  struct shard *shard = &args->shards[i];
+
+  Data_T d = args->init(shard->path, data->delim, args->options);
+  if (!d) return NULL;
+
+  d->max_resident = data->max_resident / SHARDS_OPEN;
+
+  char *tok;
+  if (Data_open(d) != E_OK) {
+    Data_free(&d);
+    return NULL;
+  }
+  if (d->get_row(d, &tok, 0, 0, 0) != E_OK) {
+    Data_close(d);
+    Data_free(&d);
+    return NULL;
+  }
+
+  return d;
+
+}
+
+static void shard_close(Data_T *d) {
+
+  Data_T shard = *d;
+  Data_close(shard);
+  Data_free(d);
+
+}
+
+struct count_job {
+  Data_T data;
+  atomic_int next;  // shard to count next
+  int end;
+};
+
+static void *count_shards(void *cl) {
+
+  struct count_job *job = cl;
+  shards_args args = job->data->args;
+
+  for (int i; (i = atomic_fetch_add(&job->next, 1)) < job->end; ) {
+    Data_T d = shard_open(job->data, i);
+    long n = d ? d->count_rows(d, 1) - args->headers : 0;
+    args->shards[i].nrows = n > 0 ? n : 0;
+    if (d) shard_close(&d);
+  }
+
+  return NULL;
+
+}
+
+// Counts the rows of the shards up to end, a thread to each core
+static void count(Data_T data, int end, int nthreads) {
+
+  shards_args args = data->args;
+  int n = end - args->ncounted;
+  if (n <= 0) return;
+
+  if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > n) nthreads = n;
+  if (nthreads < 1) nthreads = 1;
+
+  struct count_job job = { data, args->ncounted, end };
+  pthread_t *threads = CALLOC(nthreads, sizeof(pthread_t));
+  int *started = CALLOC(nthreads, sizeof(int));
+
+  // Count on this thread too, and alone if no others can be started
+  for (int i=1; i<nthreads; i++)
+    started[i] = !pthread_create(&threads[i], NULL, count_shards, &job);
+  count_shards(&job);
+  for (int i=1; i<nthreads; i++) if (started[i]) pthread_join(threads[i], NULL);
+
+  for (int i=args->ncounted; i<end; i++)
+    args->first[i+1] = args->first[i] + args->shards[i].nrows;
+  args->ncounted = end;
+  data->nrows = args->first[end];
+
+  FREE(threads);
+  FREE(started);
+
+}
+
+// The shard holding row, counting shards as far as it, or -1 if there
+// aren't that many rows
+static int locate(Data_T data, long row) {
+
+  shards_args args = data->args;
+  int batch = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+
+  while (args->ncounted < args->nshards && args->first[args->ncounted] <= row)
+    count(data, args->ncounted + batch < args->nshards
+      ? args->ncounted + batch : args->nshards, 0);
+
+  if (row >= args->first[args->ncounted]) return -1;
+
+  // The last shard starting at or before row, which can't be empty
+  int lo = 0, hi = args->ncounted;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (args->first[mid] <= row) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo - 1;
+
+}
+
+// Whether shard i holds rows near the last one read, or the header,
+// so its tokens may still be on screen
+static int near(shards_args args, int i) {
+
+  if (i == 0) return 1;
+  if (i >= args->ncounted) return 0;
+
+  long lo = args->last_row - SHARDS_KEEP, hi = args->last_row + SHARDS_KEEP;
+
+  return args->first[i] <= hi && args->first[i+1] > lo;
+
+}
+
+// Shard i, mapped if it isn't already, unmapping the one read from
+// least recently if too many are
+static Data_T mapped(Data_T data, int i) {
+
+  shards_args args = data->args;
+  struct shard *shard = &args->shards[i];
+  shard->used = ++args->clock;
+
+  if (shard->data) return shard->data;
+
+  if (args->nopen >= SHARDS_OPEN) {
+    int lru = -1;
+    for (int j=0; j<args->nshards; j++)
+      if (args->shards[j].data && !near(args, j)
+        && (lru < 0 || args->shards[j].used < args->shards[lru].used))
+        lru = j;
+    if (lru >= 0) {
+      shard_close(&args->shards[lru].data);
+      args->nopen--;
+    }
+  }
+
+  if ((shard->data = shard_open(data, i))) args->nopen++;
+
+  return shard->data;
+
+}
+
+static int get_row(Data_T data, char **buf, int row, int col_start,
+  int col_end) {
+
+  shards_args args = data->args;
+
+  if (row < 0) return E_DTA_ROW_OOB;
+
+  int i = args->headers && row == 0 ? 0 : locate(data, row);
+  if (i < 0) return E_DTA_EOF;
+
+  args->last_row = row;
+  Data_T shard = mapped(data, i);
+  if (!shard) return E_DTA_FILE_ERROR;
+
+  // Every shard has to have the columns of the first
+  if (data->ncols && shard->ncols != data->ncols) return E_DTA_BAD_INPUT;
+  data->ncols = shard->ncols;
+
+  long local = row == 0 && args->headers ? 0
+    : row - args->first[i] + args->headers;
+
+  return shard->get_row(shard, buf, local, col_start, col_end);
+
+}
+
+static int get_col(Data_T data, char **buf, int col, int row_start,
+  int row_end) {
+
+  for (int irow=row_start, i=0; irow<=row_end; irow++, i++) {
+    int err = get_row(data, &buf[i], irow, col, col);
+    if (err != E_OK) return err;
+  }
+
+  return E_OK;
+
+}
+
+// The rows of every shard, less the headers of all but the first
+static long count_rows(Data_T data, int nthreads) {
+
+  shards_args args = data->args;
+
+  count(data, args->nshards, nthreads);
+
+  return args->first[args->nshards];
+
+}
+
+// The shard holding byte offset of every shard laid end to end
+static int shard_at(shards_args args, ssize_t offset) {
+
+  int lo = 0, hi = args->nshards;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (args->shards[mid].base <= offset) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo - 1;
+
+}
+
+// Counts rows with the shards laid end to end, stopping at the end of
+// a shard. Each shard is opened on its own, so this can run on a
+// worker thread while rows are read.
+static ssize_t scan_rows(Data_T data, ssize_t offset, ssize_t nbytes,
+  long *nrows) {
+
+  shards_args args = data->args;
+
+  int i = shard_at(args, offset);
+  if (i < 0 || offset >= data->st_size) return data->st_size;
+
+  struct shard *shard = &args->shards[i];
+  ssize_t end = shard->base + shard->size, local = offset - shard->base;
+
+  Data_T d = shard_open(data, i);
+  if (!d || !d->scan_rows) {
+    if (d) shard_close(&d);
+    return end;
+  }
+
+  // Only the header of the first shard is a row
+  long n = 0;
+  local = d->scan_rows(d, local, nbytes, &n);
+  if (args->headers && i > 0 && offset == shard->base && n > 0) n--;
+  *nrows += n;
+
+  shard_close(&d);
+
+  return local < shard->size ? shard->base + local : end;
+
+}
+
+static ssize_t resident(Data_T data) {
+
+  shards_args args = data->args;
+  ssize_t bytes = args->nshards * (sizeof(struct shard) + sizeof(long));
+
+  for (int i=0; i<args->nshards; i++) {
+    Data_T d = args->shards[i].data;
+    if (d && d->resident) bytes += d->resident(d);
+  }
+
+  return bytes;
+
+}
+
+// Finds where each shard starts among the bytes of them all
+static int data_open(Data_T data) {
+
+  shards_args args = data->args;
+  ssize_t base = 0;
+
+  for (int i=0; i<args->nshards; i++) {
+    struct stat st;
+    if (stat(args->shards[i].path, &st) < 0) return E_DTA_FILE_ERROR;
+    args->shards[i].base = base;
+    args->shards[i].size = st.st_size;
+    base += st.st_size;
+  }
+
+  data->st_size = base;
+
+  return E_OK;
+
+}
+
+static int data_close(Data_T data) {
+
+  shards_args args = data->args;
+
+  for (int i=0; i<args->nshards; i++)
+    if (args->shards[i].data) shard_close(&args->shards[i].data);
+  args->nopen = 0;
+
+  return E_OK;
+
+}
+
+// Shows the files matching pattern, in order, as one table, each read
+// by an instance of init given delim and options. If headers is set,
+// the first row of each is a header and only the first is shown. NULL
+// if nothing matches.
+Data_T Data_shards_init(char *pattern, int headers,
+  Data_T (*init)(const char *path, char delim, const char *options),
+  char delim, const char *options) {
+
+  assert(pattern && init);
+
+  shards_args args;
+  NEW0(args);
+
+  if (glob(pattern, 0, NULL, &args->paths) != 0) {
+    FREE(args);
+    return NULL;
+  }
+
+  // Every shard is read the same way as the first
+  Data_T first = init(args->paths.gl_pathv[0], delim, options);
+  if (!first) {
+    globfree(&args->paths);
+    FREE(args);
+    return NULL;
+  }
+
+  Data_T data;
+  NEW0(data);
+
+  data->path = pattern;
+  data->delim = first->delim;
+  data->delimited = 0;
+  data->quoted = first->quoted;
+  data->rows = Index_new();
+  Index_append(data->rows, 0);
+  data->open = data_open;
+  data->get_col = get_col;
+  data->get_row = get_row;
+  data->mvaddntok = first->mvaddntok;
+  data->toklen = first->toklen;
+  data->format = first->format;
+  data->close = data_close;
+  data->scan_rows = scan_rows;
+  data->count_rows = count_rows;
+  data->resident = resident;
+  data->hash_rows = NULL;
+  data->scan_fields = NULL;
+  data->row_near = NULL;
+  data->free = Data_shards_free;
+  data->free_node = first->free_node;
+
+  Data_free(&first);
+
+  args->nshards = args->paths.gl_pathc;
+  args->shards = CALLOC(args->nshards, sizeof(struct shard));
+  for (int i=0; i<args->nshards; i++) {
+    args->shards[i].path = args->paths.gl_pathv[i];
+    args->shards[i].nrows = -1;
+  }
+  args->first = CALLOC(args->nshards + 1, sizeof(long));
+  args->first[0] = !!headers;
+  args->headers = !!headers;
+  args->options = options ? strdup(options) : NULL;
+  args->init = init;
+
+  data->nrows = args->first[0];
+  data->args = args;
+
+  return data;
+
+}
+
+void Data_shards_free(Data_T *data) {
+
+  assert(data && *data && (*data)->args);
+
+  shards_args args = (*data)->args;
+  for (int i=0; i<args->nshards; i++)
+    if (args->shards[i].data) shard_close(&args->shards[i].data);
+
+  globfree(&args->paths);
+  FREE(args->shards);
+  FREE(args->first);
+  if (args->options) free(args->options);
+
+  Index_free(&(*data)->rows);
+  FREE((*data)->args);
+  FREE(*data);
+
+}
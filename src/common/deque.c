@@ -107,7 +107,7 @@ void *Deque_addlo(D deque, void *x) {
   assert(deque);
 
   struct node *new, *head = deque->head;
-  NEW(new);
+  NEW0(new);
 
   if (head != NULL) {
     new->rlink = head;
@@ -124,7 +124,7 @@ void *Deque_addhi(D deque, void *x) {
   assert(deque);
 
   struct node *new, *tail = deque->tail;
-  NEW(new);
+  NEW0(new);
 
   if (tail != NULL) {
     new->llink = tail;
@@ -0,0 +1,353 @@
+//
+// -----------------------------------------------------------------------------
+// diff.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdint.h>   // uint64_t, uintptr_t
+#include <string.h>   // memcpy
+#include "error.h"
+#include "mem.h"
+#include "table.h"
+#include "diff.h"
+
+#define T Diff_T
+
+// Rows looked ahead on each side to find where two files line up again
+// after they differ. Larger windows find better alignments around long
+// edits at O(WINDOW^2) per edit.
+#define WINDOW 128
+
+struct side {
+  uint64_t *hashes;
+  uint64_t *keys;
+  long n;
+  long size;
+  long next;        // next row to be aligned
+  int done;
+};
+
+struct T {
+  int keyed;
+  struct side side[2];
+
+  // Aligned rows, -1 where a side has no row
+  long *a;
+  long *b;
+  long length;
+  long size;
+
+  // Aligned rows that differ, counted as they're aligned. Rows only in
+  // A are kept apart, since they don't differ until B is finished.
+  long changed;
+  long unmatched;
+
+  // Keyed diffs only: keys seen on one side and not yet the other. 
+  // A maps keys to aligned rows, B to its rows, both plus one.
+  Table_T pending[2];
+  unsigned char *matched;   // B rows that have been aligned
+  long nmatched;
+};
+
+T Diff_new(int keyed) {
+
+  T diff;
+  NEW0(diff);
+
+  diff->keyed = keyed;
+  if (keyed) {
+    diff->pending[DIFF_A] = Table_new(4096, NULL, NULL);
+    diff->pending[DIFF_B] = Table_new(4096, NULL, NULL);
+  }
+
+  return diff;
+
+}
+
+void Diff_free(T *diff) {
+
+  assert(diff && *diff);
+
+  for (int s=0; s<2; s++) {
+    if ((*diff)->side[s].hashes) FREE((*diff)->side[s].hashes);
+    if ((*diff)->side[s].keys) FREE((*diff)->side[s].keys);
+    if ((*diff)->pending[s]) Table_free(&(*diff)->pending[s]);
+  }
+
+  if ((*diff)->a) FREE((*diff)->a);
+  if ((*diff)->b) FREE((*diff)->b);
+  if ((*diff)->matched) FREE((*diff)->matched);
+  FREE(*diff);
+
+}
+
+static void emit(T diff, long a, long b) {
+
+  if (diff->length == diff->size) {
+    diff->size = diff->size ? 2 * diff->size : 1024;
+    if (diff->a) {
+      RESIZE(diff->a, diff->size * sizeof(long));
+      RESIZE(diff->b, diff->size * sizeof(long));
+    } else {
+      diff->a = CALLOC(diff->size, sizeof(long));
+      diff->b = CALLOC(diff->size, sizeof(long));
+    }
+  }
+
+  diff->a[diff->length] = a;
+  diff->b[diff->length] = b;
+  diff->length++;
+
+  if (a < 0) diff->changed++;
+  else if (b < 0) diff->unmatched++;
+  else if (diff->side[DIFF_A].hashes[a] != diff->side[DIFF_B].hashes[b])
+    diff->changed++;
+
+}
+
+// Emits the rows between two points where the files line up. Rows
+// removed from A and added to B are paired up as changes first.
+static void emit_gap(T diff, long na, long nb) {
+
+  struct side *A = &diff->side[DIFF_A], *B = &diff->side[DIFF_B];
+
+  for ( ; na > 0 && nb > 0; na--, nb--) emit(diff, A->next++, B->next++);
+  for ( ; na > 0; na--) emit(diff, A->next++, -1);
+  for ( ; nb > 0; nb--) emit(diff, -1, B->next++);
+
+}
+
+// Finds the first pair of equal rows on the longest common subsequence
+// of the windows after A->next and B->next. Returns 0 if there isn't one.
+static int resync(T diff, long wa, long wb, long *p, long *q) {
+
+  uint64_t *ha = diff->side[DIFF_A].hashes + diff->side[DIFF_A].next;
+  uint64_t *hb = diff->side[DIFF_B].hashes + diff->side[DIFF_B].next;
+
+  // L[x][y] is the length of the LCS of ha[x..wa) and hb[y..wb)
+  unsigned short (*L)[wb+1] = CALLOC(wa+1, sizeof *L);
+
+  for (long x=wa-1; x>=0; x--)
+    for (long y=wb-1; y>=0; y--)
+      L[x][y] = ha[x] == hb[y] ? L[x+1][y+1] + 1 
+        : L[x+1][y] > L[x][y+1] ? L[x+1][y] : L[x][y+1];
+
+  int found = 0;
+  if (L[0][0] > 0) {
+    long x = 0, y = 0;
+    while (ha[x] != hb[y]) {
+      if (L[x+1][y] >= L[x][y+1]) x++;
+      else y++;
+    }
+    *p = x, *q = y, found = 1;
+  }
+
+  FREE(L);
+
+  return found;
+
+}
+
+// Aligns as many rows as can be aligned with the hashes seen so far
+static void step_lcs(T diff) {
+
+  struct side *A = &diff->side[DIFF_A], *B = &diff->side[DIFF_B];
+
+  while (1) {
+
+    long na = A->n - A->next, nb = B->n - B->next;
+
+    if (na == 0 || nb == 0) {
+      // Whatever's left on one side once the other is finished
+      if (na == 0 && A->done) emit_gap(diff, 0, nb);
+      else if (nb == 0 && B->done) emit_gap(diff, na, 0);
+      return;
+    }
+
+    if (A->hashes[A->next] == B->hashes[B->next]) {
+      emit(diff, A->next++, B->next++);
+      continue;
+    }
+
+    // Wait for full windows unless the files are ending
+    if ((na < WINDOW && !A->done) || (nb < WINDOW && !B->done)) return;
+
+    long wa = na < WINDOW ? na : WINDOW;
+    long wb = nb < WINDOW ? nb : WINDOW;
+    long p, q;
+
+    if (resync(diff, wa, wb, &p, &q)) emit_gap(diff, p, q);
+    else emit_gap(diff, wa, wb);
+  }
+
+}
+
+static void *as_key(uint64_t key) {
+  return (void *) (uintptr_t) (key ? key : 1);
+}
+
+// Pairs up rows with the same key. Rows are kept in A's order, and
+// rows only in B go at the end once both sides are finished.
+static void step_keyed(T diff) {
+
+  struct side *A = &diff->side[DIFF_A], *B = &diff->side[DIFF_B];
+
+  for ( ; A->next < A->n; A->next++) {
+    void *key = as_key(A->keys[A->next]);
+    long b = (long) (uintptr_t) Table_remove(diff->pending[DIFF_B], key) - 1;
+    if (b < 0) Table_put(diff->pending[DIFF_A], key, 
+      (void *) (uintptr_t) (diff->length + 1));
+    else diff->matched[b] = 1, diff->nmatched++;
+    emit(diff, A->next, b);
+  }
+
+  for ( ; B->next < B->n; B->next++) {
+    void *key = as_key(B->keys[B->next]);
+    long i = (long) (uintptr_t) Table_remove(diff->pending[DIFF_A], key) - 1;
+    if (i < 0) {
+      Table_put(diff->pending[DIFF_B], key, (void *) (uintptr_t) (B->next + 1));
+      continue;
+    }
+    diff->b[i] = B->next;
+    diff->matched[B->next] = 1, diff->nmatched++;
+    diff->unmatched--;
+    if (A->hashes[diff->a[i]] != B->hashes[B->next]) diff->changed++;
+  }
+
+  if (A->done && B->done && diff->nmatched < B->n) {
+    for (long b=0; b<B->n; b++) if (!diff->matched[b]) emit(diff, -1, b);
+    diff->nmatched = B->n;
+  }
+
+}
+
+static void step(T diff) {
+
+  if (diff->keyed) step_keyed(diff);
+  else step_lcs(diff);
+
+}
+
+// Adds the hashes of the next n rows of a side, and their keys
+// for keyed diffs
+void Diff_add(T diff, int side, const uint64_t *hashes, const uint64_t *keys,
+  long n) {
+
+  assert(diff && (side == DIFF_A || side == DIFF_B) && hashes);
+  assert(!diff->keyed || keys);
+
+  struct side *s = &diff->side[side];
+  assert(!s->done);
+
+  if (s->n + n > s->size) {
+    long size = s->size ? s->size : 1024;
+    while (size < s->n + n) size *= 2;
+    if (s->hashes) RESIZE(s->hashes, size * sizeof(uint64_t));
+    else s->hashes = CALLOC(size, sizeof(uint64_t));
+    if (diff->keyed) {
+      if (s->keys) RESIZE(s->keys, size * sizeof(uint64_t));
+      else s->keys = CALLOC(size, sizeof(uint64_t));
+      if (side == DIFF_B) {
+        if (diff->matched) RESIZE(diff->matched, size);
+        else diff->matched = CALLOC(size, 1);
+        memset(diff->matched + s->size, 0, size - s->size);
+      }
+    }
+    s->size = size;
+  }
+
+  memcpy(s->hashes + s->n, hashes, n * sizeof(uint64_t));
+  if (diff->keyed) memcpy(s->keys + s->n, keys, n * sizeof(uint64_t));
+  s->n += n;
+
+  step(diff);
+
+}
+
+// Marks a side as having no more rows
+void Diff_done(T diff, int side) {
+
+  assert(diff && (side == DIFF_A || side == DIFF_B));
+
+  diff->side[side].done = 1;
+  step(diff);
+
+}
+
+int Diff_finished(T diff) {
+
+  assert(diff);
+  return diff->side[DIFF_A].done && diff->side[DIFF_B].done;
+
+}
+
+long Diff_length(T diff) {
+
+  assert(diff);
+  return diff->length;
+
+}
+
+// Returns the type of aligned row i and sets its row in each file,
+// or -1 where it isn't in that file
+int Diff_get(T diff, long i, long *a, long *b) {
+
+  assert(diff && a && b);
+  assert(i >= 0 && i < diff->length);
+
+  *a = diff->a[i];
+  *b = diff->b[i];
+
+  if (*a < 0) return DIFF_ADDED;
+  if (*b < 0) return diff->side[DIFF_B].done ? DIFF_DELETED : DIFF_PENDING;
+
+  return diff->side[DIFF_A].hashes[*a] == diff->side[DIFF_B].hashes[*b]
+    ? DIFF_SAME : DIFF_CHANGED;
+
+}
+
+static int differs(T diff, long i) {
+
+  long a, b;
+  int type = Diff_get(diff, i, &a, &b);
+
+  return type != DIFF_SAME && type != DIFF_PENDING;
+
+}
+
+// Returns the first aligned row past i in direction dir (1 or -1) that
+// starts a run of differences, or -1 if there isn't one
+long Diff_next(T diff, long i, int dir) {
+
+  assert(diff && (dir == 1 || dir == -1));
+
+  for (long j = i + dir; j >= 0 && j < diff->length; j += dir)
+    if (differs(diff, j) && (j == 0 || !differs(diff, j-1))) return j;
+
+  return -1;
+
+}
+
+// Number of aligned rows that differ
+long Diff_changes(T diff) {
+
+  assert(diff);
+
+  return diff->changed 
+    + (diff->side[DIFF_B].done ? diff->unmatched : 0);
+
+}
@@ -18,11 +18,16 @@
 // limitations under the License.
 //
 
-#include <string.h>   // strdup
-#include "mem.h"      // NEW0, CALLOC, FREE
+#include <stdarg.h>   // va_list
+#include <stdio.h>    // vsnprintf, snprintf
+#include <string.h>   // strdup, memcpy
+#include <time.h>     // clock_gettime
+#include "mem.h"      // NEW0, ALLOC, CALLOC, FREE
 #include "deque.h"
 #include "frame.h"
 #include "errorcodes.h"
+#include "pool.h"
+#include "trace.h"
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -30,6 +35,62 @@
 // TODO: this assumes num and denom are positive
 #define PERC(num, denom) (num)>(denom) ? 100 : (int) (100 * ((num)*1. / (denom)))
 
+// Columns kept loaded on each side of the screen. Scrolling onto one
+// only moves the screen over, and the margin is topped back up on the
+// pool while the next keys are read.
+#define MARGIN_COLS 4
+
+// Columns for one margin, fetched from the rows on screen on a worker
+// thread. They're only kept if the frame hasn't moved in the meantime.
+struct refill {
+  Data_T data;
+  int side;             // 1 for the right margin, -1 for the left
+  int first_col;        // column of the frame nearest the screen
+  int first_row;
+  long nrows;
+  ssize_t offset;       // where the first row on screen starts
+  int cols[MARGIN_COLS];  // data columns, nearest the screen first
+  int ncols;
+  char **toks;          // field j of row i in toks[i*ncols + j]
+  int *lens;
+  long n;
+  Pool_token token;
+};
+
+// Screens of rows read ahead of the screen as it scrolls. The depth
+// doubles while keys come in less than FAST_MS apart, as when one is
+// held down, and halves once they're more than SLOW_MS apart.
+#define AHEAD_MIN 1
+#define AHEAD_MAX 16
+#define FAST_MS 100
+#define SLOW_MS 1000
+
+// A row past the top or bottom of the screen, already split into the
+// fields of the loaded columns
+struct row {
+  int row;
+  ssize_t next;         // where the row after it starts, -1 if unknown
+  int ncols;
+  char *toks[];         // one per loaded column, left margin first
+};
+
+// Rows read on a worker thread for one side of the screen, in file
+// order. They're only kept if the loaded columns haven't changed.
+struct parse {
+  Data_T data;
+  int side;             // 1 for rows below the screen, -1 for above
+  int first_row;
+  long nrows;
+  int layout;           // frame->layout when they were asked for
+  int *cols;            // data columns, in the order they're loaded
+  int ncols;
+  ssize_t *offsets;     // where each row starts, then where the next does
+  char **toks;          // field j of row i in toks[i*ncols + j]
+  int *lens;
+  long n;               // rows read
+  Pool_token token;
+};
+
 struct free_col_args {
   void (*free_node)(void **node, void *args);
   void *args;
@@ -48,6 +109,364 @@ static void free_data_col(void **x, void *cl) {
 
 }
 
+static int fetch_row(Data_T data, char **buf, int row, int col_start,
+  int col_end) {
+
+  TRACE_START(start);
+  int ret = data->get_row(data, buf, row, col_start, col_end);
+  TRACE_STOP(TRACE_GET_ROW, start);
+
+  return ret;
+
+}
+
+static int fetch_col(Data_T data, char **buf, int col, int row_start,
+  int row_end) {
+
+  TRACE_START(start);
+  int ret = data->get_col(data, buf, col, row_start, row_end);
+  TRACE_STOP(TRACE_GET_COL, start);
+
+  return ret;
+
+}
+
+// Maps a column of the frame to a column of the data
+static int data_col(Frame_T frame, int icol) {
+  return frame->projection.cols ? frame->projection.cols[icol] : icol;
+}
+
+// Number of columns that can be scrolled through
+static int total_cols(Frame_T frame, Data_T data) {
+  return frame->projection.cols ? frame->projection.ncols : data->ncols;
+}
+
+// Range of data columns needed for the loaded columns, margins
+// included, so rows are only tokenized as far as they have to be
+static void loaded_data_cols(Frame_T frame, int *first, int *last) {
+
+  *first = *last = data_col(frame, frame->data_loaded.first_col);
+  for (int icol = frame->data_loaded.first_col - frame->margin.left; 
+    icol <= frame->data_loaded.last_col + frame->margin.right; icol++) {
+    *first = MIN(*first, data_col(frame, icol));
+    *last = MAX(*last, data_col(frame, icol));
+  }
+
+}
+
+static long now_ms(void) {
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+}
+
+static void free_rows(Deque_T rows, long keep, 
+  void free_node(void **node, void *args)) {
+
+  while (Deque_length(rows) > keep) {
+    struct row *row = Deque_remhi(rows);
+    for (int i=0; free_node && i<row->ncols; i++) 
+      free_node((void **) &row->toks[i], NULL);
+    FREE(row);
+  }
+
+}
+
+// Throws away the rows past the screen. They only hold the columns
+// that were loaded, so this happens whenever those change.
+static void flush_rows(Frame_T frame, void free_node(void **node, void *args)) {
+
+  free_rows(frame->buffered.above, 0, free_node);
+  free_rows(frame->buffered.below, 0, free_node);
+  frame->layout++;
+
+}
+
+static void run_refill(void *cl, Pool_token token) {
+
+  struct refill *refill = cl;
+
+  if (Pool_cancelled(token)) return;
+
+  refill->data->scan_fields(refill->data, refill->offset, refill->cols, 
+    refill->ncols, refill->toks, refill->lens, refill->nrows, &refill->n);
+
+}
+
+// Waits for the refill under way, if any, and throws it away
+static void drop(Frame_T frame) {
+
+  struct refill *refill = frame->refill;
+  if (!refill) return;
+
+  Pool_cancel(refill->token);
+  Pool_wait(frame->pool, refill->token);
+  Pool_token_free(&refill->token);
+
+  FREE(refill->toks);
+  FREE(refill->lens);
+  FREE(frame->refill);
+
+}
+
+// Adds the columns of a finished refill to its margin, as long as the
+// frame hasn't moved since it started. With wait, waits for it.
+static void collect(Frame_T frame, Data_T data, int wait) {
+
+  struct refill *refill = frame->refill;
+  if (!refill || (!wait && Pool_pending(refill->token))) return;
+
+  Pool_wait(frame->pool, refill->token);
+
+  int side = refill->side;
+  int edge = side > 0 
+    ? frame->data_loaded.last_col + frame->margin.right + 1
+    : frame->data_loaded.first_col - frame->margin.left - 1;
+
+  int current = refill->first_row == frame->data_loaded.first_row
+    && refill->first_col == edge && refill->n == refill->nrows
+    && refill->nrows == frame->nrows - !!frame->headers;
+
+  if (current) flush_rows(frame, data->free_node);
+
+  for (int j=0; current && j<refill->ncols; j++) {
+    char *header = NULL;
+    if (frame->headers 
+      && fetch_col(data, &header, refill->cols[j], 0, 0) != E_OK) break;
+
+    Deque_T col = Deque_new();
+    for (long i=0; i<refill->nrows; i++)
+      Deque_addhi(col, refill->toks[i * refill->ncols + j]);
+
+    if (side > 0) {
+      Deque_addhi(frame->data, col);
+      if (frame->headers) Deque_addhi(frame->headers, header);
+      frame->margin.right++;
+    } else {
+      Deque_addlo(frame->data, col);
+      if (frame->headers) Deque_addlo(frame->headers, header);
+      frame->margin.left++;
+    }
+  }
+
+  drop(frame);
+
+}
+
+// Starts filling whichever margin is short, the right one first. Scans
+// with a memory budget drop what they've read, which here is what's on
+// screen, so margins are then only filled as they're scrolled onto.
+static void prefetch(Frame_T frame, Data_T data) {
+
+  if (!frame->pool || frame->refill || !data->scan_fields 
+    || data->max_resident) return;
+
+  long nrows = frame->nrows - !!frame->headers;
+  if (nrows <= 0) return;
+
+  int total = total_cols(frame, data);
+  int right = frame->data_loaded.last_col + frame->margin.right + 1;
+  int left = frame->data_loaded.first_col - frame->margin.left - 1;
+  int side, edge, ncols;
+
+  if (frame->margin.right < MARGIN_COLS && right < total) {
+    side = 1, edge = right;
+    ncols = MIN(MARGIN_COLS - frame->margin.right, total - right);
+  } else if (frame->margin.left < MARGIN_COLS && left >= 0) {
+    side = -1, edge = left;
+    ncols = MIN(MARGIN_COLS - frame->margin.left, left + 1);
+  } else return;
+
+  struct refill *refill;
+  NEW0(refill);
+  refill->data = data;
+  refill->side = side;
+  refill->first_col = edge;
+  refill->first_row = frame->data_loaded.first_row;
+  refill->nrows = nrows;
+  refill->offset = Index_get(data->rows, refill->first_row);
+  refill->ncols = ncols;
+  for (int j=0; j<ncols; j++) refill->cols[j] = data_col(frame, edge + side*j);
+  refill->toks = CALLOC(nrows * ncols, sizeof(char *));
+  refill->lens = CALLOC(nrows * ncols, sizeof(int));
+  refill->token = Pool_token_new();
+
+  frame->refill = refill;
+  Pool_submit(frame->pool, POOL_HIGH, refill->token, run_refill, refill);
+
+}
+
+static void run_parse(void *cl, Pool_token token) {
+
+  struct parse *parse = cl;
+  Data_T data = parse->data;
+
+  for (parse->n = 0; parse->n < parse->nrows; parse->n++) {
+    ssize_t offset = parse->offsets[parse->n];
+    if (offset >= data->st_size || Pool_cancelled(token)) break;
+
+    long n;
+    parse->offsets[parse->n + 1] = data->scan_fields(data, offset, 
+      parse->cols, parse->ncols, parse->toks + parse->n * parse->ncols, 
+      parse->lens + parse->n * parse->ncols, 1, &n);
+  }
+
+}
+
+// Waits for the rows being read ahead, if any, and throws them away
+static void discard(Frame_T frame) {
+
+  struct parse *parse = frame->parse;
+  if (!parse) return;
+
+  Pool_cancel(parse->token);
+  Pool_wait(frame->pool, parse->token);
+  Pool_token_free(&parse->token);
+
+  FREE(parse->cols);
+  FREE(parse->offsets);
+  FREE(parse->toks);
+  FREE(parse->lens);
+  FREE(frame->parse);
+
+}
+
+// Adds the rows read ahead to their side of the screen once they're
+// read, skipping any that were fetched in the meantime
+static void gather(Frame_T frame) {
+
+  struct parse *parse = frame->parse;
+  if (!parse || Pool_pending(parse->token)) return;
+
+  if (parse->layout == frame->layout) {
+    Deque_T rows = parse->side > 0 
+      ? frame->buffered.below : frame->buffered.above;
+    long have = Deque_length(rows);
+    struct row *far = have ? Deque_get(rows, have-1) : NULL;
+    int next = far ? far->row + parse->side : parse->side > 0 
+      ? frame->data_loaded.last_row + 1 : frame->data_loaded.first_row - 1;
+
+    for (long k = next - parse->first_row; k >= 0 && k < parse->n; 
+      k += parse->side) {
+      struct row *row = ALLOC(sizeof *row + parse->ncols * sizeof(char *));
+      row->row = parse->first_row + k;
+      row->next = parse->offsets[k+1];
+      row->ncols = parse->ncols;
+      memcpy(row->toks, parse->toks + k * parse->ncols, 
+        parse->ncols * sizeof(char *));
+      Deque_addhi(rows, row);
+    }
+  }
+
+  discard(frame);
+
+}
+
+// Starts reading rows past the screen in the way it last scrolled,
+// once fewer than half the rows wanted are left
+static void parse_ahead(Frame_T frame, Data_T data) {
+
+  if (!frame->pool || frame->parse || !data->scan_fields 
+    || data->max_resident) return;
+
+  int side = frame->buffered.dir < 0 ? -1 : 1;
+  Deque_T rows = side > 0 ? frame->buffered.below : frame->buffered.above;
+  long screen = frame->nrows - !!frame->headers;
+  long want = frame->buffered.depth * screen, have = Deque_length(rows);
+  if (screen <= 0 || have > want / 2) return;
+
+  struct row *far = have ? Deque_get(rows, have-1) : NULL;
+  int next = far ? far->row + side : side > 0 
+    ? frame->data_loaded.last_row + 1 : frame->data_loaded.first_row - 1;
+  long nrows = want - have;
+  int first_row;
+  ssize_t offset;
+
+  if (side > 0) {
+    first_row = next;
+    if (far && far->next >= 0) offset = far->next;
+    else if (Index_length(data->rows) > next) 
+      offset = Index_get(data->rows, next);
+    else return;
+  } else {
+    // Rows above the screen have been seen, so they're in the index
+    if (next < !!frame->headers) return;
+    first_row = MAX(!!frame->headers, next - nrows + 1);
+    nrows = next - first_row + 1;
+    offset = Index_get(data->rows, first_row);
+  }
+
+  if (offset >= data->st_size) return;
+
+  struct parse *parse;
+  NEW0(parse);
+  parse->data = data;
+  parse->side = side;
+  parse->first_row = first_row;
+  parse->nrows = nrows;
+  parse->layout = frame->layout;
+  parse->ncols = Deque_length(frame->data);
+  parse->cols = CALLOC(parse->ncols, sizeof(int));
+  for (int i=0; i<parse->ncols; i++)
+    parse->cols[i] = data_col(frame, 
+      frame->data_loaded.first_col - frame->margin.left + i);
+  parse->offsets = CALLOC(nrows + 1, sizeof(ssize_t));
+  parse->offsets[0] = offset;
+  parse->toks = CALLOC(nrows * parse->ncols, sizeof(char *));
+  parse->lens = CALLOC(nrows * parse->ncols, sizeof(int));
+  parse->token = Pool_token_new();
+
+  frame->parse = parse;
+  Pool_submit(frame->pool, POOL_HIGH, parse->token, run_parse, parse);
+
+}
+
+// Reads further ahead the faster the screen scrolls
+static void pace(Frame_T frame, int n) {
+
+  long now = now_ms(), gap = now - frame->buffered.scrolled;
+
+  if (gap < FAST_MS) 
+    frame->buffered.depth = MIN(frame->buffered.depth * 2, AHEAD_MAX);
+  else if (gap > SLOW_MS) 
+    frame->buffered.depth = MAX(frame->buffered.depth / 2, AHEAD_MIN);
+
+  frame->buffered.dir = n;
+  frame->buffered.scrolled = now;
+
+}
+
+// The row past side n of the screen, if it's been read. Rows read
+// ahead aren't in the index yet, so they're added as get_row would,
+// or by get_row itself if their fields need counting.
+static struct row *take(Frame_T frame, Data_T data, int n, int row_ind) {
+
+  Deque_T rows = n > 0 ? frame->buffered.below : frame->buffered.above;
+  if (Deque_length(rows) == 0) return NULL;
+
+  struct row *row = Deque_get(rows, 0);
+  if (row->row != row_ind || row->ncols != Deque_length(frame->data)) {
+    flush_rows(frame, data->free_node);
+    return NULL;
+  }
+
+  Deque_remlo(rows);
+  if (row->next >= 0 && Index_length(data->rows) == row->row + 1) {
+    char *tok;
+    if (data->ragged) fetch_row(data, &tok, row->row, 0, 0);
+    else {
+      Index_append(data->rows, row->next);
+      data->nrows++;
+    }
+  }
+
+  return row;
+
+}
+
 Frame_T Frame_init(int col_width, int max_cols, int max_rows, int headers) {
 
   Frame_T frame;
@@ -60,6 +479,9 @@ Frame_T Frame_init(int col_width, int max_cols, int max_rows, int headers) {
   frame->max_rows = max_rows;
   frame->headers = headers ? Deque_new() : NULL;
   frame->data = Deque_new();
+  frame->buffered.above = Deque_new();
+  frame->buffered.below = Deque_new();
+  frame->buffered.depth = AHEAD_MIN;
 
   return frame;
 
@@ -70,6 +492,12 @@ void Frame_free(Frame_T *frame, void free_node(void **node, void *args),
 
   assert(frame && *frame && (*frame)->data);
 
+  drop(*frame);
+  discard(*frame);
+  flush_rows(*frame, free_node);
+  Deque_free(&(*frame)->buffered.above);
+  Deque_free(&(*frame)->buffered.below);
+
   if ((*frame)->headers) Deque_free(&(*frame)->headers);
 
   struct free_col_args free_col_args = { NULL, NULL };
@@ -84,58 +512,258 @@ void Frame_free(Frame_T *frame, void free_node(void **node, void *args),
 
   Deque_free(&(*frame)->data);
 
+  if ((*frame)->projection.cols) FREE((*frame)->projection.cols);
+  if ((*frame)->row_buf.toks) FREE((*frame)->row_buf.toks);
   FREE(*frame);
   
 }
 
-int Frame_load(Frame_T frame, Data_T data) {
+// Loads the rows starting at first_row, which must be past the header,
+// and the columns starting at first_col
+static int load(Frame_T frame, Data_T data, int first_row, int first_col) {
 
   Deque_T col = NULL;
+  char *tok;
   int ret; 
-  char *buf[MAX_COLS] = { 0 };
+  int headers = !!frame->headers;
 
   // TODO: return appropriate error code
-  // Load first row, which may be header
-  if ((ret = data->get_row(data, buf, 0, 0, frame->max_cols-1)) != E_OK) 
-    return E_DTA_PARSE_ERROR;
+  // The first time through, reading the first row tells us
+  // how many columns there are
+  if (fetch_row(data, &tok, 0, 0, 0) != E_OK) return E_DTA_PARSE_ERROR;
+
+  if (frame->projection.cols) {
+    for (int i=0; i<frame->projection.ncols; i++)
+      if (frame->projection.cols[i] >= data->ncols) return E_DTA_COL_OOB;
+  }
+
+  int total = total_cols(frame, data);
+  frame->ncols = MIN(total, frame->max_cols);
+  frame->data_loaded.first_col = MAX(0, MIN(first_col, total - frame->ncols));
+  frame->data_loaded.last_col = frame->data_loaded.first_col + frame->ncols - 1;
 
-  frame->ncols = MIN(data->ncols, frame->max_cols);
+  int first, last;
+  loaded_data_cols(frame, &first, &last);
+  char **buf = CALLOC(last - first + 1, sizeof(char *));
+
+  // Load header
+  if (headers && fetch_row(data, buf, 0, first, last) != E_OK) {
+    FREE(buf);
+    return E_DTA_PARSE_ERROR;
+  }
 
   for (int icol = 0; icol<frame->ncols; icol++) {
     col = Deque_new();
     Deque_addhi(frame->data, col);
-    if (frame->headers) Deque_addhi(frame->headers, buf[icol]);
-    else Deque_addhi(col, buf[icol]);
+    if (headers) Deque_addhi(frame->headers, 
+      buf[data_col(frame, frame->data_loaded.first_col + icol) - first]);
   }
 
-  frame->nrows++;
+  int irow = first_row;
+  frame->nrows = headers;
 
-  // Load remaining rows
-  for (int irow=1; irow < frame->max_rows ; irow++) {
+  for ( ; frame->nrows < frame->max_rows; irow++) {
 
-    ret = data->get_row(data, buf, irow, 0, frame->ncols-1);
+    ret = fetch_row(data, buf, irow, first, last);
     if (ret == E_DTA_EOF) break;
-    else if (ret != E_OK) return E_DTA_PARSE_ERROR;
+    else if (ret != E_OK) {
+      FREE(buf);
+      return E_DTA_PARSE_ERROR;
+    }
 
     for (int icol = 0; icol < frame->ncols; icol++) {
       col = Deque_get(frame->data, icol);
-      Deque_addhi(col, buf[icol]);
+      Deque_addhi(col, 
+        buf[data_col(frame, frame->data_loaded.first_col + icol) - first]);
     }
 
     frame->nrows++;
   }
 
-  frame->data_loaded.first_row = !!frame->headers;
-  frame->data_loaded.last_col = frame->ncols - 1;
-  frame->data_loaded.last_row = data->nrows - 1;
+  FREE(buf);
+
+  frame->data_loaded.first_row = first_row;
+  frame->data_loaded.last_row = irow - 1;
+
+  prefetch(frame, data);
+  parse_ahead(frame, data);
 
   return E_OK;
 
 }
 
-int Frame_print(Frame_T frame, Data_T data, int action) {
+int Frame_load(Frame_T frame, Data_T data) {
 
-  assert(frame && Deque_length(frame->data));
+  assert(frame && data);
+
+  return load(frame, data, !!frame->headers, 0);
+
+}
+
+static void unload(Frame_T frame, Data_T data) {
+
+  struct free_col_args free_col_args = { data->free_node, NULL };
+
+  drop(frame);
+  flush_rows(frame, data->free_node);
+  frame->margin.left = frame->margin.right = 0;
+
+  while (Deque_length(frame->data) > 0) {
+    Deque_T col = Deque_remhi(frame->data);
+    free_data_col((void **) &col, &free_col_args);
+  }
+
+  if (frame->headers)
+    while (Deque_length(frame->headers) > 0) Deque_remhi(frame->headers);
+
+}
+
+// Shows only cols, in the order given, in place of every column.
+// Passing NULL shows every column again. The frame keeps its rows
+// and is reloaded if it was already loaded.
+int Frame_project(Frame_T frame, Data_T data, int *cols, int ncols) {
+
+  assert(frame && data);
+  assert(!cols || ncols > 0);
+
+  for (int i=0; cols && data->ncols && i<ncols; i++)
+    if (cols[i] < 0 || cols[i] >= data->ncols) return E_DTA_COL_OOB;
+
+  int *copy = NULL;
+  if (cols) {
+    copy = CALLOC(ncols, sizeof(int));
+    memcpy(copy, cols, ncols * sizeof(int));
+  }
+
+  if (frame->projection.cols) FREE(frame->projection.cols);
+  frame->projection.cols = copy;
+  frame->projection.ncols = cols ? ncols : 0;
+
+  if (Deque_length(frame->data) == 0) return E_OK;
+
+  int first_row = frame->data_loaded.first_row;
+  unload(frame, data);
+  frame->cursor.col = 0;
+
+  return load(frame, data, first_row, 0);
+
+}
+
+// Moves the cursor to column icol of the frame, which is a column of
+// the projection if there is one. Columns are reloaded around it if
+// it isn't already on screen.
+int Frame_goto_col(Frame_T frame, Data_T data, int icol) {
+
+  assert(frame && data);
+
+  if (icol < 0 || icol >= total_cols(frame, data)) return E_DTA_COL_OOB;
+
+  if (icol < frame->data_loaded.first_col 
+    || icol > frame->data_loaded.last_col) {
+    int first_row = frame->data_loaded.first_row;
+    unload(frame, data);
+    int ret = load(frame, data, first_row, icol);
+    if (ret != E_OK) return ret;
+  }
+
+  frame->cursor.col = (icol - frame->data_loaded.first_col) * frame->col_width;
+
+  return E_OK;
+
+}
+
+// Moves the cursor to row, reloading the screen from it if it isn't
+// already on screen
+int Frame_goto_row(Frame_T frame, Data_T data, int row) {
+
+  assert(frame && data);
+
+  int headers = !!frame->headers;
+  if (row < headers) return E_DTA_ROW_OOB;
+
+  if (row < frame->data_loaded.first_row 
+    || row > frame->data_loaded.last_row) {
+    int first_col = frame->data_loaded.first_col;
+    unload(frame, data);
+    int ret = load(frame, data, row, first_col);
+    if (ret != E_OK) return ret;
+  }
+
+  frame->cursor.row = row - frame->data_loaded.first_row + headers;
+
+  return E_OK;
+
+}
+
+// Moves the cursor to the next row without as many fields as the
+// first, after the cursor if dir is 1 and before it if dir is -1. Rows
+// are marked as they're indexed, so only rows past the index are read.
+int Frame_goto_ragged(Frame_T frame, Data_T data, int dir) {
+
+  assert(frame && data);
+  assert(dir == 1 || dir == -1);
+
+  if (!data->ragged) return E_DTA_BAD_INPUT;
+
+  int headers = !!frame->headers;
+  int cur = frame->data_loaded.first_row + frame->cursor.row - headers;
+  long row = Index_next_mark(data->rows, cur, dir);
+
+  char *tok;
+  for (long irow = Index_length(data->rows) - 1; 
+    row < 0 && dir == 1; irow++) {
+    if (fetch_row(data, &tok, irow, 0, 0) != E_OK) return E_DTA_EOF;
+    if (irow > cur && Index_fields(data->rows, irow) >= 0) row = irow;
+  }
+
+  if (row < headers) return E_DTA_EOF;
+
+  return Frame_goto_row(frame, data, row);
+
+}
+
+// Fills the margins and reads rows past the screen on pool's threads,
+// ahead of the cursor, rather than as they're scrolled onto. Passing
+// NULL waits for any reads under way and stops.
+void Frame_prefetch(Frame_T frame, Data_T data, Pool_T pool) {
+
+  assert(frame && data);
+
+  drop(frame);
+  discard(frame);
+  frame->pool = pool;
+
+  if (Deque_length(frame->data) > 0) {
+    prefetch(frame, data);
+    parse_ahead(frame, data);
+  }
+
+}
+
+// Formats a byte count like 512M or 1.5G
+static void human_size(char *buf, size_t size, ssize_t n) {
+
+  const char *units = "BKMGTP";
+  double x = n;
+
+  while (x >= 1024 && units[1]) x /= 1024, units++;
+  snprintf(buf, size, x < 10 && *units != 'B' ? "%.1f%c" : "%.0f%c", 
+    x, *units);
+
+}
+
+// Number of fields of the row on line y of the screen if it doesn't
+// have as many as the first, or -1
+static int ragged(Frame_T frame, Data_T data, int y) {
+
+  int headers = !!frame->headers;
+  if (y < headers || y >= frame->nrows) return -1;
+
+  return Index_fields(data->rows, frame->data_loaded.first_row + y - headers);
+
+}
+
+static int print(Frame_T frame, Data_T data, int action) {
   
   // TODO: error checks for data
 
@@ -159,17 +787,19 @@ int Frame_print(Frame_T frame, Data_T data, int action) {
       if (frame->headers) {
 
         if (data->mvaddntok) 
-          data->mvaddntok(0, text_start, Deque_get(frame->headers, icol),
+          data->mvaddntok(0, text_start, 
+            Deque_get(frame->headers, frame->margin.left + icol),
             text_width, data->delim); // TODO: this should be args
         else 
-          mvaddnstr(0, text_start, Deque_get(frame->headers, icol), text_width);
+          mvaddnstr(0, text_start, 
+            Deque_get(frame->headers, frame->margin.left + icol), text_width);
 
         if (icol < frame->ncols-1)
           mvaddstr(0, (icol+1)*frame->col_width-1, "|");
       }
       
       // Print data
-      Deque_T col = Deque_get(frame->data, icol);
+      Deque_T col = Deque_get(frame->data, frame->margin.left + icol);
 
       for (int irow=0, n=0; irow < (frame->nrows - headers); irow++, n++) {
 
@@ -184,30 +814,70 @@ int Frame_print(Frame_T frame, Data_T data, int action) {
       }
     }
 
+    // Rows with more fields than the first are underlined
+    for (int y=headers; y<frame->nrows; y++)
+      if (ragged(frame, data, y) > data->ncols)
+        mvchgat(y, 0, frame->ncols * frame->col_width - 1, A_UNDERLINE, 0, 
+          NULL);
+
   } 
 
   if (action & O_FRM_CURS) {
-    chgat(frame->col_width-1, A_NORMAL, 0, NULL);
+    int y = getcury(stdscr);
+    chgat(frame->col_width-1, 
+      ragged(frame, data, y) > data->ncols ? A_UNDERLINE : A_NORMAL, 0, NULL);
   }
 
   int cur_row_ind = frame->cursor.row + frame->data_loaded.first_row + 
     !frame->headers - 1;
 
+  // Print status message
+  move(LINES-1, 0);
+  clrtoeol();
+  // The row under the cursor is described if it's ragged and there's
+  // nothing else to say
+  char *status = frame->status, ragged_buf[64];
+  int nfields = ragged(frame, data, frame->cursor.row);
+  if (!status[0] && nfields >= 0) {
+    snprintf(ragged_buf, sizeof ragged_buf, "Row has %d field%s, not %d", 
+      nfields, nfields == 1 ? "" : "s", data->ncols);
+    status = ragged_buf;
+  }
+  mvaddnstr(LINES-1, 0, status, 
+    MAX(COLS - (data->max_resident ? 34 : 20), 0));
+
   // Print cursor coordinates
-  char loc_buf[MAX_ROWS + MAX_COLS + 2] = { 0 };
+  char loc_buf[32] = { 0 };
   sprintf(loc_buf, "%d,%d", 
     cur_row_ind + 1,
-    (frame->cursor.col/frame->col_width) + frame->data_loaded.first_col + 1
+    data_col(frame, 
+      frame->cursor.col/frame->col_width + frame->data_loaded.first_col) + 1
   );
   mvaddnstr(LINES-1, COLS - 18, loc_buf, 10); // TODO: make this limit dynamic
 
-  // Print percentage read
-  char perc_buf[4] = { 0 };
-  sprintf(perc_buf, "%2d%%", PERC(data->row_offsets[cur_row_ind], data->st_size));
+  // Print memory held against the budget
+  if (data->max_resident && data->resident) {
+    char used[8], budget[8], mem_buf[16];
+    human_size(used, sizeof used, data->resident(data));
+    human_size(budget, sizeof budget, data->max_resident);
+    snprintf(mem_buf, sizeof mem_buf, "%s/%s", used, budget);
+    mvaddnstr(LINES-1, COLS - 32, mem_buf, 13);
+  }
+
+  // Print percentage read, by rows where they aren't in the index
+  Index_T rows = data->rows;
+  long nindexed = Index_length(rows);
+  ssize_t offset = cur_row_ind < nindexed ? Index_get(rows, cur_row_ind) 
+    : cur_row_ind < data->nrows ? cur_row_ind : 0;
+  ssize_t total = cur_row_ind < nindexed ? data->st_size : data->nrows;
+
+  char perc_buf[5] = { 0 };
+  sprintf(perc_buf, "%2d%%", PERC(offset, total));
 
   char *str;
-  if (data->row_offsets[cur_row_ind] == 0) str = "Top";
-  else if (data->row_offsets[cur_row_ind+1] == data->st_size) str = "Bot";
+  if (offset == 0) str = "Top";
+  else if (cur_row_ind+1 < nindexed 
+    && Index_get(rows, cur_row_ind+1) == data->st_size) str = "Bot";
   else str = perc_buf;
 
   mvaddnstr(LINES-1, COLS - 4, str, 3);
@@ -222,96 +892,318 @@ int Frame_print(Frame_T frame, Data_T data, int action) {
 
 }
 
-int Frame_shift_row(Frame_T frame, Data_T data, int n) {
-  
-  void *(*pop)(Deque_T deque);
-  void *(*push)(Deque_T deque, void *x);
-  int new_row_ind;
-
-  if (n == 1) { // add row on bottom (scroll down)
-    new_row_ind = frame->data_loaded.last_row + 1;
-    pop = Deque_remlo;
-    push = Deque_addhi;
-  } else if (n == -1) { // add row on top (scroll up)
-    new_row_ind = frame->data_loaded.first_row - 1;
-    pop = Deque_remhi;
-    push = Deque_addlo;
-  } else return E_DTA_BAD_INPUT;
-
-  if (new_row_ind+1 == MAX_ROWS) return E_DTA_MAX_ROWS;
-
-  char *buf[frame->ncols];
-
-  int ret = data->get_row(data, buf, new_row_ind, 0, frame->ncols-1);
-  if (ret == E_DTA_EOF) return E_DTA_EOF;
-  if (ret != E_OK) return E_DTA_PARSE_ERROR;
+int Frame_print(Frame_T frame, Data_T data, int action) {
+
+  assert(frame && Deque_length(frame->data));
+
+  TRACE_START(start);
+  int ret = print(frame, data, action);
+  TRACE_STOP(TRACE_PRINT, start);
+
+  return ret;
 
-  int icol = frame->data_loaded.first_col, i = 0;
-  while (icol <= frame->data_loaded.last_col) {
+}
+
+// Messages are shown in the bottom-left of the screen
+// the next time the frame is printed
+void Frame_status(Frame_T frame, const char *fmt, ...) {
+
+  assert(frame && fmt);
+
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(frame->status, sizeof frame->status, fmt, ap);
+  va_end(ap);
+
+}
+
+// Reads the row past side n of the screen, 1 for the bottom and -1 for
+// the top, unless it's been read ahead, and adds it to the screen
+static int add_row(Frame_T frame, Data_T data, int n) {
+
+  int row_ind = n == 1 
+    ? frame->data_loaded.last_row + 1 : frame->data_loaded.first_row - 1;
+
+  // Projections can span millions of columns, so the row's tokens
+  // aren't kept on the stack
+  int first, last;
+  loaded_data_cols(frame, &first, &last);
+  if (frame->row_buf.size < last - first + 1) {
+    if (frame->row_buf.toks) FREE(frame->row_buf.toks);
+    frame->row_buf.size = last - first + 1;
+    frame->row_buf.toks = CALLOC(frame->row_buf.size, sizeof(char *));
+  }
+  char **buf = frame->row_buf.toks;
+
+  struct row *ahead = take(frame, data, n, row_ind);
+  if (!ahead) {
+    int ret = fetch_row(data, buf, row_ind, first, last);
+    if (ret == E_DTA_EOF) return E_DTA_EOF;
+    if (ret != E_OK) return E_DTA_PARSE_ERROR;
+  }
+
+  // The margins hold the row too
+  int icol = frame->data_loaded.first_col - frame->margin.left, i = 0;
+  while (icol <= frame->data_loaded.last_col + frame->margin.right) {
     Deque_T col = Deque_get(frame->data, i);
-    pop(col);
-    push(col, buf[i]);
+    void *tok = ahead ? ahead->toks[i] : buf[data_col(frame, icol) - first];
+    if (n == 1) Deque_addhi(col, tok);
+    else Deque_addlo(col, tok);
     icol++, i++;
   }
 
-  frame->data_loaded.first_row += n;
-  frame->data_loaded.last_row += n;
-  
+  if (ahead) FREE(ahead);
+
+  if (n == 1) frame->data_loaded.last_row++;
+  else frame->data_loaded.first_row--;
+  frame->nrows++;
+
   return E_OK;
 
 }
 
-int Frame_shift_col(Frame_T frame, Data_T data, int n) {
+// Takes the row on side n off the screen, keeping it for scrolling back
+static void remove_row(Frame_T frame, Data_T data, int n) {
+
+  int nloaded = Deque_length(frame->data);
+  struct row *gone = ALLOC(sizeof *gone + nloaded * sizeof(char *));
+  gone->row = n == 1 
+    ? frame->data_loaded.last_row : frame->data_loaded.first_row;
+  gone->next = Index_length(data->rows) > gone->row + 1 
+    ? Index_get(data->rows, gone->row + 1) : -1;
+  gone->ncols = nloaded;
+
+  for (int i=0; i<nloaded; i++) {
+    Deque_T col = Deque_get(frame->data, i);
+    gone->toks[i] = n == 1 ? Deque_remhi(col) : Deque_remlo(col);
+  }
+
+  Deque_addlo(n == 1 ? frame->buffered.below : frame->buffered.above, gone);
+
+  if (n == 1) frame->data_loaded.last_row--;
+  else frame->data_loaded.first_row++;
+  frame->nrows--;
+
+}
+
+static int shift_row(Frame_T frame, Data_T data, int n) {
+
+  if (n != 1 && n != -1) return E_DTA_BAD_INPUT;
+
+  pace(frame, n);
+  gather(frame);
+
+  int ret = add_row(frame, data, n);
+  if (ret != E_OK) return ret;
+  remove_row(frame, data, -n);
+
+  long keep = AHEAD_MAX * (frame->nrows - !!frame->headers);
+  free_rows(frame->buffered.above, keep, data->free_node);
+  free_rows(frame->buffered.below, keep, data->free_node);
+
+  collect(frame, data, 0);
+  prefetch(frame, data);
+  parse_ahead(frame, data);
   
-  void *(*pop)(Deque_T deque);
-  void *(*push)(Deque_T deque, void *x);
-  int new_col_ind;
-
-  if (n == 1) {           // add col to the right
-    new_col_ind = frame->data_loaded.last_col + 1;
-    pop = Deque_remlo;
-    push = Deque_addhi;
-  } else if (n == -1) {   // add col to the left
-    new_col_ind = frame->data_loaded.first_col - 1;
-    pop = Deque_remhi;
-    push = Deque_addlo;
-  } else return E_DTA_BAD_INPUT;
-
-  if (new_col_ind >= data->ncols) return E_DTA_COL_OOB;
+  return E_OK;
+
+}
+
+// Reads the column past the margin on side n now, rather than waiting
+// for it to be filled
+static int extend(Frame_T frame, Data_T data, int n) {
+
+  void *(*push)(Deque_T deque, void *x) = n == 1 ? Deque_addhi : Deque_addlo;
+  int new_col_ind = n == 1 
+    ? frame->data_loaded.last_col + frame->margin.right + 1
+    : frame->data_loaded.first_col - frame->margin.left - 1;
 
   // Get new values from data
   char *header_buf = NULL;
   char *data_buf[frame->nrows];
 
   // Load data
+  int data_col_ind = data_col(frame, new_col_ind);
   if (frame->headers) {
-    if (data->get_col(data, &header_buf, new_col_ind, 0, 0) != E_OK)
+    if (fetch_col(data, &header_buf, data_col_ind, 0, 0) != E_OK)
       return E_DTA_PARSE_ERROR;
   }
 
-  int ret = data->get_col(data, data_buf, new_col_ind, 
+  int ret = fetch_col(data, data_buf, data_col_ind, 
     frame->data_loaded.first_row, frame->data_loaded.last_row);
 
   if (ret != E_OK) return E_DTA_PARSE_ERROR;
 
   // Update frame
-  if (frame->headers) {
-    pop(frame->headers);
-    push(frame->headers, header_buf);
-  }
-
-  Deque_T col = pop(frame->data);
-  Deque_free(&col);
+  flush_rows(frame, data->free_node);
+  if (frame->headers) push(frame->headers, header_buf);
 
-  col = Deque_new();
+  Deque_T col = Deque_new();
   push(frame->data, col);
 
   for (int i = 0; i<(frame->nrows - !!frame->headers); i++)
     Deque_addhi(col, data_buf[i]);
 
+  if (n == 1) frame->margin.right++;
+  else frame->margin.left++;
+
+  return E_OK;
+
+}
+
+// Drops the columns more than MARGIN_COLS past either side of the screen
+static void trim(Frame_T frame, Data_T data) {
+
+  struct free_col_args free_col_args = { data->free_node, NULL };
+  Deque_T col;
+
+  if (frame->margin.left > MARGIN_COLS || frame->margin.right > MARGIN_COLS)
+    flush_rows(frame, data->free_node);
+
+  for ( ; frame->margin.left > MARGIN_COLS; frame->margin.left--) {
+    col = Deque_remlo(frame->data);
+    free_data_col((void **) &col, &free_col_args);
+    if (frame->headers) Deque_remlo(frame->headers);
+  }
+
+  for ( ; frame->margin.right > MARGIN_COLS; frame->margin.right--) {
+    col = Deque_remhi(frame->data);
+    free_data_col((void **) &col, &free_col_args);
+    if (frame->headers) Deque_remhi(frame->headers);
+  }
+
+}
+
+static int shift_col(Frame_T frame, Data_T data, int n) {
+
+  if (n != 1 && n != -1) return E_DTA_BAD_INPUT;
+
+  int new_col_ind = n == 1 
+    ? frame->data_loaded.last_col + 1 
+    : frame->data_loaded.first_col - 1;
+
+  if (new_col_ind < 0 || new_col_ind >= total_cols(frame, data)) 
+    return E_DTA_COL_OOB;
+
+  // The column is read now only if it isn't in the margin and isn't
+  // about to be
+  int *margin = n == 1 ? &frame->margin.right : &frame->margin.left;
+  collect(frame, data, *margin == 0);
+  if (*margin == 0) {
+    int ret = extend(frame, data, n);
+    if (ret != E_OK) return ret;
+  }
+
+  // Otherwise the screen just moves over
   frame->data_loaded.first_col += n;
   frame->data_loaded.last_col += n;
+  frame->margin.left += n;
+  frame->margin.right -= n;
+
+  trim(frame, data);
+  prefetch(frame, data);
+
+  return E_OK;
+
+}
+
+// Fits the frame to max_cols columns and max_rows rows, counting the
+// header. The rows and columns loaded are kept and only those newly on
+// screen are read, from the margins and the rows read ahead where they
+// can be. The cursor stays on the same cell, which is kept on screen by
+// taking rows and columns from the far side of it.
+int Frame_resize(Frame_T frame, Data_T data, int max_cols, int max_rows) {
+
+  assert(frame && data);
+
+  if (max_cols < 1 || max_rows < 1) return E_DTA_BAD_INPUT;
+
+  int headers = !!frame->headers;
+  frame->max_cols = max_cols;
+  frame->max_rows = MAX(max_rows, headers + 1);
+
+  if (Deque_length(frame->data) == 0) return E_OK;
+
+  // Margins being filled are for the old rows
+  collect(frame, data, 0);
+  drop(frame);
+  gather(frame);
+
+  // Rows
+  while (frame->nrows > frame->max_rows) 
+    if (frame->cursor.row < frame->nrows - 1) remove_row(frame, data, 1);
+    else {
+      remove_row(frame, data, -1);
+      frame->cursor.row--;
+    }
+
+  while (frame->nrows < frame->max_rows) {
+    if (add_row(frame, data, 1) == E_OK) continue;
+    if (frame->data_loaded.first_row <= headers 
+      || add_row(frame, data, -1) != E_OK) break;
+    frame->cursor.row++;
+  }
+
+  // Columns
+  int total = total_cols(frame, data), icol;
+  int ncols = MIN(total, frame->max_cols);
+
+  while (frame->ncols > ncols) {
+    icol = frame->cursor.col / frame->col_width;
+    if (icol < frame->ncols - 1) {
+      frame->data_loaded.last_col--;
+      frame->margin.right++;
+    } else {
+      frame->data_loaded.first_col++;
+      frame->margin.left++;
+      frame->cursor.col -= frame->col_width;
+    }
+    frame->ncols--;
+  }
+
+  while (frame->ncols < ncols) {
+    if (frame->data_loaded.last_col + 1 < total) {
+      if (frame->margin.right == 0 && extend(frame, data, 1) != E_OK) break;
+      frame->data_loaded.last_col++;
+      frame->margin.right--;
+    } else {
+      if (frame->margin.left == 0 && extend(frame, data, -1) != E_OK) break;
+      frame->data_loaded.first_col--;
+      frame->margin.left--;
+      frame->cursor.col += frame->col_width;
+    }
+    frame->ncols++;
+  }
+
+  trim(frame, data);
+
+  long keep = AHEAD_MAX * (frame->nrows - headers);
+  free_rows(frame->buffered.above, keep, data->free_node);
+  free_rows(frame->buffered.below, keep, data->free_node);
+
+  prefetch(frame, data);
+  parse_ahead(frame, data);
 
   return E_OK;
 
 }
+
+int Frame_shift_row(Frame_T frame, Data_T data, int n) {
+
+  TRACE_START(start);
+  int ret = shift_row(frame, data, n);
+  TRACE_STOP(TRACE_SHIFT_ROW, start);
+
+  return ret;
+
+}
+
+int Frame_shift_col(Frame_T frame, Data_T data, int n) {
+
+  TRACE_START(start);
+  int ret = shift_col(frame, data, n);
+  TRACE_STOP(TRACE_SHIFT_COL, start);
+
+  return ret;
+
+}
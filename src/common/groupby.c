@@ -0,0 +1,298 @@
+//
+// -----------------------------------------------------------------------------
+// groupby.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <math.h>     // INFINITY, NAN
+#include <stdlib.h>   // qsort
+#include <string.h>   // memcmp, memcpy
+#include "error.h"
+#include "mem.h"
+#include "frame.h"    // Data_hash
+#include "groupby.h"
+
+#define T Groupby_T
+
+struct T {
+  int capacity;
+  int length;
+  Groupby_group *groups;
+  int *slots;         // open addressing into groups, -1 where empty
+  int mask;
+  long nrows;
+  long floor;         // highest count dropped, so counts are at most
+                      // this much over
+};
+
+static void rehash(T groupby) {
+
+  for (int i=0; i<=groupby->mask; i++) groupby->slots[i] = -1;
+
+  for (int i=0; i<groupby->length; i++) {
+    int s = groupby->groups[i].hash & groupby->mask;
+    while (groupby->slots[s] >= 0) s = (s + 1) & groupby->mask;
+    groupby->slots[s] = i;
+  }
+
+}
+
+T Groupby_new(int capacity) {
+
+  assert(capacity > 1);
+
+  T groupby;
+  NEW0(groupby);
+
+  // Slots are kept at most half full
+  int nslots = 2;
+  while (nslots < 2 * capacity) nslots *= 2;
+
+  groupby->capacity = capacity;
+  groupby->groups = CALLOC(capacity, sizeof(Groupby_group));
+  groupby->slots = CALLOC(nslots, sizeof(int));
+  groupby->mask = nslots - 1;
+  rehash(groupby);
+
+  return groupby;
+
+}
+
+void Groupby_free(T *groupby) {
+
+  assert(groupby && *groupby);
+
+  FREE((*groupby)->groups);
+  FREE((*groupby)->slots);
+  FREE(*groupby);
+
+}
+
+// Slot holding key, or the empty slot where it would go
+static int find(T groupby, const char *key, int len, uint64_t hash) {
+
+  int s = hash & groupby->mask;
+
+  for ( ; groupby->slots[s] >= 0; s = (s + 1) & groupby->mask) {
+    Groupby_group *g = &groupby->groups[groupby->slots[s]];
+    if (g->hash == hash && g->len == len && memcmp(g->key, key, len) == 0)
+      break;
+  }
+
+  return s;
+
+}
+
+static int by_count(const void *x, const void *y) {
+
+  long a = ((const Groupby_group *) x)->count;
+  long b = ((const Groupby_group *) y)->count;
+
+  return (a < b) - (a > b);
+
+}
+
+// Drops the least frequent half of the groups. Anything dropped
+// could have been counted at most floor times.
+static void evict(T groupby) {
+
+  qsort(groupby->groups, groupby->length, sizeof(Groupby_group), by_count);
+
+  int keep = groupby->capacity / 2;
+  if (groupby->groups[keep].count > groupby->floor)
+    groupby->floor = groupby->groups[keep].count;
+  groupby->length = keep;
+
+  rehash(groupby);
+
+}
+
+// Group for key, added with a count of floor if it's new
+static Groupby_group *group(T groupby, const char *key, int len, 
+  uint64_t hash, long floor) {
+
+  int s = find(groupby, key, len, hash);
+  if (groupby->slots[s] >= 0) return &groupby->groups[groupby->slots[s]];
+
+  if (groupby->length == groupby->capacity) {
+    evict(groupby);
+    s = find(groupby, key, len, hash);
+    if (floor < groupby->floor) floor = groupby->floor;
+  }
+
+  Groupby_group *g = &groupby->groups[groupby->length];
+  groupby->slots[s] = groupby->length++;
+
+  g->key = key;
+  g->len = len;
+  g->hash = hash;
+  g->count = g->err = floor;
+  g->n = 0;
+  g->sum = 0;
+  g->min = INFINITY;
+  g->max = -INFINITY;
+
+  return g;
+
+}
+
+void Groupby_add(T groupby, const char *key, int len, const double *value) {
+
+  assert(groupby && key && len >= 0);
+
+  Groupby_group *g = group(groupby, key, len, Data_hash(key, len), 
+    groupby->floor);
+
+  g->count++;
+  groupby->nrows++;
+
+  if (value) {
+    g->n++;
+    g->sum += *value;
+    if (*value < g->min) g->min = *value;
+    if (*value > g->max) g->max = *value;
+  }
+
+}
+
+// Groups only on one side could have been counted up to the other
+// side's floor times there
+void Groupby_merge(T into, T from) {
+
+  assert(into && from);
+
+  long floor = into->floor;
+
+  for (int i=0; i<into->length && from->floor; i++) {
+    Groupby_group *g = &into->groups[i];
+    if (from->slots[find(from, g->key, g->len, g->hash)] < 0) {
+      g->count += from->floor;
+      g->err += from->floor;
+    }
+  }
+  into->floor += from->floor;
+
+  for (int i=0; i<from->length; i++) {
+    Groupby_group *f = &from->groups[i];
+    Groupby_group *g = group(into, f->key, f->len, f->hash, floor);
+    g->count += f->count;
+    g->err += f->err;
+    g->n += f->n;
+    g->sum += f->sum;
+    if (f->min < g->min) g->min = f->min;
+    if (f->max > g->max) g->max = f->max;
+  }
+
+  into->nrows += from->nrows;
+
+}
+
+// Copy of the max most frequent groups
+T Groupby_snapshot(T groupby, int max) {
+
+  assert(groupby && max > 1);
+
+  T copy = Groupby_new(max);
+  copy->length = Groupby_top(groupby, copy->groups, max, GROUPBY_COUNT);
+  copy->nrows = groupby->nrows;
+  copy->floor = groupby->floor;
+  rehash(copy);
+
+  return copy;
+
+}
+
+int Groupby_length(T groupby) {
+
+  assert(groupby);
+  return groupby->length;
+
+}
+
+long Groupby_rows(T groupby) {
+
+  assert(groupby);
+  return groupby->nrows;
+
+}
+
+long Groupby_error(T groupby) {
+
+  assert(groupby);
+  return groupby->floor;
+
+}
+
+double Groupby_value(const Groupby_group *g, int agg) {
+
+  assert(g);
+
+  switch (agg) {
+    case GROUPBY_COUNT: return g->count;
+    case GROUPBY_SUM:   return g->sum;
+    case GROUPBY_MEAN:  return g->n ? g->sum / g->n : NAN;
+    case GROUPBY_MIN:   return g->n ? g->min : NAN;
+    case GROUPBY_MAX:   return g->n ? g->max : NAN;
+  }
+
+  return NAN;
+
+}
+
+struct order {
+  double value;
+  long count;
+  int i;
+};
+
+// Largest first, by value and then by count, with groups that have no
+// value last
+static int by_value(const void *x, const void *y) {
+
+  const struct order *a = x, *b = y;
+
+  if (isnan(a->value) != isnan(b->value)) return isnan(a->value) ? 1 : -1;
+  if (a->value != b->value && !isnan(a->value)) 
+    return a->value < b->value ? 1 : -1;
+
+  return (a->count < b->count) - (a->count > b->count);
+
+}
+
+// Copies the top max groups by agg into groups, and returns how many
+// were copied
+int Groupby_top(T groupby, Groupby_group *groups, int max, int agg) {
+
+  assert(groupby && groups && max >= 0);
+
+  struct order *order = CALLOC(groupby->length + 1, sizeof(struct order));
+
+  for (int i=0; i<groupby->length; i++) {
+    order[i].value = Groupby_value(&groupby->groups[i], agg);
+    order[i].count = groupby->groups[i].count;
+    order[i].i = i;
+  }
+  qsort(order, groupby->length, sizeof(struct order), by_value);
+
+  int n = groupby->length < max ? groupby->length : max;
+  for (int i=0; i<n; i++) groups[i] = groupby->groups[order[i].i];
+
+  FREE(order);
+
+  return n;
+
+}
@@ -0,0 +1,332 @@
+//
+// -----------------------------------------------------------------------------
+// index.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdint.h>   // uint64_t
+#include "error.h"
+#include "mem.h"
+#include "index.h"
+
+#define I Index_T
+
+// Offsets are kept in blocks of BLOCK, each Elias-Fano coded relative to
+// its first offset. An offset x is split into its low bits, stored as
+// they are, and its high bits x >> low, stored in unary: the jth offset
+// of a block sets bit j + (x >> low) of its high bits. With low chosen
+// from the block's span, that's 2 + low bits an offset, a little over
+// log2 of the average row length. Offsets past the last full block
+// are kept as they are until there are enough to fill one.
+#define BLOCK 128
+
+#define WORD_BITS 64
+
+struct block {
+  ssize_t first;      // offset of its first row
+  long word;          // where its bits start in words
+  int low;            // low bits of each offset
+};
+
+// Malformed rows are rare, so rather than a count for every row, only
+// those that are marked are kept, in order, with their counts
+struct marks {
+  long length;
+  long size;
+  long *rows;
+  int *nfields;
+};
+
+struct I {
+  long length;
+  struct block *blocks;
+  long nblocks;
+  long size;
+  uint64_t *words;    // bits of every block, each starting a new word
+  long nwords;
+  long wsize;
+  ssize_t tail[BLOCK];
+  ssize_t last;       // offset appended last
+  struct marks marks;
+};
+
+I Index_new(void) {
+
+  I index;
+  NEW0(index);
+
+  return index;
+
+}
+
+void Index_free(I *index) {
+
+  assert(index && *index);
+
+  if ((*index)->blocks) FREE((*index)->blocks);
+  if ((*index)->words) FREE((*index)->words);
+  if ((*index)->marks.rows) {
+    FREE((*index)->marks.rows);
+    FREE((*index)->marks.nfields);
+  }
+  FREE(*index);
+
+}
+
+long Index_length(I index) {
+
+  assert(index);
+  return index->length;
+
+}
+
+// Bytes taken by the index
+size_t Index_bytes(I index) {
+
+  assert(index);
+
+  return sizeof *index + index->size * sizeof(struct block)
+    + index->wsize * sizeof(uint64_t)
+    + index->marks.size * (sizeof(long) + sizeof(int));
+
+}
+
+// The n bits of words starting at bit pos, n < WORD_BITS
+static uint64_t get_bits(const uint64_t *words, long pos, int n) {
+
+  if (n == 0) return 0;
+
+  long w = pos / WORD_BITS;
+  int shift = pos % WORD_BITS;
+  uint64_t x = words[w] >> shift;
+  if (shift + n > WORD_BITS) x |= words[w+1] << (WORD_BITS - shift);
+
+  return x & ((1ULL << n) - 1);
+
+}
+
+static void set_bits(uint64_t *words, long pos, int n, uint64_t x) {
+
+  if (n == 0) return;
+
+  long w = pos / WORD_BITS;
+  int shift = pos % WORD_BITS;
+  words[w] |= x << shift;
+  if (shift + n > WORD_BITS) words[w+1] |= x >> (WORD_BITS - shift);
+
+}
+
+// Offset j of block b. The high bits are found by counting set bits a
+// word at a time, and there are at most 3 * BLOCK of them.
+static ssize_t select_block(I index, long b, int j) {
+
+  struct block *block = &index->blocks[b];
+  const uint64_t *words = index->words + block->word;
+
+  // BLOCK * low bits is a whole number of words
+  const uint64_t *high = words + BLOCK * block->low / WORD_BITS;
+  int k = j;
+  long w = 0;
+  for (;;) {
+    int ones = __builtin_popcountll(high[w]);
+    if (k < ones) break;
+    k -= ones;
+    w++;
+  }
+
+  uint64_t word = high[w];
+  while (k-- > 0) word &= word - 1;
+  long bit = w * WORD_BITS + __builtin_ctzll(word);
+
+  uint64_t x = ((uint64_t) (bit - j) << block->low) 
+    | get_bits(words, (long) j * block->low, block->low);
+
+  return block->first + x;
+
+}
+
+ssize_t Index_get(I index, long i) {
+
+  assert(index);
+  assert(i >= 0 && i < index->length);
+
+  long b = i / BLOCK;
+  if (b == index->nblocks) return index->tail[i % BLOCK];
+
+  return select_block(index, b, i % BLOCK);
+
+}
+
+// Codes the full tail as a new block
+static void compress(I index) {
+
+  ssize_t first = index->tail[0], span = index->tail[BLOCK-1] - first;
+
+  // The most low bits that leave at least BLOCK in the span of the
+  // high bits, which keeps them under 3 * BLOCK bits
+  int low = 0;
+  while (low < WORD_BITS - 2 && (span >> (low + 1)) >= BLOCK) low++;
+
+  long nbits = (long) BLOCK * low + (span >> low) + BLOCK;
+  long nwords = (nbits + WORD_BITS - 1) / WORD_BITS;
+
+  if (index->nblocks == index->size) {
+    index->size = index->size ? 2 * index->size : 64;
+    if (index->blocks) 
+      RESIZE(index->blocks, index->size * sizeof(struct block));
+    else index->blocks = CALLOC(index->size, sizeof(struct block));
+  }
+
+  if (index->nwords + nwords > index->wsize) {
+    long wsize = index->wsize ? 2 * index->wsize : 1024;
+    while (wsize < index->nwords + nwords) wsize *= 2;
+    if (index->words) RESIZE(index->words, wsize * sizeof(uint64_t));
+    else index->words = ALLOC(wsize * sizeof(uint64_t));
+    index->wsize = wsize;
+  }
+
+  uint64_t *words = index->words + index->nwords;
+  for (long w=0; w<nwords; w++) words[w] = 0;
+
+  uint64_t mask = low ? (1ULL << low) - 1 : 0;
+  long high = (long) BLOCK * low;
+  for (int j=0; j<BLOCK; j++) {
+    uint64_t x = index->tail[j] - first;
+    set_bits(words, (long) j * low, low, x & mask);
+    long bit = high + (long) (x >> low) + j;
+    words[bit / WORD_BITS] |= 1ULL << (bit % WORD_BITS);
+  }
+
+  index->blocks[index->nblocks++] = 
+    (struct block) { first, index->nwords, low };
+  index->nwords += nwords;
+
+}
+
+// Offsets must be appended in order. Rows can be empty, as the row of
+// keys of a JSON Lines file is, so an offset can repeat.
+void Index_append(I index, ssize_t offset) {
+
+  assert(index);
+  assert(offset >= 0);
+  assert(index->length == 0 || offset >= index->last);
+
+  index->last = offset;
+  index->tail[index->length++ % BLOCK] = offset;
+  if (index->length % BLOCK == 0) compress(index);
+
+}
+
+// The last row starting at or before offset, which is the row holding
+// the byte at offset. Returns -1 if every row starts after it.
+long Index_rank(I index, ssize_t offset) {
+
+  assert(index);
+
+  if (index->length == 0 || Index_get(index, 0) > offset) return -1;
+
+  // The last block starting at or before offset
+  long lo = 0, hi = index->nblocks;
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (index->blocks[mid].first <= offset) lo = mid + 1;
+    else hi = mid;
+  }
+  long b = lo - 1;
+
+  // The tail holds the rows after the last block
+  long start = b < 0 ? 0 : b * BLOCK;
+  if (b == index->nblocks - 1 && index->length > index->nblocks * BLOCK
+    && index->tail[0] <= offset) start = index->nblocks * BLOCK;
+
+  long end = start + BLOCK < index->length ? start + BLOCK : index->length;
+  lo = start, hi = end;
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (Index_get(index, mid) <= offset) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo - 1;
+
+}
+
+// Marks row i as having nfields fields. Rows must be marked in order,
+// as they're indexed.
+void Index_mark(I index, long i, int nfields) {
+
+  assert(index);
+  assert(i >= 0 && nfields >= 0);
+
+  struct marks *marks = &index->marks;
+  assert(marks->length == 0 || i > marks->rows[marks->length-1]);
+
+  if (!marks->rows) {
+    marks->size = 16;
+    marks->rows = CALLOC(marks->size, sizeof(long));
+    marks->nfields = CALLOC(marks->size, sizeof(int));
+  } else if (marks->length == marks->size) {
+    marks->size *= 2;
+    RESIZE(marks->rows, marks->size * sizeof(long));
+    RESIZE(marks->nfields, marks->size * sizeof(int));
+  }
+
+  marks->rows[marks->length] = i;
+  marks->nfields[marks->length++] = nfields;
+
+}
+
+// Position of the first mark on row i or after it
+static long search(struct marks *marks, long i) {
+
+  long lo = 0, hi = marks->length;
+
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (marks->rows[mid] < i) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo;
+
+}
+
+// Number of fields row i was marked with, or -1 if it wasn't
+int Index_fields(I index, long i) {
+
+  assert(index);
+
+  long k = search(&index->marks, i);
+
+  return k < index->marks.length && index->marks.rows[k] == i 
+    ? index->marks.nfields[k] : -1;
+
+}
+
+// The first marked row after row i if dir is 1, or before it if dir
+// is -1. Returns -1 if there isn't one.
+long Index_next_mark(I index, long i, int dir) {
+
+  assert(index);
+  assert(dir == 1 || dir == -1);
+
+  struct marks *marks = &index->marks;
+  long k = search(marks, dir == 1 ? i + 1 : i) - (dir == -1);
+
+  return k >= 0 && k < marks->length ? marks->rows[k] : -1;
+
+}
@@ -0,0 +1,379 @@
+//
+// -----------------------------------------------------------------------------
+// loop.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <errno.h>         // errno, EINTR, EAGAIN
+#include <signal.h>        // sigset_t, sigprocmask
+#include <stdint.h>        // uint64_t
+#include <unistd.h>        // read, write, close
+#include <sys/epoll.h>     // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/eventfd.h>   // eventfd
+#include <sys/signalfd.h>  // signalfd
+#include <sys/timerfd.h>   // timerfd_create, timerfd_settime
+#include "error.h"
+#include "mem.h"           // NEW0, FREE
+#include "deque.h"
+#include "spsc.h"
+#include "loop.h"
+#include "errorcodes.h"
+
+#define T Loop_T
+
+#define MAX_EVENTS 16
+
+enum { SRC_FD, SRC_SIGNAL, SRC_TIMER, SRC_WAKE, SRC_REMOVED };
+
+struct source {
+  int type;
+  int fd;
+  int signo;
+  void (*on_fd)(T loop, int fd, void *cl);
+  void (*on_signal)(T loop, int signo, void *cl);
+  void (*on_timer)(T loop, void *cl);
+  void *cl;
+};
+
+struct channel {
+  Spsc_T queue;
+  void (*on_msg)(T loop, void *msg, void *cl);
+  void *cl;
+};
+
+struct T {
+  int epfd;
+  int wakefd;
+  int running;
+  Deque_T sources;
+  Deque_T removed;    // sources events may still point to, until they're
+                      // all dispatched
+  Deque_T channels;
+};
+
+static struct source *add_source(T loop, int type, int fd) {
+
+  struct source *src;
+  NEW0(src);
+  src->type = type;
+  src->fd = fd;
+
+  struct epoll_event ev = { .events = EPOLLIN, .data.ptr = src };
+  if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    FREE(src);
+    return NULL;
+  }
+
+  Deque_addhi(loop->sources, src);
+  return src;
+
+}
+
+T Loop_new(void) {
+
+  T loop;
+  NEW0(loop);
+
+  loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+  loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  loop->sources = Deque_new();
+  loop->removed = Deque_new();
+  loop->channels = Deque_new();
+
+  if (loop->epfd < 0 || loop->wakefd < 0
+    || !add_source(loop, SRC_WAKE, loop->wakefd)) {
+    // Once registered, wakefd is closed along with the other sources
+    if (loop->wakefd >= 0 && Deque_length(loop->sources) == 0)
+      close(loop->wakefd);
+    Loop_free(&loop);
+    return NULL;
+  }
+
+  return loop;
+
+}
+
+void Loop_free(T *loop) {
+
+  assert(loop && *loop);
+
+  while (Deque_length((*loop)->sources) > 0) {
+    struct source *src = Deque_remlo((*loop)->sources);
+    // Caller owns plain file descriptors, we own the rest
+    if (src->type != SRC_FD) close(src->fd);
+    FREE(src);
+  }
+
+  while (Deque_length((*loop)->removed) > 0) {
+    struct source *src = Deque_remlo((*loop)->removed);
+    FREE(src);
+  }
+
+  while (Deque_length((*loop)->channels) > 0) {
+    struct channel *chan = Deque_remlo((*loop)->channels);
+    Spsc_free(&chan->queue);
+    FREE(chan);
+  }
+
+  if ((*loop)->epfd >= 0) close((*loop)->epfd);
+
+  Deque_free(&(*loop)->sources);
+  Deque_free(&(*loop)->removed);
+  Deque_free(&(*loop)->channels);
+  FREE(*loop);
+
+}
+
+int Loop_add_fd(T loop, int fd, void callback(T loop, int fd, void *cl),
+  void *cl) {
+
+  assert(loop && callback);
+
+  struct source *src = add_source(loop, SRC_FD, fd);
+  if (!src) return E_LOOP_RESOURCE_ERROR;
+
+  src->on_fd = callback;
+  src->cl = cl;
+
+  return E_OK;
+
+}
+
+// Stops watching fd, which the caller still owns. Safe to call from
+// the fd's own callback.
+int Loop_remove_fd(T loop, int fd) {
+
+  assert(loop);
+
+  int n = Deque_length(loop->sources);
+  for (int i=0; i<n; i++) {
+    struct source *src = Deque_get(loop->sources, i);
+    if (src->type != SRC_FD || src->fd != fd) continue;
+
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+    Deque_put(loop->sources, i, Deque_get(loop->sources, n - 1));
+    Deque_remhi(loop->sources);
+
+    // Events already returned for it are skipped
+    src->type = SRC_REMOVED;
+    Deque_addhi(loop->removed, src);
+
+    return E_OK;
+  }
+
+  return E_LOOP_RESOURCE_ERROR;
+
+}
+
+// Which of fd being readable and writable its callback is called for
+int Loop_watch_fd(T loop, int fd, int read, int write) {
+
+  assert(loop);
+
+  int n = Deque_length(loop->sources);
+  for (int i=0; i<n; i++) {
+    struct source *src = Deque_get(loop->sources, i);
+    if (src->type != SRC_FD || src->fd != fd) continue;
+
+    struct epoll_event ev = { 
+      .events = (read ? EPOLLIN : 0) | (write ? EPOLLOUT : 0), 
+      .data.ptr = src 
+    };
+    return epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) < 0
+      ? E_LOOP_RESOURCE_ERROR : E_OK;
+  }
+
+  return E_LOOP_RESOURCE_ERROR;
+
+}
+
+// The signal is blocked in the calling thread and delivered through
+// a signalfd instead. Call this before starting any threads so they
+// inherit the mask; otherwise the signal may be delivered to them.
+int Loop_add_signal(T loop, int signo,
+  void callback(T loop, int signo, void *cl), void *cl) {
+
+  assert(loop && callback);
+
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, signo);
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) return E_LOOP_RESOURCE_ERROR;
+
+  int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd < 0) return E_LOOP_RESOURCE_ERROR;
+
+  struct source *src = add_source(loop, SRC_SIGNAL, fd);
+  if (!src) {
+    close(fd);
+    return E_LOOP_RESOURCE_ERROR;
+  }
+
+  src->signo = signo;
+  src->on_signal = callback;
+  src->cl = cl;
+
+  return E_OK;
+
+}
+
+int Loop_add_timer(T loop, long msec, void callback(T loop, void *cl),
+  void *cl) {
+
+  assert(loop && callback && msec > 0);
+
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) return E_LOOP_RESOURCE_ERROR;
+
+  struct itimerspec spec = { 0 };
+  spec.it_interval.tv_sec = msec / 1000;
+  spec.it_interval.tv_nsec = (msec % 1000) * 1000000;
+  spec.it_value = spec.it_interval;
+
+  if (timerfd_settime(fd, 0, &spec, NULL) < 0) {
+    close(fd);
+    return E_LOOP_RESOURCE_ERROR;
+  }
+
+  struct source *src = add_source(loop, SRC_TIMER, fd);
+  if (!src) {
+    close(fd);
+    return E_LOOP_RESOURCE_ERROR;
+  }
+
+  src->on_timer = callback;
+  src->cl = cl;
+
+  return E_OK;
+
+}
+
+// Each producer thread gets its own channel, which keeps every queue
+// single-producer. All channels share the loop's eventfd for wakeups.
+Spsc_T Loop_channel(T loop, int capacity,
+  void callback(T loop, void *msg, void *cl), void *cl) {
+
+  assert(loop && callback);
+
+  struct channel *chan;
+  NEW0(chan);
+  chan->queue = Spsc_new(capacity);
+  chan->on_msg = callback;
+  chan->cl = cl;
+
+  Deque_addhi(loop->channels, chan);
+
+  return chan->queue;
+
+}
+
+// Safe to call from the channel's producer thread.
+// Returns 0 if the channel is full and the message wasn't posted.
+int Loop_post(T loop, Spsc_T channel, void *msg) {
+
+  assert(loop && channel);
+
+  if (!Spsc_push(channel, msg)) return 0;
+
+  uint64_t one = 1;
+  while (write(loop->wakefd, &one, sizeof one) < 0 && errno == EINTR) ;
+
+  return 1;
+
+}
+
+static void drain_channel(void **x, void *cl) {
+
+  struct channel *chan = *x;
+  T loop = cl;
+  void *msg;
+
+  while ((msg = Spsc_pop(chan->queue)) != NULL)
+    chan->on_msg(loop, msg, chan->cl);
+
+}
+
+static void dispatch(T loop, struct source *src) {
+
+  uint64_t count;
+  struct signalfd_siginfo info;
+
+  switch (src->type) {
+
+    case SRC_FD:
+      src->on_fd(loop, src->fd, src->cl);
+      break;
+
+    case SRC_SIGNAL:
+      while (read(src->fd, &info, sizeof info) == sizeof info)
+        src->on_signal(loop, info.ssi_signo, src->cl);
+      break;
+
+    case SRC_TIMER:
+      if (read(src->fd, &count, sizeof count) == sizeof count)
+        src->on_timer(loop, src->cl);
+      break;
+
+    case SRC_WAKE:
+      // Reset the counter before draining so a post that lands
+      // mid-drain still wakes us up again
+      if (read(src->fd, &count, sizeof count) < 0 && errno != EAGAIN) break;
+      Deque_map(loop->channels, drain_channel, loop);
+      break;
+
+    case SRC_REMOVED:
+      break;
+  }
+
+}
+
+int Loop_run(T loop) {
+
+  assert(loop);
+
+  struct epoll_event events[MAX_EVENTS];
+
+  loop->running = 1;
+
+  while (loop->running) {
+
+    int n = epoll_wait(loop->epfd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return E_LOOP_RESOURCE_ERROR;
+    }
+
+    for (int i=0; i<n && loop->running; i++)
+      dispatch(loop, events[i].data.ptr);
+
+    while (Deque_length(loop->removed) > 0) {
+      struct source *src = Deque_remlo(loop->removed);
+      FREE(src);
+    }
+
+  }
+
+  return E_OK;
+
+}
+
+void Loop_stop(T loop) {
+
+  assert(loop);
+  loop->running = 0;
+
+}
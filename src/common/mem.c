@@ -26,8 +26,16 @@
 // <http://www.opensource.org/licenses/mit-license.php>
 //
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>   // ENABLE_MEM_STATS
+#endif
+
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include "error.h"
 #include "mem.h"
@@ -35,12 +43,101 @@
 // Data
 const Except_T Mem_Failed = { "Allocation Failed" };
 
+#ifdef ENABLE_MEM_STATS
+
+// Callsites counted, a power of two. Sites past this many are counted
+// with the last one found.
+#define SITES 4096
+
+struct site {
+  const char *file;
+  int line;
+  atomic_int ready;     // file and line are set
+  atomic_long calls;    // blocks allocated or resized here
+  atomic_long frees;    // of the blocks last sized here
+  atomic_long live;     // bytes of them not yet freed
+  atomic_long peak;
+  long reported;        // calls as of the last report
+};
+
+// Each block starts with its size and the site that last sized it
+union header {
+  struct {
+    long nbytes;
+    int site;
+  } h;
+  max_align_t align;
+};
+
+static struct site sites[SITES];
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Finds the site, adding it if it's new. Sites are only ever added, so
+// looking one up takes no lock once it has been.
+static struct site *site(const char *file, int line) {
+  unsigned i = ((size_t) file >> 3 ^ (unsigned) line * 2654435761u) 
+    & (SITES - 1);
+  struct site *s = &sites[i];
+
+  for (int n=0; n<SITES; n++, i = (i + 1) & (SITES - 1)) {
+    s = &sites[i];
+    if (!atomic_load_explicit(&s->ready, memory_order_acquire)) {
+      pthread_mutex_lock(&sites_lock);
+      if (!atomic_load_explicit(&s->ready, memory_order_relaxed)) {
+        s->file = file;
+        s->line = line;
+        atomic_store_explicit(&s->ready, 1, memory_order_release);
+      }
+      pthread_mutex_unlock(&sites_lock);
+    }
+    if (s->file == file && s->line == line) return s;
+  }
+
+  return s;
+}
+
+// Counts block at the site, and returns where its caller's bytes start
+static void *account(union header *block, long nbytes, const char *file,
+  int line) {
+  struct site *s = site(file, line);
+
+  block->h.nbytes = nbytes;
+  block->h.site = s - sites;
+
+  atomic_fetch_add_explicit(&s->calls, 1, memory_order_relaxed);
+  long live = atomic_fetch_add_explicit(&s->live, nbytes, 
+    memory_order_relaxed) + nbytes;
+  long peak = atomic_load_explicit(&s->peak, memory_order_relaxed);
+  while (live > peak && !atomic_compare_exchange_weak_explicit(&s->peak, 
+    &peak, live, memory_order_relaxed, memory_order_relaxed)) ;
+
+  return block + 1;
+}
+
+// Takes the block holding ptr off the books of the site that last
+// sized it
+static union header *release(void *ptr) {
+  union header *block = (union header *) ptr - 1;
+
+  atomic_fetch_sub_explicit(&sites[block->h.site].live, block->h.nbytes,
+    memory_order_relaxed);
+
+  return block;
+}
+
+#endif
+
 // Functions
 void *Mem_alloc(long nbytes, const char *file, int line) {
   void *ptr;
 
   assert(nbytes > 0);
+#ifdef ENABLE_MEM_STATS
+  ptr = malloc(sizeof (union header) + nbytes);
+  if (ptr) ptr = account(ptr, nbytes, file, line);
+#else
   ptr = malloc(nbytes);
+#endif
   if (ptr == NULL) {
     if (file == NULL) RAISE(Mem_Failed);
     else Except_raise(&Mem_Failed, file, line);
@@ -53,7 +150,13 @@ void *Mem_calloc(long count, long nbytes, const char *file, int line) {
 
   assert(count > 0);
   assert(nbytes > 0);
+#ifdef ENABLE_MEM_STATS
+  if (count > (LONG_MAX - (long) sizeof (union header)) / nbytes) ptr = NULL;
+  else ptr = calloc(1, sizeof (union header) + count * nbytes);
+  if (ptr) ptr = account(ptr, count * nbytes, file, line);
+#else
   ptr = calloc(count, nbytes);
+#endif
   if (ptr == NULL) {
     if (file == NULL) RAISE(Mem_Failed);
     else Except_raise(&Mem_Failed, file, line);
@@ -62,13 +165,27 @@ void *Mem_calloc(long count, long nbytes, const char *file, int line) {
 }
 
 void Mem_free(void *ptr, const char *file, int line) {
+#ifdef ENABLE_MEM_STATS
+  if (ptr) {
+    union header *block = release(ptr);
+    atomic_fetch_add_explicit(&sites[block->h.site].frees, 1,
+      memory_order_relaxed);
+    free(block);
+  }
+#else
   if (ptr) free(ptr);
+#endif
 }
 
 void *Mem_resize(void *ptr, long nbytes, const char *file, int line) {
   assert(ptr);
   assert(nbytes > 0);
+#ifdef ENABLE_MEM_STATS
+  ptr = realloc(release(ptr), sizeof (union header) + nbytes);
+  if (ptr) ptr = account(ptr, nbytes, file, line);
+#else
   ptr = realloc(ptr, nbytes);
+#endif
   if (ptr == NULL) {
     if (file == NULL) RAISE(Mem_Failed);
     else Except_raise(&Mem_Failed, file, line);
@@ -76,4 +193,68 @@ void *Mem_resize(void *ptr, long nbytes, const char *file, int line) {
   return ptr;
 }
 
+#ifdef ENABLE_MEM_STATS
+
+struct row {
+  struct site *site;
+  long calls, since, frees, live, peak;
+};
+
+// Busiest since the last report first
+static int busier(const void *a, const void *b) {
+  const struct row *x = a, *y = b;
+
+  if (x->since != y->since) return x->since < y->since ? 1 : -1;
+  if (x->calls != y->calls) return x->calls < y->calls ? 1 : -1;
+  return 0;
+}
 
+#endif
+
+// Writes what was allocated at each callsite as JSON, the sites that
+// allocated most since the last report first. Blocks are counted where
+// they were last sized, so bytes still live at exit are leaks from
+// there. Returns 0 if accounting wasn't compiled in, -1 if the report
+// couldn't be written.
+int Mem_report(FILE *out) {
+  assert(out);
+
+#ifndef ENABLE_MEM_STATS
+  return 0;
+#else
+  // Rows are kept off the books, and in a block of their own
+  struct row *rows = malloc(SITES * sizeof *rows);
+  if (rows == NULL) return -1;
+
+  int n = 0;
+  long live = 0;
+  for (int i=0; i<SITES; i++) {
+    struct site *s = &sites[i];
+    if (!atomic_load_explicit(&s->ready, memory_order_acquire)) continue;
+    struct row *r = &rows[n++];
+    r->site = s;
+    r->calls = atomic_load_explicit(&s->calls, memory_order_relaxed);
+    r->since = r->calls - s->reported;
+    r->frees = atomic_load_explicit(&s->frees, memory_order_relaxed);
+    r->live = atomic_load_explicit(&s->live, memory_order_relaxed);
+    r->peak = atomic_load_explicit(&s->peak, memory_order_relaxed);
+    s->reported = r->calls;
+    live += r->live;
+  }
+  qsort(rows, n, sizeof *rows, busier);
+
+  fprintf(out, "{\n  \"live_bytes\": %ld,\n  \"sites\": [\n", live);
+  for (int i=0; i<n; i++)
+    fprintf(out, "    { \"site\": \"%s:%d\", \"calls\": %ld, "
+      "\"since_last_report\": %ld, \"frees\": %ld, \"live_bytes\": %ld, "
+      "\"peak_bytes\": %ld }%s\n", 
+      rows[i].site->file ? rows[i].site->file : "?", rows[i].site->line,
+      rows[i].calls, rows[i].since, rows[i].frees, rows[i].live, rows[i].peak,
+      i == n-1 ? "" : ",");
+  fprintf(out, "  ]\n}\n");
+
+  free(rows);
+
+  return ferror(out) ? -1 : 1;
+#endif
+}
@@ -0,0 +1,319 @@
+//
+// -----------------------------------------------------------------------------
+// pool.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdatomic.h> // atomic_int, atomic_long
+#include <pthread.h>   // pthread_create, pthread_join, pthread_mutex_lock
+#include <unistd.h>    // sysconf
+#include "error.h"
+#include "mem.h"
+#include "deque.h"
+#include "pool.h"
+
+#define T Pool_T
+
+struct Pool_token {
+  atomic_int cancelled;
+  atomic_long pending;      // tasks submitted and not yet finished
+};
+
+struct task {
+  void (*run)(void *cl, Pool_token token);
+  void *cl;
+  Pool_token token;
+};
+
+struct worker {
+  T pool;
+  int index;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  Deque_T tasks[POOL_PRIORITIES];
+};
+
+struct T {
+  int nthreads;
+  struct worker *workers;
+  atomic_uint next;         // worker given the next task from outside
+  atomic_long queued;
+
+  // Idle workers and waiters sleep on these
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  int stopping;
+};
+
+// Worker running on this thread, if any
+static _Thread_local struct worker *self = NULL;
+
+// Newest task of the worker's own, or the oldest of someone else's
+static struct task *pop(struct worker *w, int priority, int steal) {
+
+  pthread_mutex_lock(&w->lock);
+  struct task *task = NULL;
+  if (Deque_length(w->tasks[priority]) > 0)
+    task = steal ? Deque_remlo(w->tasks[priority]) 
+      : Deque_remhi(w->tasks[priority]);
+  pthread_mutex_unlock(&w->lock);
+
+  return task;
+
+}
+
+// The most urgent task anywhere, looking at our own first. Workers
+// are stolen from starting after us, so thieves spread out.
+static struct task *find(T pool, struct worker *me) {
+
+  int start = me ? me->index : 0;
+
+  for (int p=0; p<POOL_PRIORITIES; p++) {
+    if (me) {
+      struct task *task = pop(me, p, 0);
+      if (task) return task;
+    }
+    for (int i=1; i<=pool->nthreads; i++) {
+      struct worker *w = &pool->workers[(start + i) % pool->nthreads];
+      if (w == me) continue;
+      struct task *task = pop(w, p, 1);
+      if (task) return task;
+    }
+  }
+
+  return NULL;
+
+}
+
+static void run(T pool, struct task *task) {
+
+  atomic_fetch_sub(&pool->queued, 1);
+  task->run(task->cl, task->token);
+
+  // Waiters are woken when the last task of their token finishes
+  if (task->token && atomic_fetch_sub(&task->token->pending, 1) == 1) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  FREE(task);
+
+}
+
+static void *work(void *cl) {
+
+  struct worker *me = cl;
+  T pool = me->pool;
+  self = me;
+
+  for (;;) {
+    struct task *task = find(pool, me);
+    if (task) {
+      run(pool, task);
+      continue;
+    }
+
+    // Queued tasks are all run before the pool stops
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->queued) == 0 && !pool->stopping)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    int stop = pool->stopping && atomic_load(&pool->queued) == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (stop) break;
+  }
+
+  return NULL;
+
+}
+
+// Starts nthreads workers, or one per core if nthreads is 0
+T Pool_new(int nthreads) {
+
+  assert(nthreads >= 0);
+
+  if (nthreads == 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads < 1) nthreads = 1;
+
+  T pool;
+  NEW0(pool);
+  pool->workers = CALLOC(nthreads, sizeof(struct worker));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (int i=0; i<nthreads; i++) {
+    struct worker *w = &pool->workers[i];
+    w->pool = pool;
+    w->index = i;
+    pthread_mutex_init(&w->lock, NULL);
+    for (int p=0; p<POOL_PRIORITIES; p++) w->tasks[p] = Deque_new();
+  }
+
+  // Make do with the threads that could be started
+  for (pool->nthreads=0; pool->nthreads<nthreads; pool->nthreads++)
+    if (pthread_create(&pool->workers[pool->nthreads].thread, NULL, work, 
+      &pool->workers[pool->nthreads])) break;
+
+  for (int i=pool->nthreads; i<nthreads; i++) {
+    pthread_mutex_destroy(&pool->workers[i].lock);
+    for (int p=0; p<POOL_PRIORITIES; p++) 
+      Deque_free(&pool->workers[i].tasks[p]);
+  }
+
+  if (pool->nthreads == 0) Pool_free(&pool);
+
+  return pool;
+
+}
+
+// Runs every task already submitted, then stops the workers
+void Pool_free(T *pool) {
+
+  assert(pool && *pool);
+
+  T p = *pool;
+
+  pthread_mutex_lock(&p->lock);
+  p->stopping = 1;
+  pthread_cond_broadcast(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+
+  for (int i=0; i<p->nthreads; i++) pthread_join(p->workers[i].thread, NULL);
+
+  for (int i=0; i<p->nthreads; i++) {
+    pthread_mutex_destroy(&p->workers[i].lock);
+    for (int j=0; j<POOL_PRIORITIES; j++) 
+      Deque_free(&p->workers[i].tasks[j]);
+  }
+
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->wake);
+  pthread_cond_destroy(&p->done);
+  FREE(p->workers);
+  FREE(*pool);
+
+}
+
+int Pool_size(T pool) {
+
+  assert(pool);
+  return pool->nthreads;
+
+}
+
+// Index of the worker running this thread, or -1 if it isn't one of
+// the pool's, so tasks can keep state per worker
+int Pool_self(T pool) {
+
+  assert(pool);
+  return self && self->pool == pool ? self->index : -1;
+
+}
+
+// Queues run(cl, token) at priority. Tasks submitted by a task go on
+// its worker's deque, and the rest are spread across the workers. A
+// task whose token is cancelled before it starts still runs, and should
+// only clean up.
+void Pool_submit(T pool, int priority, Pool_token token,
+  void run(void *cl, Pool_token token), void *cl) {
+
+  assert(pool && run);
+  assert(priority >= 0 && priority < POOL_PRIORITIES);
+
+  struct task *task;
+  NEW(task);
+  task->run = run;
+  task->cl = cl;
+  task->token = token;
+  if (token) atomic_fetch_add(&token->pending, 1);
+
+  struct worker *w = Pool_self(pool) >= 0 ? self 
+    : &pool->workers[atomic_fetch_add(&pool->next, 1) % pool->nthreads];
+
+  pthread_mutex_lock(&w->lock);
+  Deque_addhi(w->tasks[priority], task);
+  pthread_mutex_unlock(&w->lock);
+
+  pthread_mutex_lock(&pool->lock);
+  atomic_fetch_add(&pool->queued, 1);
+  pthread_cond_signal(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+}
+
+// Waits for every task of token to finish. Workers run tasks in the
+// meantime, so a task can wait on the tasks it submits.
+void Pool_wait(T pool, Pool_token token) {
+
+  assert(pool && token);
+
+  struct worker *me = Pool_self(pool) >= 0 ? self : NULL;
+
+  while (atomic_load(&token->pending) > 0) {
+    struct task *task = me ? find(pool, me) : NULL;
+    if (task) {
+      run(pool, task);
+      continue;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (atomic_load(&token->pending) > 0)
+      pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+}
+
+Pool_token Pool_token_new(void) {
+
+  Pool_token token;
+  NEW0(token);
+
+  return token;
+
+}
+
+void Pool_token_free(Pool_token *token) {
+
+  assert(token && *token);
+  assert(atomic_load(&(*token)->pending) == 0);
+
+  FREE(*token);
+
+}
+
+void Pool_cancel(Pool_token token) {
+
+  assert(token);
+  atomic_store(&token->cancelled, 1);
+
+}
+
+int Pool_cancelled(Pool_token token) {
+
+  return token && atomic_load(&token->cancelled);
+
+}
+
+long Pool_pending(Pool_token token) {
+
+  assert(token);
+  return atomic_load(&token->pending);
+
+}
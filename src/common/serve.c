@@ -0,0 +1,638 @@
+//
+// -----------------------------------------------------------------------------
+// serve.c
+// -----------------------------------------------------------------------------
+//
+// Server half of serve.h. Clients are multiplexed on one event loop,
+// which also owns the data, so rows are only ever read on one thread.
+// Rows are counted on a worker thread, as they are when viewing a file,
+// and requests for the count wait for it rather than being polled.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#define _GNU_SOURCE     // accept4, memmem
+#include <stdlib.h>     // free
+#include <limits.h>     // INT_MAX
+#include <string.h>     // memcpy, memmem, memmove, strdup
+#include <errno.h>      // errno, EAGAIN
+#include <sched.h>      // sched_yield
+#include <signal.h>     // SIGINT, SIGTERM
+#include <unistd.h>     // close, unlink
+#include <sys/socket.h> // socket, bind, listen, accept4, send, recv
+#include <sys/un.h>     // sockaddr_un
+#include "error.h"
+#include "mem.h"        // NEW0, ALLOC, RESIZE, FREE
+#include "deque.h"
+#include "index.h"
+#include "loop.h"
+#include "pool.h"
+#include "serve.h"
+#include "errorcodes.h"
+
+#define T Serve_T
+
+// Bytes counted between progress reports
+#define COUNT_CHUNK (64L << 20)
+
+// Requests held for a client, and replies waiting to be sent to it,
+// past which its socket isn't read until it catches up
+#define IN_MAX (64L << 10)
+#define OUT_MAX (1L << 20)
+
+// Room first made for the text of a cell that isn't stored as text
+#define FORMAT_MIN 256
+
+// Rows indexed per turn of the loop on the way to a row far past the
+// end of the index
+#define SEEK_ROWS 65536
+
+struct client {
+  T server;
+  int fd;
+  char *in;           // requests not yet answered
+  long nin, in_size;
+  char *out;          // replies not yet sent
+  long nout, sent, out_size;
+  int64_t waiting;    // bytes a SERVE_STATS waits for the count to pass,
+                      // or -1
+  int seeking;        // the next request is for a row not indexed yet
+  int reading;        // what it's watched for
+  int writing;
+};
+
+struct progress {
+  long nrows;
+  ssize_t done;
+};
+
+struct T {
+  Data_T data;
+  int headers;
+  char *path;
+  int fd;
+  Loop_T loop;
+  Spsc_T counted;     // progress of the count
+  Spsc_T stopped;     // posted to by Serve_stop
+  Pool_T pool;
+  Pool_token counting;
+  ssize_t offset;     // how far the count has got, on the worker
+  long counting_rows;
+  long nrows;         // rows and bytes counted, as last posted
+  ssize_t done;
+  Deque_T clients;
+  char **toks;        // fields of the rows being answered
+  uint32_t *lens;     // lengths and text of the cells being sent
+  char *text;
+  char *format;       // text of the cell being formatted
+  int format_size;
+  long ntext, text_size;
+};
+
+// Counts rows a chunk per task, each queueing the next once it's done
+static void count(void *cl, Pool_token token) {
+
+  T server = cl;
+  Data_T data = server->data;
+
+  if (Pool_cancelled(token)) return;
+
+  server->offset = data->scan_rows(data, server->offset, COUNT_CHUNK,
+    &server->counting_rows);
+
+  struct progress *progress;
+  NEW0(progress);
+  progress->nrows = server->counting_rows;
+  progress->done = server->offset;
+
+  // Progress is advisory, but the end of the count has to arrive
+  int last = server->offset >= data->st_size;
+  while (!Loop_post(server->loop, server->counted, progress)) {
+    if (!last || Pool_cancelled(token)) {
+      FREE(progress);
+      break;
+    }
+    sched_yield();
+  }
+
+  if (!last) Pool_submit(server->pool, POOL_LOW, token, count, server);
+
+}
+
+static void append(char **buf, long *n, long *size, const void *bytes,
+  long len) {
+
+  if (len == 0) return;
+
+  if (*n + len > *size) {
+    while (*n + len > *size) *size = *size ? 2 * *size : 4096;
+    if (*buf) RESIZE(*buf, *size);
+    else *buf = ALLOC(*size);
+  }
+
+  memcpy(*buf + *n, bytes, len);
+  *n += len;
+
+}
+
+static struct serve_reply header(T server, int op) {
+
+  struct serve_reply reply = { 0 };
+  reply.op = op;
+  reply.err = E_OK;
+  reply.nrows = server->nrows;
+  reply.done = server->done;
+  reply.total = server->data->st_size;
+  reply.ncols = server->data->ncols;
+  reply.headers = server->headers;
+  reply.version = SERVE_VERSION;
+  reply.delim = server->data->quoted ? server->data->delim : 0;
+
+  return reply;
+
+}
+
+// Queues reply, followed by the cells gathered for it
+static void send_reply(struct client *client, struct serve_reply *reply) {
+
+  T server = client->server;
+
+  reply->len = server->ntext;
+  append(&client->out, &client->nout, &client->out_size, reply,
+    sizeof *reply);
+  append(&client->out, &client->nout, &client->out_size, server->lens,
+    reply->ncells * sizeof(uint32_t));
+  append(&client->out, &client->nout, &client->out_size, server->text,
+    server->ntext);
+
+  server->ntext = 0;
+
+}
+
+// Text of a cell, formatted into the server's buffer if it isn't
+// stored as text. The buffer grows to fit, so long cells are whole.
+static const char *cell(T server, const char *tok, int *len) {
+
+  Data_T data = server->data;
+
+  if (data->format) {
+    if (!server->format) {
+      server->format_size = FORMAT_MIN;
+      server->format = ALLOC(server->format_size);
+    }
+    *len = data->format(tok, server->format, server->format_size);
+    if (*len >= server->format_size) {
+      server->format_size = *len + 1;
+      RESIZE(server->format, server->format_size);
+      *len = data->format(tok, server->format, server->format_size);
+    }
+    if (*len >= 0) return server->format;
+  }
+
+  *len = data->toklen(tok, data->delim);
+  return tok;
+
+}
+
+static void reply_stats(struct client *client) {
+
+  struct serve_reply reply = header(client->server, SERVE_STATS);
+  send_reply(client, &reply);
+
+}
+
+// Cells of as many of the rows asked for as fit in one reply, stopping
+// at the first that can't be read
+static void reply_rows(struct client *client, struct serve_request *req) {
+
+  T server = client->server;
+  Data_T data = server->data;
+  struct serve_reply reply = header(server, SERVE_ROWS);
+
+  long col_end = req->col_end < 0 ? data->ncols - 1 : req->col_end;
+  long ncols = col_end - req->col_start + 1;
+
+  if (req->first < 0 || req->last < req->first || req->last > INT_MAX
+    || req->col_start < 0 || ncols < 1 || ncols > SERVE_CELLS) {
+    reply.err = E_DTA_BAD_INPUT;
+    send_reply(client, &reply);
+    return;
+  }
+
+  long nrows = req->last - req->first + 1;
+  if (nrows > SERVE_CELLS / ncols) nrows = SERVE_CELLS / ncols;
+
+  for (long i=0; i<nrows; i++) {
+    int err = data->get_row(data, server->toks, req->first + i,
+      req->col_start, col_end);
+    if (err != E_OK) {
+      if (i == 0) reply.err = err;
+      break;
+    }
+    for (int j=0; j<ncols; j++) {
+      int len;
+      const char *text = cell(server, server->toks[j], &len);
+      server->lens[reply.ncells++] = len;
+      append(&server->text, &server->ntext, &server->text_size, text, len);
+    }
+    reply.value++;
+  }
+
+  send_reply(client, &reply);
+
+}
+
+// The first row with the text in one of the columns, searching a
+// bounded number of rows so other clients aren't kept waiting
+static void reply_find(struct client *client, struct serve_request *req,
+  const char *text) {
+
+  T server = client->server;
+  Data_T data = server->data;
+  struct serve_reply reply = header(server, SERVE_FIND);
+
+  long col_end = req->col_end < 0 ? data->ncols - 1 : req->col_end;
+  long ncols = col_end - req->col_start + 1;
+
+  reply.value = -1;
+  reply.next = req->first;
+
+  if (req->first < 0 || req->first > INT_MAX || req->col_start < 0 
+    || ncols < 1 || ncols > SERVE_CELLS) {
+    reply.err = E_DTA_BAD_INPUT;
+    send_reply(client, &reply);
+    return;
+  }
+
+  // Searches run to INT64_MAX, which is past any row there can be
+  long last = req->last < INT_MAX ? req->last : INT_MAX;
+  if (last > req->first + SERVE_FIND_ROWS - 1)
+    last = req->first + SERVE_FIND_ROWS - 1;
+
+  for (long row=req->first; row<=last && reply.value < 0; row++) {
+    int err = data->get_row(data, server->toks, row, req->col_start,
+      col_end);
+    if (err != E_OK) {
+      reply.err = err;
+      break;
+    }
+    for (int j=0; j<ncols; j++) {
+      int len;
+      const char *tok = cell(server, server->toks[j], &len);
+      if (memmem(tok, len, text, req->len)) {
+        reply.value = row;
+        break;
+      }
+    }
+    reply.next = row + 1;
+  }
+
+  send_reply(client, &reply);
+
+}
+
+// Indexes up to SEEK_ROWS rows towards row. Returns 1 once row is
+// close enough to the end of the index to be read straight away.
+static int seek(T server, int64_t row) {
+
+  Data_T data = server->data;
+
+  if (!data->rows || row > INT_MAX) return 1;
+
+  long indexed = Index_length(data->rows) - 1;
+  if (row - indexed <= SEEK_ROWS) return 1;
+
+  // Past the end of the file the index is complete, so the request
+  // can be answered
+  return data->get_row(data, server->toks, indexed + SEEK_ROWS, 0, 0) 
+    != E_OK;
+
+}
+
+// Answers the requests received so far, in order. One waiting for the
+// count holds up those after it, as does one for a row that isn't
+// indexed yet, which is sought a step at a time between other clients.
+static int answer(struct client *client) {
+
+  T server = client->server;
+  struct serve_request req;
+
+  while (client->waiting < 0 && client->nout - client->sent < OUT_MAX
+    && client->nin >= (long) sizeof req) {
+
+    memcpy(&req, client->in, sizeof req);
+    if (req.len > SERVE_TEXT) return E_DTA_BAD_INPUT;
+    long size = sizeof req + req.len;
+    if (client->nin < size) break;
+
+    client->seeking = (req.op == SERVE_ROWS || req.op == SERVE_FIND)
+      && !seek(server, req.first);
+    if (client->seeking) break;
+
+    switch (req.op) {
+      case SERVE_STATS:
+        if (server->done <= req.first
+          && server->done < server->data->st_size)
+          client->waiting = req.first;
+        else reply_stats(client);
+        break;
+      case SERVE_ROWS:
+        reply_rows(client, &req);
+        break;
+      case SERVE_FIND:
+        reply_find(client, &req, client->in + sizeof req);
+        break;
+      default:
+        return E_DTA_BAD_INPUT;
+    }
+
+    memmove(client->in, client->in + size, client->nin - size);
+    client->nin -= size;
+  }
+
+  return E_OK;
+
+}
+
+// Reads whatever requests have arrived, unless enough are held already
+static int receive(struct client *client) {
+
+  if (!client->in) {
+    client->in_size = IN_MAX;
+    client->in = ALLOC(client->in_size);
+  }
+
+  while (client->nin < client->in_size) {
+    ssize_t n = recv(client->fd, client->in + client->nin,
+      client->in_size - client->nin, 0);
+    if (n > 0) client->nin += n;
+    else if (n == 0) return E_DTA_EOF;
+    else if (errno == EINTR) continue;
+    else if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+    else return E_DTA_FILE_ERROR;
+  }
+
+  return E_OK;
+
+}
+
+// Sends what replies it can, and watches the socket for whatever's
+// needed to carry on
+static int flush(struct client *client) {
+
+  T server = client->server;
+
+  while (client->sent < client->nout) {
+    ssize_t n = send(client->fd, client->out + client->sent,
+      client->nout - client->sent, MSG_NOSIGNAL);
+    if (n >= 0) client->sent += n;
+    else if (errno == EINTR) continue;
+    else if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+    else return E_DTA_FILE_ERROR;
+  }
+
+  if (client->sent == client->nout) client->sent = client->nout = 0;
+
+  int reading = client->nin < client->in_size
+    && client->nout - client->sent < OUT_MAX;
+  // A socket with room is always writable, so watching it brings a
+  // client that's seeking back on the next turn of the loop
+  int writing = client->sent < client->nout || client->seeking;
+  if (reading != client->reading || writing != client->writing) {
+    if (Loop_watch_fd(server->loop, client->fd, reading, writing))
+      return E_LOOP_RESOURCE_ERROR;
+    client->reading = reading;
+    client->writing = writing;
+  }
+
+  return E_OK;
+
+}
+
+static void drop(struct client *client) {
+
+  T server = client->server;
+
+  int n = Deque_length(server->clients);
+  for (int i=0; i<n; i++)
+    if (Deque_get(server->clients, i) == client) {
+      Deque_put(server->clients, i, Deque_get(server->clients, n - 1));
+      Deque_remhi(server->clients);
+      break;
+    }
+
+  Loop_remove_fd(server->loop, client->fd);
+  close(client->fd);
+  if (client->in) FREE(client->in);
+  if (client->out) FREE(client->out);
+  FREE(client);
+
+}
+
+static void on_client(Loop_T loop, int fd, void *cl) {
+
+  struct client *client = cl;
+
+  if ((client->reading && receive(client) != E_OK)
+    || answer(client) != E_OK || flush(client) != E_OK)
+    drop(client);
+
+}
+
+static void on_accept(Loop_T loop, int fd, void *cl) {
+
+  T server = cl;
+  int conn;
+
+  while ((conn = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    struct client *client;
+    NEW0(client);
+    client->server = server;
+    client->fd = conn;
+    client->waiting = -1;
+    client->reading = 1;
+    if (Loop_add_fd(loop, conn, on_client, client)) {
+      close(conn);
+      FREE(client);
+      continue;
+    }
+    Deque_addhi(server->clients, client);
+  }
+
+}
+
+// Answers the requests that were waiting for the count to get further
+static void on_counted(Loop_T loop, void *msg, void *cl) {
+
+  T server = cl;
+  struct progress *progress = msg;
+
+  server->nrows = progress->nrows;
+  server->done = progress->done;
+  FREE(progress);
+
+  // Clients may be dropped along the way
+  for (int i=Deque_length(server->clients)-1; i>=0; i--) {
+    struct client *client = Deque_get(server->clients, i);
+    if (client->waiting < 0 || (server->done <= client->waiting
+      && server->done < server->data->st_size)) continue;
+    client->waiting = -1;
+    reply_stats(client);
+    if (answer(client) != E_OK || flush(client) != E_OK) drop(client);
+  }
+
+}
+
+static void on_stop(Loop_T loop, void *msg, void *cl) {
+
+  Loop_stop(loop);
+
+}
+
+static void on_signal(Loop_T loop, int signo, void *cl) {
+
+  Loop_stop(loop);
+
+}
+
+// Whether a server is still listening at addr
+static int listening(struct sockaddr_un *addr) {
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return 0;
+
+  int alive = connect(fd, (struct sockaddr *) addr, sizeof *addr) == 0;
+  close(fd);
+
+  return alive;
+
+}
+
+// Listens at path for clients of data, which has to be open. A socket
+// left there by a server that's gone is replaced. Interrupting the
+// program stops the server, so call this before starting any threads.
+T Serve_new(Data_T data, int headers, const char *path) {
+
+  assert(data && path);
+
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof addr.sun_path) return NULL;
+  strcpy(addr.sun_path, path);
+
+  // The number of columns comes from the first row
+  char *tok;
+  if (data->get_row(data, &tok, 0, 0, 0) != E_OK) return NULL;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return NULL;
+
+  if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0
+    && (errno != EADDRINUSE || listening(&addr) || unlink(path) < 0
+      || bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0)) {
+    close(fd);
+    return NULL;
+  }
+
+  T server;
+  NEW0(server);
+  server->data = data;
+  server->headers = !!headers;
+  server->path = strdup(path);
+  server->fd = fd;
+  server->clients = Deque_new();
+  server->toks = CALLOC(SERVE_CELLS, sizeof(char *));
+  server->lens = CALLOC(SERVE_CELLS, sizeof(uint32_t));
+
+  server->loop = Loop_new();
+  if (listen(fd, SOMAXCONN) < 0 || !server->loop
+    || Loop_add_signal(server->loop, SIGINT, on_signal, NULL)
+    || Loop_add_signal(server->loop, SIGTERM, on_signal, NULL)
+    || Loop_add_fd(server->loop, fd, on_accept, server)) {
+    Serve_free(&server);
+    return NULL;
+  }
+  server->counted = Loop_channel(server->loop, 64, on_counted, server);
+  server->stopped = Loop_channel(server->loop, 1, on_stop, NULL);
+
+  // Formats that can't be counted a chunk at a time are counted now
+  if (!data->scan_rows || data->st_size == 0) {
+    server->nrows = data->count_rows(data, 0);
+    server->done = data->st_size;
+    return server;
+  }
+
+  server->pool = Pool_new(0);
+  if (!server->pool) {
+    Serve_free(&server);
+    return NULL;
+  }
+  server->counting = Pool_token_new();
+  Pool_submit(server->pool, POOL_LOW, server->counting, count, server);
+
+  return server;
+
+}
+
+// Answers clients until the program is interrupted or Serve_stop is
+// called
+int Serve_run(T server) {
+
+  assert(server);
+
+  return Loop_run(server->loop);
+
+}
+
+// Safe to call from one other thread
+void Serve_stop(T server) {
+
+  assert(server);
+
+  while (!Loop_post(server->loop, server->stopped, server)) sched_yield();
+
+}
+
+void Serve_free(T *server) {
+
+  assert(server && *server);
+
+  if ((*server)->counting) {
+    Pool_cancel((*server)->counting);
+    Pool_wait((*server)->pool, (*server)->counting);
+    Pool_token_free(&(*server)->counting);
+  }
+  if ((*server)->pool) Pool_free(&(*server)->pool);
+
+  while (Deque_length((*server)->clients) > 0)
+    drop(Deque_get((*server)->clients, 0));
+  Deque_free(&(*server)->clients);
+
+  // The count's last messages may not have been drained
+  struct progress *progress;
+  while ((*server)->counted && (progress = Spsc_pop((*server)->counted)))
+    FREE(progress);
+  if ((*server)->loop) Loop_free(&(*server)->loop);
+
+  close((*server)->fd);
+  unlink((*server)->path);
+  free((*server)->path);
+
+  FREE((*server)->toks);
+  FREE((*server)->lens);
+  if ((*server)->text) FREE((*server)->text);
+  if ((*server)->format) FREE((*server)->format);
+  FREE(*server);
+
+}
@@ -0,0 +1,482 @@
+//
+// -----------------------------------------------------------------------------
+// slice.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#define _GNU_SOURCE   // copy_file_range
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>   // HAVE_COPY_FILE_RANGE
+#endif
+
+#include <errno.h>    // errno, EINTR
+#include <fcntl.h>    // open, O_RDONLY
+#include <limits.h>   // IOV_MAX
+#include <stdlib.h>   // strtod
+#include <string.h>   // memchr, memset
+#include <unistd.h>   // copy_file_range, close
+#include <sys/sendfile.h> // sendfile
+#include <sys/uio.h>  // writev, struct iovec
+#include "mem.h"      // NEW0, CALLOC, FREE
+#include "index.h"
+#include "frame.h"
+#include "pool.h"     // Pool_cancelled
+#include "slice.h"
+#include "columns.h"
+#include "errorcodes.h"
+
+// Most bytes handed to the kernel in one call when copying whole rows.
+// A cancelled write stops at the end of a call.
+#define COPY_MAX (64L << 20)
+
+// Rows sampled to size the columns in aligned output
+#define ALIGN_SAMPLE 1000
+
+#define SEP " | "
+
+// IOV_MAX is only exposed with _XOPEN_SOURCE, and 1024 is what Linux uses
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static char spaces[256];
+static char newline = '\n';
+
+// Room for cells that are formatted or quoted rather than copied from
+// the mapping, and for the longest cell that's formatted
+#define TEXT_SIZE (64 << 10)
+#define CELL_SIZE (64 << 10)
+
+// Batches spans of the mapping into writev calls
+struct out {
+  Slice_T slice;
+  int fd;
+  int n;
+  struct iovec iov[IOV_MAX];
+  int ntext;
+  char text[TEXT_SIZE];
+  char cell[CELL_SIZE];   // the cell being formatted
+};
+
+static int cancelled(struct out *out) {
+
+  return out->slice->token && Pool_cancelled(out->slice->token);
+
+}
+
+static int flush(struct out *out) {
+
+  struct iovec *iov = out->iov;
+  int n = out->n;
+
+  while (n > 0) {
+    ssize_t written = writev(out->fd, iov, n);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return E_IO_WRITE_ERROR;
+    }
+    atomic_fetch_add(&out->slice->written, written);
+
+    // Skip whatever was written and retry the rest
+    while (n > 0 && (size_t) written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++, n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (char *) iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+
+  out->n = 0;
+  out->ntext = 0;
+  return E_OK;
+
+}
+
+static int put(struct out *out, const char *ptr, size_t len) {
+
+  if (len == 0) return E_OK;
+  if (out->n == IOV_MAX && flush(out) != E_OK) return E_IO_WRITE_ERROR;
+
+  out->iov[out->n].iov_base = (void *) ptr;
+  out->iov[out->n].iov_len = len;
+  out->n++;
+
+  return E_OK;
+
+}
+
+// Copies [lo, hi) of the file to the output without reading it into
+// memory, with copy_file_range between files and sendfile to anything
+// else. Whatever the kernel won't copy is written from the mapping.
+static int copy(struct out *out, Data_T data, const char *ptr, ssize_t lo, 
+  ssize_t hi) {
+
+  if (flush(out) != E_OK) return E_IO_WRITE_ERROR;
+
+  int src = open(data->path, O_RDONLY);
+  if (src >= 0) {
+    ssize_t n;
+
+#ifdef HAVE_COPY_FILE_RANGE
+    loff_t in = lo;
+    while (in < hi && !cancelled(out)) {
+      n = copy_file_range(src, &in, out->fd, NULL, 
+        hi - in < COPY_MAX ? hi - in : COPY_MAX, 0);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+      atomic_fetch_add(&out->slice->written, n);
+    }
+    lo = in;
+#endif
+
+    off_t off = lo;
+    while (off < hi && !cancelled(out)) {
+      n = sendfile(out->fd, src, &off, 
+        hi - off < COPY_MAX ? hi - off : COPY_MAX);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+      atomic_fetch_add(&out->slice->written, n);
+    }
+    lo = off;
+
+    close(src);
+  }
+
+  for ( ; lo < hi; lo += COPY_MAX) {
+    if (cancelled(out)) return E_IO_CANCELLED;
+    if (put(out, ptr + lo, hi - lo < COPY_MAX ? hi - lo : COPY_MAX) != E_OK
+      || flush(out) != E_OK) return E_IO_WRITE_ERROR;
+  }
+
+  return E_OK;
+
+}
+
+// Copies len bytes of tok to the output's buffer, in quotes and with
+// the quotes inside doubled if quote is set. The buffer is queued and
+// written as it fills, and is never queued without room for the run
+// being copied, so a flush can't leave part of it to be written over.
+static int put_copy(struct out *out, const char *tok, int len, int quote) {
+
+  if (out->n == IOV_MAX && flush(out) != E_OK) return E_IO_WRITE_ERROR;
+
+  char *run = out->text + out->ntext;
+  for (int i = -quote; i < len + quote; i++) {
+    char c = i < 0 || i == len ? '"' : tok[i];
+    int copies = quote && c == '"' && i >= 0 && i < len ? 2 : 1;
+    while (copies--) {
+      if (out->ntext == TEXT_SIZE) {
+        if (put(out, run, out->text + out->ntext - run) != E_OK
+          || flush(out) != E_OK) return E_IO_WRITE_ERROR;
+        run = out->text;
+      }
+      out->text[out->ntext++] = c;
+    }
+  }
+
+  return put(out, run, out->text + out->ntext - run);
+
+}
+
+// Cells that hold the delimiter, a quote or a line break have to be
+// quoted to be read back as one field
+static int needs_quotes(const char *tok, int len, char delim) {
+
+  return memchr(tok, delim, len) || memchr(tok, '"', len)
+    || memchr(tok, '\n', len) || memchr(tok, '\r', len);
+
+}
+
+static int pad(struct out *out, int n) {
+
+  for ( ; n > 0; n -= sizeof spaces)
+    if (put(out, spaces, n < (int) sizeof spaces ? n : sizeof spaces) != E_OK)
+      return E_IO_WRITE_ERROR;
+
+  return E_OK;
+
+}
+
+Slice_T Slice_init(int headers, int align, int col_width) {
+
+  if (col_width < 1) return NULL;
+
+  Slice_T slice;
+  NEW0(slice);
+
+  slice->first = 1;
+  slice->last = -1;
+  slice->headers = headers;
+  slice->align = align;
+  slice->col_width = col_width;
+
+  return slice;
+
+}
+
+void Slice_free(Slice_T *slice) {
+
+  assert(slice && *slice);
+
+  if ((*slice)->cols) FREE((*slice)->cols);
+  FREE(*slice);
+
+}
+
+// Parses a number followed by any number of +N or -N terms,
+// so that 1e6+50 is accepted
+static int parse_expr(const char **spec, long *n) {
+
+  char *end;
+  double value = strtod(*spec, &end);
+  if (end == *spec) return E_DTA_BAD_INPUT;
+
+  while (*end == '+' || *end == '-') {
+    const char *term = end;
+    double x = strtod(term + 1, &end);
+    if (end == term + 1) return E_DTA_BAD_INPUT;
+    value += *term == '+' ? x : -x;
+  }
+
+  *spec = end;
+  *n = (long) value;
+
+  return E_OK;
+
+}
+
+// Accepts N, FIRST:LAST, FIRST: and :LAST
+int Slice_parse_rows(Slice_T slice, const char *spec) {
+
+  assert(slice && spec);
+
+  long first = 1, last = -1;
+
+  if (*spec != ':' && parse_expr(&spec, &first) != E_OK)
+    return E_DTA_BAD_INPUT;
+
+  if (*spec == ':') {
+    spec++;
+    if (*spec && parse_expr(&spec, &last) != E_OK) return E_DTA_BAD_INPUT;
+  } else last = first;
+
+  if (*spec || first < 1 || (last != -1 && last < first))
+    return E_DTA_BAD_INPUT;
+
+  slice->first = first;
+  slice->last = last;
+
+  return E_OK;
+
+}
+
+// Accepts column numbers, ranges and header names, e.g. 3,7-9,Country
+int Slice_parse_cols(Slice_T slice, Data_T data, const char *spec) {
+
+  assert(slice && data && spec);
+
+  int *cols, ncols;
+  int err = Columns_parse(data, spec, slice->headers, &cols, &ncols);
+  if (err != E_OK) return err;
+
+  if (slice->cols) FREE(slice->cols);
+  slice->cols = cols;
+  slice->ncols = ncols;
+
+  return E_OK;
+
+}
+
+// Offset of the start of row, or the end of the file if there are
+// fewer rows. Rows before it are skipped without tokenizing them.
+static ssize_t row_start(Data_T data, char **buf, long row) {
+
+  data->get_row(data, buf, row, 0, 0);
+
+  return row < Index_length(data->rows)
+    ? Index_get(data->rows, row) : data->st_size;
+
+}
+
+static int measure(Slice_T slice, Data_T data, char **buf, long row,
+  int maxcol, int *widths) {
+
+  int ret = data->get_row(data, buf, row, 0, maxcol);
+  if (ret != E_OK) return ret;
+
+  for (int i=0; i<slice->ncols; i++) {
+    int len = data->toklen(buf[slice->cols[i]], data->delim);
+    if (len > slice->col_width) len = slice->col_width;
+    if (len > widths[i]) widths[i] = len;
+  }
+
+  return E_OK;
+
+}
+
+// Text of a cell, formatted into out->cell if it isn't stored as text
+static const char *text(Data_T data, struct out *out, const char *tok, 
+  int *len) {
+
+  if (data->format 
+    && (*len = data->format(tok, out->cell, sizeof out->cell)) >= 0) {
+    if (*len > CELL_SIZE - 1) *len = CELL_SIZE - 1;
+    return out->cell;
+  }
+
+  *len = data->toklen(tok, data->delim);
+  return tok;
+
+}
+
+// Cells of backends that don't store them as delimited fields are
+// quoted where they need to be, so the output reads back as CSV
+static int put_row(Slice_T slice, Data_T data, struct out *out, char **buf,
+  int *widths) {
+
+  for (int i=0; i<slice->ncols; i++) {
+    int len;
+    const char *tok = text(data, out, buf[slice->cols[i]], &len);
+    int quote = !slice->align && !data->quoted 
+      && needs_quotes(tok, len, data->delim);
+
+    // Formatted cells are overwritten by the next, so they're copied
+    if (slice->align && len > widths[i]) len = widths[i];
+    if (tok == out->cell || quote) {
+      if (put_copy(out, tok, len, quote)) return E_IO_WRITE_ERROR;
+    } else if (put(out, tok, len)) return E_IO_WRITE_ERROR;
+
+    if (slice->align) {
+      if (i < slice->ncols-1
+        && (pad(out, widths[i] - len) || put(out, SEP, sizeof SEP - 1)))
+        return E_IO_WRITE_ERROR;
+    } else if (i < slice->ncols-1 && put(out, &data->delim, 1))
+      return E_IO_WRITE_ERROR;
+  }
+
+  return put(out, &newline, 1);
+
+}
+
+int Slice_write(Slice_T slice, Data_T data, int fd) {
+
+  assert(slice && data);
+
+  int ret, maxcol = 0;
+  int headers = !!slice->headers;
+  long first = slice->first - 1 + headers;
+  long last = slice->last == -1 ? -1 : slice->last - 1 + headers;
+
+  atomic_store(&slice->written, 0);
+
+  struct out *out;
+  NEW0(out);
+  out->slice = slice;
+  out->fd = fd;
+  memset(spaces, ' ', sizeof spaces);
+
+  // The first row tells us how many columns there are
+  char *tok, **buf = NULL;
+  ret = data->get_row(data, &tok, 0, 0, 0);
+  if (ret != E_OK) goto done;
+  buf = CALLOC(data->ncols, sizeof(char *));
+
+  if (!slice->cols) {
+    slice->ncols = data->ncols;
+    slice->cols = CALLOC(data->ncols, sizeof(int));
+    for (int i=0; i<data->ncols; i++) slice->cols[i] = i;
+  }
+
+  for (int i=0; i<slice->ncols; i++) {
+    if (slice->cols[i] >= data->ncols) {
+      ret = E_DTA_COL_OOB;
+      goto done;
+    }
+    if (slice->cols[i] > maxcol) maxcol = slice->cols[i];
+  }
+
+  int *widths = CALLOC(slice->ncols, sizeof(int));
+
+  // Size aligned columns from the header and the start of the slice
+  if (slice->align) {
+    long stop = first + ALIGN_SAMPLE;
+    if (last != -1 && stop > last) stop = last;
+    if (headers) measure(slice, data, buf, 0, maxcol, widths);
+    for (long row = first; row <= stop; row++)
+      if (measure(slice, data, buf, row, maxcol, widths) != E_OK) break;
+  }
+
+  if (headers) {
+    if ((ret = data->get_row(data, buf, 0, 0, maxcol)) != E_OK
+      || (ret = put_row(slice, data, out, buf, widths)) != E_OK)
+      goto free_widths;
+  }
+
+  int identity = data->delimited && !slice->align 
+    && slice->ncols == data->ncols;
+  for (int i=0; identity && i<slice->ncols; i++)
+    identity = slice->cols[i] == i;
+
+  if (identity) {
+
+    // Every column in file order, so the rows are one stretch of the
+    // file that can be copied as it is
+    char *ptr = NULL;
+    ret = data->get_row(data, buf, first, 0, 0);
+    if (ret == E_OK) ptr = buf[0] - Index_get(data->rows, first);
+    else if (ret != E_DTA_EOF) goto free_widths;
+
+    if (ptr) {
+      ssize_t lo = Index_get(data->rows, first);
+      ssize_t hi = last == -1 ? data->st_size : row_start(data, buf, last + 1);
+      if ((ret = copy(out, data, ptr, lo, hi)) != E_OK) goto free_widths;
+
+      // Make sure the last row ends in a newline
+      if (hi == data->st_size && hi > lo && ptr[hi-1] != '\n'
+        && (ret = put(out, &newline, 1)) != E_OK) goto free_widths;
+    }
+
+  } else {
+
+    for (long row = first; last == -1 || row <= last; row++) {
+      if (cancelled(out)) {
+        ret = E_IO_CANCELLED;
+        goto free_widths;
+      }
+      ret = data->get_row(data, buf, row, 0, maxcol);
+      if (ret == E_DTA_EOF) break;
+      if (ret != E_OK) goto free_widths;
+      if ((ret = put_row(slice, data, out, buf, widths)) != E_OK)
+        goto free_widths;
+    }
+
+  }
+
+  ret = flush(out);
+
+free_widths:
+  FREE(widths);
+done:
+  if (buf) FREE(buf);
+  FREE(out);
+
+  return ret == E_DTA_EOF ? E_OK : ret;
+
+}
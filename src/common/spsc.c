@@ -0,0 +1,101 @@
+//
+// -----------------------------------------------------------------------------
+// spsc.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stddef.h>    // NULL
+#include <stdatomic.h>
+#include "error.h"
+#include "mem.h"
+#include "spsc.h"
+
+#define Q Spsc_T
+
+#define CACHE_LINE 64
+
+// head is only written by the consumer and tail only by the producer,
+// so they are padded apart to avoid false sharing
+struct Q {
+  atomic_ulong head;
+  char pad_head[CACHE_LINE - sizeof(atomic_ulong)];
+  atomic_ulong tail;
+  char pad_tail[CACHE_LINE - sizeof(atomic_ulong)];
+  unsigned long mask;
+  void **slots;
+};
+
+Q Spsc_new(int capacity) {
+
+  assert(capacity > 0);
+
+  // Round up to a power of two so indices wrap with a mask
+  unsigned long size = 1;
+  while (size < (unsigned long) capacity) size <<= 1;
+
+  Q queue;
+  NEW0(queue);
+  queue->mask = size - 1;
+  queue->slots = CALLOC(size, sizeof(void *));
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+
+  return queue;
+}
+
+void Spsc_free(Q *queue) {
+  assert(queue && *queue);
+
+  FREE((*queue)->slots);
+  FREE(*queue);
+}
+
+// Returns 0 if the queue is full
+int Spsc_push(Q queue, void *x) {
+  assert(queue);
+
+  unsigned long tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  unsigned long head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+  if (tail - head > queue->mask) return 0;
+
+  queue->slots[tail & queue->mask] = x;
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+  return 1;
+}
+
+// Returns NULL if the queue is empty
+void *Spsc_pop(Q queue) {
+  assert(queue);
+
+  unsigned long head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  unsigned long tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+  if (head == tail) return NULL;
+
+  void *x = queue->slots[head & queue->mask];
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+  return x;
+}
+
+int Spsc_length(Q queue) {
+  assert(queue);
+
+  return (int) (atomic_load(&queue->tail) - atomic_load(&queue->head));
+}
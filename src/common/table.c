@@ -0,0 +1,168 @@
+//
+// -----------------------------------------------------------------------------
+// table.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <limits.h>   // INT_MAX
+#include <stddef.h>   // NULL
+#include <stdint.h>   // uintptr_t
+#include "error.h"
+#include "mem.h"
+#include "table.h"
+
+#define T Table_T
+
+struct binding {
+  struct binding *link;
+  const void *key;
+  void *value;
+};
+
+struct T {
+  int size;
+  int length;
+  int (*cmp)(const void *x, const void *y);
+  unsigned (*hash)(const void *key);
+  struct binding **buckets;
+};
+
+static int cmpatom(const void *x, const void *y) {
+  return x != y;
+}
+
+static unsigned hashatom(const void *key) {
+  return (uintptr_t) key >> 2;
+}
+
+T Table_new(int hint, int cmp(const void *x, const void *y),
+  unsigned hash(const void *key)) {
+
+  // Bucket counts are primes so poor hash functions still spread out
+  static int primes[] = { 509, 509, 1021, 2053, 4093, 8191, 16381, 32771, 
+    65521, INT_MAX };
+
+  assert(hint >= 0);
+
+  int i;
+  for (i=1; primes[i] < hint; i++) ;
+
+  T table;
+  NEW0(table);
+  table->size = primes[i-1];
+  table->cmp = cmp ? cmp : cmpatom;
+  table->hash = hash ? hash : hashatom;
+  table->buckets = CALLOC(table->size, sizeof(struct binding *));
+
+  return table;
+
+}
+
+void Table_free(T *table) {
+
+  assert(table && *table);
+
+  for (int i=0; i<(*table)->size; i++) {
+    struct binding *p, *q;
+    for (p = (*table)->buckets[i]; p; p = q) {
+      q = p->link;
+      FREE(p);
+    }
+  }
+
+  FREE((*table)->buckets);
+  FREE(*table);
+
+}
+
+int Table_length(T table) {
+
+  assert(table);
+  return table->length;
+
+}
+
+// Returns the previous value for key, or NULL if it's new
+void *Table_put(T table, const void *key, void *value) {
+
+  assert(table && key);
+
+  int i = table->hash(key) % table->size;
+  struct binding *p;
+
+  for (p = table->buckets[i]; p; p = p->link)
+    if (table->cmp(key, p->key) == 0) {
+      void *prev = p->value;
+      p->value = value;
+      return prev;
+    }
+
+  NEW(p);
+  p->key = key;
+  p->value = value;
+  p->link = table->buckets[i];
+  table->buckets[i] = p;
+  table->length++;
+
+  return NULL;
+
+}
+
+void *Table_get(T table, const void *key) {
+
+  assert(table && key);
+
+  int i = table->hash(key) % table->size;
+
+  for (struct binding *p = table->buckets[i]; p; p = p->link)
+    if (table->cmp(key, p->key) == 0) return p->value;
+
+  return NULL;
+
+}
+
+// Returns the value for key, or NULL if it wasn't there
+void *Table_remove(T table, const void *key) {
+
+  assert(table && key);
+
+  int i = table->hash(key) % table->size;
+
+  for (struct binding **pp = &table->buckets[i]; *pp; pp = &(*pp)->link)
+    if (table->cmp(key, (*pp)->key) == 0) {
+      struct binding *p = *pp;
+      void *value = p->value;
+      *pp = p->link;
+      FREE(p);
+      table->length--;
+      return value;
+    }
+
+  return NULL;
+
+}
+
+void Table_map(T table, void apply(const void *key, void **value, void *cl),
+  void *cl) {
+
+  assert(table && apply);
+
+  for (int i=0; i<table->size; i++)
+    for (struct binding *p = table->buckets[i]; p; p = p->link)
+      apply(p->key, &p->value, cl);
+
+}
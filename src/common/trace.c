@@ -0,0 +1,209 @@
+//
+// -----------------------------------------------------------------------------
+// trace.c
+// -----------------------------------------------------------------------------
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#define _GNU_SOURCE         // RUSAGE_THREAD
+#include <stdio.h>          // FILE, fprintf, snprintf
+#include <time.h>           // clock_gettime
+#include <sys/resource.h>   // getrusage, RUSAGE_THREAD
+#include "error.h"
+#include "trace.h"
+
+// Log-linear histogram: values below 8 get a bucket each, above that
+// every power of two is split into 8 linear sub-buckets, which keeps
+// the relative error of any percentile under 12.5%
+#define SUB_BITS 3
+#define SUB (1 << SUB_BITS)
+#define NBUCKETS (SUB + (64 - SUB_BITS) * SUB)
+
+typedef struct hist {
+  unsigned long long count;
+  unsigned long long max;
+  unsigned long long buckets[NBUCKETS];
+} hist;
+
+static const char *op_names[TRACE_NOPS] = {
+  "get_row", "get_col", "shift_row", "shift_col", "print"
+};
+
+static hist ops[TRACE_NOPS];
+static hist key_bytes;
+
+// Bytes and page faults are counted per thread so that background
+// scans don't inflate the numbers for the keystroke being handled
+static _Thread_local long bytes;
+
+static long minflt, majflt, last_minflt, last_majflt;
+static struct rusage key_usage;
+static int in_key;
+
+static int bucket(unsigned long long v) {
+
+  if (v < SUB) return v;
+
+  int e = 63 - __builtin_clzll(v);
+  int m = (v >> (e - SUB_BITS)) & (SUB - 1);
+
+  return SUB + (e - SUB_BITS) * SUB + m;
+
+}
+
+// Midpoint of the values that fall into bucket b
+static unsigned long long bucket_value(int b) {
+
+  if (b < SUB) return b;
+
+  int e = (b - SUB) / SUB + SUB_BITS;
+  int m = (b - SUB) % SUB;
+  unsigned long long lo = (unsigned long long) (SUB + m) << (e - SUB_BITS);
+  unsigned long long width = 1ULL << (e - SUB_BITS);
+
+  return lo + width / 2;
+
+}
+
+static void hist_add(hist *h, unsigned long long v) {
+
+  h->count++;
+  h->buckets[bucket(v)]++;
+  if (v > h->max) h->max = v;
+
+}
+
+static unsigned long long hist_percentile(hist *h, double p) {
+
+  if (!h->count) return 0;
+
+  unsigned long long rank = (unsigned long long) (p * h->count);
+  if (rank >= h->count) rank = h->count - 1;
+
+  unsigned long long seen = 0;
+  for (int b=0; b<NBUCKETS; b++) {
+    seen += h->buckets[b];
+    if (seen > rank) {
+      unsigned long long v = bucket_value(b);
+      return v < h->max ? v : h->max;
+    }
+  }
+
+  return h->max;
+
+}
+
+unsigned long long Trace_clock(void) {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+}
+
+void Trace_record(int op, unsigned long long nsec) {
+
+  assert(op >= 0 && op < TRACE_NOPS);
+  hist_add(&ops[op], nsec);
+
+}
+
+void Trace_bytes(long nbytes) {
+  bytes += nbytes;
+}
+
+void Trace_key_start(void) {
+
+  bytes = 0;
+  getrusage(RUSAGE_THREAD, &key_usage);
+  in_key = 1;
+
+}
+
+void Trace_key_stop(void) {
+
+  if (!in_key) return;
+  in_key = 0;
+
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+
+  last_minflt = usage.ru_minflt - key_usage.ru_minflt;
+  last_majflt = usage.ru_majflt - key_usage.ru_majflt;
+  minflt += last_minflt;
+  majflt += last_majflt;
+
+  hist_add(&key_bytes, bytes);
+
+}
+
+// Formats a one-line summary for the debug HUD.
+// Returns 0 if tracing wasn't compiled in.
+int Trace_hud(char *buf, size_t size) {
+
+  assert(buf && size > 0);
+
+#ifndef ENABLE_TRACE
+  snprintf(buf, size, "tracing disabled, reconfigure with --enable-trace");
+  return 0;
+#else
+  int n = 0;
+
+  for (int op=0; op<TRACE_NOPS && n < (int) size; op++) {
+    if (!ops[op].count) continue;
+    n += snprintf(buf + n, size - n, "%s %.1f/%.1f/%.1fus ",
+      op_names[op],
+      hist_percentile(&ops[op], .50) / 1e3,
+      hist_percentile(&ops[op], .99) / 1e3,
+      ops[op].max / 1e3);
+  }
+
+  if (n < (int) size)
+    snprintf(buf + n, size - n, "%lluB/key flt %ld/%ld",
+      hist_percentile(&key_bytes, .50), last_minflt, last_majflt);
+
+  return 1;
+#endif
+
+}
+
+static void dump_hist(FILE *out, const char *name, hist *h, int last) {
+
+  fprintf(out, "    \"%s\": { \"count\": %llu, \"p50\": %llu, "
+    "\"p99\": %llu, \"max\": %llu }%s\n",
+    name, h->count, hist_percentile(h, .50), hist_percentile(h, .99), h->max,
+    last ? "" : ",");
+
+}
+
+// Writes every histogram as JSON. Latencies are in nanoseconds.
+int Trace_dump(FILE *out) {
+
+  assert(out);
+
+  fprintf(out, "{\n  \"latency_ns\": {\n");
+  for (int op=0; op<TRACE_NOPS; op++)
+    dump_hist(out, op_names[op], &ops[op], op == TRACE_NOPS-1);
+  fprintf(out, "  },\n  \"keystrokes\": {\n");
+  dump_hist(out, "bytes_scanned", &key_bytes, 0);
+  fprintf(out, "    \"minor_faults\": %ld,\n", minflt);
+  fprintf(out, "    \"major_faults\": %ld\n", majflt);
+  fprintf(out, "  }\n}\n");
+
+  return ferror(out) ? -1 : 0;
+
+}
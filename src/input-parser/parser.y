@@ -14,14 +14,19 @@
 #include "errorcodes.h"
 %}
 
+%define api.pure full
+%define api.push-pull push
+
 %union {
   char c;
-  // char *s;
+  char *s;
   // long i;
   // double f;
 }
 
-%token <c> LEFT RIGHT UP DOWN OTHER
+%token <c> LEFT RIGHT UP DOWN HUD NEXT_CHANGE PREV_CHANGE NEXT_RAGGED 
+%token <c> PREV_RAGGED MEM_REPORT OTHER
+%token <s> CMD
 
 // TODO: add error handling
 
@@ -29,12 +34,23 @@
 
 list:
   | list cmd
-  | list OTHER               { return 0; }
+  | list OTHER               {
+                               // Any other key closes the panel or the
+                               // sample, or quits
+                               if (!panel && !whole) YYACCEPT;
+                               if (panel) close_panel();
+                               else close_sample();
+                               Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+                             }
   ;
 
 cmd:
   LEFT                  {
-                          if (frame->cursor.col/frame->col_width > 0) {
+                          if (panel) ;  // groups don't scroll sideways
+                          else if (diffview) {
+                            Diffview_move(diffview, 0, -1);
+                            Diffview_print(diffview);
+                          } else if (frame->cursor.col/frame->col_width > 0) {
                             frame->cursor.col -= frame->col_width;
                             Frame_print(frame, data, O_FRM_CURS);
                           } else if (frame->data_loaded.first_col > 0) {
@@ -43,17 +59,25 @@ cmd:
                           }
                         }
   | RIGHT               {
-                          if (frame->cursor.col/frame->col_width < frame->ncols-1) {
+                          if (panel) ;  // groups don't scroll sideways
+                          else if (diffview) {
+                            Diffview_move(diffview, 0, 1);
+                            Diffview_print(diffview);
+                          } else if (frame->cursor.col/frame->col_width < frame->ncols-1) {
                             frame->cursor.col += frame->col_width;
                             Frame_print(frame, data, O_FRM_CURS);
-                          } else if (frame->data_loaded.last_col < data->ncols-1) {
-                            Frame_shift_col(frame, data, 1);
+                          } else if (Frame_shift_col(frame, data, 1) == E_OK)
                             Frame_print(frame, data, O_FRM_DATA);
-                          }
                           // TODO: print errors (parse/oob) in status row
                         }
   | UP                  {
-                          if (frame->cursor.row > 0) {
+                          if (panel) {
+                            Panel_move(panel, -1);
+                            Panel_print(panel);
+                          } else if (diffview) {
+                            Diffview_move(diffview, -1, 0);
+                            Diffview_print(diffview);
+                          } else if (frame->cursor.row > 0) {
                             frame->cursor.row--;
                             Frame_print(frame, data, O_FRM_CURS);
                           } else if 
@@ -64,13 +88,50 @@ cmd:
                         }
 
   | DOWN                {
-                          if (frame->cursor.row < frame->nrows - 1) {
+                          if (panel) {
+                            Panel_move(panel, 1);
+                            Panel_print(panel);
+                          } else if (diffview) {
+                            Diffview_move(diffview, 1, 0);
+                            Diffview_print(diffview);
+                          } else if (frame->cursor.row < frame->nrows - 1) {
                             frame->cursor.row++;
                             Frame_print(frame, data, O_FRM_CURS);
                           } else if (Frame_shift_row(frame, data, 1) == E_OK)
                             Frame_print(frame, data, O_FRM_DATA);
                           // TODO: print errors (parse/oob) in status row
                         }
+  | HUD                 {
+                          if (!diffview && !panel) {
+                            hud = !hud;
+                            if (hud) show_hud();
+                            else Frame_status(frame, "");
+                            Frame_print(frame, data, 0);
+                          }
+                        }
+  | MEM_REPORT          {
+                          if (!diffview && !panel) {
+                            report_mem();
+                            Frame_print(frame, data, 0);
+                          }
+                        }
+  | NEXT_CHANGE         {
+                          if (diffview) {
+                            if (Diffview_jump(diffview, 1) != E_OK)
+                              Diffview_status(diffview, "No more differences");
+                            Diffview_print(diffview);
+                          }
+                        }
+  | PREV_CHANGE         {
+                          if (diffview) {
+                            if (Diffview_jump(diffview, -1) != E_OK)
+                              Diffview_status(diffview, "No more differences");
+                            Diffview_print(diffview);
+                          }
+                        }
+  | NEXT_RAGGED         { if (!diffview && !panel) goto_ragged(1); }
+  | PREV_RAGGED         { if (!diffview && !panel) goto_ragged(-1); }
+  | CMD                 { if (run_command($1)) YYACCEPT; }
   ;
 
 %%
@@ -0,0 +1,120 @@
+//
+// -----------------------------------------------------------------------------
+// scanner.c
+// -----------------------------------------------------------------------------
+//
+// Scanner for input-parser. Translates keystrokes into parser tokens.
+// Keys are pushed in one at a time by the event loop rather than pulled
+// with getch, so the scanner never blocks.
+//
+// Tyler Wayne © 2021
+//
+
+#include <ncurses.h>
+#include "preview.h"
+#include "parser.h"
+
+#define ESCAPE 27
+
+// Command typed after ':', echoed in the status line as it's typed
+static char line[sizeof ((Frame_T) 0)->status - 1];
+static int len = 0;
+static int in_command = 0;
+
+// First key of a two-key binding such as ]c or [e
+static int prefix = 0;
+
+static void echo_command(void) {
+
+  if (diffview) {
+    if (in_command) Diffview_status(diffview, ":%.*s", len, line);
+    else Diffview_status(diffview, "");
+    Diffview_print(diffview);
+    return;
+  }
+
+  if (panel) {
+    if (in_command) Panel_status(panel, ":%.*s", len, line);
+    else Panel_status(panel, "");
+    Panel_print(panel);
+    return;
+  }
+
+  if (in_command) Frame_status(frame, ":%.*s", len, line);
+  else Frame_status(frame, "");
+  Frame_print(frame, data, 0);
+
+}
+
+// Builds up a command one key at a time. Returns CMD with the
+// command in *text once it's entered.
+static int scan_command(int c, char **text) {
+
+  switch (c) {
+    case '\n':
+    case '\r':
+    case KEY_ENTER:
+      in_command = 0;
+      line[len] = '\0';
+      *text = line;
+      return CMD;
+
+    case ESCAPE:
+      in_command = 0;
+      break;
+
+    case KEY_BACKSPACE:
+    case 127:
+    case '\b':
+      if (len > 0) len--;
+      else in_command = 0;
+      break;
+
+    default:
+      if (c >= ' ' && c < 127 && len < (int) sizeof line - 1) line[len++] = c;
+  }
+
+  echo_command();
+
+  return 0;
+
+}
+
+// Returns the token for a keystroke, or 0 if the key doesn't
+// complete a token on its own
+int scan_key(int c, char **text) {
+
+  // ncurses reports a resize as a key too, but it's handled by the
+  // event loop's SIGWINCH handler
+  if (c == KEY_RESIZE) return 0;
+
+  if (in_command) return scan_command(c, text);
+
+  if (prefix) {
+    int first = prefix;
+    prefix = 0;
+    if (c == 'c') return first == ']' ? NEXT_CHANGE : PREV_CHANGE;
+    if (c == 'e') return first == ']' ? NEXT_RAGGED : PREV_RAGGED;
+    return OTHER;
+  }
+
+  switch (c) {
+    case 'h': return LEFT;
+    case 'l': return RIGHT;
+    case 'j': return DOWN;
+    case 'k': return UP;
+    case '=': return HUD;
+    case 'M': return MEM_REPORT;
+    case ']':
+    case '[':
+      prefix = c;
+      return 0;
+    case ':':
+      in_command = 1;
+      len = 0;
+      echo_command();
+      return 0;
+    default:  return OTHER;
+  }
+
+}
@@ -0,0 +1,347 @@
+//
+// -----------------------------------------------------------------------------
+// command.c
+// -----------------------------------------------------------------------------
+//
+// Commands entered after ':'. Each command is a name followed by
+// its argument, e.g. ":cols 1,Country,5-7", ":col 15000" or
+// ":agg sum(amount) by Country".
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdio.h>    // snprintf
+#include <stdlib.h>   // strtod
+#include <string.h>   // strcmp, strspn, strcspn, strchr, memcpy
+#include <fcntl.h>    // open, O_WRONLY
+#include "mem.h"      // CALLOC, FREE
+#include "preview.h"
+#include "columns.h"
+#include "slice.h"
+#include "errorcodes.h"
+
+// :cols LIST shows only the columns in LIST, :cols shows them all
+static void cmd_cols(char *arg) {
+
+  int *cols = NULL, ncols = 0, err;
+
+  if (*arg) {
+    err = Columns_parse(data, arg, !!frame->headers, &cols, &ncols);
+    if (err == E_OK) {
+      err = Frame_project(frame, data, cols, ncols);
+      FREE(cols);
+    }
+  } else err = Frame_project(frame, data, NULL, 0);
+
+  switch (err) {
+    case E_OK:
+      Frame_status(frame, "");
+      break;
+    case E_DTA_COL_OOB:
+      Frame_status(frame, "Column out of range: %s", arg);
+      break;
+    case E_DTA_BAD_INPUT:
+      Frame_status(frame, "No such column: %s", arg);
+      break;
+    default:
+      Frame_status(frame, "Error loading columns");
+  }
+
+  Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+
+}
+
+// :col N or :col NAME moves the cursor to that column
+static void cmd_col(char *arg) {
+
+  int *cols = NULL, ncols = 0, icol = -1;
+
+  int err = Columns_parse(data, arg, !!frame->headers, &cols, &ncols);
+  if (err == E_OK) {
+    if (!frame->projection.cols) icol = cols[0];
+    else for (int i=0; i<frame->projection.ncols; i++)
+      if (frame->projection.cols[i] == cols[0]) icol = i;
+    FREE(cols);
+    err = Frame_goto_col(frame, data, icol);
+  }
+
+  switch (err) {
+    case E_OK:
+      Frame_status(frame, "");
+      break;
+    case E_DTA_COL_OOB:
+      Frame_status(frame, "Column not shown: %s", arg);
+      break;
+    case E_DTA_BAD_INPUT:
+      Frame_status(frame, "No such column: %s", arg);
+      break;
+    default:
+      Frame_status(frame, "Error loading columns");
+  }
+
+  Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+
+}
+
+// ]e and [e move the cursor to the next or previous ragged row
+void goto_ragged(int dir) {
+
+  switch (Frame_goto_ragged(frame, data, dir)) {
+    case E_OK:
+      Frame_status(frame, "");
+      break;
+    case E_DTA_BAD_INPUT:
+      Frame_status(frame, "Rows are only checked with --ragged");
+      break;
+    default:
+      Frame_status(frame, "No more ragged rows");
+  }
+
+  Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+
+}
+
+// Column under the cursor
+static int current_col(void) {
+
+  int icol = frame->data_loaded.first_col + frame->cursor.col / frame->col_width;
+
+  return frame->projection.cols ? frame->projection.cols[icol] : icol;
+
+}
+
+// Header of col without quotes, or its number if there's no header
+static void col_name(int col, char *buf, int size) {
+
+  char *tok;
+
+  if (!frame->headers || data->get_row(data, &tok, 0, col, col) != E_OK) {
+    snprintf(buf, size, "column %d", col + 1);
+    return;
+  }
+
+  int len = data->toklen(tok, data->delim);
+  if (len >= 2 && tok[0] == '"' && tok[len-1] == '"') tok++, len -= 2;
+  snprintf(buf, size, "%.*s", len, tok);
+
+}
+
+// The first column in spec, or -1 if it isn't one
+static int parse_col(const char *spec) {
+
+  int *cols, ncols, col;
+
+  if (Columns_parse(data, spec, !!frame->headers, &cols, &ncols) != E_OK)
+    return -1;
+  col = cols[0];
+  FREE(cols);
+
+  return col;
+
+}
+
+static void group(int key_col, int val_col, int agg, const char *func) {
+
+  char key[64], value[64] = "", name[48];
+
+  if (!data->scan_fields) {
+    close_panel();
+    Frame_status(frame, whole ? "Can't group sampled rows"
+      : "Can't group rows of this format");
+    Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+    return;
+  }
+
+  col_name(key_col, key, sizeof key);
+  if (val_col >= 0) {
+    col_name(val_col, name, sizeof name);
+    snprintf(value, sizeof value, "%s(%s)", func, name);
+  }
+
+  Frame_status(frame, "");
+  Panel_T new = Panel_new(key, val_col >= 0 ? value : NULL, agg);
+  if (!new || open_panel(new, key_col, val_col) != E_OK) {
+    Frame_status(frame, "Error starting the scan");
+    Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+  }
+
+}
+
+// :count counts the values of the current column, :count COL of COL
+static void cmd_count(char *arg) {
+
+  int col = *arg ? parse_col(arg) : current_col();
+
+  if (col < 0) {
+    close_panel();
+    Frame_status(frame, "No such column: %s", arg);
+    Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+    return;
+  }
+
+  group(col, -1, GROUPBY_COUNT, NULL);
+
+}
+
+// :agg FUNC(COL) by KEY, where FUNC is count, sum, mean, min or max
+static void cmd_agg(char *arg) {
+
+  static const char *funcs[] = { "count", "sum", "mean", "min", "max" };
+  int agg = -1, val_col = -1, key_col = -1;
+
+  char *open = strchr(arg, '('), *close = open ? strchr(open, ')') : NULL;
+  if (close) {
+    *open = *close = '\0';
+    for (int i=0; i<(int) (sizeof funcs / sizeof *funcs); i++)
+      if (strcmp(arg, funcs[i]) == 0) agg = i;
+    if (strcmp(arg, "avg") == 0) agg = GROUPBY_MEAN;
+
+    char *by = close + 1 + strspn(close + 1, " ");
+    if (strncmp(by, "by ", 3) == 0) {
+      val_col = parse_col(open + 1);
+      key_col = parse_col(by + 3 + strspn(by + 3, " "));
+    }
+  }
+
+  if (agg < 0 || val_col < 0 || key_col < 0) {
+    close_panel();
+    Frame_status(frame, "Usage: :agg sum(COL) by COL");
+    Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+    return;
+  }
+
+  group(key_col, val_col, agg, funcs[agg]);
+
+}
+
+// :w FILE writes the columns shown to FILE, and :w FILE ROWS only
+// the rows in ROWS, e.g. 1e6:1e6+50. The rows are written in the
+// background, and any key stops them.
+static void cmd_write(char *arg) {
+
+  char *path = arg, *rows = arg + strcspn(arg, " ");
+  if (*rows) *rows++ = '\0';
+  rows += strspn(rows, " ");
+
+  int err = E_OK, fd = -1;
+  Slice_T slice = Slice_init(!!frame->headers, 0, frame->col_width);
+
+  if (!*path) err = E_DTA_BAD_INPUT;
+  else if (*rows) err = Slice_parse_rows(slice, rows);
+
+  if (err == E_OK && frame->projection.cols) {
+    slice->ncols = frame->projection.ncols;
+    slice->cols = CALLOC(slice->ncols, sizeof(int));
+    memcpy(slice->cols, frame->projection.cols, slice->ncols * sizeof(int));
+  }
+
+  if (err == E_OK) {
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) err = E_IO_WRITE_ERROR;
+  }
+
+  if (err == E_OK) {
+    open_write(slice, fd, path);
+    return;
+  }
+
+  Slice_free(&slice);
+
+  if (err == E_DTA_BAD_INPUT) 
+    Frame_status(frame, "Usage: :w FILE [FIRST:LAST]");
+  else Frame_status(frame, "Error writing %s", path);
+
+  Frame_print(frame, data, 0);
+
+}
+
+// :sample N shows N rows picked at random from the whole file, and
+// :sample a thousand
+static void cmd_sample(char *arg) {
+
+  char *end;
+  double n = *arg ? strtod(arg, &end) : 1000;
+
+  if (*arg && (end == arg || *end || n < 1 || n > 1e12)) {
+    Frame_status(frame, "Usage: :sample [N]");
+    Frame_print(frame, data, 0);
+    return;
+  }
+
+  switch (open_sample(n)) {
+    case E_OK:
+      return;
+    case E_DTA_BAD_INPUT:
+      Frame_status(frame, "Rows of this format can't be sampled");
+      break;
+    default:
+      Frame_status(frame, "Error loading data");
+  }
+
+  Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+
+}
+
+static struct {
+  const char *name;
+  void (*run)(char *arg);
+} commands[] = {
+  { "agg", cmd_agg },
+  { "col", cmd_col },
+  { "cols", cmd_cols },
+  { "count", cmd_count },
+  { "sample", cmd_sample },
+  { "w", cmd_write },
+  { NULL, NULL }
+};
+
+int run_command(char *line) {
+
+  line += strspn(line, " ");
+  char *arg = line + strcspn(line, " ");
+  if (*arg) *arg++ = '\0';
+  arg += strspn(arg, " ");
+
+  if (*line == '\0') return 0;
+  if (strcmp(line, "q") == 0) return 1;
+
+  // The other commands act on the frame, which a diff doesn't have
+  if (diffview) {
+    Diffview_status(diffview, "Not a command: %s", line);
+    Diffview_print(diffview);
+    return 0;
+  }
+
+  for (int i=0; commands[i].name; i++)
+    if (strcmp(line, commands[i].name) == 0) {
+      // Commands that act on the frame close the panel first
+      if (commands[i].run != cmd_count && commands[i].run != cmd_agg) 
+        close_panel();
+      commands[i].run(arg);
+      return 0;
+    }
+
+  if (panel) {
+    Panel_status(panel, "Not a command: %s", line);
+    Panel_print(panel);
+    return 0;
+  }
+
+  Frame_status(frame, "Not a command: %s", line);
+  Frame_print(frame, data, 0);
+
+  return 0;
+
+}
@@ -0,0 +1,262 @@
+//
+// -----------------------------------------------------------------------------
+// diffview.c
+// -----------------------------------------------------------------------------
+//
+// Side-by-side view of two files for --diff. The screen is split down
+// the middle, rows are lined up by the diff as the files are hashed in
+// the background, and cells that differ are shown in bold.
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdarg.h>   // va_list
+#include <stdio.h>    // vsnprintf
+#include <string.h>   // memcmp
+#include <ncurses.h>
+#include "mem.h"      // NEW0, CALLOC, FREE
+#include "preview.h"
+#include "errorcodes.h"
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// Markers shown in the gutter of each side
+static const char markers[] = { ' ', '~', '-', '+', ' ' };
+
+Diffview_T Diffview_new(Data_T a, Data_T b, int keyed, int headers,
+  int col_width) {
+
+  if (!a || !b || col_width < 4) return NULL;
+
+  Diffview_T view;
+  NEW0(view);
+
+  view->diff = Diff_new(keyed);
+  view->data[DIFF_A] = a;
+  view->data[DIFF_B] = b;
+  view->headers = !!headers;
+  view->col_width = col_width;
+
+  return view;
+
+}
+
+void Diffview_free(Diffview_T *view) {
+
+  assert(view && *view);
+
+  Diff_free(&(*view)->diff);
+  FREE(*view);
+
+}
+
+void Diffview_status(Diffview_T view, const char *fmt, ...) {
+
+  assert(view && fmt);
+
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(view->status, sizeof view->status, fmt, ap);
+  va_end(ap);
+
+}
+
+static int visible_rows(Diffview_T view) {
+  return MAX(LINES - 1 - view->headers, 1);
+}
+
+static int visible_cols(Diffview_T view) {
+  return MAX((COLS / 2 - 2) / view->col_width, 1);
+}
+
+static int total_cols(Diffview_T view) {
+  return MAX(view->data[DIFF_A]->ncols, view->data[DIFF_B]->ncols);
+}
+
+// Fetches the visible cells of a row of one file. Cells past the end
+// of the file's columns are left NULL.
+static int fetch(Diffview_T view, int side, long row, char **buf, int n) {
+
+  Data_T data = view->data[side];
+  int first = view->first_col, last = MIN(first + n, data->ncols) - 1;
+
+  for (int i=0; i<n; i++) buf[i] = NULL;
+  if (row < 0 || last < first) return E_OK;
+
+  return data->get_row(data, buf, row, first, last);
+
+}
+
+static int same_cell(Diffview_T view, const char *a, const char *b) {
+
+  if (!a || !b) return a == b;
+
+  Data_T da = view->data[DIFF_A], db = view->data[DIFF_B];
+  int la = da->toklen(a, da->delim), lb = db->toklen(b, db->delim);
+
+  return la == lb && memcmp(a, b, la) == 0;
+
+}
+
+static void print_side(Diffview_T view, int side, int y, int marker,
+  char **cells, char **other, int n, int bold) {
+
+  Data_T data = view->data[side];
+  int x0 = side == DIFF_A ? 0 : COLS / 2 + 1;
+
+  mvaddch(y, x0, marker);
+
+  for (int i=0; i<n; i++) {
+    int x = x0 + 2 + i * view->col_width;
+    int changed = bold || (other && !same_cell(view, cells[i], other[i]));
+
+    if (changed) attron(A_BOLD);
+    if (cells[i]) 
+      data->mvaddntok(y, x, cells[i], view->col_width - 3, data->delim);
+    if (changed) attroff(A_BOLD);
+
+    if (i < n-1) mvaddch(y, x + view->col_width - 2, '|');
+  }
+
+}
+
+void Diffview_print(Diffview_T view) {
+
+  assert(view);
+
+  int nrows = visible_rows(view), ncols = visible_cols(view);
+  char **a = CALLOC(ncols, sizeof(char *));
+  char **b = CALLOC(ncols, sizeof(char *));
+
+  erase();
+
+  // Headers
+  if (view->headers) {
+    attron(A_UNDERLINE);
+    if (fetch(view, DIFF_A, 0, a, ncols) == E_OK)
+      print_side(view, DIFF_A, 0, ' ', a, NULL, ncols, 0);
+    if (fetch(view, DIFF_B, 0, b, ncols) == E_OK)
+      print_side(view, DIFF_B, 0, ' ', b, NULL, ncols, 0);
+    attroff(A_UNDERLINE);
+  }
+
+  long length = Diff_length(view->diff);
+
+  for (int y=0; y<nrows && view->top + y < length; y++) {
+
+    long ra, rb;
+    int type = Diff_get(view->diff, view->top + y, &ra, &rb);
+    if (ra >= 0) ra += view->headers;
+    if (rb >= 0) rb += view->headers;
+
+    if (fetch(view, DIFF_A, ra, a, ncols) != E_OK
+      || fetch(view, DIFF_B, rb, b, ncols) != E_OK) continue;
+
+    int row = y + view->headers;
+    if (ra >= 0) print_side(view, DIFF_A, row, markers[type], a, 
+      type == DIFF_CHANGED ? b : NULL, ncols, type == DIFF_DELETED);
+    if (rb >= 0) print_side(view, DIFF_B, row, markers[type], b, 
+      type == DIFF_CHANGED ? a : NULL, ncols, type == DIFF_ADDED);
+  }
+
+  mvvline(0, COLS / 2, ACS_VLINE, LINES - 1);
+
+  // Status line
+  mvaddnstr(LINES-1, 0, view->status, MAX(COLS - 24, 0));
+
+  char loc_buf[64];
+  snprintf(loc_buf, sizeof loc_buf, "%ld/%ld,%d", 
+    view->top + view->cursor_row + 1, length, 
+    view->first_col + view->cursor_col + 1);
+  mvaddnstr(LINES-1, COLS - 22, loc_buf, 22);
+
+  // Highlight the current cell on both sides
+  int y = view->cursor_row + view->headers;
+  int x = 2 + view->cursor_col * view->col_width;
+  mvchgat(y, x, view->col_width - 3, A_REVERSE, 0, NULL);
+  mvchgat(y, COLS / 2 + 1 + x, view->col_width - 3, A_REVERSE, 0, NULL);
+
+  refresh();
+
+  FREE(a);
+  FREE(b);
+
+}
+
+// Moves the cursor, scrolling when it runs off the screen
+void Diffview_move(Diffview_T view, int drow, int dcol) {
+
+  assert(view);
+
+  long length = Diff_length(view->diff);
+  int nrows = visible_rows(view), ncols = visible_cols(view);
+
+  long row = view->top + view->cursor_row + drow;
+  row = MAX(0, MIN(row, length - 1));
+  if (row < view->top) view->top = row;
+  if (row >= view->top + nrows) view->top = row - nrows + 1;
+  view->cursor_row = MAX(row - view->top, 0);
+
+  int col = view->first_col + view->cursor_col + dcol;
+  col = MAX(0, MIN(col, total_cols(view) - 1));
+  if (col < view->first_col) view->first_col = col;
+  if (col >= view->first_col + ncols) view->first_col = col - ncols + 1;
+  view->cursor_col = col - view->first_col;
+
+}
+
+// Moves to the next (dir 1) or previous (dir -1) run of differences
+int Diffview_jump(Diffview_T view, int dir) {
+
+  assert(view);
+
+  long row = Diff_next(view->diff, view->top + view->cursor_row, dir);
+  if (row < 0) return E_DTA_ROW_OOB;
+
+  int nrows = visible_rows(view);
+  if (row < view->top || row >= view->top + nrows)
+    view->top = MAX(0, row - nrows / 3);
+  view->cursor_row = row - view->top;
+
+  return E_OK;
+
+}
+
+void Diffview_message(Diffview_T view, Msg_T msg) {
+
+  assert(view && msg);
+
+  switch (msg->type) {
+    case MSG_HASH_ROWS:
+      Diff_add(view->diff, msg->side, msg->hashes, msg->keys, msg->n);
+      view->progress[msg->side] = 100. * msg->done / MAX(msg->total, 1);
+      FREE(msg->hashes);
+      if (msg->keys) FREE(msg->keys);
+      break;
+    case MSG_HASH_DONE:
+      Diff_done(view->diff, msg->side);
+      view->progress[msg->side] = 100;
+      break;
+  }
+
+  if (Diff_finished(view->diff))
+    Diffview_status(view, "%ld rows differ", Diff_changes(view->diff));
+  else
+    Diffview_status(view, "Diffing... %ld%% / %ld%%, %ld rows differ so far",
+      (long) view->progress[DIFF_A], (long) view->progress[DIFF_B],
+      Diff_changes(view->diff));
+
+}
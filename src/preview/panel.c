@@ -0,0 +1,172 @@
+//
+// -----------------------------------------------------------------------------
+// panel.c
+// -----------------------------------------------------------------------------
+//
+// Frequency table for :count and :agg, shown in place of the frame
+// until it's closed. Groups are shown as they arrive from the
+// background scan, most frequent first.
+//
+// Copyright © 2021 Tyler Wayne
+// the background, and cells that differ are shown in bold.
+//
+// Copyright © 2021 Tyler Wayne
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+
+#include <math.h>     // isnan
+#include <stdarg.h>   // va_list
+#include <stdio.h>    // snprintf, vsnprintf
+#include <string.h>   // strcpy
+#include <ncurses.h>
+#include "mem.h"      // NEW0, CALLOC, FREE
+#include "preview.h"
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// Most groups listed
+#define PANEL_MAX 1000
+
+// Width of the count and value columns
+#define NUM_WIDTH 14
+
+Panel_T Panel_new(const char *key, const char *value, int agg) {
+
+  if (!key) return NULL;
+
+  Panel_T panel;
+  NEW0(panel);
+
+  panel->agg = agg;
+  snprintf(panel->key, sizeof panel->key, "%s", key);
+  snprintf(panel->value, sizeof panel->value, "%s", value ? value : "percent");
+  panel->top = CALLOC(PANEL_MAX, sizeof(Groupby_group));
+
+  return panel;
+
+}
+
+void Panel_free(Panel_T *panel) {
+
+  assert(panel && *panel);
+
+  FREE((*panel)->top);
+  FREE(*panel);
+
+}
+
+void Panel_status(Panel_T panel, const char *fmt, ...) {
+
+  assert(panel && fmt);
+
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(panel->status, sizeof panel->status, fmt, ap);
+  va_end(ap);
+
+}
+
+static int visible_rows(void) {
+  return MAX(LINES - 2, 1);
+}
+
+void Panel_print(Panel_T panel) {
+
+  assert(panel);
+
+  int key_width = MAX(COLS - 2 * NUM_WIDTH, 1);
+  char buf[32];
+
+  erase();
+
+  attron(A_UNDERLINE);
+  mvhline(0, 0, ' ', COLS);
+  mvaddnstr(0, 0, panel->key, key_width - 1);
+  mvprintw(0, key_width, "%*s", NUM_WIDTH, "count");
+  mvprintw(0, key_width + NUM_WIDTH, "%*.*s", NUM_WIDTH, NUM_WIDTH - 1, 
+    panel->value);
+  attroff(A_UNDERLINE);
+
+  for (int y=0; y<visible_rows() && panel->first + y < panel->ntop; y++) {
+    Groupby_group *g = &panel->top[panel->first + y];
+
+    // Values are shown as they are in the file, less any quotes
+    const char *key = g->key;
+    int len = g->len;
+    if (len >= 2 && key[0] == '"' && key[len-1] == '"') key++, len -= 2;
+    mvaddnstr(y + 1, 0, key, MIN(len, key_width - 1));
+    mvprintw(y + 1, key_width, "%*ld", NUM_WIDTH, g->count);
+
+    if (panel->agg == GROUPBY_COUNT)
+      snprintf(buf, sizeof buf, "%.2f%%", 
+        panel->nrows ? 100. * g->count / panel->nrows : 0.);
+    else if (isnan(Groupby_value(g, panel->agg))) strcpy(buf, "-");
+    else snprintf(buf, sizeof buf, "%.*g", NUM_WIDTH - 4, 
+      Groupby_value(g, panel->agg));
+    mvprintw(y + 1, key_width + NUM_WIDTH, "%*s", NUM_WIDTH, buf);
+  }
+
+  // Status line
+  mvaddnstr(LINES-1, 0, panel->status, MAX(COLS - 24, 0));
+
+  char loc_buf[24];
+  snprintf(loc_buf, sizeof loc_buf, "%d/%d", 
+    panel->ntop ? panel->first + panel->cursor + 1 : 0, panel->ntop);
+  mvaddnstr(LINES-1, COLS - 22, loc_buf, 22);
+
+  if (panel->ntop) mvchgat(panel->cursor + 1, 0, COLS, A_REVERSE, 0, NULL);
+
+  refresh();
+
+}
+
+// Moves the cursor, scrolling when it runs off the screen
+void Panel_move(Panel_T panel, int drow) {
+
+  assert(panel);
+
+  int row = panel->first + panel->cursor + drow;
+  row = MAX(0, MIN(row, panel->ntop - 1));
+  if (row < panel->first) panel->first = row;
+  if (row >= panel->first + visible_rows()) 
+    panel->first = row - visible_rows() + 1;
+  panel->cursor = MAX(row - panel->first, 0);
+
+}
+
+// Takes the groups posted by the scan
+void Panel_message(Panel_T panel, Msg_T msg) {
+
+  assert(panel && msg);
+
+  if (!msg->groups) return;
+
+  panel->ntop = Groupby_top(msg->groups, panel->top, PANEL_MAX, panel->agg);
+  panel->nrows = Groupby_rows(msg->groups);
+  panel->error = Groupby_error(msg->groups);
+  panel->ngroups = Groupby_length(msg->groups);
+  Groupby_free(&msg->groups);
+  Panel_move(panel, 0);
+
+  char approx[64] = "";
+  if (panel->error) 
+    snprintf(approx, sizeof approx, " (counts may be over by %ld)", 
+      panel->error);
+
+  if (msg->type == MSG_GROUP_DONE)
+    Panel_status(panel, "%ld rows, %s%d groups%s", panel->nrows, 
+      panel->error ? "more than " : "", panel->ngroups, approx);
+  else
+    Panel_status(panel, "Grouping... %ld%%, %ld rows so far%s", 
+      msg->total ? (long) (100. * msg->done / msg->total) : 100L, 
+      panel->nrows, approx);
+
+}
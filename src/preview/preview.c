@@ -20,12 +20,26 @@
 // limitations under the License.
 //
 
-#include <stdio.h>    // fprintf
-#include <stdlib.h>   // exit, EXIT_FAILURE
+#include <stdio.h>    // fprintf, snprintf
+#include <stdlib.h>   // exit, getenv, EXIT_FAILURE
+#include <string.h>   // memset, strcmp, strrchr, strpbrk
+#include <sys/stat.h> // stat
+#include <signal.h>   // SIGWINCH
+#include <unistd.h>   // STDIN_FILENO, close
+#include <pthread.h>  // pthread_create, pthread_join
+#include <time.h>     // clock_gettime
 #include <ncurses.h>
 #include "argparse.h" // arguments, argp_parse
+#include "backend.h"
+#include "mem.h"      // CALLOC, FREE, Mem_report
 #include "preview.h"
+#include "serve.h"
+#include "slice.h"
+#include "index.h"    // Index_get
+#include "columns.h"
+#include "parser.h"   // yypstate, yypush_parse
 #include "errorcodes.h"
+#include "trace.h"
 
 #define EXIT(msg) do { \
   endwin(); \
@@ -33,6 +47,8 @@
   exit(EXIT_FAILURE); \
   } while (0)
 
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
 void print_char_node(void **x, void *cl) {
 
   printf("%s\n", * (char **) x);
@@ -48,6 +64,708 @@ void yyerror(char *s) {
 // TODO: make parser reentrant to avoid global variables
 Frame_T frame;
 Data_T data;
+Diffview_T diffview = NULL;
+Panel_T panel = NULL;
+Pool_T pool = NULL;
+Data_T whole = NULL;
+
+int hud = 0;
+
+// Screen needs its status line redrawn on the next tick
+static int dirty = 0;
+
+// Background scan for the panel, which posts to its own channel
+static Loop_T ui_loop;
+static Spsc_T group_channel;
+static struct Worker_T grouper;
+static pthread_t grouper_thread;
+static int grouping = 0;
+
+// Write started by :w, which posts to its own channel once it's done
+static Spsc_T write_channel;
+static struct Worker_T writer;
+static Pool_token writing = NULL;
+static char write_path[256];
+
+// Screen was resized while a write had the data
+static int resized = 0;
+
+// Frame of the whole file while a sample is shown
+static Frame_T whole_frame;
+
+// Samples can't be asked for more rows than this
+#define SAMPLE_MAX (1L << 20)
+
+void show_hud(void) {
+
+  char buf[sizeof frame->status];
+  Trace_hud(buf, sizeof buf);
+  Frame_status(frame, "%s", buf);
+
+}
+
+// File given with --mem-report, if any
+static const char *mem_report = NULL;
+
+static int write_mem_report(void) {
+
+  FILE *out = fopen(mem_report, "w");
+  int written = out ? Mem_report(out) : -1;
+  if (out && fclose(out)) written = -1;
+
+  return written;
+
+}
+
+void report_mem(void) {
+
+  if (!mem_report) 
+    Frame_status(frame, "Start with --mem-report FILE to write allocations");
+  else if (write_mem_report() < 0)
+    Frame_status(frame, "Error writing allocations to %s", mem_report);
+  else Frame_status(frame, "Allocations written to %s", mem_report);
+
+}
+
+// Run once everything's been freed, so what's still live has leaked
+static void report_mem_at_exit(void) {
+
+  if (write_mem_report() < 0)
+    fprintf(stderr, "Error writing allocations to %s\n", mem_report);
+
+}
+
+static void on_input(Loop_T loop, int fd, void *cl) {
+
+  yypstate *parser = cl;
+  YYSTYPE lval = { 0 };
+  int c;
+
+  // getch doesn't block since the terminal is in nodelay mode
+  while ((c = getch()) != ERR) {
+    char *text = NULL;
+    // Any key stops a write, which has the data to itself till then
+    if (writing) {
+      close_write();
+      Frame_print(frame, data, 0);
+      continue;
+    }
+
+    int token = scan_key(c, &text);
+    if (!token) continue;
+    if (token == CMD) lval.s = text;
+    else lval.c = c;
+    TRACE_KEY_START();
+    int status = yypush_parse(parser, token, &lval);
+    TRACE_KEY_STOP();
+    if (status != YYPUSH_MORE) {
+      Loop_stop(loop);
+      return;
+    }
+    if (hud) {
+      show_hud();
+      dirty = 1;
+    }
+  }
+
+}
+
+// The frame is fitted to the new size in place, keeping what's been
+// read, so resizing doesn't go back to the file for what's on screen
+static void fit_screen(void) {
+
+  if (frame) {
+    int max_rows, max_cols;
+    getmaxyx(stdscr, max_rows, max_cols);
+    max_cols = MAX(max_cols / frame->col_width, 1);
+    max_rows = MAX(max_rows - 1, 1);
+    Frame_resize(frame, data, max_cols, max_rows);
+    if (whole) Frame_resize(whole_frame, whole, max_cols, max_rows);
+  }
+
+  if (diffview) Diffview_print(diffview);
+  else if (panel) Panel_print(panel);
+  else Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+
+}
+
+// A write has the data to itself, so the frame is fitted once it's done
+static void on_resize(Loop_T loop, int signo, void *cl) {
+
+  endwin();
+  refresh();
+
+  if (writing) {
+    resized = 1;
+    Frame_print(frame, data, 0);
+  } else fit_screen();
+
+}
+
+static void on_tick(Loop_T loop, void *cl) {
+
+  if (writing && !hud) {
+    Frame_status(frame, "Writing %s... %ldM", write_path, 
+      atomic_load(&writer.slice->written) >> 20);
+    dirty = 1;
+  }
+
+  if (!dirty) return;
+  if (diffview) Diffview_print(diffview);
+  else if (panel) Panel_print(panel);
+  else Frame_print(frame, data, 0);
+  dirty = 0;
+
+}
+
+static void on_message(Loop_T loop, void *x, void *cl) {
+
+  Msg_T msg = x;
+
+  if (diffview) {
+    Diffview_message(diffview, msg);
+    dirty = 1;
+    FREE(msg);
+    return;
+  }
+
+  // Rows are counted in the whole file, even while a sample is shown
+  Frame_T target = whole ? whole_frame : frame;
+
+  switch (msg->type) {
+    case MSG_INDEX_PROGRESS:
+      if (hud) break;
+      Frame_status(target, "Indexing... %ld%%", 
+        (long) (100. * msg->done / msg->total));
+      break;
+    case MSG_INDEX_DONE:
+      if (hud) break;
+      Frame_status(target, "%ld rows", msg->nrows - !!target->headers);
+      break;
+  }
+
+  dirty = 1;
+  FREE(msg);
+
+}
+
+static void on_group(Loop_T loop, void *x, void *cl) {
+
+  Msg_T msg = x;
+
+  if (panel) {
+    Panel_message(panel, msg);
+    dirty = 1;
+  }
+
+  if (msg->groups) Groupby_free(&msg->groups);
+  FREE(msg);
+
+}
+
+// Closes the file and says how the write went
+static void finish_write(int err) {
+
+  Pool_token_free(&writing);
+  if (close(writer.fd) < 0 && err == E_OK) err = E_IO_WRITE_ERROR;
+  Slice_free(&writer.slice);
+
+  switch (err) {
+    case E_OK:
+      Frame_status(frame, "Wrote %s", write_path);
+      break;
+    case E_IO_CANCELLED:
+      Frame_status(frame, "Stopped writing %s", write_path);
+      break;
+    case E_IO_WRITE_ERROR:
+      Frame_status(frame, "Error writing %s", write_path);
+      break;
+    default:
+      Frame_status(frame, "Error loading data");
+  }
+
+  if (resized) {
+    resized = 0;
+    fit_screen();
+  }
+
+}
+
+static void on_write(Loop_T loop, void *x, void *cl) {
+
+  Msg_T msg = x;
+
+  if (writing) {
+    Pool_wait(pool, writing);
+    finish_write(msg->err);
+    dirty = 1;
+  }
+
+  FREE(msg);
+
+}
+
+void open_write(Slice_T slice, int fd, const char *path) {
+
+  assert(slice && fd >= 0 && path);
+
+  close_write();
+
+  memset(&writer, 0, sizeof writer);
+  writer.loop = ui_loop;
+  writer.channel = write_channel;
+  writer.data = data;
+  writer.pool = pool;
+  writer.slice = slice;
+  writer.fd = fd;
+  snprintf(write_path, sizeof write_path, "%s", path);
+
+  writing = Pool_token_new();
+  Pool_submit(pool, POOL_LOW, writing, Worker_write, &writer);
+
+  Frame_status(frame, "Writing %s...", write_path);
+  Frame_print(frame, data, 0);
+
+}
+
+void close_write(void) {
+
+  if (!writing) return;
+
+  // The write posts once it's done, unless it finished first
+  Pool_cancel(writing);
+  atomic_store(&writer.stop, 1);
+  Pool_wait(pool, writing);
+
+  int err = E_IO_CANCELLED;
+  Msg_T msg;
+  while ((msg = Spsc_pop(write_channel))) {
+    err = msg->err;
+    FREE(msg);
+  }
+
+  finish_write(err);
+
+}
+
+int open_panel(Panel_T new, int key_col, int val_col) {
+
+  assert(new);
+
+  close_panel();
+
+  memset(&grouper, 0, sizeof grouper);
+  grouper.loop = ui_loop;
+  grouper.channel = group_channel;
+  grouper.data = data;
+  grouper.key_col = key_col;
+  grouper.val_col = val_col;
+  grouper.offset = frame->headers ? Index_get(data->rows, 1) : 0;
+  grouper.pool = pool;
+
+  if (pthread_create(&grouper_thread, NULL, Worker_group, &grouper)) {
+    Panel_free(&new);
+    return E_DTA_RESOURCE_ERROR;
+  }
+
+  grouping = 1;
+  panel = new;
+  Panel_status(panel, "Grouping...");
+  Panel_print(panel);
+
+  return E_OK;
+
+}
+
+void close_panel(void) {
+
+  // The scan reads the mapping, so it has to finish first. Whatever
+  // it posted before it stopped is dropped.
+  if (grouping) {
+    atomic_store(&grouper.stop, 1);
+    pthread_join(grouper_thread, NULL);
+    Msg_T msg;
+    while ((msg = Spsc_pop(group_channel))) {
+      if (msg->groups) Groupby_free(&msg->groups);
+      FREE(msg);
+    }
+    grouping = 0;
+  }
+
+  if (panel) Panel_free(&panel);
+
+}
+
+// Seeds each sample differently
+static uint64_t seed(void) {
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+}
+
+int open_sample(long n) {
+
+  assert(n > 0);
+
+  close_sample();
+
+  if (!data->row_near || !data->scan_fields) return E_DTA_BAD_INPUT;
+  if (n > SAMPLE_MAX) n = SAMPLE_MAX;
+
+  ssize_t offset = frame->headers ? Index_get(data->rows, 1) : 0;
+  ssize_t *rows = CALLOC(n, sizeof(ssize_t));
+  n = Data_sample(data, offset, n, seed(), rows);
+  Data_T sample = Data_sample_init(data, !!frame->headers, rows, n);
+  FREE(rows);
+
+  Frame_T new = Frame_init(frame->col_width, frame->max_cols, 
+    frame->max_rows, !!frame->headers);
+
+  int err = E_OK;
+  if (frame->projection.cols) 
+    err = Frame_project(new, sample, frame->projection.cols, 
+      frame->projection.ncols);
+  if (err == E_OK) err = Frame_load(new, sample);
+
+  if (err) {
+    Frame_free(&new, sample->free_node, NULL);
+    Data_free(&sample);
+    return err;
+  }
+
+  Frame_status(frame, "");
+  whole = data;
+  whole_frame = frame;
+  data = sample;
+  frame = new;
+
+  Frame_status(frame, "%ld rows picked at random", n);
+  Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
+
+  return E_OK;
+
+}
+
+void close_sample(void) {
+
+  if (!whole) return;
+
+  Frame_free(&frame, data->free_node, NULL);
+  Data_free(&data);
+
+  data = whole;
+  frame = whole_frame;
+  whole = NULL;
+
+}
+
+// Built-in backends. Delimited files are the default, so they aren't
+// picked out by extension.
+static Data_T csv_init(const char *path, char delim, const char *options) {
+
+  return Data_mmap_init((char *) path, delim);
+
+}
+
+// Delimited files read ahead through io_uring, for storage where faults
+// on the mapping are slow
+static Data_T uring_init(const char *path, char delim, const char *options) {
+
+  return Data_uring_init((char *) path, delim);
+
+}
+
+static Data_T json_init(const char *path, char delim, const char *options) {
+
+  return Data_json_init((char *) path);
+
+}
+
+static Data_T arrow_init(const char *path, char delim, const char *options) {
+
+  return Data_arrow_init((char *) path);
+
+}
+
+// Options are the widths of the columns, if they're given
+static Data_T fixed_init(const char *path, char delim, const char *options) {
+
+  int nwidths = 0, *widths = NULL;
+  if (options) {
+    nwidths = parse_widths(options, NULL);
+    if (nwidths < 0) return NULL;
+    widths = CALLOC(nwidths, sizeof(int));
+    parse_widths(options, widths);
+  }
+
+  Data_T data = Data_fixed_init((char *) path, widths, nwidths);
+  if (widths) FREE(widths);
+
+  return data;
+
+}
+
+static const char *const json_extensions[] = { ".jsonl", ".ndjson", NULL };
+static const char *const arrow_extensions[] = 
+  { ".arrow", ".feather", ".ipc", NULL };
+static const char *const fixed_extensions[] = { ".fwf", NULL };
+
+static struct Backend_T builtins[] = {
+  { BACKEND_ABI, "csv", NULL, NULL, 0, 0, csv_init },
+  { BACKEND_ABI, "uring", NULL, NULL, 0, 0, uring_init },
+  { BACKEND_ABI, "jsonl", json_extensions, NULL, 0, 1, json_init },
+  { BACKEND_ABI, "arrow", arrow_extensions, "ARROW1", 6, 1, arrow_init },
+  { BACKEND_ABI, "fixed", fixed_extensions, NULL, 0, 0, fixed_init },
+};
+
+// Backend files are read with
+static Backend_T backend;
+
+// A path like 'dir/part-*.csv' that isn't itself a file is opened as
+// every file it matches
+static int is_pattern(const char *path) {
+
+  struct stat st;
+
+  return strpbrk(path, "*?[") && stat(path, &st) < 0;
+
+}
+
+static Data_T data_init(struct arguments *arguments, char *path) {
+
+  // The server knows whether its file has a header
+  if (arguments->connect) {
+    Data_T data = Data_remote_init(arguments->connect);
+    if (data) arguments->headers = Data_remote_headers(data);
+    return data;
+  }
+
+  Data_T data = is_pattern(path)
+    ? Data_shards_init(path, arguments->headers, backend->init, 
+        arguments->delim, arguments->widths)
+    : backend->init(path, arguments->delim, arguments->widths);
+
+  if (data) {
+    data->max_resident = arguments->max_resident;
+    // Only delimited rows are split into a varying number of fields
+    data->ragged = arguments->ragged && data->delimited;
+  }
+
+  return data;
+
+}
+
+static int headless(struct arguments *arguments) {
+
+  Data_T data = data_init(arguments, arguments->path);
+  if (!data || Data_open(data)) {
+    fprintf(stderr, "Error opening data\n");
+    return EXIT_FAILURE;
+  }
+
+  int err = E_OK;
+  Data_T sample = NULL;
+
+  // Sampled rows are written like a slice of the file
+  if (arguments->sample) {
+    char *tok;
+    if (!data->row_near || !data->scan_fields) {
+      fprintf(stderr, "Rows of this format can't be sampled\n");
+      err = E_DTA_BAD_INPUT;
+    } else if ((err = data->get_row(data, &tok, 0, 0, 0)) == E_OK) {
+      long n = arguments->sample < SAMPLE_MAX ? arguments->sample : SAMPLE_MAX;
+      ssize_t offset = arguments->headers ? Index_get(data->rows, 1) : 0;
+      ssize_t *rows = CALLOC(n, sizeof(ssize_t));
+      n = Data_sample(data, offset, n, seed(), rows);
+      sample = Data_sample_init(data, arguments->headers, rows, n);
+      FREE(rows);
+    } else fprintf(stderr, "Error loading data\n");
+  }
+
+  if (err == E_OK && arguments->count) {
+    printf("%ld\n", data->count_rows(data, 0) - !!arguments->headers);
+  } else if (err == E_OK) {
+    Data_T from = sample ? sample : data;
+    Slice_T slice = Slice_init(arguments->headers, arguments->align,
+      arguments->col_width);
+    if (!slice) err = E_DTA_BAD_INPUT;
+    else if (arguments->rows && Slice_parse_rows(slice, arguments->rows)) {
+      fprintf(stderr, "Invalid row range: %s\n", arguments->rows);
+      err = E_DTA_BAD_INPUT;
+    } else if (arguments->cols 
+      && Slice_parse_cols(slice, from, arguments->cols)) {
+      fprintf(stderr, "Invalid column list: %s\n", arguments->cols);
+      err = E_DTA_BAD_INPUT;
+    } else if ((err = Slice_write(slice, from, STDOUT_FILENO))) {
+      switch (err) {
+        case E_DTA_COL_OOB:
+          fprintf(stderr, "Column out of range\n");
+          break;
+        case E_DTA_MISSING_FIELD:
+          fprintf(stderr, 
+            "Row has incorrect number of fields, see --ragged\n");
+          break;
+        case E_IO_WRITE_ERROR:
+          fprintf(stderr, "Error writing output\n");
+          break;
+        default:
+          fprintf(stderr, "Error loading data\n");
+      }
+    }
+    if (slice) Slice_free(&slice);
+  }
+
+  if (sample) Data_free(&sample);
+
+  if (Data_close(data)) {
+    fprintf(stderr, "Error closing data\n");
+    err = E_DTA_RESOURCE_ERROR;
+  }
+  Data_free(&data);
+
+  return err ? EXIT_FAILURE : EXIT_SUCCESS;
+
+}
+
+// Serves the file to other previews until interrupted
+static int serve(struct arguments *arguments) {
+
+  Data_T data = data_init(arguments, arguments->path);
+  if (!data || Data_open(data)) {
+    fprintf(stderr, "Error opening data\n");
+    return EXIT_FAILURE;
+  }
+
+  Serve_T server = Serve_new(data, arguments->headers, arguments->serve);
+  int err = server ? Serve_run(server) : E_DTA_RESOURCE_ERROR;
+  if (!server) fprintf(stderr, "Error serving on %s\n", arguments->serve);
+  else Serve_free(&server);
+
+  if (Data_close(data)) {
+    fprintf(stderr, "Error closing data\n");
+    err = E_DTA_RESOURCE_ERROR;
+  }
+  Data_free(&data);
+
+  return err ? EXIT_FAILURE : EXIT_SUCCESS;
+
+}
+
+// Opens one side of a diff, and finds where its first data row starts
+// and which column holds its key
+static Data_T diff_open(struct arguments *arguments, char *path,
+  ssize_t *offset, int *key_col) {
+
+  Data_T data = data_init(arguments, path);
+  if (!data) return NULL;
+
+  char *tok;
+  if (Data_open(data) || data->get_row(data, &tok, 0, 0, 0) != E_OK) {
+    Data_free(&data);
+    return NULL;
+  }
+
+  *offset = arguments->headers ? Index_get(data->rows, 1) : 0;
+  *key_col = -1;
+
+  if (arguments->key) {
+    int *cols, ncols;
+    if (Columns_parse(data, arguments->key, arguments->headers, &cols, &ncols)) {
+      Data_close(data);
+      Data_free(&data);
+      return NULL;
+    }
+    *key_col = cols[0];
+    FREE(cols);
+  }
+
+  return data;
+
+}
+
+static int diff(struct arguments *arguments) {
+
+  char *paths[2] = { arguments->path, arguments->path2 };
+  Data_T files[2];
+  struct Worker_T hashers[2];
+  pthread_t threads[2];
+
+  for (int side=0; side<2; side++) {
+    memset(&hashers[side], 0, sizeof hashers[side]);
+    files[side] = diff_open(arguments, paths[side], 
+      &hashers[side].offset, &hashers[side].key_col);
+    if (!files[side]) {
+      fprintf(stderr, "Error opening %s\n", paths[side]);
+      return EXIT_FAILURE;
+    }
+
+    // Rows of Arrow files aren't stored as bytes that can be hashed
+    if (!files[side]->hash_rows) {
+      fprintf(stderr, "Files read by the %s backend can't be diffed\n",
+        backend->name);
+      return EXIT_FAILURE;
+    }
+  }
+
+  initscr();
+  cbreak();
+  noecho();
+  curs_set(0);
+
+  diffview = Diffview_new(files[DIFF_A], files[DIFF_B], !!arguments->key,
+    arguments->headers, arguments->col_width);
+  if (!diffview) EXIT("Error initializing diff\n");
+  Diffview_status(diffview, "Diffing...");
+  Diffview_print(diffview);
+
+  nodelay(stdscr, TRUE);
+
+  Loop_T loop = Loop_new();
+  if (!loop) EXIT("Error initializing event loop\n");
+
+  yypstate *parser = yypstate_new();
+
+  if (Loop_add_signal(loop, SIGWINCH, on_resize, NULL)
+    || Loop_add_fd(loop, STDIN_FILENO, on_input, parser)
+    || Loop_add_timer(loop, 50, on_tick, NULL))
+    EXIT("Error initializing event loop\n");
+
+  // Both files are hashed at once, each with its own channel
+  Spsc_T channels[2];
+  for (int side=0; side<2; side++) {
+    channels[side] = Loop_channel(loop, 64, on_message, NULL);
+    hashers[side].loop = loop;
+    hashers[side].channel = channels[side];
+    hashers[side].data = files[side];
+    hashers[side].side = side;
+    if (pthread_create(&threads[side], NULL, Worker_hash, &hashers[side]))
+      EXIT("Error starting hasher\n");
+  }
+
+  int err = Loop_run(loop);
+  if (err) EXIT("Error reading user input\n");
+
+  endwin();
+
+  // Hashers read the mappings, so they have to finish first. Nothing
+  // drains the channels anymore, so tell them to stop.
+  for (int side=0; side<2; side++) atomic_store(&hashers[side].stop, 1);
+  for (int side=0; side<2; side++) pthread_join(threads[side], NULL);
+  Loop_free(&loop);
+  yypstate_delete(parser);
+  Diffview_free(&diffview);
+
+  for (int side=0; side<2; side++) {
+    if (Data_close(files[side])) err = E_DTA_RESOURCE_ERROR;
+    Data_free(&files[side]);
+  }
+
+  return err ? EXIT_FAILURE : EXIT_SUCCESS;
+
+}
 
 int main(int argc, char **argv) {
 
@@ -58,10 +776,71 @@ int main(int argc, char **argv) {
   arguments.headers = 0;
   arguments.col_width = 16;
   arguments.delim = ',';
+  arguments.trace = NULL;
+  arguments.rows = NULL;
+  arguments.cols = NULL;
+  arguments.count = 0;
+  arguments.align = 0;
+  arguments.max_resident = 0;
+  arguments.diff = 0;
+  arguments.path2 = NULL;
+  arguments.key = NULL;
+  arguments.format = NULL;
+  arguments.widths = NULL;
+  arguments.sample = 0;
+  arguments.ragged = 0;
+  arguments.serve = NULL;
+  arguments.connect = NULL;
+  arguments.mem_report = NULL;
 
   // Command line arguments
   argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+  if (arguments.mem_report) {
+#ifndef ENABLE_MEM_STATS
+    fprintf(stderr, "--mem-report needs ./configure --enable-mem-stats\n");
+    exit(EXIT_FAILURE);
+#endif
+    mem_report = arguments.mem_report;
+    atexit(report_mem_at_exit);
+  }
+
+  // Backends built elsewhere are loaded from a directory of shared
+  // objects, and take the place of any built in by the same name
+  for (int i=0; i<(int) (sizeof builtins / sizeof builtins[0]); i++)
+    Backend_register(&builtins[i]);
+  char *dir = getenv("PREVIEW_BACKENDS");
+  Backend_load(dir ? dir : BACKEND_DIR);
+
+  if (arguments.format) backend = Backend_find(arguments.format);
+  else if (arguments.widths) backend = Backend_find("fixed");
+  else {
+    // The server reads the file a client shows
+    backend = arguments.connect ? NULL : Backend_detect(arguments.path);
+    if (!backend) backend = Backend_find("csv");
+  }
+  if (!backend) {
+    fprintf(stderr, "Unknown backend '%s'\n", arguments.format);
+    exit(EXIT_FAILURE);
+  }
+
+  // Column names of JSON Lines and Arrow files are their header
+  if (backend->headers) arguments.headers = 1;
+
+  if (arguments.diff) exit(diff(&arguments));
+
+  if (arguments.serve) exit(serve(&arguments));
+
+  // Slices and counts are written straight to stdout, as is
+  // everything when stdout isn't a terminal
+  if (arguments.rows || arguments.count || !isatty(STDOUT_FILENO))
+    exit(headless(&arguments));
  
+  // TODO: check if the file can be mmapped, if it can't use file buffers
+  // A server says whether its file has a header, which the frame needs
+  data = data_init(&arguments, arguments.path);
+  if (!data) EXIT("Error initializing data\n");
+
   initscr();
   cbreak();    // disable line buffering
   noecho();    // disable echo for getch
@@ -80,16 +859,17 @@ int main(int argc, char **argv) {
   );
   if (!frame) EXIT("Error initializing frame\n");
 
-  // TODO: check if the file can be mmapped, if it can't use file buffers
-  data = Data_mmap_init(
-    arguments.path,       // path
-    arguments.delim       // delim
-  );
-  if (!data) EXIT("Error initializing data\n");
-
   int err = Data_open(data);
   if (err) EXIT("Error opening data\n");
 
+  if (arguments.cols) {
+    int *cols, ncols;
+    if (Columns_parse(data, arguments.cols, arguments.headers, &cols, &ncols)
+      || Frame_project(frame, data, cols, ncols))
+      EXIT("Invalid column list\n");
+    FREE(cols);
+  }
+
   err = Frame_load(frame, data);
   if (err) {
     endwin();
@@ -98,7 +878,11 @@ int main(int argc, char **argv) {
         fprintf(stderr, "Error parsing file\n");
         break;
       case E_DTA_MISSING_FIELD:
-        fprintf(stderr, "Row has incorrect number of fields\n");
+        fprintf(stderr, 
+          "Row has incorrect number of fields, see --ragged\n");
+        break;
+      case E_DTA_COL_OOB:
+        fprintf(stderr, "Column out of range\n");
         break;
       default:
         fprintf(stderr, "Error loading data\n");
@@ -108,17 +892,77 @@ int main(int argc, char **argv) {
 
   Frame_print(frame, data, O_FRM_DATA | O_FRM_CURS);
 
-  err = yyparse();
-  if (err) EXIT("Error parsing user input\n");
+  // Input is read as it arrives rather than blocking in getch
+  nodelay(stdscr, TRUE);
+
+  Loop_T loop = Loop_new();
+  if (!loop) EXIT("Error initializing event loop\n");
+  ui_loop = loop;
+  group_channel = Loop_channel(loop, 64, on_group, NULL);
+  write_channel = Loop_channel(loop, 4, on_write, NULL);
+
+  yypstate *parser = yypstate_new();
+
+  // Signals must be blocked before any worker thread starts
+  if (Loop_add_signal(loop, SIGWINCH, on_resize, NULL)
+    || Loop_add_fd(loop, STDIN_FILENO, on_input, parser)
+    || Loop_add_timer(loop, 50, on_tick, NULL))
+    EXIT("Error initializing event loop\n");
+
+  pool = Pool_new(0);
+  if (!pool) EXIT("Error starting worker threads\n");
+
+  // Columns either side of the screen are read ahead of the cursor
+  Frame_prefetch(frame, data, pool);
+
+  struct Worker_T indexer = { 
+    loop, 
+    Loop_channel(loop, 64, on_message, NULL),
+    data 
+  };
+  indexer.pool = pool;
+
+  // Counting rows reads the whole file, so anything for the screen
+  // goes first
+  Pool_token indexing = Pool_token_new();
+  Pool_submit(pool, POOL_LOW, indexing, Worker_index, &indexer);
+
+  if (arguments.sample && open_sample(arguments.sample) != E_OK) {
+    Frame_status(frame, "Rows of this format can't be sampled");
+    Frame_print(frame, data, 0);
+  }
+
+  err = Loop_run(loop);
+  if (err) EXIT("Error reading user input\n");
 
   endwin();
 
+  // Background work reads the mapping, so it has to finish before
+  // the data is closed. Nothing drains the channels anymore.
+  atomic_store(&indexer.stop, 1);
+  Pool_cancel(indexing);
+  Pool_wait(pool, indexing);
+  Pool_token_free(&indexing);
+  close_write();
+  close_panel();
+  close_sample();
+  Frame_prefetch(frame, data, NULL);
+  Pool_free(&pool);
+  Loop_free(&loop);
+  yypstate_delete(parser);
+
   if (Data_close(data)) {
     fprintf(stderr, "Error closing data\n");
     exit(EXIT_FAILURE);
   }
 
+  if (arguments.trace) {
+    FILE *trace = fopen(arguments.trace, "w");
+    if (!trace || Trace_dump(trace) || fclose(trace))
+      fprintf(stderr, "Error writing trace to %s\n", arguments.trace);
+  }
+
   Frame_free(&frame, data->free_node, NULL);
-  Data_mmap_free(&data);
+  Data_free(&data);
 
 }
@@ -0,0 +1,333 @@
+//
+// -----------------------------------------------------------------------------
+// worker.c
+// -----------------------------------------------------------------------------
+//
+// Background jobs for Preview. Workers never touch ncurses or the
+// frame; they post their results to the UI thread through the loop.
+//
+// Copyright © 2021 Tyler Wayne
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <sched.h>    // sched_yield
+#include <stdlib.h>   // strtod
+#include <string.h>   // memcpy
+#include <time.h>     // nanosleep
+#include <pthread.h>  // pthread_mutex_lock
+#include "mem.h"      // NEW0, CALLOC, FREE
+#include "spsc.h"
+#include "pool.h"
+#include "preview.h"
+
+// Bytes scanned between progress reports
+#define INDEX_CHUNK (64L << 20)
+
+// Rows hashed per message
+#define HASH_BATCH 65536
+
+// Grouping hands out chunks of about this many bytes, cut at rows
+#define GROUP_CHUNK (4L << 20)
+
+// Rows tokenized at a time while grouping
+#define GROUP_BATCH 4096
+
+// Groups kept per pool worker before the least frequent are dropped,
+// and the most frequent groups of each shown while grouping
+#define GROUP_CAPACITY (1 << 16)
+#define GROUP_TOP 256
+
+// Time between progress reports while grouping
+#define GROUP_REPORT_MS 100
+
+static void send(Worker_T worker, Msg_T msg) {
+
+  if (msg->type == MSG_INDEX_PROGRESS) {
+    // Progress is advisory, drop it if the UI is behind
+    if (!Loop_post(worker->loop, worker->channel, msg)) FREE(msg);
+    return;
+  }
+
+  while (!Loop_post(worker->loop, worker->channel, msg)) {
+    if (atomic_load(&worker->stop)) {
+      if (msg->hashes) FREE(msg->hashes);
+      if (msg->keys) FREE(msg->keys);
+      if (msg->groups) Groupby_free(&msg->groups);
+      FREE(msg);
+      return;
+    }
+    sched_yield();
+  }
+
+}
+
+static void post(Worker_T worker, int type, long nrows, ssize_t done,
+  ssize_t total) {
+
+  Msg_T msg;
+  NEW0(msg);
+  msg->type = type;
+  msg->nrows = nrows;
+  msg->done = done;
+  msg->total = total;
+  msg->side = worker->side;
+
+  send(worker, msg);
+
+}
+
+// Counts the rows in the whole file, a chunk per task. Each chunk
+// queues the next once it's done, so only one posts at a time. Quitting
+// sets worker->stop, which is checked between chunks, so it never waits
+// for more than one.
+void Worker_index(void *cl, Pool_token token) {
+
+  Worker_T worker = cl;
+  Data_T data = worker->data;
+  ssize_t total = data->st_size;
+
+  if (!data->scan_rows || atomic_load(&worker->stop) 
+    || Pool_cancelled(token)) return;
+
+  if (worker->offset < total) {
+    worker->offset = data->scan_rows(data, worker->offset, INDEX_CHUNK, 
+      &worker->nrows);
+    post(worker, MSG_INDEX_PROGRESS, worker->nrows, worker->offset, total);
+    Pool_submit(worker->pool, POOL_LOW, token, Worker_index, worker);
+  } else post(worker, MSG_INDEX_DONE, worker->nrows, total, total);
+
+}
+
+// Writes worker->slice to worker->fd, stopping early once the token's
+// cancelled, and posts what Slice_write returned
+void Worker_write(void *cl, Pool_token token) {
+
+  Worker_T worker = cl;
+
+  worker->slice->token = token;
+
+  Msg_T msg;
+  NEW0(msg);
+  msg->type = MSG_WRITE_DONE;
+  msg->err = Slice_write(worker->slice, worker->data, worker->fd);
+  send(worker, msg);
+
+}
+
+// Hashes every row from worker->offset on, posting the hashes a batch
+// at a time so the diff can start before the whole file is read
+void *Worker_hash(void *cl) {
+
+  Worker_T worker = cl;
+  Data_T data = worker->data;
+  ssize_t offset = worker->offset, total = data->st_size;
+  long nrows = 0;
+
+  while (offset < total && !atomic_load(&worker->stop)) {
+    Msg_T msg;
+    NEW0(msg);
+    msg->type = MSG_HASH_ROWS;
+    msg->side = worker->side;
+    msg->hashes = CALLOC(HASH_BATCH, sizeof(uint64_t));
+    if (worker->key_col >= 0) 
+      msg->keys = CALLOC(HASH_BATCH, sizeof(uint64_t));
+
+    offset = data->hash_rows(data, offset, worker->key_col, 
+      msg->hashes, msg->keys, HASH_BATCH, &msg->n);
+
+    nrows += msg->n;
+    msg->nrows = nrows;
+    msg->done = offset;
+    msg->total = total;
+    send(worker, msg);
+  }
+
+  post(worker, MSG_HASH_DONE, nrows, total, total);
+
+  return NULL;
+
+}
+
+struct grouping {
+  Worker_T worker;
+  Pool_token token;
+  pthread_mutex_t lock;
+  ssize_t next;       // start of the next chunk to hand out
+  Groupby_T *groups;  // each pool worker's groups
+  Spsc_T *snapshots;  // the most frequent of each worker's groups so far
+};
+
+// Reads a field as a number, ignoring quotes and blanks around it
+static int number(const char *tok, int len, double *value) {
+
+  char buf[64], *end;
+
+  while (len > 0 && (*tok == '"' || *tok == ' ')) tok++, len--;
+  while (len > 0 && (tok[len-1] == '"' || tok[len-1] == ' ')) len--;
+  if (len == 0 || len >= (int) sizeof buf) return 0;
+
+  memcpy(buf, tok, len);
+  buf[len] = '\0';
+  *value = strtod(buf, &end);
+
+  return *end == '\0';
+
+}
+
+// Claims the rows starting in the next chunk. Chunks are only cut at
+// rows once the chunk before them is, so this is done under the lock.
+static long claim(struct grouping *g, ssize_t *offset) {
+
+  Data_T data = g->worker->data;
+  long nrows = 0;
+
+  pthread_mutex_lock(&g->lock);
+  *offset = g->next;
+  if (g->next < data->st_size)
+    g->next = data->scan_rows(data, g->next, GROUP_CHUNK, &nrows);
+  pthread_mutex_unlock(&g->lock);
+
+  return nrows;
+
+}
+
+// Groups the rows of the next chunk into this pool worker's groups.
+// The chunk after it is queued first, so that work for the screen can
+// run in between.
+static void group_chunk(void *cl, Pool_token token) {
+
+  struct grouping *g = cl;
+  Worker_T worker = g->worker;
+  Data_T data = worker->data;
+
+  ssize_t offset;
+  long nrows;
+  if (Pool_cancelled(token) || (nrows = claim(g, &offset)) == 0) return;
+  Pool_submit(worker->pool, POOL_LOW, token, group_chunk, g);
+
+  int self = Pool_self(worker->pool);
+  int cols[2] = { worker->key_col, worker->val_col };
+  int ncols = worker->val_col >= 0 ? 2 : 1;
+  char **toks = CALLOC(GROUP_BATCH * ncols, sizeof(char *));
+  int *lens = CALLOC(GROUP_BATCH * ncols, sizeof(int));
+
+  while (nrows > 0 && !Pool_cancelled(token)) {
+    long n;
+    offset = data->scan_fields(data, offset, cols, ncols, toks, lens,
+      nrows < GROUP_BATCH ? nrows : GROUP_BATCH, &n);
+    if (n == 0) break;
+
+    for (long i=0; i<n; i++) {
+      double value;
+      int numeric = ncols == 2 
+        && number(toks[i*ncols+1], lens[i*ncols+1], &value);
+      Groupby_add(g->groups[self], toks[i*ncols], lens[i*ncols], 
+        numeric ? &value : NULL);
+    }
+    nrows -= n;
+  }
+
+  FREE(toks);
+  FREE(lens);
+
+  // Snapshots are only for show, so drop them if the last one
+  // hasn't been picked up
+  Groupby_T snapshot = Groupby_snapshot(g->groups[self], GROUP_TOP);
+  if (!Spsc_push(g->snapshots[self], snapshot)) Groupby_free(&snapshot);
+
+}
+
+// Groups every row from worker->offset on by worker->key_col, a chunk
+// at a time on the pool, with a set of groups per pool worker. Their
+// most frequent groups are merged and posted as they go, and all of
+// their groups once they're done.
+void *Worker_group(void *cl) {
+
+  Worker_T worker = cl;
+  Data_T data = worker->data;
+  int nthreads = Pool_size(worker->pool);
+
+  struct grouping g = { worker, Pool_token_new() };
+  pthread_mutex_init(&g.lock, NULL);
+  g.next = worker->offset;
+  g.groups = CALLOC(nthreads, sizeof(Groupby_T));
+  g.snapshots = CALLOC(nthreads, sizeof(Spsc_T));
+
+  Groupby_T *latest = CALLOC(nthreads, sizeof(Groupby_T));
+
+  for (int i=0; i<nthreads; i++) {
+    g.groups[i] = Groupby_new(GROUP_CAPACITY);
+    g.snapshots[i] = Spsc_new(4);
+  }
+
+  // Each chunk queues the next, so this keeps every worker busy
+  for (int i=0; i<nthreads; i++)
+    Pool_submit(worker->pool, POOL_LOW, g.token, group_chunk, &g);
+
+  struct timespec pause = { 0, GROUP_REPORT_MS * 1000000L };
+  while (Pool_pending(g.token) > 0) {
+    nanosleep(&pause, NULL);
+    if (atomic_load(&worker->stop)) Pool_cancel(g.token);
+
+    Groupby_T progress = Groupby_new(nthreads * GROUP_TOP);
+    for (int i=0; i<nthreads; i++) {
+      Groupby_T snapshot;
+      while ((snapshot = Spsc_pop(g.snapshots[i]))) {
+        if (latest[i]) Groupby_free(&latest[i]);
+        latest[i] = snapshot;
+      }
+      if (latest[i]) Groupby_merge(progress, latest[i]);
+    }
+
+    pthread_mutex_lock(&g.lock);
+    ssize_t done = g.next;
+    pthread_mutex_unlock(&g.lock);
+
+    Msg_T msg;
+    NEW0(msg);
+    msg->type = MSG_GROUP_PROGRESS;
+    msg->groups = progress;
+    msg->done = done;
+    msg->total = data->st_size;
+    send(worker, msg);
+  }
+
+  Groupby_T groups = Groupby_new(GROUP_CAPACITY);
+  for (int i=0; i<nthreads; i++) {
+    Groupby_merge(groups, g.groups[i]);
+
+    Groupby_T snapshot;
+    while ((snapshot = Spsc_pop(g.snapshots[i]))) Groupby_free(&snapshot);
+    if (latest[i]) Groupby_free(&latest[i]);
+    Spsc_free(&g.snapshots[i]);
+    Groupby_free(&g.groups[i]);
+  }
+
+  FREE(g.groups);
+  FREE(g.snapshots);
+  FREE(latest);
+  Pool_token_free(&g.token);
+  pthread_mutex_destroy(&g.lock);
+
+  Msg_T msg;
+  NEW0(msg);
+  msg->type = MSG_GROUP_DONE;
+  msg->groups = groups;
+  msg->nrows = Groupby_rows(groups);
+  msg->done = msg->total = data->st_size;
+  send(worker, msg);
+
+  return NULL;
+
+}
@@ -0,0 +1,26 @@
+//
+// -----------------------------------------------------------------------------
+// test-backend-plugin.c
+// -----------------------------------------------------------------------------
+//
+// Backend loaded by test-backend. Opening a file gives back a Data_T
+// that only knows its path.
+//
+// Tyler Wayne © 2021
+//
+
+#include "backend.h"
+
+static struct Data_T opened;
+
+static Data_T init(const char *path, char delim, const char *options) {
+  opened.path = (char *) path;
+  opened.delim = delim;
+  return &opened;
+}
+
+static const char *const extensions[] = { ".tst", NULL };
+
+struct Backend_T preview_backend = {
+  BACKEND_ABI, "test", extensions, "TST1", 4, 1, init
+};
@@ -0,0 +1,114 @@
+//
+// -----------------------------------------------------------------------------
+// test-backend.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "error.h"
+#include "minunit.h"
+#include "backend.h"
+#include "errorcodes.h"
+
+int tests_run = 0;
+
+static Data_T init(const char *path, char delim, const char *options) {
+  return NULL;
+}
+
+static const char *const csv_extensions[] = { ".csv", NULL };
+static const char *const arrow_extensions[] = { ".arrow", NULL };
+
+static struct Backend_T csv = { 
+  BACKEND_ABI, "csv", csv_extensions, NULL, 0, 0, init 
+};
+static struct Backend_T arrow = { 
+  BACKEND_ABI, "arrow", arrow_extensions, "ARROW1", 6, 1, init 
+};
+
+// Writes text to a temporary file ending in ext
+static void write_file(char *path, int extlen, const char *text) {
+  int fd = mkstemps(path, extlen);
+  if (fd < 0) return;
+  if (write(fd, text, strlen(text)) < 0) path[0] = '\0';
+  close(fd);
+}
+
+// int Backend_register(Backend_T backend);
+static char *test_Backend_register_other_abi() {
+  struct Backend_T old = { BACKEND_ABI + 1, "old", NULL, NULL, 0, 0, init };
+  mu_assert("Backend_register took a backend built against another ABI",
+    Backend_register(&old) == E_DTA_BAD_INPUT && !Backend_find("old"));
+}
+
+// Backend_T Backend_find(const char *name);
+static char *test_Backend_find() {
+  int pass = Backend_register(&csv) == E_OK 
+    && Backend_register(&arrow) == E_OK
+    && Backend_find("csv") == &csv && Backend_find("arrow") == &arrow
+    && !Backend_find("parquet");
+  mu_assert("Backend_find didn't find backends by name", pass);
+}
+
+// Backend_T Backend_detect(const char *path);
+static char *test_Backend_detect_magic_first() {
+  char named[] = "/tmp/test-backend-XXXXXX.csv";
+  char unnamed[] = "/tmp/test-backend-XXXXXX";
+  write_file(named, 4, "ARROW1\0\0");
+  write_file(unnamed, 0, "a,b\n");
+  int pass = Backend_detect(named) == &arrow
+    && Backend_detect(unnamed) == NULL
+    && Backend_detect("/tmp/missing.csv") == &csv
+    && Backend_detect("/tmp/dir.csv/missing") == NULL;
+  unlink(named);
+  unlink(unnamed);
+  mu_assert("Backend_detect didn't go by magic and then extension", pass);
+}
+
+// int Backend_load(const char *dir);
+static char *test_Backend_load_plugin() {
+  char path[] = "/tmp/test-backend-XXXXXX.tst";
+  write_file(path, 4, "a,b\n");
+  Backend_T plugin = Backend_load(".libs") == 1 ? Backend_find("test") : NULL;
+  Data_T data = plugin ? plugin->init(path, ';', NULL) : NULL;
+  int pass = plugin && plugin->abi == BACKEND_ABI && plugin->headers
+    && Backend_detect(path) == plugin
+    && data && strcmp(data->path, path) == 0 && data->delim == ';';
+  unlink(path);
+  mu_assert("Backend_load didn't load the backend of a shared object", pass);
+}
+
+static char *test_Backend_load_missing_dir() {
+  mu_assert("Backend_load loaded backends from a missing directory",
+    Backend_load("/tmp/test-backend-missing") == 0);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Backend_register_other_abi,
+    test_Backend_find,
+    test_Backend_detect_magic_first,
+    test_Backend_load_plugin,
+    test_Backend_load_missing_dir,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -0,0 +1,154 @@
+//
+// -----------------------------------------------------------------------------
+// test-cache.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "error.h"
+#include "minunit.h"
+#include "cache.h"
+
+int tests_run = 0;
+
+// Ten and a half blocks
+#define SIZE (10 * CACHE_BLOCK + CACHE_BLOCK / 2)
+#define NBLOCKS 11
+
+static char path[] = "/tmp/test-cache-XXXXXX";
+static int created = 0;
+
+static int open_file(void) {
+  if (!created++) {
+    FILE *file = fdopen(mkstemp(path), "w");
+    if (!file) return -1;
+    for (long i=0; i<SIZE; i++) putc(i % 64 ? 'x' : '\n', file);
+    fclose(file);
+  }
+  return open(path, O_RDONLY);
+}
+
+// void Cache_want(Cache_T cache, ssize_t offset, ssize_t len);
+static int reads_each_block_once(int uring) {
+  Cache_T cache = Cache_new(open_file(), SIZE, uring);
+  Cache_want(cache, 0, SIZE);
+  int pass = Cache_reads(cache) == NBLOCKS;
+  Cache_want(cache, CACHE_BLOCK + 5, 3 * CACHE_BLOCK);
+  Cache_want(cache, SIZE - 1, 0);
+  pass = pass && Cache_reads(cache) == NBLOCKS;
+  Cache_free(&cache);
+  return pass;
+}
+
+static char *test_Cache_want_uring() {
+  mu_assert("Cache_want didn't read each block once through io_uring",
+    reads_each_block_once(1));
+}
+
+static char *test_Cache_want_readahead() {
+  mu_assert("Cache_want didn't read each block once with readahead",
+    reads_each_block_once(0));
+}
+
+// Reads through io_uring start on the blocks after the one wanted
+static char *test_Cache_want_reads_ahead() {
+  Cache_T cache = Cache_new(open_file(), SIZE, 1);
+  Cache_want(cache, 0, 0);
+  long reads = Cache_reads(cache);
+  int pass = !Cache_uring(cache) || reads > 1;
+  Cache_free(&cache);
+  mu_assert("Cache_want didn't read past the block wanted", pass);
+}
+
+// Without io_uring, the kernel is told about the blocks after it
+static char *test_Cache_want_advises_ahead() {
+  Cache_T cache = Cache_new(open_file(), SIZE, 0);
+  Cache_want(cache, 0, 0);
+  int pass = Cache_reads(cache) > 1;
+  Cache_free(&cache);
+  mu_assert("Cache_want didn't mark the blocks ahead read", pass);
+}
+
+// void Cache_forget(Cache_T cache, ssize_t offset, ssize_t len);
+static char *test_Cache_forget() {
+  Cache_T cache = Cache_new(open_file(), SIZE, 0);
+  Cache_want(cache, 0, SIZE);
+  // Only the blocks wholly inside are forgotten
+  Cache_forget(cache, CACHE_BLOCK / 2, 3 * CACHE_BLOCK);
+  Cache_want(cache, 0, SIZE);
+  int pass = Cache_reads(cache) == NBLOCKS + 2;
+  Cache_free(&cache);
+  mu_assert("Cache_forget didn't have blocks read again", pass);
+}
+
+struct reader {
+  Cache_T cache;
+  unsigned seed;
+};
+
+static void *read_randomly(void *cl) {
+  struct reader *r = cl;
+  for (int i=0; i<200; i++) {
+    ssize_t offset = rand_r(&r->seed) % SIZE;
+    Cache_want(r->cache, offset, rand_r(&r->seed) % (2 * CACHE_BLOCK));
+    if (i % 16 == 0) Cache_forget(r->cache, 0, SIZE);
+  }
+  return NULL;
+}
+
+// Threads waiting on each other's reads all get theirs
+static char *test_Cache_want_threads() {
+  Cache_T cache = Cache_new(open_file(), SIZE, 1);
+  pthread_t threads[8];
+  struct reader readers[8];
+  for (int i=0; i<8; i++) {
+    readers[i] = (struct reader) { cache, i + 1 };
+    pthread_create(&threads[i], NULL, read_randomly, &readers[i]);
+  }
+  for (int i=0; i<8; i++) pthread_join(threads[i], NULL);
+  Cache_free(&cache);
+  mu_assert("Cache_want didn't return to every thread", !cache);
+}
+
+// void Cache_free(Cache_T *cache);
+static char *test_Cache_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Cache_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Cache_free didn't throw error when passed NULL", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Cache_want_uring,
+    test_Cache_want_readahead,
+    test_Cache_want_reads_ahead,
+    test_Cache_want_advises_ahead,
+    test_Cache_forget,
+    test_Cache_want_threads,
+    test_Cache_free_throw_NULL_arg,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  unlink(path);
+  return result != 0;
+}
@@ -0,0 +1,207 @@
+//
+// -----------------------------------------------------------------------------
+// test-data-arrow.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "error.h"
+#include "minunit.h"
+#include "testdata.h"
+#include "frame.h"
+#include "slice.h"
+#include "errorcodes.h"
+
+int tests_run = 0;
+
+// Data_T Data_arrow_init(char *path);
+static char *test_Data_arrow_init_valid() {
+  Data_T data = Data_arrow_init("path.arrow");
+  mu_assert("Data_arrow_init returned NULL", data);
+}
+
+static char *test_Data_arrow_init_empty_path() {
+  Data_T data = Data_arrow_init("");
+  mu_assert("Data_arrow_init didn't return NULL for an empty path", !data);
+}
+
+// void Data_arrow_free(Data_T *data);
+static char *test_Data_arrow_free_valid() {
+  Data_T data = Data_arrow_init("path.arrow");
+  Data_arrow_free(&data);
+  mu_assert("Data_arrow_free didn't set data to NULL", !data);
+}
+
+static char *test_Data_arrow_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Data_arrow_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Data_arrow_free didn't throw error when passed NULL", pass);
+}
+
+// int open(Data_T data);
+static char *test_Data_arrow_open_not_arrow() {
+  char path[] = "/tmp/test-data-arrow-XXXXXX";
+  const char csv[] = "ARROW1,but,not\n1,2,3\n4,5,ARROW1";
+  int pass = write_temp(path, csv, sizeof csv - 1) == 0;
+  Data_T data = Data_arrow_init(path);
+  pass = pass && Data_open(data) == E_DTA_PARSE_ERROR;
+  Data_arrow_free(&data);
+  unlink(path);
+  mu_assert("open didn't reject a file that isn't Arrow", pass);
+}
+
+// types.arrow was written by pyarrow, in two record batches:
+//
+//   i8    i16     i32          name         color  u32
+//   -1    -300    -1           apple        red    4294967295
+//   2     300     null         null         blue   0
+//   null  0       2147483647   kiwi         null   null
+//   -128  -32768  -2147483648  ""           green  1
+//   127   1       7            "pear, big"  red    2
+//
+// color is dictionary encoded with int8 indices
+static Data_T open_types() {
+  Data_T data = Data_arrow_init(TEST_DATA "/types.arrow");
+  if (Data_open(data) != E_OK) Data_arrow_free(&data);
+  return data;
+}
+
+static void close_types(Data_T *data) {
+  Data_T d = *data;
+  Data_close(d);
+  Data_arrow_free(data);
+}
+
+static char *test_Data_arrow_get_row_names() {
+  Data_T data = open_types();
+  char *buf[6];
+  int pass = data && data->ncols == 6 
+    && data->get_row(data, buf, 0, 0, 5) == E_OK
+    && is(data, buf[0], "i8") && is(data, buf[3], "name")
+    && is(data, buf[5], "u32");
+  if (data) close_types(&data);
+  mu_assert("get_row didn't read the column names", pass);
+}
+
+static char *test_Data_arrow_get_row_signed() {
+  Data_T data = open_types();
+  char *buf[6];
+  int pass = data
+    && data->get_row(data, buf, 1, 0, 5) == E_OK
+    && is(data, buf[0], "-1") && is(data, buf[1], "-300") 
+    && is(data, buf[2], "-1") && is(data, buf[5], "4294967295")
+    && data->get_row(data, buf, 4, 0, 2) == E_OK
+    && is(data, buf[0], "-128") && is(data, buf[1], "-32768") 
+    && is(data, buf[2], "-2147483648");
+  if (data) close_types(&data);
+  mu_assert("get_row didn't sign extend narrow ints", pass);
+}
+
+static char *test_Data_arrow_get_row_strings() {
+  Data_T data = open_types();
+  char *buf[6];
+  int pass = data
+    && data->get_row(data, buf, 1, 3, 4) == E_OK
+    && is(data, buf[0], "apple") && is(data, buf[1], "red")
+    && data->get_row(data, buf, 5, 3, 4) == E_OK
+    && is(data, buf[0], "pear, big") && is(data, buf[1], "red")
+    && data->get_row(data, buf, 4, 3, 4) == E_OK
+    && is(data, buf[0], "") && is(data, buf[1], "green");
+  if (data) close_types(&data);
+  mu_assert("get_row didn't read strings or look up the dictionary", pass);
+}
+
+static char *test_Data_arrow_get_row_nulls() {
+  Data_T data = open_types();
+  char *buf[6];
+  int pass = data
+    && data->get_row(data, buf, 2, 2, 3) == E_OK
+    && is(data, buf[0], "") && is(data, buf[1], "")
+    && data->get_row(data, buf, 3, 0, 5) == E_OK
+    && is(data, buf[0], "") && is(data, buf[2], "2147483647")
+    && is(data, buf[4], "") && is(data, buf[5], "");
+  if (data) close_types(&data);
+  mu_assert("get_row didn't show nulls as empty", pass);
+}
+
+// Rows past the end, and columns read down the batches
+static char *test_Data_arrow_get_col() {
+  Data_T data = open_types();
+  char *buf[5], *row[1];
+  int pass = data
+    && data->count_rows(data, 0) == 6
+    && data->get_col(data, buf, 0, 1, 5) == E_OK
+    && is(data, buf[0], "-1") && is(data, buf[2], "") 
+    && is(data, buf[3], "-128") && is(data, buf[4], "127")
+    && data->get_row(data, row, 6, 0, 0) == E_DTA_EOF;
+  if (data) close_types(&data);
+  mu_assert("get_col didn't read a column across batches", pass);
+}
+
+// int Slice_write(Slice_T slice, Data_T data, int fd);
+static char *test_Data_arrow_write() {
+  char path[] = "/tmp/test-data-arrow-XXXXXX", text[128] = { 0 };
+  int fd = mkstemp(path);
+  Data_T data = open_types(), csv = NULL;
+  Slice_T slice = Slice_init(1, 0, 20);
+  char *buf[6];
+  int pass = data && fd >= 0 && Slice_parse_rows(slice, "5") == E_OK
+    && Slice_write(slice, data, fd) == E_OK
+    && pread(fd, text, sizeof text - 1, 0) > 0
+    && strcmp(text, "i8,i16,i32,name,color,u32\n"
+      "127,1,7,\"pear, big\",red,2\n") == 0;
+  if (fd >= 0) close(fd);
+
+  // Read back as CSV, the quoted cell is still one field
+  if (pass) {
+    csv = Data_mmap_init(path, ',');
+    pass = Data_open(csv) == E_OK
+      && csv->get_row(csv, buf, 1, 0, 5) == E_OK && csv->ncols == 6
+      && csv->toklen(buf[3], ',') == 11 && csv->toklen(buf[4], ',') == 3;
+    Data_close(csv);
+    Data_mmap_free(&csv);
+  }
+
+  unlink(path);
+  Slice_free(&slice);
+  if (data) close_types(&data);
+  mu_assert("Slice_write didn't quote the cell holding a comma", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Data_arrow_init_valid,
+    test_Data_arrow_init_empty_path,
+    test_Data_arrow_free_valid,
+    test_Data_arrow_free_throw_NULL_arg,
+    test_Data_arrow_open_not_arrow,
+    test_Data_arrow_get_row_names,
+    test_Data_arrow_get_row_signed,
+    test_Data_arrow_get_row_strings,
+    test_Data_arrow_get_row_nulls,
+    test_Data_arrow_get_col,
+    test_Data_arrow_write,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -0,0 +1,163 @@
+//
+// -----------------------------------------------------------------------------
+// test-data-fixed.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "error.h"
+#include "minunit.h"
+#include "testdata.h"
+#include "frame.h"
+#include "errorcodes.h"
+
+int tests_run = 0;
+
+static char path[] = "/tmp/test-data-fixed-XXXXXX";
+
+static const char rows[] =
+  "id  name        amount\n"
+  "1   apple        12.50\n"
+  "22  big pear         3\r\n"
+  "333                100\n"
+  "4   kiwi\n";
+
+static Data_T open_rows(const int *widths, int nwidths) {
+  if (write_temp(path, rows, sizeof rows - 1)) return NULL;
+  Data_T data = Data_fixed_init(path, widths, nwidths);
+  if (Data_open(data) != E_OK) return NULL;
+  return data;
+}
+
+static void close_rows(Data_T data) {
+  Data_close(data);
+  Data_fixed_free(&data);
+  remove_temp(path);
+}
+
+// Data_T Data_fixed_init(char *path, const int *widths, int nwidths);
+static char *test_Data_fixed_init_valid() {
+  Data_T data = Data_fixed_init("path.fwf", NULL, 0);
+  mu_assert("Data_fixed_init returned NULL", data);
+}
+
+static char *test_Data_fixed_init_bad_widths() {
+  int widths[] = { 4, 0 };
+  Data_T data = Data_fixed_init("path.fwf", widths, 2);
+  mu_assert("Data_fixed_init accepted a width of 0", !data);
+}
+
+// void Data_fixed_free(Data_T *data);
+static char *test_Data_fixed_free_valid() {
+  Data_T data = Data_fixed_init("path.fwf", NULL, 0);
+  Data_fixed_free(&data);
+  mu_assert("Data_fixed_free didn't set data to NULL", !data);
+}
+
+static char *test_Data_fixed_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Data_fixed_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Data_fixed_free didn't throw error when passed NULL", pass);
+}
+
+// int get_row(Data_T data, char **buf, int row, int col_start, int col_end);
+static char *test_Data_fixed_get_row_inferred() {
+  Data_T data = open_rows(NULL, 0);
+  char *buf[3];
+  int pass = data && data->ncols == 3
+    && data->get_row(data, buf, 0, 0, 2) == E_OK
+    && is(data, buf[0], "id") && is(data, buf[1], "name")
+    && is(data, buf[2], "amount")
+    && data->get_row(data, buf, 2, 0, 2) == E_OK
+    && is(data, buf[0], "22") && is(data, buf[1], "big pear")
+    && is(data, buf[2], "3")
+    && data->get_row(data, buf, 3, 1, 2) == E_OK
+    && is(data, buf[0], "") && is(data, buf[1], "100")
+    && data->get_row(data, buf, 4, 2, 2) == E_OK && is(data, buf[0], "")
+    && data->get_row(data, buf, 5, 0, 0) == E_DTA_EOF;
+  if (data) close_rows(data);
+  mu_assert("get_row didn't split rows at the inferred columns", pass);
+}
+
+static char *test_Data_fixed_get_row_widths() {
+  int widths[] = { 2, 2, 18 };
+  Data_T data = open_rows(widths, 3);
+  char *buf[3];
+  int pass = data && data->ncols == 3
+    && data->get_row(data, buf, 3, 0, 2) == E_OK
+    && is(data, buf[0], "33") && is(data, buf[1], "3")
+    && is(data, buf[2], "100");
+  if (data) close_rows(data);
+  mu_assert("get_row didn't split rows at the given widths", pass);
+}
+
+// int get_col(Data_T data, char **buf, int col, int row_start, int row_end);
+static char *test_Data_fixed_get_col() {
+  Data_T data = open_rows(NULL, 0);
+  char *buf[5];
+  int pass = data && data->get_row(data, buf, 4, 0, 0) == E_OK
+    && data->get_col(data, buf, 1, 1, 4) == E_OK
+    && is(data, buf[0], "apple") && is(data, buf[1], "big pear")
+    && is(data, buf[2], "") && is(data, buf[3], "kiwi");
+  if (data) close_rows(data);
+  mu_assert("get_col didn't find the column in each row", pass);
+}
+
+// long count_rows(Data_T data, int nthreads);
+static char *test_Data_fixed_count_rows() {
+  Data_T data = open_rows(NULL, 0);
+  int pass = data && data->count_rows(data, 0) == 5;
+  if (data) close_rows(data);
+  mu_assert("count_rows didn't count every line", pass);
+}
+
+// A few long lines mustn't start a column at each of their words
+static char *test_Data_fixed_long_lines() {
+  char text[4096] = "USER  PID  COMMAND\n";
+  for (int i=0; i<40; i++) strcat(text, "root    1  init\n");
+  strcat(text, "root    2  /usr/bin/python3 -m http.server --bind ::1 80\n");
+  int pass = write_temp(path, text, strlen(text)) == 0;
+  Data_T data = Data_fixed_init(path, NULL, 0);
+  char *buf[3];
+  pass = pass && Data_open(data) == E_OK && data->ncols == 3
+    && data->get_row(data, buf, 41, 2, 2) == E_OK
+    && is(data, buf[0], "/usr/bin/python3 -m http.server --bind ::1 80");
+  close_rows(data);
+  mu_assert("a long line started columns of its own", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Data_fixed_init_valid,
+    test_Data_fixed_init_bad_widths,
+    test_Data_fixed_free_valid,
+    test_Data_fixed_free_throw_NULL_arg,
+    test_Data_fixed_get_row_inferred,
+    test_Data_fixed_get_row_widths,
+    test_Data_fixed_get_col,
+    test_Data_fixed_count_rows,
+    test_Data_fixed_long_lines,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
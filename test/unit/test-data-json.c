@@ -0,0 +1,187 @@
+//
+// -----------------------------------------------------------------------------
+// test-data-json.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "error.h"
+#include "minunit.h"
+#include "testdata.h"
+#include "frame.h"
+#include "slice.h"
+#include "errorcodes.h"
+
+int tests_run = 0;
+
+static char path[] = "/tmp/test-data-json-XXXXXX";
+
+static const char rows[] =
+  "{\"id\": 1, \"name\": \"a,\\\"b\\\"\", \"tags\": [1, {\"id\": 9}]}\n"
+  "{\"name\": \"c\", \"id\": 2, \"extra\": null}\n"
+  "\n"
+  "{\"id\": 3, \"name\": \"" 
+  "a long value that spans more than one block of the structural scan\"}\n";
+
+static Data_T open_rows() {
+  if (write_temp(path, rows, sizeof rows - 1)) return NULL;
+  Data_T data = Data_json_init(path);
+  if (Data_open(data) != E_OK) return NULL;
+  return data;
+}
+
+static void close_rows(Data_T data) {
+  Data_close(data);
+  Data_json_free(&data);
+  remove_temp(path);
+}
+
+// Data_T Data_json_init(char *path);
+static char *test_Data_json_init_valid() {
+  Data_T data = Data_json_init("path.jsonl");
+  mu_assert("Data_json_init returned NULL", data);
+}
+
+// void Data_json_free(Data_T *data);
+static char *test_Data_json_free_valid() {
+  Data_T data = Data_json_init("path.jsonl");
+  Data_json_free(&data);
+  mu_assert("Data_json_free didn't set data to NULL", !data);
+}
+
+static char *test_Data_json_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Data_json_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Data_json_free didn't throw error when passed NULL", pass);
+}
+
+// int get_row(Data_T data, char **buf, int row, int col_start, int col_end);
+static char *test_Data_json_get_row_keys() {
+  Data_T data = open_rows();
+  char *buf[4];
+  int pass = data && data->ncols == 4
+    && data->get_row(data, buf, 0, 0, 3) == E_OK
+    && is(data, buf[0], "id") && is(data, buf[1], "name")
+    && is(data, buf[2], "tags") && is(data, buf[3], "extra");
+  if (data) close_rows(data);
+  mu_assert("get_row didn't return the keys as row 0", pass);
+}
+
+static char *test_Data_json_get_row_values() {
+  Data_T data = open_rows();
+  char *buf[4];
+  int pass = data 
+    && data->get_row(data, buf, 1, 0, 3) == E_OK
+    && is(data, buf[0], "1") && is(data, buf[1], "a,\"b\"")
+    && is(data, buf[2], "[1, {\"id\": 9}]") && is(data, buf[3], "")
+    && data->get_row(data, buf, 2, 0, 1) == E_OK
+    && is(data, buf[0], "2") && is(data, buf[1], "c");
+  if (data) close_rows(data);
+  mu_assert("get_row didn't find the values of each key", pass);
+}
+
+static char *test_Data_json_get_row_long() {
+  Data_T data = open_rows();
+  char *buf[1];
+  int pass = data 
+    && data->get_row(data, buf, 3, 0, 0) == E_OK && is(data, buf[0], "")
+    && data->get_row(data, buf, 4, 1, 1) == E_OK
+    && data->toklen(buf[0], data->delim) == 68
+    && data->get_row(data, buf, 5, 0, 0) == E_DTA_EOF;
+  if (data) close_rows(data);
+  mu_assert("get_row didn't handle blank and long rows", pass);
+}
+
+// long count_rows(Data_T data, int nthreads);
+static char *test_Data_json_count_rows() {
+  Data_T data = open_rows();
+  int pass = data && data->count_rows(data, 0) == 5;
+  if (data) close_rows(data);
+  mu_assert("count_rows didn't count the keys and every line", pass);
+}
+
+// ssize_t scan_fields(Data_T data, ssize_t offset, const int *cols, ...);
+static char *test_Data_json_scan_fields() {
+  Data_T data = open_rows();
+  int cols[] = { 1, 0 }, lens[4];
+  char *toks[4];
+  long n;
+  int pass = data 
+    && data->scan_fields(data, 0, cols, 2, toks, lens, 2, &n) > 0 && n == 2
+    && lens[0] == 9 && memcmp(toks[0], "\"a,", 3) == 0
+    && lens[1] == 1 && toks[1][0] == '1'
+    && lens[2] == 3 && memcmp(toks[2], "\"c\"", 3) == 0
+    && lens[3] == 1 && toks[3][0] == '2';
+  if (data) close_rows(data);
+  mu_assert("scan_fields didn't find the values of each row", pass);
+}
+
+// int format(const char *tok, char *buf, int size);
+static char *test_Data_json_format() {
+  Data_T data = Data_json_init("path.jsonl");
+  char buf[16];
+  int pass = data->format("\"a,\\\"b\\\"\\n\"", buf, sizeof buf) == 6
+    && strcmp(buf, "a,\"b\"\n") == 0
+    && data->format("\"\\u00e9\\ud83d\\ude00\"", buf, sizeof buf) == 6
+    && strcmp(buf, "\xc3\xa9\xf0\x9f\x98\x80") == 0
+    && data->format("\"0123456789abcdef\"", buf, sizeof buf) == 16
+    && strcmp(buf, "0123456789abcde") == 0
+    && data->format("[1, 2]", buf, sizeof buf) == -1;
+  Data_json_free(&data);
+  mu_assert("format didn't unescape strings", pass);
+}
+
+// int Slice_write(Slice_T slice, Data_T data, int fd);
+static char *test_Data_json_write() {
+  Data_T data = open_rows();
+  Slice_T slice = Slice_init(1, 0, 20);
+  FILE *out = tmpfile();
+  char text[128] = { 0 };
+  int pass = data && out && Slice_parse_rows(slice, "1:2") == E_OK
+    && Slice_write(slice, data, fileno(out)) == E_OK
+    && pread(fileno(out), text, sizeof text - 1, 0) > 0
+    && strcmp(text, "id,name,tags,extra\n"
+      "1,\"a,\"\"b\"\"\",\"[1, {\"\"id\"\": 9}]\",\n"
+      "2,c,,null\n") == 0;
+  if (out) fclose(out);
+  Slice_free(&slice);
+  if (data) close_rows(data);
+  mu_assert("Slice_write didn't quote the values it unescaped", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Data_json_init_valid,
+    test_Data_json_free_valid,
+    test_Data_json_free_throw_NULL_arg,
+    test_Data_json_get_row_keys,
+    test_Data_json_get_row_values,
+    test_Data_json_get_row_long,
+    test_Data_json_count_rows,
+    test_Data_json_scan_fields,
+    test_Data_json_format,
+    test_Data_json_write,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -7,9 +7,15 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "error.h"
 #include "minunit.h"
+#include "testdata.h"
+#include "index.h"
 #include "frame.h"
+#include "errorcodes.h"
 
 int tests_run = 0;
 
@@ -55,6 +61,108 @@ static char *test_Data_free_throw_NULL_data_args() {
     pass);
 }
 
+// Rows 2 and 5 are short and row 4 is long
+static const char ragged_rows[] =
+  "a,b,c\n1,2,3\n4,5\n6,7,8\n9,10,11,12\n13\n14,15,16\n";
+
+// int get_row(Data_T data, char **buf, int row, int col_start, int col_end);
+static char *test_get_row_ragged() {
+  char path[] = "/tmp/test-data-mmap-XXXXXX";
+  if (write_temp(path, ragged_rows, sizeof ragged_rows - 1)) return "write";
+
+  Data_T strict = Data_mmap_init(path, ',');
+  Data_T data = Data_mmap_init(path, ',');
+  data->ragged = 1;
+  char *buf[3];
+
+  int pass = Data_open(strict) == E_OK 
+    && strict->get_row(strict, buf, 0, 0, -1) == E_OK
+    && strict->get_row(strict, buf, 2, 0, 2) == E_DTA_MISSING_FIELD;
+
+  // Row 3 is skipped over on the way to row 4, and still counted
+  pass = pass && Data_open(data) == E_OK
+    && data->get_row(data, buf, 0, 0, -1) == E_OK
+    && data->get_row(data, buf, 2, 1, 2) == E_OK 
+    && is(data, buf[0], "5") && is(data, buf[1], "")
+    && data->get_row(data, buf, 5, 0, 0) == E_OK && is(data, buf[0], "13")
+    && Index_fields(data->rows, 2) == 2 && Index_fields(data->rows, 3) == -1
+    && Index_fields(data->rows, 4) == 4 && Index_fields(data->rows, 5) == 1
+    && data->get_col(data, buf, 2, 3, 5) == E_OK
+    && is(data, buf[0], "8") && is(data, buf[1], "11") 
+    && is(data, buf[2], "");
+
+  Data_close(strict);
+  Data_mmap_free(&strict);
+  Data_close(data);
+  Data_mmap_free(&data);
+  unlink(path);
+  mu_assert("get_row didn't pad short rows and mark ragged ones", pass);
+}
+
+// int mvaddntok(int row, int col, const char *tok, int n, char delim);
+static char *test_mvaddntok_padded() {
+  char path[] = "/tmp/test-data-mmap-XXXXXX";
+  if (write_temp(path, ragged_rows, sizeof ragged_rows - 1)) return "write";
+
+  Data_T data = Data_mmap_init(path, ',');
+  data->ragged = 1;
+  char *buf[3], line[17] = "";
+
+  // Row 2 is short, so its last field is padded
+  int pass = Data_open(data) == E_OK
+    && data->get_row(data, buf, 0, 0, -1) == E_OK
+    && data->get_row(data, buf, 2, 0, 2) == E_OK;
+
+  FILE *out = fopen("/dev/null", "w"), *in = fopen("/dev/null", "r");
+  SCREEN *screen = pass ? newterm("vt100", out, in) : NULL;
+  if (screen) {
+    data->mvaddntok(0, 0, buf[1], 8, data->delim);
+    data->mvaddntok(0, 8, buf[2], 8, data->delim);
+    mvinnstr(0, 0, line, 16);
+    endwin();
+    delscreen(screen);
+  }
+  fclose(out);
+  fclose(in);
+
+  Data_close(data);
+  Data_mmap_free(&data);
+  unlink(path);
+  mu_assert("mvaddntok didn't draw a padded field as blank", 
+    pass && screen && strcmp(line, "5               ") == 0);
+}
+
+// Data_T Data_uring_init(char *path, char delim);
+static char *test_Data_uring_init_same_rows() {
+  char path[] = "/tmp/test-data-mmap-XXXXXX";
+  int fd = mkstemp(path);
+  FILE *file = fdopen(fd, "w");
+  fprintf(file, "id,name,note\n");
+  for (int i=0; i<100000; i++)
+    fprintf(file, "%d,name %d,\"note, %d\"\n", i, i, i);
+  fclose(file);
+
+  Data_T mapped = Data_mmap_init(path, ',');
+  Data_T data = Data_uring_init(path, ',');
+  char *a[3], *b[3];
+
+  int pass = Data_open(mapped) == E_OK && Data_open(data) == E_OK
+    && mapped->get_row(mapped, a, 99999, 0, 2) == E_OK
+    && data->get_row(data, b, 99999, 0, 2) == E_OK
+    && is(data, b[0], "99998") && is(data, b[2], "\"note, 99998\"")
+    && data->count_rows(data, 4) == mapped->count_rows(mapped, 4)
+    && data->get_col(data, b, 1, 50000, 50002) == E_OK
+    && is(data, b[2], "name 50001");
+
+  Data_close(mapped);
+  Data_mmap_free(&mapped);
+  Data_close(data);
+  Data_mmap_free(&data);
+  unlink(path);
+  mu_assert("Data_uring_init didn't read the same rows as Data_mmap_init", 
+    pass);
+}
+
 static char* run_all_tests() {
 
   char *(*all_tests[])() = {
@@ -63,6 +171,9 @@ static char* run_all_tests() {
     test_Data_free_throw_NULL_arg,
     test_Data_free_throw_NULL_data,
     test_Data_free_throw_NULL_data_args,
+    test_get_row_ragged,
+    test_mvaddntok_padded,
+    test_Data_uring_init_same_rows,
     NULL
   };
 
@@ -0,0 +1,153 @@
+//
+// -----------------------------------------------------------------------------
+// test-data-sample.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "error.h"
+#include "minunit.h"
+#include "testdata.h"
+#include "index.h"
+#include "frame.h"
+#include "errorcodes.h"
+
+int tests_run = 0;
+
+static char path[] = "/tmp/test-data-sample-XXXXXX";
+
+// The third row has a quoted field over three lines
+static const char rows[] =
+  "id,name,note\n"
+  "1,apple,plain\n"
+  "2,\"pear, big\",\"line one\n"
+  "line two, still quoted\n"
+  "line three\"\n"
+  "3,\"kiwi \"\"gold\"\"\",x\n"
+  "4,plum,\n";
+
+static Data_T open_text(const char *text, size_t len) {
+  if (write_temp(path, text, len)) return NULL;
+  Data_T data = Data_mmap_init(path, ',');
+  char *tok;
+  if (Data_open(data) != E_OK || data->get_row(data, &tok, 0, 0, 0) != E_OK)
+    return NULL;
+  return data;
+}
+
+static void close_text(Data_T data) {
+  Data_close(data);
+  Data_mmap_free(&data);
+  remove_temp(path);
+}
+
+// ssize_t row_near(Data_T data, ssize_t offset, ssize_t *end);
+static char *test_row_near_quoted() {
+  Data_T data = open_text(rows, sizeof rows - 1);
+  ssize_t row = strstr(rows, "2,") - rows, next = strstr(rows, "3,") - rows;
+  ssize_t end, inside = strstr(rows, "line three") - rows + 2;
+  int pass = data
+    && data->row_near(data, inside, &end) == row && end == next
+    && data->row_near(data, row, &end) == row && end == next
+    && data->row_near(data, next + 4, &end) == next;
+  if (data) close_text(data);
+  mu_assert("row_near didn't find the start of a row over many lines", pass);
+}
+
+// long Data_sample(Data_T data, ssize_t offset, long n, uint64_t seed,
+//   ssize_t *rows);
+static char *test_Data_sample_every_row() {
+  Data_T data = open_text(rows, sizeof rows - 1);
+  ssize_t offset = data ? Index_get(data->rows, 1) : 0, picked[10];
+  long n = data ? Data_sample(data, offset, 10, 7, picked) : 0;
+  int pass = n == 4 && picked[0] == offset
+    && picked[1] == strstr(rows, "2,") - rows
+    && picked[2] == strstr(rows, "3,") - rows
+    && picked[3] == strstr(rows, "4,") - rows;
+  if (data) close_text(data);
+  mu_assert("Data_sample didn't pick each row once, in order", pass);
+}
+
+// Long rows hold more bytes, but mustn't be picked more often
+static char *test_Data_sample_unbiased() {
+  char text[40 * 201];
+  int len = 0;
+  for (int i=0; i<20; i++) {
+    len += sprintf(text + len, "s,%02d\n", i);
+    len += sprintf(text + len, "l,%0196d\n", i);
+  }
+  Data_T data = open_text(text, len);
+  int longs = 0, trials = 4000;
+  for (int i=0; data && i<trials; i++) {
+    ssize_t picked;
+    if (Data_sample(data, 0, 1, i + 1, &picked) == 1 && text[picked] == 'l')
+      longs++;
+  }
+  if (data) close_text(data);
+  mu_assert("Data_sample picked long rows more often than short ones",
+    longs > trials * 0.4 && longs < trials * 0.6);
+}
+
+// Data_T Data_sample_init(Data_T data, int headers, const ssize_t *rows,
+//   long n);
+static char *test_Data_sample_get_row() {
+  Data_T data = open_text(rows, sizeof rows - 1);
+  ssize_t picked[2] = {
+    strstr(rows, "2,") - rows, strstr(rows, "4,") - rows
+  };
+  Data_T sample = data ? Data_sample_init(data, 1, picked, 2) : NULL;
+  char *buf[3];
+  int pass = sample && sample->ncols == 3 && sample->nrows == 3
+    && sample->get_row(sample, buf, 0, 0, 2) == E_OK
+    && is(sample, buf[0], "id") && is(sample, buf[2], "note")
+    && sample->get_row(sample, buf, 1, 1, 2) == E_OK
+    && is(sample, buf[0], "\"pear, big\"")
+    && sample->get_row(sample, buf, 2, 0, 2) == E_OK
+    && is(sample, buf[0], "4") && is(sample, buf[1], "plum")
+    && is(sample, buf[2], "")
+    && sample->get_row(sample, buf, 3, 0, 0) == E_DTA_EOF
+    && sample->get_col(sample, buf, 0, 1, 2) == E_OK
+    && is(sample, buf[0], "2") && is(sample, buf[1], "4");
+  if (sample) Data_sample_free(&sample);
+  if (data) close_text(data);
+  mu_assert("Data_sample_init didn't show the rows picked", pass);
+}
+
+// void Data_sample_free(Data_T *data);
+static char *test_Data_sample_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Data_sample_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Data_sample_free didn't throw error when passed NULL", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_row_near_quoted,
+    test_Data_sample_every_row,
+    test_Data_sample_unbiased,
+    test_Data_sample_get_row,
+    test_Data_sample_free_throw_NULL_arg,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -0,0 +1,151 @@
+//
+// -----------------------------------------------------------------------------
+// test-data-shards.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "error.h"
+#include "minunit.h"
+#include "testdata.h"
+#include "index.h"
+#include "frame.h"
+#include "errorcodes.h"
+
+int tests_run = 0;
+
+static char dir[] = "/tmp/test-data-shards-XXXXXX";
+static char pattern[64];
+
+// The third part is empty, as Spark writes them when a partition is
+static const char *parts[] = {
+  "id,name\n1,apple\n2,pear\n",
+  "id,name\n3,kiwi\n",
+  "",
+  "id,name\n4,plum\n5,fig\n6,lime\n",
+};
+#define NPARTS (sizeof parts / sizeof parts[0])
+
+static Data_T mmap_init(const char *path, char delim, const char *options) {
+  (void) options;
+  return Data_mmap_init((char *) path, delim);
+}
+
+static Data_T open_parts() {
+  if (!mkdtemp(dir)) return NULL;
+  for (int i=0; i<(int) NPARTS; i++) {
+    char path[64];
+    sprintf(path, "%s/part-%05d.csv", dir, i);
+    FILE *fp = fopen(path, "w");
+    if (!fp) return NULL;
+    fputs(parts[i], fp);
+    fclose(fp);
+  }
+  sprintf(pattern, "%s/part-*.csv", dir);
+  Data_T data = Data_shards_init(pattern, 1, mmap_init, ',', NULL);
+  if (!data || Data_open(data) != E_OK) return NULL;
+  return data;
+}
+
+static void close_parts(Data_T data) {
+  Data_close(data);
+  Data_shards_free(&data);
+  for (int i=0; i<(int) NPARTS; i++) {
+    char path[64];
+    sprintf(path, "%s/part-%05d.csv", dir, i);
+    unlink(path);
+  }
+  remove_temp(dir);
+}
+
+// Data_T Data_shards_init(char *pattern, int headers, ...);
+static char *test_Data_shards_init_no_match() {
+  Data_T data = Data_shards_init("/tmp/test-data-shards-none/*.csv", 1,
+    mmap_init, ',', NULL);
+  mu_assert("Data_shards_init didn't return NULL when nothing matched",
+    data == NULL);
+}
+
+// Rows run on from one shard to the next, with one header
+static char *test_Data_shards_get_row() {
+  Data_T data = open_parts();
+  char *buf[2];
+  int pass = data
+    && data->get_row(data, buf, 0, 0, 1) == E_OK
+    && is(data, buf[0], "id") && is(data, buf[1], "name")
+    && data->get_row(data, buf, 2, 0, 1) == E_OK
+    && is(data, buf[0], "2") && is(data, buf[1], "pear")
+    && data->get_row(data, buf, 3, 1, 1) == E_OK
+    && is(data, buf[0], "kiwi")
+    && data->get_row(data, buf, 4, 0, 1) == E_OK
+    && is(data, buf[0], "4") && is(data, buf[1], "plum")
+    && data->get_row(data, buf, 1, 0, 0) == E_OK && is(data, buf[0], "1")
+    && data->get_row(data, buf, 7, 0, 0) == E_DTA_EOF
+    && data->get_col(data, buf, 1, 3, 4) == E_OK
+    && is(data, buf[0], "kiwi") && is(data, buf[1], "plum");
+  if (data) close_parts(data);
+  mu_assert("Data_shards didn't read rows across shards", pass);
+}
+
+// long count_rows(Data_T data, int nthreads);
+static char *test_Data_shards_count_rows() {
+  Data_T data = open_parts();
+  char *buf[2];
+  int pass = data && data->count_rows(data, 2) == 7 && data->nrows == 7
+    && data->get_row(data, buf, 6, 0, 1) == E_OK
+    && is(data, buf[0], "6") && is(data, buf[1], "lime");
+  if (data) close_parts(data);
+  mu_assert("Data_shards didn't count the rows of every shard", pass);
+}
+
+// ssize_t scan_rows(Data_T data, ssize_t offset, ssize_t nbytes,
+//   long *nrows);
+static char *test_Data_shards_scan_rows() {
+  Data_T data = open_parts();
+  long nrows = 0;
+  ssize_t offset = 0;
+  while (data && offset < data->st_size)
+    offset = data->scan_rows(data, offset, 1 << 20, &nrows);
+  int pass = data && nrows == 7 && offset == data->st_size;
+  if (data) close_parts(data);
+  mu_assert("Data_shards scan_rows didn't count each row once", pass);
+}
+
+// void Data_shards_free(Data_T *data);
+static char *test_Data_shards_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Data_shards_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Data_shards_free didn't throw error when passed NULL", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Data_shards_init_no_match,
+    test_Data_shards_get_row,
+    test_Data_shards_count_rows,
+    test_Data_shards_scan_rows,
+    test_Data_shards_free_throw_NULL_arg,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
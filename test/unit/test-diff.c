@@ -0,0 +1,185 @@
+//
+// -----------------------------------------------------------------------------
+// test-diff.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include "error.h"
+#include "minunit.h"
+#include "diff.h"
+
+int tests_run = 0;
+
+// Runs a whole diff of two lists of row hashes
+static Diff_T diff_of(const uint64_t *a, long na, const uint64_t *b, long nb,
+  const uint64_t *ka, const uint64_t *kb) {
+  Diff_T diff = Diff_new(ka != NULL);
+  Diff_add(diff, DIFF_A, a, ka, na);
+  Diff_add(diff, DIFF_B, b, kb, nb);
+  Diff_done(diff, DIFF_A);
+  Diff_done(diff, DIFF_B);
+  return diff;
+}
+
+// Diff_T Diff_new(int keyed);
+static char *test_Diff_new_valid() {
+  Diff_T diff = Diff_new(0);
+  mu_assert("Diff_new returned NULL", diff);
+}
+
+// void Diff_free(Diff_T *diff);
+static char *test_Diff_free_valid() {
+  Diff_T diff = Diff_new(1);
+  Diff_free(&diff);
+  mu_assert("Diff_free didn't set diff to NULL", !diff);
+}
+
+static char *test_Diff_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Diff_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Diff_free didn't throw error when passed NULL", pass);
+}
+
+// void Diff_add(Diff_T diff, int side, ...);
+static char *test_Diff_add_throw_after_done() {
+  Diff_T diff = Diff_new(0);
+  uint64_t h = 1;
+  Diff_done(diff, DIFF_A);
+  unsigned char pass = 0;
+  TRY Diff_add(diff, DIFF_A, &h, NULL, 1);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Diff_add didn't throw error when side was done", pass);
+}
+
+// int Diff_get(Diff_T diff, long i, long *a, long *b);
+static char *test_Diff_get_identical() {
+  uint64_t rows[] = { 1, 2, 3, 4 };
+  Diff_T diff = diff_of(rows, 4, rows, 4, NULL, NULL);
+  long a, b;
+  int same = Diff_length(diff) == 4;
+  for (long i=0; same && i<4; i++)
+    same = Diff_get(diff, i, &a, &b) == DIFF_SAME && a == i && b == i;
+  mu_assert("Diff_get didn't line up identical files", same);
+}
+
+static char *test_Diff_get_inserted() {
+  uint64_t a[] = { 1, 2, 3 }, b[] = { 1, 9, 2, 3 };
+  Diff_T diff = diff_of(a, 3, b, 4, NULL, NULL);
+  long ra, rb;
+  mu_assert("Diff_get didn't find an inserted row",
+    Diff_length(diff) == 4 
+    && Diff_get(diff, 1, &ra, &rb) == DIFF_ADDED && rb == 1
+    && Diff_get(diff, 2, &ra, &rb) == DIFF_SAME && ra == 1 && rb == 2);
+}
+
+static char *test_Diff_get_changed() {
+  uint64_t a[] = { 1, 2, 3 }, b[] = { 1, 7, 3 };
+  Diff_T diff = diff_of(a, 3, b, 3, NULL, NULL);
+  long ra, rb;
+  mu_assert("Diff_get didn't pair a changed row",
+    Diff_length(diff) == 3 
+    && Diff_get(diff, 1, &ra, &rb) == DIFF_CHANGED && ra == 1 && rb == 1);
+}
+
+static char *test_Diff_get_deleted_at_end() {
+  uint64_t a[] = { 1, 2, 3 }, b[] = { 1, 2 };
+  Diff_T diff = diff_of(a, 3, b, 2, NULL, NULL);
+  long ra, rb;
+  mu_assert("Diff_get didn't find a deleted row",
+    Diff_length(diff) == 3 
+    && Diff_get(diff, 2, &ra, &rb) == DIFF_DELETED && ra == 2 && rb == -1);
+}
+
+static char *test_Diff_get_keyed() {
+  uint64_t a[] = { 10, 20, 30 }, ka[] = { 1, 2, 3 };
+  uint64_t b[] = { 30, 21, 40 }, kb[] = { 3, 2, 4 };
+  Diff_T diff = diff_of(a, 3, b, 3, ka, kb);
+  long ra, rb;
+  mu_assert("Diff_get didn't line up rows by key",
+    Diff_length(diff) == 4
+    && Diff_get(diff, 0, &ra, &rb) == DIFF_DELETED && ra == 0
+    && Diff_get(diff, 1, &ra, &rb) == DIFF_CHANGED && ra == 1 && rb == 1
+    && Diff_get(diff, 2, &ra, &rb) == DIFF_SAME && ra == 2 && rb == 0
+    && Diff_get(diff, 3, &ra, &rb) == DIFF_ADDED && rb == 2);
+}
+
+static char *test_Diff_get_incremental() {
+  uint64_t a[300], b[300];
+  for (int i=0; i<300; i++) a[i] = b[i] = i + 1;
+  b[200] = 0;
+  Diff_T diff = Diff_new(0);
+  for (int i=0; i<300; i+=100) {
+    Diff_add(diff, DIFF_A, a + i, NULL, 100);
+    Diff_add(diff, DIFF_B, b + i, NULL, 100);
+  }
+  int early = Diff_length(diff) >= 200;
+  Diff_done(diff, DIFF_A);
+  Diff_done(diff, DIFF_B);
+  mu_assert("Diff didn't align rows as they were added",
+    early && Diff_length(diff) == 300 && Diff_changes(diff) == 1);
+}
+
+// long Diff_changes(Diff_T diff);
+static char *test_Diff_changes_keyed() {
+  uint64_t a[] = { 10, 20, 30 }, ka[] = { 1, 2, 3 };
+  uint64_t b[] = { 30, 21, 40 }, kb[] = { 3, 2, 4 };
+  Diff_T diff = Diff_new(1);
+  Diff_add(diff, DIFF_A, a, ka, 3);
+  Diff_done(diff, DIFF_A);
+  int pending = Diff_changes(diff) == 0;
+  Diff_add(diff, DIFF_B, b, kb, 2);
+  int matched = Diff_changes(diff) == 1;
+  Diff_add(diff, DIFF_B, b + 2, kb + 2, 1);
+  Diff_done(diff, DIFF_B);
+  int pass = pending && matched && Diff_changes(diff) == 3;
+  Diff_free(&diff);
+  mu_assert("Diff_changes didn't count rows as they were aligned", pass);
+}
+
+// long Diff_next(Diff_T diff, long i, int dir);
+static char *test_Diff_next_runs() {
+  uint64_t a[] = { 1, 2, 3, 4, 5, 6 }, b[] = { 1, 8, 9, 4, 5, 7 };
+  Diff_T diff = diff_of(a, 6, b, 6, NULL, NULL);
+  mu_assert("Diff_next didn't find the start of each run",
+    Diff_next(diff, 0, 1) == 1 && Diff_next(diff, 1, 1) == 5
+    && Diff_next(diff, 5, 1) == -1 && Diff_next(diff, 5, -1) == 1);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Diff_new_valid,
+    test_Diff_free_valid,
+    test_Diff_free_throw_NULL_arg,
+    test_Diff_add_throw_after_done,
+    test_Diff_get_identical,
+    test_Diff_get_inserted,
+    test_Diff_get_changed,
+    test_Diff_get_deleted_at_end,
+    test_Diff_get_keyed,
+    test_Diff_get_incremental,
+    test_Diff_changes_keyed,
+    test_Diff_next_runs,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -7,9 +7,15 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "error.h"
 #include "minunit.h"
+#include "deque.h"
 #include "frame.h"
+#include "pool.h"
+#include "errorcodes.h"
 
 int tests_run = 0;
 
@@ -79,6 +85,141 @@ static char *test_Frame_print_throw_length0_data() {
   mu_assert("Frame_print didn't throw error when passed length 0 data", pass);
 }
 
+// Whether the cells on screen are those of rows first_row on and
+// columns first_col on, which hold rRcC
+static int shows(Frame_T frame, Data_T data, int first_row, int first_col) {
+  char want[16];
+  for (int icol=0; icol<frame->ncols; icol++) {
+    Deque_T col = Deque_get(frame->data, frame->margin.left + icol);
+    for (int irow=0; irow<frame->nrows-1; irow++) {
+      snprintf(want, sizeof want, "r%dc%d", first_row + irow, first_col + icol);
+      char *tok = Deque_get(col, irow);
+      if (data->toklen(tok, data->delim) != (int) strlen(want)
+        || memcmp(tok, want, strlen(want))) return 0;
+    }
+  }
+  return 1;
+}
+
+// Writes a header and nrows-1 rows of ncols cells holding rRcC
+static void write_grid(char *path, int nrows, int ncols) {
+  int fd = mkstemp(path);
+  FILE *f = fdopen(fd, "w");
+  for (int col=0; col<ncols; col++) fprintf(f, "%sh%d", col ? "," : "", col);
+  for (int row=1; row<nrows; row++)
+    for (int col=0; col<ncols; col++)
+      fprintf(f, "%sr%dc%d", col ? "," : "\n", row, col);
+  fprintf(f, "\n");
+  fclose(f);
+}
+
+// int Frame_shift_col(Frame_T frame, Data_T data, int n);
+static char *test_Frame_shift_col_prefetch() {
+  char path[] = "/tmp/test-frame-XXXXXX";
+  write_grid(path, 10, 20);
+
+  Data_T data = Data_mmap_init(path, ',');
+  Frame_T frame = Frame_init(16, 3, 4, 1);
+  Pool_T pool = Pool_new(2);
+  int pass = Data_open(data) == E_OK && Frame_load(frame, data) == E_OK;
+  Frame_prefetch(frame, data, pool);
+
+  for (int i=0; pass && i<6; i++) 
+    pass = Frame_shift_col(frame, data, 1) == E_OK;
+  pass = pass && shows(frame, data, 1, 6)
+    && Frame_shift_row(frame, data, 1) == E_OK && shows(frame, data, 2, 6);
+  for (int i=0; pass && i<4; i++) 
+    pass = Frame_shift_col(frame, data, -1) == E_OK;
+  pass = pass && shows(frame, data, 2, 2) && frame->margin.right > 0
+    && Frame_shift_col(frame, data, 1) == E_OK && shows(frame, data, 2, 3);
+
+  Frame_prefetch(frame, data, NULL);
+  Pool_free(&pool);
+  Frame_free(&frame, NULL, NULL);
+  Data_close(data);
+  Data_mmap_free(&data);
+  unlink(path);
+  mu_assert("Frame_shift_col didn't show the columns scrolled to", pass);
+}
+
+// int Frame_shift_row(Frame_T frame, Data_T data, int n);
+static char *test_Frame_shift_row_ahead() {
+  char path[] = "/tmp/test-frame-XXXXXX";
+  write_grid(path, 200, 20);
+
+  Data_T data = Data_mmap_init(path, ',');
+  Frame_T frame = Frame_init(16, 3, 4, 1);
+  Pool_T pool = Pool_new(2);
+  int pass = Data_open(data) == E_OK && Frame_load(frame, data) == E_OK;
+  Frame_prefetch(frame, data, pool);
+
+  // Rows come from the read-ahead buffer or the file, depending on how
+  // far the worker has got, and must be the same either way
+  int row = 1;
+  for (int i=0; pass && i<150; i++, row++) {
+    if (i % 40 == 0) usleep(10000);
+    pass = Frame_shift_row(frame, data, 1) == E_OK 
+      && shows(frame, data, row + 1, 0);
+  }
+  pass = pass && Frame_shift_col(frame, data, 1) == E_OK;
+  for (int i=0; pass && i<100; i++, row--) {
+    if (i % 40 == 0) usleep(10000);
+    pass = Frame_shift_row(frame, data, -1) == E_OK 
+      && shows(frame, data, row - 1, 1);
+  }
+  while (pass && Frame_shift_row(frame, data, 1) == E_OK) row++;
+
+  // Rows read ahead are added to the index as they're scrolled onto
+  char *tok;
+  pass = pass && row == 197 && shows(frame, data, row, 1) 
+    && data->get_row(data, &tok, 150, 0, 0) == E_OK 
+    && memcmp(tok, "r150c0,", 7) == 0;
+
+  Frame_prefetch(frame, data, NULL);
+  Pool_free(&pool);
+  Frame_free(&frame, NULL, NULL);
+  Data_close(data);
+  Data_mmap_free(&data);
+  unlink(path);
+  mu_assert("Frame_shift_row didn't show the rows scrolled to", pass);
+}
+
+// int Frame_resize(Frame_T frame, Data_T data, int max_cols, int max_rows);
+static char *test_Frame_resize_keeps_cursor() {
+  char path[] = "/tmp/test-frame-XXXXXX";
+  write_grid(path, 50, 20);
+
+  Data_T data = Data_mmap_init(path, ',');
+  Frame_T frame = Frame_init(16, 5, 10, 1);
+  int pass = Data_open(data) == E_OK && Frame_load(frame, data) == E_OK;
+
+  // Cursor on r3c2, which has to stay on screen as it shrinks
+  frame->cursor.row = 3;
+  frame->cursor.col = 2 * frame->col_width;
+  pass = pass && Frame_resize(frame, data, 2, 3) == E_OK
+    && frame->ncols == 2 && frame->nrows == 3 && shows(frame, data, 2, 1)
+    && frame->data_loaded.first_row + frame->cursor.row - 1 == 3
+    && frame->data_loaded.first_col + frame->cursor.col / 16 == 2;
+
+  pass = pass && Frame_resize(frame, data, 6, 12) == E_OK
+    && frame->ncols == 6 && frame->nrows == 12 && shows(frame, data, 2, 1)
+    && frame->data_loaded.first_row + frame->cursor.row - 1 == 3
+    && frame->data_loaded.first_col + frame->cursor.col / 16 == 2;
+
+  // Past the last row and column, rows and columns come from before
+  for (int i=0; pass && i<13; i++) 
+    pass = Frame_shift_col(frame, data, 1) == E_OK;
+  while (pass && Frame_shift_row(frame, data, 1) == E_OK) ;
+  pass = pass && Frame_resize(frame, data, 8, 20) == E_OK
+    && shows(frame, data, 31, 12) && frame->data_loaded.last_row == 49;
+
+  Frame_free(&frame, NULL, NULL);
+  Data_close(data);
+  Data_mmap_free(&data);
+  unlink(path);
+  mu_assert("Frame_resize didn't keep the cursor on the same cell", pass);
+}
+
 static char* run_all_tests() {
 
   char *(*all_tests[])() = {
@@ -91,6 +232,9 @@ static char* run_all_tests() {
     test_Frame_free_throw_NULL_frame,
     test_Frame_print_throw_NULL_frame,
     test_Frame_print_throw_length0_data,
+    test_Frame_shift_col_prefetch,
+    test_Frame_shift_row_ahead,
+    test_Frame_resize_keeps_cursor,
     NULL
   };
 
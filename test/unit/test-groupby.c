@@ -0,0 +1,151 @@
+//
+// -----------------------------------------------------------------------------
+// test-groupby.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "error.h"
+#include "minunit.h"
+#include "groupby.h"
+
+int tests_run = 0;
+
+static void add(Groupby_T groupby, const char *key, double value) {
+  Groupby_add(groupby, key, strlen(key), &value);
+}
+
+static int is(Groupby_group *group, const char *key) {
+  return group->len == (int) strlen(key) 
+    && memcmp(group->key, key, group->len) == 0;
+}
+
+// Groupby_T Groupby_new(int capacity);
+static char *test_Groupby_new_valid() {
+  Groupby_T groupby = Groupby_new(16);
+  mu_assert("Groupby_new returned NULL", groupby);
+}
+
+static char *test_Groupby_new_throw_small_capacity() {
+  unsigned char pass = 0;
+  TRY Groupby_new(1);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Groupby_new didn't throw error when capacity was 1", pass);
+}
+
+// void Groupby_free(Groupby_T *groupby);
+static char *test_Groupby_free_valid() {
+  Groupby_T groupby = Groupby_new(16);
+  Groupby_free(&groupby);
+  mu_assert("Groupby_free didn't set groupby to NULL", !groupby);
+}
+
+static char *test_Groupby_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Groupby_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Groupby_free didn't throw error when passed NULL", pass);
+}
+
+// int Groupby_top(Groupby_T groupby, Groupby_group *groups, int max, int agg);
+static char *test_Groupby_top_count() {
+  Groupby_T groupby = Groupby_new(16);
+  const char *keys[] = { "b", "a", "b", "c", "b", "a" };
+  for (int i=0; i<6; i++) Groupby_add(groupby, keys[i], 1, NULL);
+  Groupby_group top[4];
+  int n = Groupby_top(groupby, top, 4, GROUPBY_COUNT);
+  int pass = n == 3 && Groupby_rows(groupby) == 6 && Groupby_error(groupby) == 0
+    && is(&top[0], "b") && top[0].count == 3 
+    && is(&top[1], "a") && top[1].count == 2 
+    && is(&top[2], "c") && top[2].count == 1;
+  Groupby_free(&groupby);
+  mu_assert("Groupby_top didn't list groups by count", pass);
+}
+
+static char *test_Groupby_top_aggregates() {
+  Groupby_T groupby = Groupby_new(16);
+  add(groupby, "x", 1);
+  add(groupby, "y", 10);
+  add(groupby, "x", 5);
+  Groupby_add(groupby, "z", 1, NULL);
+  Groupby_group top[3];
+  int n = Groupby_top(groupby, top, 3, GROUPBY_MEAN);
+  int pass = n == 3 && is(&top[0], "y") && is(&top[1], "x") && is(&top[2], "z")
+    && Groupby_value(&top[1], GROUPBY_SUM) == 6
+    && Groupby_value(&top[1], GROUPBY_MEAN) == 3
+    && Groupby_value(&top[1], GROUPBY_MIN) == 1
+    && Groupby_value(&top[1], GROUPBY_MAX) == 5
+    && Groupby_value(&top[2], GROUPBY_MEAN) != Groupby_value(&top[2], GROUPBY_MEAN);
+  Groupby_free(&groupby);
+  mu_assert("Groupby_top didn't list groups by aggregate", pass);
+}
+
+// Heavy hitters are kept once there are too many groups to keep them all
+static char *test_Groupby_add_evict() {
+  Groupby_T groupby = Groupby_new(8);
+  char keys[100][4];
+  for (int i=0; i<100; i++) {
+    snprintf(keys[i], sizeof keys[i], "%d", i);
+    Groupby_add(groupby, keys[i], strlen(keys[i]), NULL);
+    Groupby_add(groupby, "hot", 3, NULL);
+    Groupby_add(groupby, "hot", 3, NULL);
+  }
+  Groupby_group top[1];
+  Groupby_top(groupby, top, 1, GROUPBY_COUNT);
+  int pass = Groupby_length(groupby) <= 8 && Groupby_error(groupby) > 0
+    && is(&top[0], "hot") && top[0].count >= 200 
+    && top[0].count - top[0].err <= 200;
+  Groupby_free(&groupby);
+  mu_assert("Groupby_add didn't keep the most frequent group", pass);
+}
+
+// void Groupby_merge(Groupby_T into, Groupby_T from);
+static char *test_Groupby_merge() {
+  Groupby_T a = Groupby_new(16), b = Groupby_new(16);
+  add(a, "x", 1);
+  add(a, "y", 2);
+  add(b, "x", 3);
+  add(b, "z", 4);
+  Groupby_merge(a, b);
+  Groupby_group top[4];
+  int n = Groupby_top(a, top, 4, GROUPBY_COUNT);
+  int pass = n == 3 && Groupby_rows(a) == 4 && is(&top[0], "x") 
+    && top[0].count == 2 && top[0].sum == 4 && top[0].min == 1 
+    && top[0].max == 3;
+  Groupby_free(&a);
+  Groupby_free(&b);
+  mu_assert("Groupby_merge didn't combine groups", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Groupby_new_valid,
+    test_Groupby_new_throw_small_capacity,
+    test_Groupby_free_valid,
+    test_Groupby_free_throw_NULL_arg,
+    test_Groupby_top_count,
+    test_Groupby_top_aggregates,
+    test_Groupby_add_evict,
+    test_Groupby_merge,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
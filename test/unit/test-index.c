@@ -0,0 +1,202 @@
+//
+// -----------------------------------------------------------------------------
+// test-index.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "error.h"
+#include "minunit.h"
+#include "index.h"
+
+int tests_run = 0;
+
+// Index_T Index_new(void);
+static char *test_Index_new_valid() {
+  Index_T index = Index_new();
+  mu_assert("Index_new returned NULL", index);
+}
+
+static char *test_Index_new_empty() {
+  Index_T index = Index_new();
+  mu_assert("Index_new didn't return an empty index", 
+    Index_length(index) == 0);
+}
+
+// void Index_free(Index_T *index);
+static char *test_Index_free_valid() {
+  Index_T index = Index_new();
+  Index_free(&index);
+  mu_assert("Index_free didn't set index to NULL", !index);
+}
+
+static char *test_Index_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Index_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Index_free didn't throw error when passed NULL", pass);
+}
+
+// void Index_append(Index_T index, ssize_t offset);
+static char *test_Index_append_grows() {
+  Index_T index = Index_new();
+  for (long i=0; i<100000; i++) Index_append(index, i * 10);
+  mu_assert("Index_append lost offsets while growing",
+    Index_length(index) == 100000 && Index_get(index, 99999) == 999990);
+}
+
+static char *test_Index_append_large_offset() {
+  Index_T index = Index_new();
+  Index_append(index, 0);
+  Index_append(index, 5L << 30);
+  mu_assert("Index_append truncated an offset past 4GB",
+    Index_get(index, 1) == 5L << 30);
+}
+
+static char *test_Index_append_throw_decreasing() {
+  unsigned char pass = 0;
+  Index_T index = Index_new();
+  Index_append(index, 10);
+  TRY Index_append(index, 5);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Index_append didn't throw error on a decreasing offset", pass);
+}
+
+// Offsets that repeat, as empty rows do, jump past 4GB and vary in
+// spacing, compared against an array
+#define N 10000
+static ssize_t offsets[N];
+
+static Index_T random_index(long n) {
+  Index_T index = Index_new();
+  ssize_t offset = 0;
+  srand(7);
+  for (long i=0; i<n; i++) {
+    int r = rand() % 100;
+    offset += r < 5 ? 0 : r < 6 ? 5L << 30 : r < 50 ? rand() % 100 
+      : rand() % 100000;
+    offsets[i] = offset;
+    Index_append(index, offset);
+  }
+  return index;
+}
+
+// ssize_t Index_get(Index_T index, long i);
+static char *test_Index_get_random() {
+  Index_T index = random_index(N);
+  int pass = Index_length(index) == N;
+  for (long i=0; pass && i<N; i++) pass = Index_get(index, i) == offsets[i];
+  Index_free(&index);
+  mu_assert("Index_get didn't give back the offsets appended", pass);
+}
+
+static char *test_Index_get_throw_oob() {
+  unsigned char pass = 0;
+  Index_T index = Index_new();
+  Index_append(index, 0);
+  TRY Index_get(index, 1);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Index_get didn't throw error when out of bounds", pass);
+}
+
+// long Index_rank(Index_T index, ssize_t offset);
+static char *test_Index_rank() {
+  long n = N - 37;
+  Index_T index = random_index(n);
+  int pass = Index_rank(index, offsets[0] - 1) == -1
+    && Index_rank(index, offsets[n-1] + 5) == n - 1;
+  for (long i=0; pass && i<n; i++) {
+    long last = i;
+    while (last + 1 < n && offsets[last+1] == offsets[i]) last++;
+    pass = Index_rank(index, offsets[i]) == last
+      && (last + 1 == n || offsets[last+1] == offsets[i] + 1
+        || Index_rank(index, offsets[i] + 1) == last);
+    i = last;
+  }
+  Index_free(&index);
+  mu_assert("Index_rank didn't find the row holding an offset", pass);
+}
+
+// size_t Index_bytes(Index_T index);
+static char *test_Index_bytes_compressed() {
+  Index_T index = Index_new();
+  for (long i=0; i<1000000; i++) Index_append(index, i * 80 + i % 7);
+  int pass = Index_bytes(index) < 1000000 * 3;
+  Index_free(&index);
+  mu_assert("Index_bytes was over three bytes a row", pass);
+}
+
+// void Index_mark(Index_T index, long i, int nfields);
+static char *test_Index_mark_fields() {
+  Index_T index = Index_new();
+  for (long i=0; i<100; i++) if (i % 7 == 3) Index_mark(index, i, i % 5);
+  int pass = Index_fields(index, 3) == 3 && Index_fields(index, 10) == 0
+    && Index_fields(index, 4) == -1 && Index_fields(index, 200) == -1;
+  Index_free(&index);
+  mu_assert("Index_fields didn't give the count rows were marked with", pass);
+}
+
+static char *test_Index_mark_throw_out_of_order() {
+  Index_T index = Index_new();
+  Index_mark(index, 5, 2);
+  unsigned char pass = 0;
+  TRY Index_mark(index, 5, 3);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  Index_free(&index);
+  mu_assert("Index_mark didn't throw error when rows weren't in order", pass);
+}
+
+// long Index_next_mark(Index_T index, long i, int dir);
+static char *test_Index_next_mark() {
+  Index_T index = Index_new();
+  int pass = Index_next_mark(index, 0, 1) == -1;
+  Index_mark(index, 4, 1);
+  Index_mark(index, 9, 1);
+  pass = pass && Index_next_mark(index, 0, 1) == 4 
+    && Index_next_mark(index, 4, 1) == 9 && Index_next_mark(index, 9, 1) == -1
+    && Index_next_mark(index, 9, -1) == 4 && Index_next_mark(index, 12, -1) == 9
+    && Index_next_mark(index, 4, -1) == -1;
+  Index_free(&index);
+  mu_assert("Index_next_mark didn't find the nearest marked row", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Index_new_valid,
+    test_Index_new_empty,
+    test_Index_free_valid,
+    test_Index_free_throw_NULL_arg,
+    test_Index_append_grows,
+    test_Index_append_large_offset,
+    test_Index_append_throw_decreasing,
+    test_Index_get_throw_oob,
+    test_Index_get_random,
+    test_Index_rank,
+    test_Index_bytes_compressed,
+    test_Index_mark_fields,
+    test_Index_mark_throw_out_of_order,
+    test_Index_next_mark,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
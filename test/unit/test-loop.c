@@ -0,0 +1,107 @@
+//
+// -----------------------------------------------------------------------------
+// test-loop.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <pthread.h>
+#include "error.h"
+#include "minunit.h"
+#include "errorcodes.h"
+#include "loop.h"
+
+int tests_run = 0;
+
+struct producer {
+  Loop_T loop;
+  Spsc_T channel;
+};
+
+static int received = 0;
+static int ticks = 0;
+
+static void on_message(Loop_T loop, void *msg, void *cl) {
+  if (++received == 3) Loop_stop(loop);
+}
+
+static void on_tick(Loop_T loop, void *cl) {
+  if (++ticks == 2) Loop_stop(loop);
+}
+
+static void *produce(void *cl) {
+  struct producer *p = cl;
+  static int x = 1;
+  for (int i=0; i<3; i++) Loop_post(p->loop, p->channel, &x);
+  return NULL;
+}
+
+// Loop_T Loop_new(void);
+static char *test_Loop_new_valid() {
+  Loop_T loop = Loop_new();
+  mu_assert("Loop_new returned NULL", loop);
+}
+
+// void Loop_free(Loop_T *loop);
+static char *test_Loop_free_valid() {
+  Loop_T loop = Loop_new();
+  Loop_free(&loop);
+  mu_assert("Loop_free didn't set loop to NULL", !loop);
+}
+
+static char *test_Loop_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Loop_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Loop_free didn't throw error when passed NULL", pass);
+}
+
+// int Loop_add_timer(Loop_T loop, long msec, ...);
+static char *test_Loop_timer_fires() {
+  Loop_T loop = Loop_new();
+  Loop_add_timer(loop, 1, on_tick, NULL);
+  int err = Loop_run(loop);
+  Loop_free(&loop);
+  mu_assert("Loop timer didn't fire twice", err == E_OK && ticks == 2);
+}
+
+// int Loop_post(Loop_T loop, Spsc_T channel, void *msg);
+static char *test_Loop_post_from_thread() {
+  Loop_T loop = Loop_new();
+  struct producer p = { loop, Loop_channel(loop, 4, on_message, NULL) };
+  pthread_t thread;
+  pthread_create(&thread, NULL, produce, &p);
+  int err = Loop_run(loop);
+  pthread_join(thread, NULL);
+  Loop_free(&loop);
+  mu_assert("Loop didn't deliver posted messages", 
+    err == E_OK && received == 3);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Loop_new_valid,
+    test_Loop_free_valid,
+    test_Loop_free_throw_NULL_arg,
+    test_Loop_timer_fires,
+    test_Loop_post_from_thread,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -0,0 +1,179 @@
+//
+// -----------------------------------------------------------------------------
+// test-pool.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include "error.h"
+#include "minunit.h"
+#include "pool.h"
+
+int tests_run = 0;
+
+static atomic_int count;
+
+static void add_one(void *cl, Pool_token token) {
+  atomic_fetch_add(&count, 1);
+}
+
+// Holds the only worker until the flag is set
+static void block(void *cl, Pool_token token) {
+  while (!atomic_load((atomic_int *) cl)) ;
+}
+
+// Records the order tasks ran in
+static int order[4], norder;
+
+static void record(void *cl, Pool_token token) {
+  order[norder++] = Pool_cancelled(token) ? -1 : *(int *) cl;
+}
+
+// Pool_T Pool_new(int nthreads);
+static char *test_Pool_new_valid() {
+  Pool_T pool = Pool_new(2);
+  int pass = pool && Pool_size(pool) == 2;
+  Pool_free(&pool);
+  mu_assert("Pool_new didn't start 2 workers", pass);
+}
+
+static char *test_Pool_new_throw_negative() {
+  unsigned char pass = 0;
+  TRY Pool_new(-1);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Pool_new didn't throw error when passed -1", pass);
+}
+
+// void Pool_free(Pool_T *pool);
+static char *test_Pool_free_valid() {
+  Pool_T pool = Pool_new(1);
+  Pool_free(&pool);
+  mu_assert("Pool_free didn't set pool to NULL", !pool);
+}
+
+static char *test_Pool_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Pool_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Pool_free didn't throw error when passed NULL", pass);
+}
+
+// void Pool_submit(Pool_T pool, int priority, Pool_token token, ...);
+static char *test_Pool_submit_runs_all() {
+  Pool_T pool = Pool_new(4);
+  Pool_token token = Pool_token_new();
+  atomic_store(&count, 0);
+  for (int i=0; i<1000; i++) 
+    Pool_submit(pool, i % POOL_PRIORITIES, token, add_one, NULL);
+  Pool_wait(pool, token);
+  int pass = atomic_load(&count) == 1000 && Pool_pending(token) == 0;
+  Pool_token_free(&token);
+  Pool_free(&pool);
+  mu_assert("Pool_submit didn't run every task", pass);
+}
+
+static char *test_Pool_submit_priority() {
+  Pool_T pool = Pool_new(1);
+  Pool_token token = Pool_token_new();
+  atomic_int go = 0;
+  int low = 2, normal = 1, high = 0;
+  norder = 0;
+  Pool_submit(pool, POOL_HIGH, token, block, &go);
+  Pool_submit(pool, POOL_LOW, token, record, &low);
+  Pool_submit(pool, POOL_NORMAL, token, record, &normal);
+  Pool_submit(pool, POOL_HIGH, token, record, &high);
+  atomic_store(&go, 1);
+  Pool_wait(pool, token);
+  int pass = norder == 3 && order[0] == 0 && order[1] == 1 && order[2] == 2;
+  Pool_token_free(&token);
+  Pool_free(&pool);
+  mu_assert("Pool_submit didn't run urgent tasks first", pass);
+}
+
+static char *test_Pool_submit_throw_bad_priority() {
+  Pool_T pool = Pool_new(1);
+  unsigned char pass = 0;
+  TRY Pool_submit(pool, POOL_PRIORITIES, NULL, add_one, NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  Pool_free(&pool);
+  mu_assert("Pool_submit didn't throw error on a bad priority", pass);
+}
+
+// void Pool_cancel(Pool_token token);
+static char *test_Pool_cancel() {
+  Pool_T pool = Pool_new(1);
+  Pool_token token = Pool_token_new(), other = Pool_token_new();
+  atomic_int go = 0;
+  int one = 1;
+  norder = 0;
+  Pool_submit(pool, POOL_HIGH, other, block, &go);
+  Pool_submit(pool, POOL_LOW, token, record, &one);
+  Pool_submit(pool, POOL_LOW, other, record, &one);
+  Pool_cancel(token);
+  atomic_store(&go, 1);
+  Pool_wait(pool, token);
+  Pool_wait(pool, other);
+  int pass = norder == 2 && order[0] + order[1] == 0;
+  Pool_token_free(&token);
+  Pool_token_free(&other);
+  Pool_free(&pool);
+  mu_assert("Pool_cancel didn't cancel only its own tasks", pass);
+}
+
+// A task that waits on tasks it submits runs them itself if it has to
+static void spawn(void *cl, Pool_token token) {
+  Pool_T pool = cl;
+  Pool_token children = Pool_token_new();
+  for (int i=0; i<10; i++) Pool_submit(pool, POOL_LOW, children, add_one, NULL);
+  Pool_wait(pool, children);
+  Pool_token_free(&children);
+  if (Pool_self(pool) == 0) atomic_fetch_add(&count, 100);
+}
+
+// void Pool_wait(Pool_T pool, Pool_token token);
+static char *test_Pool_wait_nested() {
+  Pool_T pool = Pool_new(1);
+  Pool_token token = Pool_token_new();
+  atomic_store(&count, 0);
+  Pool_submit(pool, POOL_NORMAL, token, spawn, pool);
+  Pool_wait(pool, token);
+  int pass = atomic_load(&count) == 110 && Pool_self(pool) == -1;
+  Pool_token_free(&token);
+  Pool_free(&pool);
+  mu_assert("Pool_wait didn't run the tasks it waited on", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Pool_new_valid,
+    test_Pool_new_throw_negative,
+    test_Pool_free_valid,
+    test_Pool_free_throw_NULL_arg,
+    test_Pool_submit_runs_all,
+    test_Pool_submit_priority,
+    test_Pool_submit_throw_bad_priority,
+    test_Pool_cancel,
+    test_Pool_wait_nested,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
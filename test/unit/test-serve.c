@@ -0,0 +1,228 @@
+//
+// -----------------------------------------------------------------------------
+// test-serve.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "error.h"
+#include "minunit.h"
+#include "index.h"
+#include "frame.h"
+#include "serve.h"
+#include "errorcodes.h"
+
+int tests_run = 0;
+
+static char path[] = "/tmp/test-serve-XXXXXX";
+static char sock[64];
+
+static const char rows[] =
+  "id,name,note\n"
+  "1,apple,plain\n"
+  "2,\"pear, big\",\"two\n"
+  "lines\"\n"
+  "3,kiwi,green\n"
+  "4,plum,\n";
+
+struct served {
+  Data_T data;
+  Serve_T server;
+  pthread_t thread;
+};
+
+static void *run(void *cl) {
+  Serve_run(((struct served *) cl)->server);
+  return NULL;
+}
+
+static int serve_text(struct served *s, const char *text, long len) {
+  int fd = mkstemp(path);
+  if (fd < 0 || write(fd, text, len) < 0) return -1;
+  close(fd);
+  sprintf(sock, "%s.sock", path);
+  s->data = Data_mmap_init(path, ',');
+  if (Data_open(s->data) != E_OK) return -1;
+  s->server = Serve_new(s->data, 1, sock);
+  if (!s->server) return -1;
+  return pthread_create(&s->thread, NULL, run, s);
+}
+
+static int serve(struct served *s) {
+  return serve_text(s, rows, sizeof rows - 1);
+}
+
+static void stop(struct served *s) {
+  Serve_stop(s->server);
+  pthread_join(s->thread, NULL);
+  Serve_free(&s->server);
+  Data_close(s->data);
+  Data_mmap_free(&s->data);
+  unlink(path);
+  strcpy(path + strlen(path) - 6, "XXXXXX");
+}
+
+static int is(const char *tok, const char *str) {
+  return tok && strcmp(tok, str) == 0;
+}
+
+// Data_T Data_remote_init(char *path);
+static char *test_Data_remote_get_row() {
+  struct served s;
+  Data_T data = serve(&s) == 0 ? Data_remote_init(sock) : NULL;
+  char *buf[3];
+  int pass = data && Data_remote_headers(data) == 1 && data->ncols == 3
+    && data->get_row(data, buf, 0, 0, 2) == E_OK
+    && is(buf[0], "id") && is(buf[2], "note")
+    && data->get_row(data, buf, 2, 1, 2) == E_OK
+    && is(buf[0], "\"pear, big\"") && is(buf[1], "\"two\nlines\"")
+    && data->get_row(data, buf, 4, 0, 2) == E_OK
+    && is(buf[0], "4") && is(buf[2], "")
+    && data->get_row(data, buf, 5, 0, 0) == E_DTA_EOF
+    && data->get_col(data, buf, 1, 1, 3) == E_OK
+    && is(buf[0], "apple") && is(buf[2], "kiwi");
+  if (data) Data_remote_free(&data);
+  stop(&s);
+  mu_assert("Data_remote didn't read the rows served", pass);
+}
+
+// Cells already handed out mustn't move when more columns are fetched
+static char *test_Data_remote_cells_kept() {
+  struct served s;
+  Data_T data = serve(&s) == 0 ? Data_remote_init(sock) : NULL;
+  char *first[1], *buf[3];
+  int pass = data
+    && data->get_row(data, first, 3, 0, 0) == E_OK
+    && data->get_row(data, buf, 3, 0, 2) == E_OK
+    && buf[0] == first[0] && is(first[0], "3") && is(buf[2], "green");
+  if (data) Data_remote_free(&data);
+  stop(&s);
+  mu_assert("Data_remote moved cells it had handed out", pass);
+}
+
+// long count_rows(Data_T data, int nthreads);
+static char *test_Data_remote_count_rows() {
+  struct served s;
+  Data_T data = serve(&s) == 0 ? Data_remote_init(sock) : NULL;
+  Data_T other = data ? Data_remote_init(sock) : NULL;
+  int pass = data && other && data->count_rows(data, 0) == 5
+    && other->count_rows(other, 0) == 5;
+  if (other) Data_remote_free(&other);
+  if (data) Data_remote_free(&data);
+  stop(&s);
+  mu_assert("Data_remote didn't count the rows served", pass);
+}
+
+// long Data_remote_find(Data_T data, const char *text, long from,
+//   int col_start, int col_end);
+static char *test_Data_remote_find() {
+  struct served s;
+  Data_T data = serve(&s) == 0 ? Data_remote_init(sock) : NULL;
+  int pass = data
+    && Data_remote_find(data, "kiwi", 1, 0, -1) == 3
+    && Data_remote_find(data, "lines", 0, 2, 2) == 2
+    && Data_remote_find(data, "lines", 3, 0, -1) == -1
+    && Data_remote_find(data, "kiwi", 1, 0, 0) == -1;
+  if (data) Data_remote_free(&data);
+  stop(&s);
+  mu_assert("Data_remote_find didn't find the rows with the text", pass);
+}
+
+// Rows far past the index are sought a step at a time
+static char *test_Data_remote_get_row_deep() {
+  long len = 0, size = 300000 * 10;
+  char *text = malloc(size);
+  for (int i=0; i<300000; i++) len += sprintf(text + len, "%d,x\n", i);
+  struct served s;
+  Data_T data = serve_text(&s, text, len) == 0 
+    ? Data_remote_init(sock) : NULL;
+  char *buf[1];
+  int pass = data && data->get_row(data, buf, 250000, 0, 0) == E_OK
+    && is(buf[0], "250000")
+    && data->get_row(data, buf, 300000, 0, 0) == E_DTA_EOF;
+  if (data) Data_remote_free(&data);
+  stop(&s);
+  free(text);
+  mu_assert("Data_remote didn't read a row far past the index", pass);
+}
+
+// Rows past INT_MAX can't be read, and aren't answered with row 0
+static char *test_Serve_rows_past_int() {
+  struct served s;
+  int fd = serve(&s) == 0 ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+  struct sockaddr_un addr = { AF_UNIX };
+  strcpy(addr.sun_path, sock);
+  struct serve_request req = { SERVE_ROWS, 0, 1L << 32, 1L << 32, 0, 0 };
+  struct serve_reply reply = { 0 };
+  int pass = fd >= 0
+    && connect(fd, (struct sockaddr *) &addr, sizeof addr) == 0
+    && write(fd, &req, sizeof req) == sizeof req
+    && recv(fd, &reply, sizeof reply, MSG_WAITALL) == sizeof reply
+    && reply.err == E_DTA_BAD_INPUT && reply.value == 0;
+  if (fd >= 0) close(fd);
+  stop(&s);
+  mu_assert("Serve answered a row past INT_MAX", pass);
+}
+
+// Serve_T Serve_new(Data_T data, int headers, const char *path);
+static char *test_Serve_new_in_use() {
+  struct served s;
+  int served = serve(&s) == 0;
+  Serve_T other = served ? Serve_new(s.data, 1, sock) : NULL;
+  if (other) Serve_free(&other);
+  stop(&s);
+  mu_assert("Serve_new took over a socket still being served",
+    served && !other);
+}
+
+static char *test_Data_remote_init_no_server() {
+  Data_T data = Data_remote_init("/tmp/test-serve-none.sock");
+  mu_assert("Data_remote_init didn't return NULL without a server", !data);
+}
+
+// void Serve_free(Serve_T *server);
+static char *test_Serve_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Serve_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Serve_free didn't throw error when passed NULL", pass);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Data_remote_get_row,
+    test_Data_remote_cells_kept,
+    test_Data_remote_count_rows,
+    test_Data_remote_find,
+    test_Data_remote_get_row_deep,
+    test_Serve_rows_past_int,
+    test_Serve_new_in_use,
+    test_Data_remote_init_no_server,
+    test_Serve_free_throw_NULL_arg,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -0,0 +1,115 @@
+//
+// -----------------------------------------------------------------------------
+// test-spsc.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "error.h"
+#include "minunit.h"
+#include "spsc.h"
+
+int tests_run = 0;
+
+#define NITEMS 100000
+
+// Spsc_T Spsc_new(int capacity);
+static char *test_Spsc_new_valid() {
+  Spsc_T queue = Spsc_new(4);
+  mu_assert("Spsc_new returned NULL", queue);
+}
+
+static char *test_Spsc_new_throw_capacity0() {
+  unsigned char pass = 0;
+  TRY Spsc_new(0);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Spsc_new didn't throw error when passed capacity 0", pass);
+}
+
+// void Spsc_free(Spsc_T *queue);
+static char *test_Spsc_free_valid() {
+  Spsc_T queue = Spsc_new(4);
+  Spsc_free(&queue);
+  mu_assert("Spsc_free didn't set queue to NULL", !queue);
+}
+
+// int Spsc_push(Spsc_T queue, void *x);
+static char *test_Spsc_push_full() {
+  Spsc_T queue = Spsc_new(2);
+  int x = 1;
+  Spsc_push(queue, &x);
+  Spsc_push(queue, &x);
+  mu_assert("Spsc_push didn't return 0 when queue was full",
+    !Spsc_push(queue, &x));
+}
+
+// void *Spsc_pop(Spsc_T queue);
+static char *test_Spsc_pop_empty() {
+  Spsc_T queue = Spsc_new(2);
+  mu_assert("Spsc_pop didn't return NULL on empty queue", !Spsc_pop(queue));
+}
+
+static char *test_Spsc_pop_fifo() {
+  Spsc_T queue = Spsc_new(4);
+  int a = 1, b = 2;
+  Spsc_push(queue, &a);
+  Spsc_push(queue, &b);
+  int *first = Spsc_pop(queue);
+  mu_assert("Spsc_pop didn't return items in FIFO order", first == &a);
+}
+
+static void *produce(void *cl) {
+  Spsc_T queue = cl;
+  for (uintptr_t i=1; i<=NITEMS; i++)
+    while (!Spsc_push(queue, (void *) i)) ;
+  return NULL;
+}
+
+static char *test_Spsc_threaded_order() {
+  Spsc_T queue = Spsc_new(64);
+  pthread_t producer;
+  pthread_create(&producer, NULL, produce, queue);
+
+  int in_order = 1;
+  for (uintptr_t expected=1; expected<=NITEMS; ) {
+    void *x = Spsc_pop(queue);
+    if (!x) continue;
+    if ((uintptr_t) x != expected) in_order = 0;
+    expected++;
+  }
+
+  pthread_join(producer, NULL);
+  mu_assert("Spsc_pop lost or reordered items across threads", in_order);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Spsc_new_valid,
+    test_Spsc_new_throw_capacity0,
+    test_Spsc_free_valid,
+    test_Spsc_push_full,
+    test_Spsc_pop_empty,
+    test_Spsc_pop_fifo,
+    test_Spsc_threaded_order,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}
@@ -0,0 +1,163 @@
+//
+// -----------------------------------------------------------------------------
+// test-table.c
+// -----------------------------------------------------------------------------
+//
+// Tyler Wayne © 2021
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "error.h"
+#include "minunit.h"
+#include "table.h"
+
+int tests_run = 0;
+
+static int cmpstr(const void *x, const void *y) {
+  return strcmp(x, y);
+}
+
+static unsigned hashstr(const void *key) {
+  unsigned h = 0;
+  for (const char *s = key; *s; s++) h = h * 31 + *s;
+  return h;
+}
+
+// Table_T Table_new(int hint, int cmp(...), unsigned hash(...));
+static char *test_Table_new_valid() {
+  Table_T table = Table_new(0, NULL, NULL);
+  mu_assert("Table_new returned NULL", table);
+}
+
+static char *test_Table_new_throw_negative_hint() {
+  unsigned char pass = 0;
+  TRY Table_new(-1, NULL, NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Table_new didn't throw error when passed negative hint", pass);
+}
+
+// void Table_free(Table_T *table);
+static char *test_Table_free_valid() {
+  Table_T table = Table_new(0, NULL, NULL);
+  Table_free(&table);
+  mu_assert("Table_free didn't set table to NULL", !table);
+}
+
+static char *test_Table_free_throw_NULL_arg() {
+  unsigned char pass = 0;
+  TRY Table_free(NULL);
+  EXCEPT (Assert_Failed) pass = 1;
+  END_TRY;
+  mu_assert("Table_free didn't throw error when passed NULL", pass);
+}
+
+// void *Table_put(Table_T table, const void *key, void *value);
+static char *test_Table_put_replace() {
+  Table_T table = Table_new(0, cmpstr, hashstr);
+  int a = 1, b = 2;
+  Table_put(table, "key", &a);
+  void *prev = Table_put(table, "key", &b);
+  mu_assert("Table_put didn't return previous value", prev == &a);
+}
+
+static char *test_Table_put_length() {
+  Table_T table = Table_new(0, cmpstr, hashstr);
+  Table_put(table, "a", "1");
+  Table_put(table, "b", "2");
+  Table_put(table, "a", "3");
+  mu_assert("Table_put counted a replaced key twice", 
+    Table_length(table) == 2);
+}
+
+// void *Table_get(Table_T table, const void *key);
+static char *test_Table_get_by_value() {
+  Table_T table = Table_new(0, cmpstr, hashstr);
+  char key[] = "Country";
+  Table_put(table, "Country", (void *) 2);
+  mu_assert("Table_get didn't compare keys with cmp", 
+    Table_get(table, key) == (void *) 2);
+}
+
+static char *test_Table_get_missing() {
+  Table_T table = Table_new(0, cmpstr, hashstr);
+  Table_put(table, "a", "1");
+  mu_assert("Table_get didn't return NULL for a missing key",
+    !Table_get(table, "b"));
+}
+
+static char *test_Table_get_many() {
+  Table_T table = Table_new(0, NULL, NULL);
+  static int keys[5000];
+  for (intptr_t i=0; i<5000; i++) Table_put(table, &keys[i], (void *) (i+1));
+  int found = 1;
+  for (intptr_t i=0; i<5000; i++) 
+    if (Table_get(table, &keys[i]) != (void *) (i+1)) found = 0;
+  mu_assert("Table_get lost keys in a full table", found);
+}
+
+// void *Table_remove(Table_T table, const void *key);
+static char *test_Table_remove_valid() {
+  Table_T table = Table_new(0, cmpstr, hashstr);
+  Table_put(table, "a", "1");
+  Table_put(table, "b", "2");
+  void *value = Table_remove(table, "a");
+  mu_assert("Table_remove didn't remove the binding", 
+    value && !Table_get(table, "a") && Table_length(table) == 1);
+}
+
+static char *test_Table_remove_missing() {
+  Table_T table = Table_new(0, cmpstr, hashstr);
+  Table_put(table, "a", "1");
+  mu_assert("Table_remove didn't return NULL for a missing key",
+    !Table_remove(table, "b") && Table_length(table) == 1);
+}
+
+static void count(const void *key, void **value, void *cl) {
+  (*(int *) cl)++;
+}
+
+// void Table_map(Table_T table, void apply(...), void *cl);
+static char *test_Table_map_visits_all() {
+  Table_T table = Table_new(0, cmpstr, hashstr);
+  Table_put(table, "a", "1");
+  Table_put(table, "b", "2");
+  Table_put(table, "c", "3");
+  int n = 0;
+  Table_map(table, count, &n);
+  mu_assert("Table_map didn't visit every binding", n == 3);
+}
+
+static char* run_all_tests() {
+
+  char *(*all_tests[])() = {
+    test_Table_new_valid,
+    test_Table_new_throw_negative_hint,
+    test_Table_free_valid,
+    test_Table_free_throw_NULL_arg,
+    test_Table_put_replace,
+    test_Table_put_length,
+    test_Table_get_by_value,
+    test_Table_get_missing,
+    test_Table_get_many,
+    test_Table_remove_valid,
+    test_Table_remove_missing,
+    test_Table_map_visits_all,
+    NULL
+  };
+
+  // Returns message of first failing test
+  mu_run_all(all_tests);
+    
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  char* result = run_all_tests();
+  if (result != 0) printf("%s\n", result);
+  else printf("ALL TESTS PASSED\n");
+  printf("Tests run: %d\n", tests_run);
+  return result != 0;
+}